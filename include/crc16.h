@@ -2,17 +2,22 @@
 #define _CRC_16_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
+#define CRC16_CCITT_POLYNOME   (0x1021)
+
 typedef struct
 {
-    uint16_t crctab[256];
+    const uint16_t* crctab;     // shared read-only table, NULL when computed bit by bit
     uint16_t polynome;
 } crc16_context_t;
 
+extern const uint16_t crc16_ccitt_table[256];
+
 extern void crc16_init(crc16_context_t* pThis, uint16_t polynome);
 extern uint16_t crc16_doCalcul(crc16_context_t* pThis, uint8_t* data, uint32_t len, uint16_t initValue, uint16_t xorFinal);
 
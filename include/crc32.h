@@ -0,0 +1,22 @@
+#ifndef _CRC_32_H
+#define _CRC_32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+extern const uint32_t crc32_ieee_table[256];
+
+// CRC-32 of zip and ethernet: crc32_update(0, data, len), or the crc of the previous bytes to continue it
+extern uint32_t crc32_update(uint32_t crc, const uint8_t* data, uint32_t len);
+
+#ifdef	__cplusplus
+}
+#endif
+
+
+
+#endif /* _CRC_32_H */
@@ -5,6 +5,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "crc16.h"
+#include "crc32.h"
+#include "lmodem_config.h"
+#include "lmodem_trace.h"
+#include "lmodem_ring.h"
+#include "lmodem_step.h"
+#include "lmodem_compress.h"
+#include "lmodem_delta.h"
 
 #ifdef	__cplusplus
 extern "C" {
@@ -14,6 +21,29 @@ extern "C" {
 #define LXMODEM_128_CRC_BUFFER_MIN_SIZE       (1 + 2 + 128 + 2)
 #define LXMODEM_1K_BUFFER_MIN_SIZE            (1 + 2 + 1024 + 2)
 #define LYMODEM_BUFFER_MIN_SIZE               LXMODEM_1K_BUFFER_MIN_SIZE
+// reception only, 1k blocks are streamed into the file buffer (see lmodem_set_low_memory_rx)
+#define LXMODEM_LOW_MEMORY_RX_BUFFER_MIN_SIZE LXMODEM_128_CRC_BUFFER_MIN_SIZE
+
+// smallest line buffer accepted by every variant of the compiled profile
+#if LMODEM_CFG_1K_BLOCKS
+#define LMODEM_LINE_BUFFER_MIN_SIZE           LXMODEM_1K_BUFFER_MIN_SIZE
+#elif LMODEM_CFG_CRC
+#define LMODEM_LINE_BUFFER_MIN_SIZE           LXMODEM_128_CRC_BUFFER_MIN_SIZE
+#else
+#define LMODEM_LINE_BUFFER_MIN_SIZE           LXMODEM_128_CHKSUM_BUFFER_MIN_SIZE
+#endif
+
+// RAM budget of a context (modem_context_t) for the compiled profile, checked at build time: the size of the fields of
+// each feature on a 64 bits target (a 32 bits one uses less), without margin, a field added to the context must be
+// added to the term of its feature. the DMA and YMODEM fields are partly per side.
+#define LMODEM_CONTEXT_MAX_SIZE               (512 + 24 * LMODEM_CFG_RX + 40 * LMODEM_CFG_TX + 32 * LMODEM_CFG_CRC \
+                                               + LMODEM_CFG_DMA * (16 + 24 * LMODEM_CFG_RX) \
+                                               + LMODEM_CFG_YMODEM * (112 + 120 * LMODEM_CFG_RX + 16 * LMODEM_CFG_TX))
+
+// alignment of the line buffer for the DMA reception (see lmodem_set_rx_dma), e.g. a cache line
+#ifndef LMODEM_DMA_ALIGNMENT
+#define LMODEM_DMA_ALIGNMENT                  (4)
+#endif
 
 typedef enum
 {
@@ -43,6 +73,7 @@ typedef struct
     uint32_t max_size;
 } lmodem_linebuffer;
 
+#if LMODEM_CFG_YMODEM
 typedef struct
 {
     uint32_t valid;
@@ -52,37 +83,290 @@ typedef struct
     uint32_t modif_date;
     uint16_t permission;
     uint32_t serial_number;
+    uint32_t crc32;
 } lmodem_file_characteristics;
+#endif
+
+typedef struct
+{
+    uint32_t blocks_sent;           // data blocks, without retransmissions
+    uint32_t blocks_received;       // data blocks committed in the file buffer
+    uint32_t naks_sent;
+    uint32_t naks_received;
+    uint32_t retransmissions;
+    uint32_t crc_errors;
+    uint32_t checksum_errors;
+    uint32_t block_number_errors;
+    uint32_t duplicate_blocks;
+    uint32_t timeouts;              // getchar callback returned false
+    uint32_t cans_received;
+    uint64_t bytes_on_wire_tx;
+    uint64_t bytes_on_wire_rx;
+    uint64_t payload_bytes;         // acknowledged (emission) or committed (reception) data bytes
+    // following fields are only filled when a clock callback is set (nanoseconds)
+    uint64_t start_time_ns;
+    uint64_t handshake_time_ns;
+    uint64_t transfer_time_ns;
+    uint32_t ack_rtt_count;
+    uint64_t ack_rtt_min_ns;
+    uint64_t ack_rtt_max_ns;
+    uint64_t ack_rtt_total_ns;
+    bool handshake_done;
+} lmodem_stats;
+
+// given to the progress callback after each committed (reception) or acknowledged (emission) block
+typedef struct
+{
+    uint64_t bytes_done;
+    uint64_t bytes_total;           // 0 when unknown (xmodem reception, ymodem without size)
+    uint32_t retries;               // naks sent (reception) or retransmissions (emission) so far
+    // following fields need a clock callback, 0 otherwise
+    uint64_t elapsed_ns;
+    uint64_t instant_bps;           // bytes per second measured on the last block
+    uint64_t smoothed_bps;          // exponentially weighted moving average of instant_bps
+    uint64_t eta_ns;                // 0 when bytes_total or smoothed_bps is unknown
+} lmodem_progress;
 
 typedef struct modem_context modem_context_t;
 
+// framed blocks of data sent many times, built once (lmodem_block_table_build) and sent with lmodem_set_block_table.
+// block index is at blocks + index * stride, its size is given by its header (SOH or STX) and trailer_size. the
+// table only depends on the data, the protocol and the options: it can be saved and mapped again later.
+typedef struct
+{
+    uint8_t* blocks;
+    uint32_t stride;
+    uint32_t nb_blocks;
+    uint32_t trailer_size;
+    lmodem_protocol protocol;
+} lmodem_block_table;
+
+#if LMODEM_CFG_CRC
+// CRC-16 CCITT of the blocks (see lmodem_set_crc_provider): init gives the initial value, update adds size bytes
+// to *pCrc and returns true, or returns false when the computation completes later with lmodem_crc_complete
+// (e.g. a CRC peripheral or a DMA, the data stay valid until then), final gives the value sent on the line.
+typedef struct
+{
+    uint16_t (*init)(modem_context_t* pThis);
+    bool (*update)(modem_context_t* pThis, uint8_t* data, uint32_t size, uint16_t* pCrc);
+    uint16_t (*final)(modem_context_t* pThis, uint16_t crc);
+} lmodem_crc_provider;
+#endif
+
+struct lmodem_mux;
+
 struct modem_context
 {
     lmodem_protocol protocol;
+#if LMODEM_CFG_CRC
     crc16_context_t crc16;
+    const lmodem_crc_provider* crc_provider;
+    lmodem_ring_index crc_result;           // completion flag and crc, written by lmodem_crc_complete
+#endif
     lxmodem_opts opts;
     lmodem_linebuffer blk_buffer;
+#if LMODEM_CFG_TX
+    lmodem_linebuffer next_blk_buffer;      // emission: next block built while waiting for the ACK (optional)
+#endif
     lmodem_buffer ramfile;
+#if LMODEM_CFG_YMODEM
     lmodem_file_characteristics file_data;
+#endif
+#if LMODEM_CFG_COMPRESS
+#if LMODEM_CFG_TX
+    lmodem_compressor* compressor;          // emission: compression offered in block 0, NULL for none
+#endif
+    bool compressed;                        // the data blocks of the transfer are compressed
+#if LMODEM_CFG_RX
+    bool decompression;                     // reception: an offer of compression is accepted
+    lmodem_decompressor decompressor;
+#endif
+#endif
+#if LMODEM_CFG_DELTA
+#if LMODEM_CFG_TX
+    lmodem_delta_encoder* delta_encoder;    // emission: delta transfer offered in block 0, NULL for none
+#endif
+    bool delta;                             // the data blocks of the transfer are a delta
+#if LMODEM_CFG_RX
+    bool delta_base;                        // reception: the file buffer holds a previous version of delta_base_size bytes
+    uint32_t delta_base_size;
+    lmodem_delta_decoder delta_decoder;
+#endif
+#endif
+#if LMODEM_CFG_FILE_CRC
+    bool skipped;                           // the receiver already had the file, no data block
+#if LMODEM_CFG_TX
+    bool file_crc;                          // emission: the crc32 of the file is offered (lmodem_set_file_crc)
+    bool file_crc_offered;                  // emission: the crc32 of the file is in block 0
+#endif
+#if LMODEM_CFG_RX
+    bool present;                           // reception: a file is already held, an identical offer is skipped
+    uint32_t present_size;
+    uint32_t present_crc;
+    bool file_crc_check;                    // reception: the file is checked against the crc32 of block 0
+    uint32_t file_crc_offset;               // file bytes in file_crc_value
+    uint32_t file_crc_value;
+#endif
+#endif
     bool withCrc;
+#if LMODEM_CFG_RX
+    bool lowMemoryRx;
+#endif
     bool (*getchar)(modem_context_t* pThis, uint8_t* data, uint32_t size);
     void (*putchar)(modem_context_t* pThis, uint8_t* data, uint32_t size);
+    uint64_t (*clock_ns)(modem_context_t* pThis);
+    lmodem_stats stats;
+    void (*progress)(modem_context_t* pThis, const lmodem_progress* pProgress);
+    lmodem_progress progress_state;
+    uint64_t progress_last_ns;
+    lmodem_trace_ring trace;
+#if LMODEM_CFG_TX
+    int32_t (*read_data)(modem_context_t* pThis, uint8_t* data, uint32_t size);
+    const uint8_t* (*get_block)(modem_context_t* pThis, uint32_t index, uint32_t* pSize);
+    const lmodem_block_table* block_table;
+#endif
+    lmodem_ring* rx_ring;
+    uint64_t rx_timeout_ns;
+    void (*rx_idle)(modem_context_t* pThis);
+#if LMODEM_CFG_DMA
+    void (*rx_dma_start)(modem_context_t* pThis, uint8_t* data, uint32_t size);
+    lmodem_ring_index rx_dma_result;        // completion flag and nb of bytes, written by lmodem_rx_dma_complete
+#endif
+    struct lmodem_mux* mux;                 // line shared with other channels (lmodem_mux.h)
+    uint8_t mux_channel;
+    void* user_data;                        // owned by the application, given back to the callbacks through pThis
+    lmodem_step_state step;                 // state of the running transfer
 };
 
 extern void lmodem_init(modem_context_t* pThis, lxmodem_opts opts);
+extern void lmodem_set_user_data(modem_context_t* pThis, void* userData);
+extern void* lmodem_get_user_data(modem_context_t* pThis);
 extern void lmodem_set_putchar_cb(modem_context_t* pThis, void (*putchar)(modem_context_t* pThis, uint8_t* data, uint32_t size));
 extern void lmodem_set_getchar_cb(modem_context_t* pThis, bool (*getchar)(modem_context_t* pThis, uint8_t* data, uint32_t size));
+extern void lmodem_set_clock_cb(modem_context_t* pThis, uint64_t (*clock_ns)(modem_context_t* pThis));
+extern void lmodem_set_progress_cb(modem_context_t* pThis, void (*progress)(modem_context_t* pThis, const lmodem_progress* pProgress));
+extern bool lmodem_set_trace_buffer(modem_context_t* pThis, lmodem_trace_event* events, uint32_t nbEvents);
+#if LMODEM_CFG_RX
+// the minimum size of the line buffer depends on this mode: for lxmodem_1k a LXMODEM_LOW_MEMORY_RX_BUFFER_MIN_SIZE
+// line buffer is enough once it is set. both can be called in any order, lmodem_set_line_buffer keeps a buffer too
+// small for the current mode (returns false) and this call checks again the line buffer already set (false when it
+// is too small for the new mode). with a line buffer too small, an emission is refused and a reception is
+// cancelled at the first block which does not fit.
+extern bool lmodem_set_low_memory_rx(modem_context_t* pThis, bool lowMemoryRx);
+#endif
 extern bool lmodem_set_line_buffer(modem_context_t* pThis, uint8_t* buffer, uint32_t size);
+#if LMODEM_CFG_TX
+extern void lmodem_set_next_line_buffer(modem_context_t* pThis, uint8_t* buffer, uint32_t size);
+#endif
+extern void lmodem_set_rx_ring(modem_context_t* pThis, lmodem_ring* pRing, uint64_t timeoutNs, void (*idle)(modem_context_t* pThis));
+extern bool lmodem_ring_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size);
+#if LMODEM_CFG_DMA
+// DMA reception (lmodem_step): start arms the reception of up to size bytes in data (size 0 stops it), the
+// transport calls lmodem_rx_dma_complete, e.g. from its interrupt, when they are received or when the line goes
+// idle after some bytes. a data block is requested at once, header to trailer, in the line buffer which must be
+// set before, aligned on LMODEM_DMA_ALIGNMENT and large enough for the largest block of the profile.
+extern bool lmodem_set_rx_dma(modem_context_t* pThis, void (*start)(modem_context_t* pThis, uint8_t* data, uint32_t size),
+                              uint64_t timeoutNs);
+extern void lmodem_rx_dma_complete(modem_context_t* pThis, uint32_t nbReceived);
+#endif
+#if LMODEM_CFG_CRC
+// NULL gives back the software table. an asynchronous update is awaited by lmodem_step like received bytes
+// (WOULD_BLOCK), lmodem_receive/lmodem_emit poll lmodem_crc_complete; both cancel the transfer after the rx timeout
+// (1 s without one). the deadline needs lmodem_set_clock_cb: without clock, lmodem_step waits for the completion as
+// long as it is called and the blocking api polls once, an update which is not complete then cancels the transfer.
+extern void lmodem_set_crc_provider(modem_context_t* pThis, const lmodem_crc_provider* pProvider);
+extern void lmodem_crc_complete(modem_context_t* pThis, uint16_t crc);
+extern const lmodem_crc_provider lmodem_crc_software;
+#endif
+#if LMODEM_CFG_TX
+extern void lmodem_set_data_source_cb(modem_context_t* pThis, int32_t (*read_data)(modem_context_t* pThis, uint8_t* data, uint32_t size));
+// block cache (emission): get_block gives the framed data block index (block number index + 1) and its size, NULL
+// after the last one. the blocks are built once, e.g. with lmodem_build_block, and shared by several contexts
+// sending the same data; they must not change during the transfer.
+extern void lmodem_set_block_source_cb(modem_context_t* pThis,
+                                       const uint8_t* (*get_block)(modem_context_t* pThis, uint32_t index, uint32_t* pSize));
+// frames the data block index of the file buffer in pBlock (LXMODEM_1K_BUFFER_MIN_SIZE bytes) as the emission of
+// protocol does, returns its size, 0 after the last block. the crc goes through the provider of the context, 0 is also
+// returned when an asynchronous one does not complete in time.
+extern uint32_t lmodem_build_block(modem_context_t* pThis, lmodem_protocol protocol, uint32_t index, uint8_t* pBlock);
+// block table of the file buffer: init gives the geometry and returns the bytes to give in pTable->blocks, build
+// frames the blocks first to first + count - 1 (the context is only read, disjoint ranges can be built in parallel
+// threads, one after the other with an asynchronous crc provider), get has the contract of get_block.
+extern uint32_t lmodem_block_table_init(modem_context_t* pThis, lmodem_protocol protocol, lmodem_block_table* pTable);
+extern void lmodem_block_table_build(modem_context_t* pThis, lmodem_block_table* pTable, uint32_t first, uint32_t count);
+extern const uint8_t* lmodem_block_table_get(const lmodem_block_table* pTable, uint32_t index, uint32_t* pSize);
+extern void lmodem_set_block_table(modem_context_t* pThis, const lmodem_block_table* pTable);
+#endif
 extern void lmodem_set_file_buffer(modem_context_t* pThis, uint8_t* buffer, uint32_t size);
-extern void lmodem_set_filename_buffer(modem_context_t* pThis, char* buffer, uint32_t size);
+#if LMODEM_CFG_COMPRESS
+// YMODEM: the sender offers in block 0 to compress the data blocks with pCompressor (no offer without file size or
+// with a block source). a receiver set with lmodem_set_decompression accepts and decompresses each block into the
+// file buffer as it comes (not in low memory mode), any other receiver gets the raw data. the results and the
+// progress count the raw bytes.
+#if LMODEM_CFG_TX
+extern void lmodem_set_compression(modem_context_t* pThis, lmodem_compressor* pCompressor);
+#endif
+#if LMODEM_CFG_RX
+extern void lmodem_set_decompression(modem_context_t* pThis, bool accept);
+#endif
+// true when the data blocks of the last transfer were compressed
+extern bool lmodem_is_compressed(modem_context_t* pThis);
+#endif
+#if LMODEM_CFG_DELTA
+// YMODEM: the sender offers in block 0 to send only the blocks which differ from the file of the receiver, whose hashes
+// are received in hashes (maxHashes, one per LMODEM_DELTA_BLOCK_SIZE bytes of the file, the others are sent). a
+// receiver set with lmodem_set_delta_base (after lmodem_set_file_buffer, the buffer holds the previous version on its
+// first size bytes) accepts and patches the buffer in place, it is preferred to the compression. the blocks 0 and the
+// blocks of a declined offer are received in the line buffer (when it holds them), the previous version stays intact
+// until the data blocks replace it. the results and the progress count the bytes of the file, sent or kept.
+#if LMODEM_CFG_TX
+extern void lmodem_set_delta(modem_context_t* pThis, lmodem_delta_encoder* pEncoder, uint32_t* hashes, uint32_t maxHashes);
+#endif
+#if LMODEM_CFG_RX
+extern void lmodem_set_delta_base(modem_context_t* pThis, bool enable, uint32_t size);
+#endif
+// true when the data blocks of the last transfer were a delta
+extern bool lmodem_is_delta(modem_context_t* pThis);
+#endif
+#if LMODEM_CFG_FILE_CRC
+// YMODEM: crc32 of the whole file, sent in block 0 by a sender set with lmodem_set_file_crc (off by default). the sender
+// computes it when the file buffer holds the file, it must be set for a data source. the receiver computes it as the blocks are committed and cancels the transfer instead of
+// acknowledging the EOT when it differs. a receiver set with lmodem_set_present_file already holds a file of size
+// bytes and crc32 crc: an identical offer is skipped, without data block, both sides return the size (the file buffer
+// is not written) and lmodem_is_skipped tells it. the skip answer replaces the 'C' which asks for the end of batch
+// block, it is repeated until that block comes. the blocks are then received in the line buffer when it holds
+// them.
+#if LMODEM_CFG_TX
+extern void lmodem_set_file_crc(modem_context_t* pThis, bool offer);
+#endif
+extern void lmodem_metadata_set_file_crc(modem_context_t* pThis, uint32_t crc);
+extern bool lmodem_metadata_get_file_crc(modem_context_t* pThis, uint32_t* crc);
+#if LMODEM_CFG_RX
+extern void lmodem_set_present_file(modem_context_t* pThis, bool present, uint32_t size, uint32_t crc);
+#endif
+extern bool lmodem_is_skipped(modem_context_t* pThis);
+#endif
 
 extern int32_t lmodem_receive(modem_context_t* pThis, lmodem_protocol protocol);
 extern int32_t lmodem_emit(modem_context_t* pThis, lmodem_protocol protocol);
 
+// non-blocking transfer: start it, then call lmodem_step until it returns DONE or ERROR. the received bytes are
+// read from the rx ring (lmodem_set_rx_ring) or by DMA (lmodem_set_rx_dma), the timeouts use the clock callback,
+// putchar must not block.
+extern bool lmodem_start_receive(modem_context_t* pThis, lmodem_protocol protocol);
+extern bool lmodem_start_emit(modem_context_t* pThis, lmodem_protocol protocol);
+extern lmodem_step_status lmodem_step(modem_context_t* pThis);
+extern int32_t lmodem_get_result(modem_context_t* pThis);
+
+extern const lmodem_stats* lmodem_get_stats(modem_context_t* pThis);
+extern uint64_t lmodem_stats_get_ack_rtt_avg_ns(const lmodem_stats* pStats);
+
 extern bool lmodem_buffer_set_write_offset(lmodem_buffer* pThis, uint32_t newWriteOffset);
 extern int32_t lmodem_buffer_read(lmodem_buffer* pThis, uint8_t* buffer, uint32_t size);
 extern int32_t lmodem_buffer_write(lmodem_buffer* pThis, uint8_t* buffer, uint32_t size);
 
+#if LMODEM_CFG_YMODEM
+extern void lmodem_set_filename_buffer(modem_context_t* pThis, char* buffer, uint32_t size);
 extern void lmodem_metadata_set_filename(modem_context_t* pThis, char* filename);
 extern void lmodem_metadata_set_filesize(modem_context_t* pThis, uint32_t size);
 extern void lmodem_metadata_set_modif_time(modem_context_t* pThis, uint32_t modif_date);
@@ -94,6 +378,7 @@ extern bool lmodem_metadata_get_filesize(modem_context_t* pThis, uint32_t* files
 extern bool lmodem_metadata_get_modif_time(modem_context_t* pThis, uint32_t* modiftime);
 extern bool lmodem_metadata_get_permission(modem_context_t* pThis, uint32_t* mode);
 extern bool lmodem_metadata_get_serial(modem_context_t* pThis, uint32_t* serial);
+#endif
 
 #ifdef	__cplusplus
 }
@@ -0,0 +1,89 @@
+#ifndef LMODEM_COMPRESS_H
+#define LMODEM_COMPRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// streaming compression of the data blocks: LZ77 matches in a sliding window plus runs of zeros and SUB (erased
+// or padded areas). the stream is a list of tokens, read byte by byte so a token may span two blocks:
+//   0x00..0x7F  ctrl + 1 literals follow
+//   0x80..0xBF  copy of (ctrl & 0x3F) + 4 bytes from offset + 1 bytes back, offset on 2 bytes (little endian)
+//   0xC0..0xDF  ((ctrl & 0x1F) << 8 | next byte) + 1 zeros
+//   0xE0..0xFE  same length, SUB bytes
+//   0xFF        end of the stream, the rest of the block is padding
+// the decoder reads its history in the output buffer, it only needs a few bytes of state.
+
+#ifndef LMODEM_COMPRESS_WINDOW_BITS
+#define LMODEM_COMPRESS_WINDOW_BITS    (12)
+#endif
+#ifndef LMODEM_COMPRESS_HASH_BITS
+#define LMODEM_COMPRESS_HASH_BITS      (12)
+#endif
+
+#define LMODEM_COMPRESS_WINDOW         (1u << LMODEM_COMPRESS_WINDOW_BITS)
+#define LMODEM_COMPRESS_HASH_SIZE      (1u << LMODEM_COMPRESS_HASH_BITS)
+#define LMODEM_COMPRESS_MIN_MATCH      (4)
+#define LMODEM_COMPRESS_MAX_MATCH      (LMODEM_COMPRESS_MIN_MATCH + 0x3F)
+#define LMODEM_COMPRESS_MAX_LITERALS   (0x80)
+#define LMODEM_COMPRESS_MIN_RUN        (3)
+#define LMODEM_COMPRESS_MAX_RUN        ((0x1E << 8) + 0x100)
+#define LMODEM_COMPRESS_END            (0xFF)
+
+// version of the format, offered in block 0 after the metadata ("lz:<version>"), the receiver accepts with
+// LMODEM_COMPRESS_ACCEPT instead of the 'C' which starts the data blocks
+#define LMODEM_COMPRESS_VERSION        (1)
+#define LMODEM_COMPRESS_ACCEPT         ('Z')
+
+// emission: raw bytes of the source (the file buffer or the data source of the context) through pArg, the
+// number of bytes read, 0 at the end, negative on error
+typedef int32_t (*lmodem_compress_read_raw)(void* pArg, uint8_t* data, uint32_t size);
+
+typedef struct
+{
+    uint8_t window[2 * LMODEM_COMPRESS_WINDOW];   // history then lookahead
+    uint32_t head[LMODEM_COMPRESS_HASH_SIZE];     // last raw position + 1 of each hash, 0 for none
+    uint64_t window_base;                         // raw position of window[0]
+    uint32_t start;                               // next byte to encode in window
+    uint32_t end;                                 // bytes in window
+    uint8_t literals[LMODEM_COMPRESS_MAX_LITERALS];
+    uint32_t nb_literals;
+    uint8_t out[1 + LMODEM_COMPRESS_MAX_LITERALS + 3];
+    uint32_t out_size;
+    uint32_t out_offset;
+    bool eof;
+    bool ended;                                   // end token produced
+    uint64_t raw_bytes;                           // encoded so far
+    uint64_t compressed_bytes;
+} lmodem_compressor;
+
+typedef struct
+{
+    uint8_t state;
+    uint8_t ctrl;
+    uint32_t count;                               // bytes left in the token
+    uint32_t offset;
+    uint64_t compressed_bytes;
+} lmodem_decompressor;
+
+extern void lmodem_compress_init(lmodem_compressor* pThis);
+// fills data with up to size compressed bytes, less only at the end of the stream (0 once it is ended),
+// negative when the source fails
+extern int32_t lmodem_compress_read(lmodem_compressor* pThis, lmodem_compress_read_raw readRaw, void* pArg, uint8_t* data,
+                                    uint32_t size);
+
+extern void lmodem_decompress_init(lmodem_decompressor* pThis);
+// decodes size bytes of the stream at out + *pOutOffset (the bytes before are the history), returns the nb of bytes
+// produced, negative on a corrupted stream or when outSize is too small. the bytes after the end token are ignored.
+extern int32_t lmodem_decompress(lmodem_decompressor* pThis, const uint8_t* data, uint32_t size, uint8_t* out,
+                                 uint32_t* pOutOffset, uint32_t outSize);
+extern bool lmodem_decompress_is_ended(const lmodem_decompressor* pThis);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* LMODEM_COMPRESS_H */
@@ -0,0 +1,78 @@
+#ifndef LMODEM_CONFIG_H
+#define LMODEM_CONFIG_H
+
+// protocol profile, everything is enabled by default.
+// cmake option MODEM_PROFILE (or the MODEM_WITH_* options for a CUSTOM profile) sets these macros to 0
+// on the library target and on its users, so the code and the RAM of the unused variants are not built.
+
+#ifndef LMODEM_CFG_RX
+#define LMODEM_CFG_RX                  (1)
+#endif
+
+#ifndef LMODEM_CFG_TX
+#define LMODEM_CFG_TX                  (1)
+#endif
+
+#ifndef LMODEM_CFG_XMODEM_CHKSUM
+#define LMODEM_CFG_XMODEM_CHKSUM       (1)
+#endif
+
+#ifndef LMODEM_CFG_XMODEM_CRC
+#define LMODEM_CFG_XMODEM_CRC          (1)
+#endif
+
+#ifndef LMODEM_CFG_XMODEM_1K
+#define LMODEM_CFG_XMODEM_1K           (1)
+#endif
+
+#ifndef LMODEM_CFG_YMODEM
+#define LMODEM_CFG_YMODEM              (1)
+#endif
+
+// reception by DMA for lmodem_step (see lmodem_set_rx_dma)
+#ifndef LMODEM_CFG_DMA
+#define LMODEM_CFG_DMA                 (1)
+#endif
+
+// derived features
+#define LMODEM_CFG_CRC                 (LMODEM_CFG_XMODEM_CRC || LMODEM_CFG_XMODEM_1K || LMODEM_CFG_YMODEM)
+#define LMODEM_CFG_1K_BLOCKS           (LMODEM_CFG_XMODEM_1K || LMODEM_CFG_YMODEM)
+
+// compression of the data blocks, negotiated through the YMODEM block 0 (see lmodem_compress.h)
+#ifndef LMODEM_CFG_COMPRESS
+#define LMODEM_CFG_COMPRESS            LMODEM_CFG_YMODEM
+#endif
+
+// transfer of the blocks which differ from a previous version held by the receiver (see lmodem_delta.h)
+#ifndef LMODEM_CFG_DELTA
+#define LMODEM_CFG_DELTA               LMODEM_CFG_YMODEM
+#endif
+
+// crc32 of the whole file in block 0: end to end check, skip of a file the receiver already has
+#ifndef LMODEM_CFG_FILE_CRC
+#define LMODEM_CFG_FILE_CRC            LMODEM_CFG_YMODEM
+#endif
+
+#if !(LMODEM_CFG_RX || LMODEM_CFG_TX)
+#error "lmodem profile: at least one of reception or emission must be enabled"
+#endif
+
+#if !(LMODEM_CFG_XMODEM_CHKSUM || LMODEM_CFG_CRC)
+#error "lmodem profile: at least one protocol variant must be enabled"
+#endif
+
+#if LMODEM_CFG_COMPRESS && !LMODEM_CFG_YMODEM
+#error "lmodem profile: the compression is negotiated by YMODEM"
+#endif
+
+#if LMODEM_CFG_DELTA && !LMODEM_CFG_YMODEM
+#error "lmodem profile: the delta transfer is negotiated by YMODEM"
+#endif
+
+#if LMODEM_CFG_FILE_CRC && !LMODEM_CFG_YMODEM
+#error "lmodem profile: the crc32 of the file is sent in the YMODEM block 0"
+#endif
+
+#define LMODEM_STATIC_ASSERT(cond, msg)   _Static_assert(cond, msg)
+
+#endif /* LMODEM_CONFIG_H */
@@ -0,0 +1,83 @@
+#ifndef LMODEM_DELTA_H
+#define LMODEM_DELTA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// delta transfer: the receiver already holds a previous version of the file (e.g. the firmware being replaced), it
+// sends the hash of each LMODEM_DELTA_BLOCK_SIZE bytes block of it and the sender only sends the blocks which differ.
+// the handshake: the sender offers "dl:<version>" in block 0 after the metadata, the receiver accepts by sending,
+// instead of the 'C' which starts the data blocks, LMODEM_DELTA_ACCEPT then the hash list:
+//   nb of hashes (4 bytes), the hashes (4 bytes each), CRC-16 CCITT of both (MSB first), all little endian
+// the CRC-16 is computed through the crc provider of each side (lmodem_set_crc_provider) like the one of a block.
+// the sender answers ACK and starts the data blocks, or NAK and the receiver sends the list again. a receiver which
+// reads the first data block instead of the ACK takes it as the ACK and NAKs the block, a sender which reads the list
+// again instead of the reply to the first block acknowledges it again.
+// the data blocks carry a stream of records, read byte by byte so a record may span two blocks:
+//   offset (4 bytes, a multiple of LMODEM_DELTA_BLOCK_SIZE) then the block, which ends at the file size
+//   LMODEM_DELTA_END as offset ends the stream, the rest of the data block is padding
+// the receiver patches its file buffer in place, the blocks without record are kept.
+
+#define LMODEM_DELTA_BLOCK_SIZE        (1024)
+#define LMODEM_DELTA_OFFSET_SIZE       (4)
+#define LMODEM_DELTA_END               (0xFFFFFFFFu)
+
+#define LMODEM_DELTA_VERSION           (1)
+#define LMODEM_DELTA_ACCEPT            ('D')
+
+// emission: raw bytes of the source through pArg, the number of bytes read, 0 at the end, negative on error
+typedef int32_t (*lmodem_delta_read_raw)(void* pArg, uint8_t* data, uint32_t size);
+
+typedef struct
+{
+    uint32_t* hashes;                             // hashes of the receiver blocks
+    uint32_t max_hashes;
+    uint32_t nb_hashes;
+    uint32_t index;                               // next block of the source
+    uint8_t out[LMODEM_DELTA_OFFSET_SIZE + LMODEM_DELTA_BLOCK_SIZE];
+    uint32_t out_size;
+    uint32_t out_offset;
+    bool ended;                                   // end record produced
+    uint64_t raw_bytes;                           // source bytes read so far
+    uint32_t blocks_sent;
+    uint32_t blocks_skipped;
+} lmodem_delta_encoder;
+
+typedef struct
+{
+    uint8_t state;
+    uint8_t nb_offset_bytes;
+    uint32_t offset;                              // next byte to patch
+    uint32_t count;                               // bytes left in the block
+    uint32_t covered;                             // end of the last record, the file is final up to it
+    uint32_t file_size;
+} lmodem_delta_decoder;
+
+#define LMODEM_FNV1A_INIT              (2166136261u)
+
+// FNV-1a: lmodem_fnv1a(LMODEM_FNV1A_INIT, data, size), or the hash of the previous bytes to continue it
+extern uint32_t lmodem_fnv1a(uint32_t hash, const uint8_t* data, uint32_t size);
+// hash of a block, its size is part of it (the last block of two versions may differ only by its size)
+extern uint32_t lmodem_delta_hash(const uint8_t* data, uint32_t size);
+
+extern void lmodem_delta_encode_init(lmodem_delta_encoder* pThis);
+// fills data with up to size bytes of records, less only at the end of the stream (0 once it is ended), negative
+// when the source fails
+extern int32_t lmodem_delta_read(lmodem_delta_encoder* pThis, lmodem_delta_read_raw readRaw, void* pArg, uint8_t* data,
+                                 uint32_t size);
+
+extern void lmodem_delta_decode_init(lmodem_delta_decoder* pThis, uint32_t fileSize);
+// patches out (at least fileSize bytes) with size bytes of the stream, returns the nb of bytes of the file covered by
+// them (patched or kept), negative on a corrupted stream. the bytes after the end record are ignored.
+extern int32_t lmodem_delta_apply(lmodem_delta_decoder* pThis, const uint8_t* data, uint32_t size, uint8_t* out);
+extern bool lmodem_delta_is_ended(const lmodem_delta_decoder* pThis);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* LMODEM_DELTA_H */
@@ -0,0 +1,47 @@
+#ifndef LMODEM_ESCAPE_H
+#define LMODEM_ESCAPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// ZMODEM style escaping: each byte of the escape set is replaced by ZDLE followed by (byte ^ 0x40).
+// escape set is ZDLE, DLE, XON, XOFF and the same values with the high bit set.
+#define LMODEM_ZDLE                   (0x18)
+#define LMODEM_ZDLE_XOR               (0x40)
+
+// worst case: every byte is escaped
+#define LMODEM_ESCAPE_MAX_SIZE(size)  (2 * (size))
+
+typedef struct
+{
+    bool pendingZdle;
+} lmodem_escape_decoder;
+
+static inline bool lmodem_escape_is_needed(uint8_t c)
+{
+    uint8_t low = c & 0x7F;
+    return (low == 0x10) || (low == 0x11) || (low == 0x13) || (low == LMODEM_ZDLE);
+}
+
+// dst must be able to hold LMODEM_ESCAPE_MAX_SIZE(size) bytes, return the number of bytes written in dst
+extern uint32_t lmodem_escape_encode(uint8_t* dst, uint8_t* src, uint32_t size);
+extern uint32_t lmodem_escape_encode_scalar(uint8_t* dst, uint8_t* src, uint32_t size);
+
+// dst must be able to hold size bytes, return the number of bytes written in dst.
+// a ZDLE at the end of src is kept in the decoder and applied on the next call
+extern void lmodem_escape_decoder_init(lmodem_escape_decoder* pThis);
+extern uint32_t lmodem_escape_decode(lmodem_escape_decoder* pThis, uint8_t* dst, uint8_t* src, uint32_t size);
+extern uint32_t lmodem_escape_decode_scalar(lmodem_escape_decoder* pThis, uint8_t* dst, uint8_t* src, uint32_t size);
+
+// name of the kernel selected at compilation time ("avx2", "sse2" or "scalar")
+extern const char* lmodem_escape_kernel_name(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* LMODEM_ESCAPE_H */
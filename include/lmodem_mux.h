@@ -0,0 +1,116 @@
+#ifndef LMODEM_MUX_H
+#define LMODEM_MUX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "crc16.h"
+#include "lmodem_ring.h"
+#include "lmodem.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// logical channels over one serial line, e.g. a file transfer, a console and a control RPC sharing a UART.
+// the bytes of each channel are cut in frames: SOF, channel, payload length (1 to max payload), header check
+// (channel ^ length ^ 0xFF), payload and the CRC-16 CCITT of channel, length and payload (MSB first). a frame is never
+// interrupted, at each frame boundary the line takes the channel with the lowest priority value which has bytes, so a
+// control message waits at most one frame of the bulk transfer. a bad header makes the receiver look for the next
+// SOF, a bad CRC drops the frame, except on the channels opened with LMODEM_MUX_KEEP_CORRUPTED: an XMODEM channel
+// checks its blocks itself and a NAK recovers a corrupted block sooner than a timeout recovers missing bytes.
+// the line side has two entry points: lmodem_mux_pull gives the next bytes to send (UART tx interrupt or writer
+// thread) and lmodem_mux_input takes the received bytes (UART rx interrupt or reader thread). the channels are
+// SPSC rings: one writer per channel, one line side.
+
+#define LMODEM_MUX_SOF                 (0xA5)
+#define LMODEM_MUX_HEADER_SIZE         (4)
+#define LMODEM_MUX_TRAILER_SIZE        (2)
+#define LMODEM_MUX_MAX_PAYLOAD         (255)
+#define LMODEM_MUX_MAX_CHANNELS        (8)
+#define LMODEM_MUX_FRAME_MAX_SIZE      (LMODEM_MUX_HEADER_SIZE + LMODEM_MUX_MAX_PAYLOAD + LMODEM_MUX_TRAILER_SIZE)
+
+// flags of a channel
+#define LMODEM_MUX_KEEP_CORRUPTED      (0x01)
+
+typedef struct lmodem_mux lmodem_mux;
+
+typedef struct
+{
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+    uint32_t rx_overflows;              // payload bytes lost, rx ring full
+    uint32_t rx_corrupted;              // frames with a bad CRC (delivered with LMODEM_MUX_KEEP_CORRUPTED)
+} lmodem_mux_channel_stats;
+
+typedef struct
+{
+    bool open;
+    uint8_t priority;                   // 0 first
+    uint8_t flags;
+    lmodem_ring tx_ring;
+    lmodem_ring* rx_ring;               // NULL: the payloads go to the deliver callback
+    lmodem_mux_channel_stats stats;
+} lmodem_mux_channel;
+
+typedef enum
+{
+    LMODEM_MUX_RX_SOF,
+    LMODEM_MUX_RX_CHANNEL,
+    LMODEM_MUX_RX_LENGTH,
+    LMODEM_MUX_RX_HEADER_CHECK,
+    LMODEM_MUX_RX_PAYLOAD,
+    LMODEM_MUX_RX_CRC
+} lmodem_mux_rx_state;
+
+struct lmodem_mux
+{
+    lmodem_mux_channel channels[LMODEM_MUX_MAX_CHANNELS];
+    uint32_t max_payload;
+    crc16_context_t crc16;
+    // emission: the frame on the line
+    uint8_t tx_frame[LMODEM_MUX_FRAME_MAX_SIZE];
+    uint32_t tx_size;
+    uint32_t tx_offset;
+    // reception
+    lmodem_mux_rx_state rx_state;
+    uint8_t rx_frame[LMODEM_MUX_FRAME_MAX_SIZE];
+    uint32_t rx_size;
+    uint32_t rx_expected;
+    uint32_t rx_header_errors;
+    uint32_t rx_skipped;                // bytes outside of a frame
+    void (*deliver)(lmodem_mux* pThis, uint8_t channel, const uint8_t* data, uint32_t size);
+    void* user_data;
+};
+
+// maxPayload bounds the wait of a priority channel behind a frame of another one (1 to LMODEM_MUX_MAX_PAYLOAD)
+extern bool lmodem_mux_init(lmodem_mux* pThis, uint32_t maxPayload);
+// txStorage: ring of the bytes waiting on the channel (power of two size), pRxRing: received payloads, or NULL for
+// the deliver callback
+extern bool lmodem_mux_open_channel(lmodem_mux* pThis, uint8_t channel, uint8_t priority, uint8_t flags, uint8_t* txStorage,
+                                    uint32_t txSize, lmodem_ring* pRxRing);
+extern void lmodem_mux_set_user_data(lmodem_mux* pThis, void* userData);
+extern void* lmodem_mux_get_user_data(lmodem_mux* pThis);
+extern void lmodem_mux_set_deliver_cb(lmodem_mux* pThis,
+                                      void (*deliver)(lmodem_mux* pThis, uint8_t channel, const uint8_t* data, uint32_t size));
+
+// channel writer: returns the nb of bytes queued, less than size when the ring is full
+extern uint32_t lmodem_mux_send(lmodem_mux* pThis, uint8_t channel, const uint8_t* data, uint32_t size);
+// line side: up to size bytes to send, 0 when no channel has bytes
+extern uint32_t lmodem_mux_pull(lmodem_mux* pThis, uint8_t* data, uint32_t size);
+extern void lmodem_mux_input(lmodem_mux* pThis, const uint8_t* data, uint32_t size);
+extern const lmodem_mux_channel_stats* lmodem_mux_get_stats(lmodem_mux* pThis, uint8_t channel);
+
+// the transfers of the context go through channel: it reads the rx ring of the channel (lmodem_set_rx_ring with
+// timeoutNs and idle) and its putchar queues the blocks on the channel. idle is also called while the channel is
+// full, without idle the bytes which do not fit are lost (the tx ring should hold a whole block for lmodem_step).
+extern bool lmodem_set_mux(modem_context_t* pThis, lmodem_mux* pMux, uint8_t channel, uint64_t timeoutNs,
+                           void (*idle)(modem_context_t* pThis));
+extern void lmodem_mux_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* LMODEM_MUX_H */
@@ -0,0 +1,61 @@
+#ifndef LMODEM_RING_H
+#define LMODEM_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// wait-free single producer / single consumer byte ring, e.g. a UART interrupt (producer) and the getchar
+// callback (consumer), or two threads. the size is a power of two, the buffer is given by the user.
+// head is only written by the producer, tail only by the consumer: no lock and no interrupt masking.
+// C11 atomics are used when the compiler has them, otherwise the gcc/clang __atomic builtins, otherwise
+// volatile indexes (enough for a single core, the producer being an interrupt).
+
+#ifndef LMODEM_RING_USE_C11_ATOMICS
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_ATOMICS__) && !defined(__cplusplus)
+#define LMODEM_RING_USE_C11_ATOMICS    (1)
+#else
+#define LMODEM_RING_USE_C11_ATOMICS    (0)
+#endif
+#endif
+
+#if LMODEM_RING_USE_C11_ATOMICS
+#include <stdatomic.h>
+typedef atomic_uint_least32_t lmodem_ring_index;
+#else
+typedef volatile uint32_t lmodem_ring_index;
+#endif
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint8_t* buffer;
+    uint32_t mask;
+    lmodem_ring_index head;         // free running, written by the producer
+    lmodem_ring_index tail;         // free running, written by the consumer
+} lmodem_ring;
+
+extern bool lmodem_ring_init(lmodem_ring* pThis, uint8_t* buffer, uint32_t size);
+
+// producer side
+extern uint32_t lmodem_ring_push(lmodem_ring* pThis, const uint8_t* data, uint32_t size);
+extern bool lmodem_ring_push_byte(lmodem_ring* pThis, uint8_t c);
+// contiguous free span (e.g. for a DMA or a read()), made visible to the consumer by lmodem_ring_commit
+extern uint32_t lmodem_ring_get_write_span(lmodem_ring* pThis, uint8_t** ppSpan);
+extern void lmodem_ring_commit(lmodem_ring* pThis, uint32_t size);
+extern uint32_t lmodem_ring_get_free(lmodem_ring* pThis);
+
+// consumer side
+extern uint32_t lmodem_ring_pop(lmodem_ring* pThis, uint8_t* data, uint32_t size);
+// contiguous readable span, given back to the producer by lmodem_ring_release
+extern uint32_t lmodem_ring_get_read_span(lmodem_ring* pThis, uint8_t** ppSpan);
+extern void lmodem_ring_release(lmodem_ring* pThis, uint32_t size);
+extern uint32_t lmodem_ring_get_count(lmodem_ring* pThis);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* LMODEM_RING_H */
@@ -0,0 +1,290 @@
+#ifndef LMODEM_STEP_H
+#define LMODEM_STEP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lmodem_config.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// resumable transfers: the protocol functions are stackless protothreads, their variables live in frames of the
+// context and each wait for received bytes returns to the caller. lmodem_receive/lmodem_emit answer the waits
+// with the blocking getchar callback, lmodem_step answers them from the rx ring without blocking.
+
+typedef enum
+{
+    LMODEM_STEP_WOULD_BLOCK,        // waiting for bytes or for a timeout, lmodem_step must be called again
+    LMODEM_STEP_DONE,               // transfer finished, lmodem_get_result gives the nb of bytes
+    LMODEM_STEP_ERROR               // transfer aborted, or not started
+} lmodem_step_status;
+
+typedef enum
+{
+    LMODEM_PT_WAITING,
+    LMODEM_PT_ENDED
+} lmodem_pt_status;
+
+typedef enum
+{
+    LXMODEM_RECV_OK,
+    LXMODEM_RECV_PREVIOUS_BLOCK,
+    LXMODEM_RECV_ERROR,
+    LXMODEM_RECV_NO_SPACE,
+    LXMODEM_RECV_FILE_CHECK_ERROR   // the whole file differs from the crc32 of block 0
+} lxmodem_reception_status;
+
+// local continuation: line of the last wait, 0 when the function is not running
+typedef uint16_t lmodem_lc;
+
+// bytes awaited by the transfer
+typedef struct
+{
+    uint8_t* data;
+    uint32_t size;
+    uint32_t done;
+    uint64_t deadline_ns;           // inter-byte timeout (lmodem_step)
+    bool pending;
+    bool up_to;                     // complete with the first bytes received, size is the maximum
+    bool armed;                     // DMA reception started for the remaining bytes
+    bool result;                    // false on timeout
+} lmodem_io_request;
+
+#if LMODEM_CFG_RX
+
+typedef struct
+{
+    lmodem_lc lc;
+    uint8_t c;
+    bool bReceived;
+    uint32_t nbPurged;
+} lmodem_frame_purge;
+
+typedef struct
+{
+    lmodem_lc lc;
+    uint32_t offset;
+    uint32_t chunkSize;
+    uint16_t crc;
+    bool bReceived;
+} lmodem_frame_stream;
+
+typedef struct
+{
+    lmodem_lc lc;
+    uint16_t crc;
+    lxmodem_reception_status status;
+} lmodem_frame_check;
+
+#if LMODEM_CFG_DMA
+typedef struct
+{
+    lmodem_lc lc;
+    uint32_t nbReceived;
+    uint32_t frameSize;
+    uint32_t blksize;
+    lxmodem_reception_status status;
+    bool bReceived;
+} lmodem_frame_dma;
+#endif
+
+typedef struct
+{
+    lmodem_lc lc;
+    lxmodem_reception_status status;
+    uint32_t trailerSize;
+    uint8_t* pPayload;
+    uint8_t* pTrailer;
+    uint16_t crc;
+    bool bReceived;
+} lmodem_frame_block;
+
+typedef struct
+{
+    lmodem_lc lc;
+    int32_t receivedBytes;
+    lxmodem_reception_status rcvStatus;
+    lxmodem_reception_status frameStatus;
+    uint8_t header;
+    uint32_t nbHeaders;
+    uint8_t expectedBlkNumber;
+    uint32_t blksize;
+    uint32_t canCharReceived;
+    uint32_t nbRetry;
+    uint8_t* pPayload;
+    bool bFinished;
+    bool bReceived;
+    bool bReadBlock;
+    bool bPurge;
+    bool bFramed;
+} lmodem_frame_xmodem_rx;
+
+typedef struct
+{
+    lmodem_lc lc;
+    uint32_t timeout;
+    uint8_t startBlock0;
+    bool bReceived;
+    bool bFinished;
+    int32_t receivedBytes;
+    lxmodem_reception_status rxStatus;
+    uint8_t* pPayload;
+    uint32_t blksize;
+} lmodem_frame_ymodem_rx;
+
+typedef struct
+{
+    lmodem_lc lc;
+    uint32_t retry;
+    uint32_t timeout;
+    uint8_t reply;
+    bool bReceived;
+    bool bAcked;
+    uint32_t offset;                // next hash of the list to send
+    uint32_t size;
+    uint16_t crc;
+} lmodem_frame_delta_rx;
+
+typedef struct
+{
+    lmodem_frame_xmodem_rx xmodem;
+    lmodem_frame_block block;
+#if LMODEM_CFG_DMA
+    lmodem_frame_dma frame;
+#endif
+    lmodem_frame_check check;
+    lmodem_frame_stream stream;
+    lmodem_frame_purge purge;
+#if LMODEM_CFG_YMODEM
+    lmodem_frame_ymodem_rx ymodem;
+    lmodem_frame_ymodem_rx next_file;
+#endif
+#if LMODEM_CFG_DELTA
+    lmodem_frame_delta_rx delta;
+#endif
+} lmodem_rx_frames;
+
+#endif /* LMODEM_CFG_RX */
+
+#if LMODEM_CFG_TX
+
+typedef struct
+{
+    lmodem_lc lc;
+    uint32_t timeout;
+    uint8_t receivedChar;
+    bool bReceived;
+    bool isReceivedOk;
+} lmodem_frame_wait;
+
+typedef struct
+{
+    lmodem_lc lc;
+    int32_t emittedBytes;
+    uint32_t timeout;
+    uint8_t preambule;
+    bool bReceived;
+} lmodem_frame_xmodem_tx;
+
+typedef struct
+{
+    lmodem_lc lc;
+    bool bFinished;
+    bool withCrc;
+    uint32_t defaultBlksize;
+    uint8_t blkNo;
+    uint32_t blkIndex;
+    const uint8_t* pBlock;          // block on the line, in the line buffer or in the block cache
+    uint32_t blockSize;
+    int32_t emittedBytes;
+    int32_t nbEmitted;
+    int32_t nbRaw;                  // data bytes of the block before compression
+    uint8_t ackBytes;
+    uint32_t retry;
+    uint32_t timeout;
+    bool bAckReceived;
+    bool isLastBlock;
+    bool bDoubleBuffer;
+    bool bNextReady;
+    int32_t nbNextEmitted;
+    int32_t nbNextRaw;
+    uint64_t sendTime;
+#if LMODEM_CFG_DELTA
+    bool bHashesAgain;              // the receiver missed the ACK of its hashes and sends them again
+#endif
+} lmodem_frame_blocks_tx;
+
+typedef struct
+{
+    lmodem_lc lc;
+    uint16_t crc;
+} lmodem_frame_trailer;
+
+typedef struct
+{
+    lmodem_lc lc;
+    int32_t nbEmitted;
+    uint32_t blksize;
+    uint8_t receivedChar;
+    uint32_t retry;
+    bool bOk;
+    bool bDone;
+} lmodem_frame_ymodem_tx;
+
+typedef struct
+{
+    lmodem_lc lc;
+    uint32_t nbHashes;
+    uint32_t index;
+    uint8_t bytes[4];
+    uint16_t crc;
+    uint32_t retry;
+    uint32_t nbPurged;
+    bool bReceived;
+    bool bOk;
+} lmodem_frame_delta_tx;
+
+typedef struct
+{
+    lmodem_frame_xmodem_tx xmodem;
+    lmodem_frame_blocks_tx blocks;
+    lmodem_frame_wait wait;
+    lmodem_frame_trailer trailer;
+#if LMODEM_CFG_YMODEM
+    lmodem_frame_ymodem_tx ymodem;
+#endif
+#if LMODEM_CFG_DELTA
+    lmodem_frame_delta_tx delta;
+#endif
+} lmodem_tx_frames;
+
+#endif /* LMODEM_CFG_TX */
+
+struct modem_context;
+
+typedef struct
+{
+    lmodem_lc lc;
+    bool running;
+    int32_t result;
+    lmodem_pt_status (*task)(struct modem_context* pThis);
+    lmodem_io_request io;
+    bool crc_pending;               // asynchronous crc update awaited, its result goes in crc_value
+    uint16_t crc_value;
+    union
+    {
+#if LMODEM_CFG_RX
+        lmodem_rx_frames rx;
+#endif
+#if LMODEM_CFG_TX
+        lmodem_tx_frames tx;
+#endif
+    } frames;
+} lmodem_step_state;
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* LMODEM_STEP_H */
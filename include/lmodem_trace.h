@@ -0,0 +1,74 @@
+#ifndef LMODEM_TRACE_H
+#define LMODEM_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// binary trace of the transfer events, kept in a user provided ring (see lmodem_set_trace_buffer).
+// the oldest events are overwritten when the ring is full. timestamps come from the clock callback.
+
+typedef enum
+{
+    LMODEM_TRACE_TX,                // value: nb bytes sent, data: first byte
+    LMODEM_TRACE_RX,                // value: nb bytes received, data: first byte
+    LMODEM_TRACE_TIMEOUT,           // value: nb bytes requested
+    LMODEM_TRACE_BLOCK,             // block committed (reception) or acknowledged (emission), value: payload size, data: block number
+    LMODEM_TRACE_NAK,               // NAK sent (reception) or received (emission), data: block number when known
+    LMODEM_TRACE_STATE,             // data: lmodem_trace_state
+    LMODEM_TRACE_NB_TYPES
+} lmodem_trace_type;
+
+typedef enum
+{
+    LMODEM_STATE_HANDSHAKE,
+    LMODEM_STATE_DATA,
+    LMODEM_STATE_DONE,
+    LMODEM_STATE_CANCEL,
+    LMODEM_STATE_NB
+} lmodem_trace_state;
+
+typedef struct
+{
+    uint64_t time_ns;
+    uint8_t type;
+    uint8_t data;
+    uint16_t reserved;
+    uint32_t value;
+} lmodem_trace_event;
+
+typedef struct
+{
+    lmodem_trace_event* events;
+    uint32_t mask;                  // nb events - 1, nb events is a power of two
+    uint32_t head;                  // nb events recorded since the last reset
+} lmodem_trace_ring;
+
+// dump file: header followed by header.count events, oldest first
+#define LMODEM_TRACE_FILE_MAGIC      "LMTR"
+#define LMODEM_TRACE_FILE_VERSION    (1)
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t event_size;
+    uint32_t count;
+} lmodem_trace_file_header;
+
+extern void lmodem_trace_reset(lmodem_trace_ring* pThis);
+// nb of events available (at most the ring size)
+extern uint32_t lmodem_trace_get_count(lmodem_trace_ring* pThis);
+// index 0 is the oldest event still in the ring
+extern const lmodem_trace_event* lmodem_trace_get_event(lmodem_trace_ring* pThis, uint32_t index);
+extern const char* lmodem_trace_type_name(uint8_t type);
+extern const char* lmodem_trace_state_name(uint8_t state);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif /* LMODEM_TRACE_H */
@@ -0,0 +1,22 @@
+# flash and static RAM of the library in the footprint probe: the probe minus the same application without the library
+# cmake -DSIZE_TOOL=<size> -DPROBE=<probe> -DBASE=<probe without the library> -DPROFILE=<profile> -P footprint.cmake
+
+function(modem_read_size file prefix)
+execute_process(COMMAND ${SIZE_TOOL} ${file} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+# berkeley format: a header line then text, data, bss, dec, hex, filename
+if ((NOT result EQUAL 0) OR (NOT output MATCHES "\n[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)"))
+message(FATAL_ERROR "unable to read the size of ${file}")
+endif()
+set(${prefix}_TEXT ${CMAKE_MATCH_1} PARENT_SCOPE)
+set(${prefix}_DATA ${CMAKE_MATCH_2} PARENT_SCOPE)
+set(${prefix}_BSS ${CMAKE_MATCH_3} PARENT_SCOPE)
+endfunction()
+
+modem_read_size(${PROBE} PROBE)
+modem_read_size(${BASE} BASE)
+math(EXPR MODEM_TEXT "${PROBE_TEXT} - ${BASE_TEXT}")
+math(EXPR MODEM_DATA "${PROBE_DATA} - ${BASE_DATA}")
+math(EXPR MODEM_BSS "${PROBE_BSS} - ${BASE_BSS}")
+# the bss of the probe holds a context, a line buffer and a 4 KiB file buffer
+message(STATUS "lmodem footprint for profile ${PROFILE}: flash ${MODEM_TEXT} bytes (text) + ${MODEM_DATA} bytes (data), "
+               "RAM of the probe ${MODEM_BSS} bytes (bss, one context and its buffers)")
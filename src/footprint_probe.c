@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+// smallest application of the profile: a transfer with the blocking api over two callbacks. linked with --gc-sections
+// it keeps only what the profile really uses, LMODEM_FOOTPRINT_BASE builds it without the library to subtract the C
+// runtime (see footprint.cmake).
+
+static volatile uint8_t probe_uart;
+
+#ifndef LMODEM_FOOTPRINT_BASE
+#include "lmodem.h"
+
+static modem_context_t probe_context;
+static uint8_t probe_line[LMODEM_LINE_BUFFER_MIN_SIZE];
+static uint8_t probe_file[4096];
+
+static bool probe_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    uint32_t i;
+    (void) pThis;
+
+    for (i = 0; i < size; i++)
+    {
+        data[i] = probe_uart;
+    }
+    return true;
+}
+
+static void probe_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    uint32_t i;
+    (void) pThis;
+
+    for (i = 0; i < size; i++)
+    {
+        probe_uart = data[i];
+    }
+}
+#endif
+
+int main(void)
+{
+    int32_t result;
+
+    //the variant and the protocol are only known at run time, none of them is dropped by the link
+    result = probe_uart;
+#ifndef LMODEM_FOOTPRINT_BASE
+    lmodem_init(&probe_context, (lxmodem_opts) probe_uart);
+    lmodem_set_line_buffer(&probe_context, probe_line, sizeof(probe_line));
+    lmodem_set_file_buffer(&probe_context, probe_file, sizeof(probe_file));
+    lmodem_set_getchar_cb(&probe_context, probe_getchar);
+    lmodem_set_putchar_cb(&probe_context, probe_putchar);
+#if LMODEM_CFG_RX
+    result = lmodem_receive(&probe_context, (lmodem_protocol) probe_uart);
+#endif
+#if LMODEM_CFG_TX
+    result += lmodem_emit(&probe_context, (lmodem_protocol) probe_uart);
+#endif
+#endif
+    return (int) result;
+}
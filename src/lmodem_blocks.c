@@ -0,0 +1,57 @@
+#include "lmodem.h"
+#include "lmodem_priv.h"
+#include <string.h>
+
+#if LMODEM_CFG_TX
+
+uint32_t lmodem_block_table_init(modem_context_t* pThis, lmodem_protocol protocol, lmodem_block_table* pTable)
+{
+    uint32_t defaultBlksize;
+    bool withCrc;
+
+    lxmode_get_block_format(pThis, protocol, &defaultBlksize, &withCrc);
+    memset(pTable, 0, sizeof(lmodem_block_table));
+    pTable->protocol = protocol;
+    pTable->trailer_size = withCrc ? LXMODEM_CRC16_SIZE : LXMODEM_CHKSUM_SIZE;
+    pTable->stride = 1 + LXMODEM_HEADER_SIZE + defaultBlksize + pTable->trailer_size;
+    pTable->nb_blocks = (pThis->ramfile.write_offset + defaultBlksize - 1) / defaultBlksize;
+    return pTable->nb_blocks * pTable->stride;
+}
+
+void lmodem_block_table_build(modem_context_t* pThis, lmodem_block_table* pTable, uint32_t first, uint32_t count)
+{
+    uint32_t index;
+
+    for (index = first; (index < first + count) && (index < pTable->nb_blocks); index++)
+    {
+        lmodem_build_block(pThis, pTable->protocol, index, pTable->blocks + index * pTable->stride);
+    }
+}
+
+const uint8_t* lmodem_block_table_get(const lmodem_block_table* pTable, uint32_t index, uint32_t* pSize)
+{
+    const uint8_t* pBlock;
+
+    if (index >= pTable->nb_blocks)
+    {
+        return NULL;
+    }
+
+    pBlock = pTable->blocks + index * pTable->stride;
+    *pSize = 1 + LXMODEM_HEADER_SIZE + ((pBlock[0] == STX) ? LXMODEM_BLOCK_SIZE_1024 : LXMODEM_BLOCK_SIZE_128) + pTable->trailer_size;
+    return pBlock;
+}
+
+static const uint8_t* lmodem_block_table_source(modem_context_t* pThis, uint32_t index, uint32_t* pSize)
+{
+    return lmodem_block_table_get(pThis->block_table, index, pSize);
+}
+
+void lmodem_set_block_table(modem_context_t* pThis, const lmodem_block_table* pTable)
+{
+    //sending and retransmissions read the table, nothing is framed during the transfer
+    pThis->block_table = pTable;
+    lmodem_set_block_source_cb(pThis, (pTable != NULL) ? lmodem_block_table_source : NULL);
+}
+
+#endif /* LMODEM_CFG_TX */
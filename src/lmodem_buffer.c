@@ -37,6 +37,24 @@ int32_t lmodem_buffer_write(lmodem_buffer* pThis, uint8_t* buffer, uint32_t size
     return nbToCopy;
 }
 
+uint8_t* lmodem_buffer_get_write_pointer(lmodem_buffer* pThis, uint32_t size)
+{
+    uint8_t* pWrite;
+    pWrite = NULL;
+
+    if ((pThis->buffer != NULL) && (lmodem_buffer_get_remaining_capacity(pThis) >= (int32_t) size))
+    {
+        pWrite = &pThis->buffer[pThis->write_offset];
+    }
+
+    return pWrite;
+}
+
+bool lmodem_buffer_commit_write(lmodem_buffer* pThis, uint32_t size)
+{
+    return lmodem_buffer_set_write_offset(pThis, pThis->write_offset + size);
+}
+
 int32_t lmodem_buffer_get_size(lmodem_buffer* pThis)
 {
     return pThis->write_offset - pThis->read_offset;
@@ -10,6 +10,10 @@ extern "C" {
 
 extern void lmodem_buffer_init(lmodem_buffer* pThis, uint8_t* buffer,  uint32_t max_size);
 extern int32_t lmodem_buffer_get_size(lmodem_buffer* pThis);
+extern int32_t lmodem_buffer_get_remaining_capacity(lmodem_buffer* pThis);
+// direct access to the free area, data become part of the buffer only after commit
+extern uint8_t* lmodem_buffer_get_write_pointer(lmodem_buffer* pThis, uint32_t size);
+extern bool lmodem_buffer_commit_write(lmodem_buffer* pThis, uint32_t size);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,342 @@
+#include "lmodem.h"
+#include "lmodem_priv.h"
+#include "lmodem_compress.h"
+#include <string.h>
+
+#if LMODEM_CFG_COMPRESS
+
+#define LMODEM_COMPRESS_RUN_ZEROS      (0xC0)
+#define LMODEM_COMPRESS_RUN_SUB        (0xE0)
+#define LMODEM_COMPRESS_MATCH          (0x80)
+
+typedef enum
+{
+    LMODEM_DECOMPRESS_CTRL,
+    LMODEM_DECOMPRESS_LITERALS,
+    LMODEM_DECOMPRESS_OFFSET_LO,
+    LMODEM_DECOMPRESS_OFFSET_HI,
+    LMODEM_DECOMPRESS_RUN_LENGTH,
+    LMODEM_DECOMPRESS_ENDED
+} lmodem_decompress_state;
+
+#if LMODEM_CFG_TX
+
+static uint32_t lmodem_compress_hash(const uint8_t* p)
+{
+    uint32_t v;
+    v = (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+    return (v * 2654435761u) >> (32 - LMODEM_COMPRESS_HASH_BITS);
+}
+
+void lmodem_compress_init(lmodem_compressor* pThis)
+{
+    memset(pThis->head, 0, sizeof(pThis->head));
+    pThis->window_base = 0;
+    pThis->start = 0;
+    pThis->end = 0;
+    pThis->nb_literals = 0;
+    pThis->out_size = 0;
+    pThis->out_offset = 0;
+    pThis->eof = false;
+    pThis->ended = false;
+    pThis->raw_bytes = 0;
+    pThis->compressed_bytes = 0;
+}
+
+// keeps a whole window of history before start and reads the lookahead after it
+static int32_t lmodem_compress_fill(lmodem_compressor* pThis, lmodem_compress_read_raw readRaw, void* pArg)
+{
+    uint32_t shift;
+    int32_t n;
+
+    if (pThis->start > LMODEM_COMPRESS_WINDOW)
+    {
+        shift = pThis->start - LMODEM_COMPRESS_WINDOW;
+        memmove(pThis->window, &pThis->window[shift], pThis->end - shift);
+        pThis->window_base += shift;
+        pThis->start -= shift;
+        pThis->end -= shift;
+    }
+
+    while ((!pThis->eof) && (pThis->end < sizeof(pThis->window)))
+    {
+        n = readRaw(pArg, &pThis->window[pThis->end], sizeof(pThis->window) - pThis->end);
+        if (n < 0)
+        {
+            return -1;
+        }
+        pThis->eof = (n == 0);
+        pThis->end += n;
+    }
+    return 0;
+}
+
+static void lmodem_compress_flush_literals(lmodem_compressor* pThis)
+{
+    if (pThis->nb_literals > 0)
+    {
+        pThis->out[pThis->out_size++] = (uint8_t) (pThis->nb_literals - 1);
+        memcpy(&pThis->out[pThis->out_size], pThis->literals, pThis->nb_literals);
+        pThis->out_size += pThis->nb_literals;
+        pThis->nb_literals = 0;
+    }
+}
+
+static uint32_t lmodem_compress_run(lmodem_compressor* pThis, const uint8_t* p, uint32_t avail)
+{
+    uint32_t length;
+    uint32_t max;
+
+    length = 0;
+    max = min(avail, LMODEM_COMPRESS_MAX_RUN);
+    while ((length < max) && (p[length] == p[0]))
+    {
+        length++;
+    }
+    if (length < LMODEM_COMPRESS_MIN_RUN)
+    {
+        return 0;
+    }
+
+    lmodem_compress_flush_literals(pThis);
+    pThis->out[pThis->out_size++] = ((p[0] == 0) ? LMODEM_COMPRESS_RUN_ZEROS : LMODEM_COMPRESS_RUN_SUB) | ((length - 1) >> 8);
+    pThis->out[pThis->out_size++] = (uint8_t) (length - 1);
+    return length;
+}
+
+static uint32_t lmodem_compress_match(lmodem_compressor* pThis, const uint8_t* p, uint32_t avail)
+{
+    const uint8_t* pCandidate;
+    uint64_t position;
+    uint32_t candidate;
+    uint32_t distance;
+    uint32_t length;
+    uint32_t max;
+    uint32_t i;
+
+    length = 0;
+    position = pThis->window_base + pThis->start;
+    i = lmodem_compress_hash(p);
+    candidate = pThis->head[i];
+    pThis->head[i] = (uint32_t) position + 1;
+    if ((candidate == 0) || (candidate - 1 < pThis->window_base) || (position - (candidate - 1) > LMODEM_COMPRESS_WINDOW))
+    {
+        return 0;
+    }
+
+    distance = (uint32_t) (position - (candidate - 1));
+    pCandidate = p - distance;
+    max = min(avail, LMODEM_COMPRESS_MAX_MATCH);
+    while ((length < max) && (pCandidate[length] == p[length]))
+    {
+        length++;
+    }
+    if (length < LMODEM_COMPRESS_MIN_MATCH)
+    {
+        return 0;
+    }
+
+    lmodem_compress_flush_literals(pThis);
+    pThis->out[pThis->out_size++] = LMODEM_COMPRESS_MATCH | (length - LMODEM_COMPRESS_MIN_MATCH);
+    pThis->out[pThis->out_size++] = (uint8_t) (distance - 1);
+    pThis->out[pThis->out_size++] = (uint8_t) ((distance - 1) >> 8);
+    //the positions inside the match may start the next ones
+    for (i = 1; (i < length) && (avail - i >= LMODEM_COMPRESS_MIN_MATCH); i++)
+    {
+        pThis->head[lmodem_compress_hash(p + i)] = (uint32_t) (position + i) + 1;
+    }
+    return length;
+}
+
+// encodes until at least one token is in out
+static int32_t lmodem_compress_next(lmodem_compressor* pThis, lmodem_compress_read_raw readRaw, void* pArg)
+{
+    const uint8_t* p;
+    uint32_t avail;
+    uint32_t length;
+
+    pThis->out_size = 0;
+    pThis->out_offset = 0;
+    while (pThis->out_size == 0)
+    {
+        if ((pThis->end - pThis->start < LMODEM_COMPRESS_MAX_MATCH) && (!pThis->eof))
+        {
+            if (lmodem_compress_fill(pThis, readRaw, pArg) < 0)
+            {
+                return -1;
+            }
+        }
+
+        avail = pThis->end - pThis->start;
+        if (avail == 0)
+        {
+            lmodem_compress_flush_literals(pThis);
+            pThis->out[pThis->out_size++] = LMODEM_COMPRESS_END;
+            pThis->ended = true;
+            break;
+        }
+
+        p = &pThis->window[pThis->start];
+        length = 0;
+        if ((p[0] == 0) || (p[0] == SUB))
+        {
+            length = lmodem_compress_run(pThis, p, avail);
+        }
+        if ((length == 0) && (avail >= LMODEM_COMPRESS_MIN_MATCH))
+        {
+            length = lmodem_compress_match(pThis, p, avail);
+        }
+        if (length == 0)
+        {
+            pThis->literals[pThis->nb_literals++] = p[0];
+            length = 1;
+            if (pThis->nb_literals == LMODEM_COMPRESS_MAX_LITERALS)
+            {
+                lmodem_compress_flush_literals(pThis);
+            }
+        }
+        pThis->start += length;
+        pThis->raw_bytes += length;
+    }
+
+    pThis->compressed_bytes += pThis->out_size;
+    return 0;
+}
+
+int32_t lmodem_compress_read(lmodem_compressor* pThis, lmodem_compress_read_raw readRaw, void* pArg, uint8_t* data, uint32_t size)
+{
+    uint32_t nbRead;
+    uint32_t n;
+
+    nbRead = 0;
+    while (nbRead < size)
+    {
+        if (pThis->out_offset == pThis->out_size)
+        {
+            if (pThis->ended)
+            {
+                break;
+            }
+            if (lmodem_compress_next(pThis, readRaw, pArg) < 0)
+            {
+                return -1;
+            }
+        }
+        //a token may be split between two blocks
+        n = min(pThis->out_size - pThis->out_offset, size - nbRead);
+        memcpy(&data[nbRead], &pThis->out[pThis->out_offset], n);
+        pThis->out_offset += n;
+        nbRead += n;
+    }
+    return (int32_t) nbRead;
+}
+
+#endif /* LMODEM_CFG_TX */
+
+#if LMODEM_CFG_RX
+
+void lmodem_decompress_init(lmodem_decompressor* pThis)
+{
+    memset(pThis, 0, sizeof(lmodem_decompressor));
+    pThis->state = LMODEM_DECOMPRESS_CTRL;
+}
+
+int32_t lmodem_decompress(lmodem_decompressor* pThis, const uint8_t* data, uint32_t size, uint8_t* out, uint32_t* pOutOffset,
+                          uint32_t outSize)
+{
+    uint32_t outOffset;
+    uint32_t i;
+    uint8_t c;
+
+    outOffset = *pOutOffset;
+    for (i = 0; (i < size) && (pThis->state != LMODEM_DECOMPRESS_ENDED); i++)
+    {
+        c = data[i];
+        switch (pThis->state)
+        {
+            case LMODEM_DECOMPRESS_CTRL:
+                pThis->ctrl = c;
+                if (c < LMODEM_COMPRESS_MATCH)
+                {
+                    pThis->count = c + 1;
+                    pThis->state = LMODEM_DECOMPRESS_LITERALS;
+                }
+                else if (c < LMODEM_COMPRESS_RUN_ZEROS)
+                {
+                    pThis->count = (c & 0x3F) + LMODEM_COMPRESS_MIN_MATCH;
+                    pThis->state = LMODEM_DECOMPRESS_OFFSET_LO;
+                }
+                else if (c == LMODEM_COMPRESS_END)
+                {
+                    pThis->state = LMODEM_DECOMPRESS_ENDED;
+                }
+                else
+                {
+                    pThis->state = LMODEM_DECOMPRESS_RUN_LENGTH;
+                }
+                break;
+
+            case LMODEM_DECOMPRESS_LITERALS:
+                if (outOffset >= outSize)
+                {
+                    return -1;
+                }
+                out[outOffset++] = c;
+                pThis->count--;
+                if (pThis->count == 0)
+                {
+                    pThis->state = LMODEM_DECOMPRESS_CTRL;
+                }
+                break;
+
+            case LMODEM_DECOMPRESS_OFFSET_LO:
+                pThis->offset = c;
+                pThis->state = LMODEM_DECOMPRESS_OFFSET_HI;
+                break;
+
+            case LMODEM_DECOMPRESS_OFFSET_HI:
+                pThis->offset = (pThis->offset | ((uint32_t) c << 8)) + 1;
+                if ((pThis->offset > outOffset) || (pThis->count > outSize - outOffset))
+                {
+                    return -1;
+                }
+                //byte by byte: the copy may overlap its source (a repeated pattern)
+                for (; pThis->count > 0; pThis->count--)
+                {
+                    out[outOffset] = out[outOffset - pThis->offset];
+                    outOffset++;
+                }
+                pThis->state = LMODEM_DECOMPRESS_CTRL;
+                break;
+
+            case LMODEM_DECOMPRESS_RUN_LENGTH:
+                pThis->count = ((((uint32_t) pThis->ctrl & 0x1F) << 8) | c) + 1;
+                if (pThis->count > outSize - outOffset)
+                {
+                    return -1;
+                }
+                memset(&out[outOffset], (pThis->ctrl >= LMODEM_COMPRESS_RUN_SUB) ? SUB : 0, pThis->count);
+                outOffset += pThis->count;
+                pThis->count = 0;
+                pThis->state = LMODEM_DECOMPRESS_CTRL;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    pThis->compressed_bytes += i;
+    i = outOffset - *pOutOffset;
+    *pOutOffset = outOffset;
+    return (int32_t) i;
+}
+
+bool lmodem_decompress_is_ended(const lmodem_decompressor* pThis)
+{
+    return (pThis->state == LMODEM_DECOMPRESS_ENDED);
+}
+
+#endif /* LMODEM_CFG_RX */
+
+#endif /* LMODEM_CFG_COMPRESS */
@@ -0,0 +1,102 @@
+#include "lmodem.h"
+#include "lmodem_priv.h"
+
+#if LMODEM_CFG_CRC
+
+// default provider: the CRC-16 CCITT table of the context
+static uint16_t lmodem_crc_software_init(modem_context_t* pThis)
+{
+    (void) pThis;
+    return LXMODEM_CRC16_INIT_VALUE;
+}
+
+static bool lmodem_crc_software_update(modem_context_t* pThis, uint8_t* data, uint32_t size, uint16_t* pCrc)
+{
+    *pCrc = crc16_doCalcul(&pThis->crc16, data, size, *pCrc, 0);
+    return true;
+}
+
+static uint16_t lmodem_crc_software_final(modem_context_t* pThis, uint16_t crc)
+{
+    (void) pThis;
+    return crc ^ LXMODEM_CRC16_XOR_FINAL;
+}
+
+const lmodem_crc_provider lmodem_crc_software =
+{
+    lmodem_crc_software_init,
+    lmodem_crc_software_update,
+    lmodem_crc_software_final
+};
+
+void lmodem_set_crc_provider(modem_context_t* pThis, const lmodem_crc_provider* pProvider)
+{
+    pThis->crc_provider = (pProvider != NULL) ? pProvider : &lmodem_crc_software;
+}
+
+void lmodem_crc_complete(modem_context_t* pThis, uint16_t crc)
+{
+    lmodem_ring_store_release(&pThis->crc_result, LMODEM_CRC_DONE | crc);
+}
+
+bool lmodem_crc_poll(modem_context_t* pThis, uint16_t* pCrc)
+{
+    uint32_t crcResult;
+
+    crcResult = lmodem_ring_load_acquire(&pThis->crc_result);
+    if ((crcResult & LMODEM_CRC_DONE) == 0)
+    {
+        return false;
+    }
+    //consumed: a next update starts from a cleared result
+    lmodem_ring_store_release(&pThis->crc_result, 0);
+    *pCrc = (uint16_t) crcResult;
+    return true;
+}
+
+bool lmodem_crc_wait(modem_context_t* pThis, uint16_t* pCrc)
+{
+    uint64_t deadline;
+
+    if (lmodem_crc_poll(pThis, pCrc))
+    {
+        return true;
+    }
+    //without clock it is polled once, like the rx ring
+    if (pThis->clock_ns == NULL)
+    {
+        return false;
+    }
+
+    deadline = pThis->clock_ns(pThis) + lmodem_crc_timeout(pThis);
+    while (!lmodem_crc_poll(pThis, pCrc))
+    {
+        if (pThis->clock_ns(pThis) >= deadline)
+        {
+            pThis->stats.timeouts++;
+            lmodem_trace(pThis, LMODEM_TRACE_TIMEOUT, 0, 0);
+            return false;
+        }
+        if (pThis->rx_idle != NULL)
+        {
+            pThis->rx_idle(pThis);
+        }
+    }
+    return true;
+}
+
+bool lmodem_crc_block(modem_context_t* pThis, uint8_t* data, uint32_t size, uint16_t* pCrc)
+{
+    uint16_t crc;
+
+    //nothing is written in the context by a synchronous provider
+    crc = lmodem_crc_init(pThis);
+    if ((!pThis->crc_provider->update(pThis, data, size, &crc)) && (!lmodem_crc_wait(pThis, &crc)))
+    {
+        return false;
+    }
+    *pCrc = lmodem_crc_final(pThis, crc);
+    return true;
+}
+
+#endif /* LMODEM_CFG_CRC */
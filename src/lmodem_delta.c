@@ -0,0 +1,210 @@
+#include "lmodem.h"
+#include "lmodem_priv.h"
+#include "lmodem_delta.h"
+#include <string.h>
+
+uint32_t lmodem_fnv1a(uint32_t hash, const uint8_t* data, uint32_t size)
+{
+    uint32_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+#if LMODEM_CFG_DELTA
+
+typedef enum
+{
+    LMODEM_DELTA_DECODE_OFFSET,
+    LMODEM_DELTA_DECODE_DATA,
+    LMODEM_DELTA_DECODE_ENDED
+} lmodem_delta_decode_state;
+
+uint32_t lmodem_delta_hash(const uint8_t* data, uint32_t size)
+{
+    //FNV-1a, started from the size
+    return lmodem_fnv1a(LMODEM_FNV1A_INIT ^ size, data, size);
+}
+
+#if LMODEM_CFG_TX
+
+void lmodem_delta_encode_init(lmodem_delta_encoder* pThis)
+{
+    //the hashes are kept, they are received before the data blocks
+    pThis->index = 0;
+    pThis->out_size = 0;
+    pThis->out_offset = 0;
+    pThis->ended = false;
+    pThis->raw_bytes = 0;
+    pThis->blocks_sent = 0;
+    pThis->blocks_skipped = 0;
+}
+
+// reads the source until a block differs from the one of the receiver, or the end record
+static int32_t lmodem_delta_next(lmodem_delta_encoder* pThis, lmodem_delta_read_raw readRaw, void* pArg)
+{
+    uint8_t* pBlock;
+    uint32_t blockSize;
+    int32_t n;
+
+    pThis->out_size = 0;
+    pThis->out_offset = 0;
+    pBlock = &pThis->out[LMODEM_DELTA_OFFSET_SIZE];
+    while (pThis->out_size == 0)
+    {
+        blockSize = 0;
+        while (blockSize < LMODEM_DELTA_BLOCK_SIZE)
+        {
+            n = readRaw(pArg, &pBlock[blockSize], LMODEM_DELTA_BLOCK_SIZE - blockSize);
+            if (n < 0)
+            {
+                return -1;
+            }
+            if (n == 0)
+            {
+                break;
+            }
+            blockSize += n;
+        }
+
+        if (blockSize == 0)
+        {
+            lmodem_put_le32(pThis->out, LMODEM_DELTA_END);
+            pThis->out_size = LMODEM_DELTA_OFFSET_SIZE;
+            pThis->ended = true;
+            break;
+        }
+
+        pThis->raw_bytes += blockSize;
+        if ((pThis->index < pThis->nb_hashes) && (pThis->hashes[pThis->index] == lmodem_delta_hash(pBlock, blockSize)))
+        {
+            pThis->blocks_skipped++;
+        }
+        else
+        {
+            lmodem_put_le32(pThis->out, pThis->index * LMODEM_DELTA_BLOCK_SIZE);
+            pThis->out_size = LMODEM_DELTA_OFFSET_SIZE + blockSize;
+            pThis->blocks_sent++;
+        }
+        pThis->index++;
+    }
+    return 0;
+}
+
+int32_t lmodem_delta_read(lmodem_delta_encoder* pThis, lmodem_delta_read_raw readRaw, void* pArg, uint8_t* data, uint32_t size)
+{
+    uint32_t nbRead;
+    uint32_t n;
+
+    nbRead = 0;
+    while (nbRead < size)
+    {
+        if (pThis->out_offset == pThis->out_size)
+        {
+            if (pThis->ended)
+            {
+                break;
+            }
+            if (lmodem_delta_next(pThis, readRaw, pArg) < 0)
+            {
+                return -1;
+            }
+        }
+        //a record may be split between two data blocks
+        n = min(pThis->out_size - pThis->out_offset, size - nbRead);
+        memcpy(&data[nbRead], &pThis->out[pThis->out_offset], n);
+        pThis->out_offset += n;
+        nbRead += n;
+    }
+    return (int32_t) nbRead;
+}
+
+#endif /* LMODEM_CFG_TX */
+
+#if LMODEM_CFG_RX
+
+void lmodem_delta_decode_init(lmodem_delta_decoder* pThis, uint32_t fileSize)
+{
+    memset(pThis, 0, sizeof(lmodem_delta_decoder));
+    pThis->state = LMODEM_DELTA_DECODE_OFFSET;
+    pThis->file_size = fileSize;
+}
+
+int32_t lmodem_delta_apply(lmodem_delta_decoder* pThis, const uint8_t* data, uint32_t size, uint8_t* out)
+{
+    uint32_t covered;
+    uint32_t i;
+    uint32_t n;
+
+    covered = pThis->covered;
+    i = 0;
+    while ((i < size) && (pThis->state != LMODEM_DELTA_DECODE_ENDED))
+    {
+        switch (pThis->state)
+        {
+            case LMODEM_DELTA_DECODE_OFFSET:
+                if (pThis->nb_offset_bytes == 0)
+                {
+                    pThis->offset = 0;
+                }
+                pThis->offset |= (uint32_t) data[i] << (8 * pThis->nb_offset_bytes);
+                pThis->nb_offset_bytes++;
+                i++;
+                if (pThis->nb_offset_bytes < LMODEM_DELTA_OFFSET_SIZE)
+                {
+                    break;
+                }
+
+                pThis->nb_offset_bytes = 0;
+                if (pThis->offset == LMODEM_DELTA_END)
+                {
+                    //the blocks after the last record are kept
+                    pThis->covered = pThis->file_size;
+                    pThis->state = LMODEM_DELTA_DECODE_ENDED;
+                }
+                else if (((pThis->offset % LMODEM_DELTA_BLOCK_SIZE) != 0) || (pThis->offset < pThis->covered)
+                         || (pThis->offset >= pThis->file_size))
+                {
+                    return -1;
+                }
+                else
+                {
+                    pThis->count = min(LMODEM_DELTA_BLOCK_SIZE, pThis->file_size - pThis->offset);
+                    pThis->covered = pThis->offset;
+                    pThis->state = LMODEM_DELTA_DECODE_DATA;
+                }
+                break;
+
+            case LMODEM_DELTA_DECODE_DATA:
+                n = min(pThis->count, size - i);
+                memcpy(&out[pThis->offset], &data[i], n);
+                pThis->offset += n;
+                pThis->count -= n;
+                pThis->covered = pThis->offset;
+                i += n;
+                if (pThis->count == 0)
+                {
+                    pThis->state = LMODEM_DELTA_DECODE_OFFSET;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    n = pThis->covered - covered;
+    return (int32_t) n;
+}
+
+bool lmodem_delta_is_ended(const lmodem_delta_decoder* pThis)
+{
+    return (pThis->state == LMODEM_DELTA_DECODE_ENDED);
+}
+
+#endif /* LMODEM_CFG_RX */
+
+#endif /* LMODEM_CFG_DELTA */
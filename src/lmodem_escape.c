@@ -0,0 +1,201 @@
+#include "lmodem_escape.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LMODEM_ESCAPE_KERNEL           "avx2"
+#define LMODEM_VEC_SIZE                (32)
+typedef __m256i lmodem_vec;
+#define lmodem_vec_load(p)             _mm256_loadu_si256((const __m256i*) (p))
+#define lmodem_vec_store(p, v)         _mm256_storeu_si256((__m256i*) (p), (v))
+#define lmodem_vec_set1(c)             _mm256_set1_epi8((char) (c))
+#define lmodem_vec_and(a, b)           _mm256_and_si256((a), (b))
+#define lmodem_vec_or(a, b)            _mm256_or_si256((a), (b))
+#define lmodem_vec_cmpeq(a, b)         _mm256_cmpeq_epi8((a), (b))
+#define lmodem_vec_movemask(v)         ((uint32_t) _mm256_movemask_epi8(v))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LMODEM_ESCAPE_KERNEL           "sse2"
+#define LMODEM_VEC_SIZE                (16)
+typedef __m128i lmodem_vec;
+#define lmodem_vec_load(p)             _mm_loadu_si128((const __m128i*) (p))
+#define lmodem_vec_store(p, v)         _mm_storeu_si128((__m128i*) (p), (v))
+#define lmodem_vec_set1(c)             _mm_set1_epi8((char) (c))
+#define lmodem_vec_and(a, b)           _mm_and_si128((a), (b))
+#define lmodem_vec_or(a, b)            _mm_or_si128((a), (b))
+#define lmodem_vec_cmpeq(a, b)         _mm_cmpeq_epi8((a), (b))
+#define lmodem_vec_movemask(v)         ((uint32_t) _mm_movemask_epi8(v))
+#else
+#define LMODEM_ESCAPE_KERNEL           "scalar"
+#endif
+
+uint32_t lmodem_escape_encode_scalar(uint8_t* dst, uint8_t* src, uint32_t size)
+{
+    uint32_t i;
+    uint32_t o;
+
+    o = 0;
+    for (i = 0; i < size; i++)
+    {
+        if (lmodem_escape_is_needed(src[i]))
+        {
+            dst[o++] = LMODEM_ZDLE;
+            dst[o++] = src[i] ^ LMODEM_ZDLE_XOR;
+        }
+        else
+        {
+            dst[o++] = src[i];
+        }
+    }
+
+    return o;
+}
+
+void lmodem_escape_decoder_init(lmodem_escape_decoder* pThis)
+{
+    pThis->pendingZdle = false;
+}
+
+uint32_t lmodem_escape_decode_scalar(lmodem_escape_decoder* pThis, uint8_t* dst, uint8_t* src, uint32_t size)
+{
+    uint32_t i;
+    uint32_t o;
+
+    o = 0;
+    for (i = 0; i < size; i++)
+    {
+        if (pThis->pendingZdle)
+        {
+            dst[o++] = src[i] ^ LMODEM_ZDLE_XOR;
+            pThis->pendingZdle = false;
+        }
+        else if (src[i] == LMODEM_ZDLE)
+        {
+            pThis->pendingZdle = true;
+        }
+        else
+        {
+            dst[o++] = src[i];
+        }
+    }
+
+    return o;
+}
+
+#ifdef LMODEM_VEC_SIZE
+
+static inline uint32_t lmodem_escape_mask(lmodem_vec v)
+{
+    lmodem_vec low;
+    lmodem_vec m;
+
+    low = lmodem_vec_and(v, lmodem_vec_set1(0x7F));
+    m = lmodem_vec_cmpeq(low, lmodem_vec_set1(0x10));
+    m = lmodem_vec_or(m, lmodem_vec_cmpeq(low, lmodem_vec_set1(0x11)));
+    m = lmodem_vec_or(m, lmodem_vec_cmpeq(low, lmodem_vec_set1(0x13)));
+    m = lmodem_vec_or(m, lmodem_vec_cmpeq(low, lmodem_vec_set1(LMODEM_ZDLE)));
+    return lmodem_vec_movemask(m);
+}
+
+uint32_t lmodem_escape_encode(uint8_t* dst, uint8_t* src, uint32_t size)
+{
+    uint32_t i;
+    uint32_t o;
+    uint32_t mask;
+    uint32_t n;
+    lmodem_vec v;
+
+    i = 0;
+    o = 0;
+    // o <= 2 * i, so the full vector store always stays inside LMODEM_ESCAPE_MAX_SIZE(size)
+    while ((i + LMODEM_VEC_SIZE) <= size)
+    {
+        v = lmodem_vec_load(src + i);
+        mask = lmodem_escape_mask(v);
+        lmodem_vec_store(dst + o, v);
+        if (mask == 0)
+        {
+            i += LMODEM_VEC_SIZE;
+            o += LMODEM_VEC_SIZE;
+        }
+        else
+        {
+            //keep the bytes before the first escape, escape it and restart the scan after it
+            n = __builtin_ctz(mask);
+            i += n;
+            o += n;
+            dst[o++] = LMODEM_ZDLE;
+            dst[o++] = src[i++] ^ LMODEM_ZDLE_XOR;
+        }
+    }
+
+    o += lmodem_escape_encode_scalar(dst + o, src + i, size - i);
+    return o;
+}
+
+uint32_t lmodem_escape_decode(lmodem_escape_decoder* pThis, uint8_t* dst, uint8_t* src, uint32_t size)
+{
+    uint32_t i;
+    uint32_t o;
+    uint32_t mask;
+    uint32_t n;
+    lmodem_vec v;
+
+    i = 0;
+    o = 0;
+    if ((pThis->pendingZdle) && (size > 0))
+    {
+        dst[o++] = src[i++] ^ LMODEM_ZDLE_XOR;
+        pThis->pendingZdle = false;
+    }
+
+    // o <= i, so the full vector store always stays inside size
+    while ((i + LMODEM_VEC_SIZE) <= size)
+    {
+        v = lmodem_vec_load(src + i);
+        mask = lmodem_vec_movemask(lmodem_vec_cmpeq(v, lmodem_vec_set1(LMODEM_ZDLE)));
+        lmodem_vec_store(dst + o, v);
+        if (mask == 0)
+        {
+            i += LMODEM_VEC_SIZE;
+            o += LMODEM_VEC_SIZE;
+        }
+        else
+        {
+            n = __builtin_ctz(mask);
+            i += n;
+            o += n;
+            if ((i + 1) < size)
+            {
+                dst[o++] = src[i + 1] ^ LMODEM_ZDLE_XOR;
+                i += 2;
+            }
+            else
+            {
+                pThis->pendingZdle = true;
+                i++;
+            }
+        }
+    }
+
+    o += lmodem_escape_decode_scalar(pThis, dst + o, src + i, size - i);
+    return o;
+}
+
+#else
+
+uint32_t lmodem_escape_encode(uint8_t* dst, uint8_t* src, uint32_t size)
+{
+    return lmodem_escape_encode_scalar(dst, src, size);
+}
+
+uint32_t lmodem_escape_decode(lmodem_escape_decoder* pThis, uint8_t* dst, uint8_t* src, uint32_t size)
+{
+    return lmodem_escape_decode_scalar(pThis, dst, src, size);
+}
+
+#endif /* LMODEM_VEC_SIZE */
+
+const char* lmodem_escape_kernel_name(void)
+{
+    return LMODEM_ESCAPE_KERNEL;
+}
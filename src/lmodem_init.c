@@ -4,16 +4,29 @@
 #include "lmodem_buffer.h"
 #include <string.h>
 
-#define LXMODEM_CRC16_CCITT_POLYNOME   (0x1021)
+static uint32_t lmodem_get_line_buffer_min_size(modem_context_t* pThis);
+
+LMODEM_STATIC_ASSERT(sizeof(modem_context_t) <= LMODEM_CONTEXT_MAX_SIZE, "context larger than the RAM budget of the profile");
 
 void lmodem_init(modem_context_t* pThis, lxmodem_opts opts)
 {
     memset(pThis, 0, sizeof(modem_context_t));
     pThis->opts = opts;
-    //if ((opts == lxmodem_128_with_crc) || (opts == lxmodem_1k))
-    //{
-    crc16_init(&pThis->crc16, LXMODEM_CRC16_CCITT_POLYNOME);
-    //}
+#if LMODEM_CFG_CRC
+    crc16_init(&pThis->crc16, CRC16_CCITT_POLYNOME);
+    pThis->crc_provider = &lmodem_crc_software;
+#endif
+}
+
+void lmodem_set_user_data(modem_context_t* pThis, void* userData)
+{
+    //state of the callbacks, the library has no global state and the contexts are independent
+    pThis->user_data = userData;
+}
+
+void* lmodem_get_user_data(modem_context_t* pThis)
+{
+    return pThis->user_data;
 }
 
 void lmodem_set_putchar_cb(modem_context_t* pThis, void (*putchar)(modem_context_t* pThis, uint8_t* data, uint32_t size))
@@ -26,42 +39,142 @@ void lmodem_set_getchar_cb(modem_context_t* pThis, bool (*getchar)(modem_context
     pThis->getchar = getchar;
 }
 
-bool lmodem_set_line_buffer(modem_context_t* pThis, uint8_t* buffer, uint32_t size)
+void lmodem_set_clock_cb(modem_context_t* pThis, uint64_t (*clock_ns)(modem_context_t* pThis))
 {
-    bool bOk;
-    uint32_t expectedSize;
+    //monotonic clock, used for the timings of the statistics
+    pThis->clock_ns = clock_ns;
+}
+
+void lmodem_set_progress_cb(modem_context_t* pThis, void (*progress)(modem_context_t* pThis, const lmodem_progress* pProgress))
+{
+    //called from the transfer loop, it must return quickly
+    pThis->progress = progress;
+}
 
+bool lmodem_set_trace_buffer(modem_context_t* pThis, lmodem_trace_event* events, uint32_t nbEvents)
+{
+    bool bOk;
     bOk = false;
-    expectedSize = 0;
+
+    //nb events must be a power of two, NULL disables the trace
+    if (events == NULL)
+    {
+        pThis->trace.events = NULL;
+        pThis->trace.mask = 0;
+        bOk = true;
+    }
+    else if ((nbEvents > 0) && ((nbEvents & (nbEvents - 1)) == 0))
+    {
+        pThis->trace.events = events;
+        pThis->trace.mask = nbEvents - 1;
+        bOk = true;
+    }
+    pThis->trace.head = 0;
+
+    return bOk;
+}
+
+#if LMODEM_CFG_RX
+bool lmodem_set_low_memory_rx(modem_context_t* pThis, bool lowMemoryRx)
+{
+    //1k blocks are received in place in the file buffer by chunks,
+    //the line buffer only needs to hold a 128 bytes block
+    pThis->lowMemoryRx = lowMemoryRx;
+
+    //the line buffer may have been set before, it is checked again against the new mode
+    return (pThis->blk_buffer.buffer == NULL) || (pThis->blk_buffer.max_size >= lmodem_get_line_buffer_min_size(pThis));
+}
+#endif
+
+bool lmodem_set_line_buffer(modem_context_t* pThis, uint8_t* buffer, uint32_t size)
+{
+    //kept even when too small: lmodem_set_low_memory_rx called after may make it large enough
+    pThis->withCrc = (pThis->opts != lxmodem_128_with_chksum);
+    pThis->blk_buffer.buffer = buffer;
+    pThis->blk_buffer.max_size = size;
+    pThis->blk_buffer.current_size = 0;
+
+    return (size >= lmodem_get_line_buffer_min_size(pThis));
+}
+
+static uint32_t lmodem_get_line_buffer_min_size(modem_context_t* pThis)
+{
+    uint32_t expectedSize;
 
     switch (pThis->opts)
     {
+#if LMODEM_CFG_XMODEM_CHKSUM
         case lxmodem_128_with_chksum:
             // blk data  =  no Bko (2 bytes) + data (128) + chksum 1(byte)
             expectedSize = LXMODEM_HEADER_SIZE + LXMODEM_BLOCK_SIZE_128 + LXMODEM_CHKSUM_SIZE;
-            pThis->withCrc = false;
             break;
+#endif
+#if LMODEM_CFG_XMODEM_CRC
         case lxmodem_128_with_crc:
             // blk data  =  no Bko (2 bytes) + data (128) + crc  2(bytes)
             expectedSize = LXMODEM_HEADER_SIZE + LXMODEM_BLOCK_SIZE_128 + LXMODEM_CRC16_SIZE;
-            pThis->withCrc = true;
             break;
+#endif
+#if LMODEM_CFG_1K_BLOCKS
         case lxmodem_1k:
             // blk data = no Blo (2 bytes) + data (1024) + crc (2bytes)
             expectedSize = LXMODEM_HEADER_SIZE + LXMODEM_BLOCK_SIZE_1024 + LXMODEM_CRC16_SIZE;
-            pThis->withCrc = true;
+#if LMODEM_CFG_RX
+            if (pThis->lowMemoryRx)
+            {
+                expectedSize = LXMODEM_HEADER_SIZE + LXMODEM_BLOCK_SIZE_128 + LXMODEM_CRC16_SIZE;
+            }
+#endif
+            break;
+#endif
+        default:
+            //variant not compiled in the profile (a ymodem only profile uses lxmodem_1k)
+            expectedSize = UINT32_MAX;
             break;
     }
 
-    if (size >= expectedSize)
+    return expectedSize;
+}
+
+#if LMODEM_CFG_TX
+void lmodem_set_next_line_buffer(modem_context_t* pThis, uint8_t* buffer, uint32_t size)
+{
+    //emission only: block N+1 is built in this buffer while the ACK of block N is awaited,
+    //ignored when smaller than the line buffer needed by the emission, NULL disables it
+    pThis->next_blk_buffer.buffer = buffer;
+    pThis->next_blk_buffer.max_size = (buffer != NULL) ? size : 0;
+    pThis->next_blk_buffer.current_size = 0;
+}
+
+void lmodem_set_data_source_cb(modem_context_t* pThis, int32_t (*read_data)(modem_context_t* pThis, uint8_t* data, uint32_t size))
+{
+    //emission: data are read from the callback instead of the file buffer.
+    //returns the nb of bytes read (less than size is allowed), 0 at the end of the data, negative on error (cancel)
+    pThis->read_data = read_data;
+}
+
+void lmodem_set_block_source_cb(modem_context_t* pThis,
+                                const uint8_t* (*get_block)(modem_context_t* pThis, uint32_t index, uint32_t* pSize))
+{
+    //emission: the blocks are sent as given, the file buffer and the data source are not read
+    pThis->get_block = get_block;
+}
+#endif
+
+const lmodem_stats* lmodem_get_stats(modem_context_t* pThis)
+{
+    return &pThis->stats;
+}
+
+uint64_t lmodem_stats_get_ack_rtt_avg_ns(const lmodem_stats* pStats)
+{
+    uint64_t avg;
+    avg = 0;
+    if (pStats->ack_rtt_count > 0)
     {
-        pThis->blk_buffer.buffer = buffer;
-        pThis->blk_buffer.max_size = size;
-        pThis->blk_buffer.current_size = 0;
-        bOk = true;
+        avg = pStats->ack_rtt_total_ns / pStats->ack_rtt_count;
     }
-
-    return bOk;
+    return avg;
 }
 
 void lmodem_set_file_buffer(modem_context_t* pThis, uint8_t* buffer, uint32_t size)
@@ -69,6 +182,80 @@ void lmodem_set_file_buffer(modem_context_t* pThis, uint8_t* buffer, uint32_t si
     lmodem_buffer_init(&pThis->ramfile, buffer, size);
 }
 
+#if LMODEM_CFG_COMPRESS
+
+#if LMODEM_CFG_TX
+void lmodem_set_compression(modem_context_t* pThis, lmodem_compressor* pCompressor)
+{
+    //the compressor is initialized by each emission which offers it
+    pThis->compressor = pCompressor;
+}
+#endif
+
+#if LMODEM_CFG_RX
+void lmodem_set_decompression(modem_context_t* pThis, bool accept)
+{
+    pThis->decompression = accept;
+}
+#endif
+
+bool lmodem_is_compressed(modem_context_t* pThis)
+{
+    return pThis->compressed;
+}
+
+#endif
+
+#if LMODEM_CFG_DELTA
+
+#if LMODEM_CFG_TX
+void lmodem_set_delta(modem_context_t* pThis, lmodem_delta_encoder* pEncoder, uint32_t* hashes, uint32_t maxHashes)
+{
+    pThis->delta_encoder = pEncoder;
+    if (pEncoder != NULL)
+    {
+        pEncoder->hashes = hashes;
+        pEncoder->max_hashes = maxHashes;
+        pEncoder->nb_hashes = 0;
+    }
+}
+#endif
+
+#if LMODEM_CFG_RX
+void lmodem_set_delta_base(modem_context_t* pThis, bool enable, uint32_t size)
+{
+    pThis->delta_base = enable;
+    pThis->delta_base_size = min(size, pThis->ramfile.max_size);
+}
+#endif
+
+bool lmodem_is_delta(modem_context_t* pThis)
+{
+    return pThis->delta;
+}
+
+#endif
+
+#if LMODEM_CFG_FILE_CRC
+
+#if LMODEM_CFG_RX
+void lmodem_set_present_file(modem_context_t* pThis, bool present, uint32_t size, uint32_t crc)
+{
+    pThis->present = present;
+    pThis->present_size = size;
+    pThis->present_crc = crc;
+}
+#endif
+
+bool lmodem_is_skipped(modem_context_t* pThis)
+{
+    return pThis->skipped;
+}
+
+#endif
+
+#if LMODEM_CFG_YMODEM
+
 void lmodem_set_filename_buffer(modem_context_t* pThis, char* buffer, uint32_t size)
 {
     pThis->file_data.filename = buffer;
@@ -110,6 +297,21 @@ void lmodem_metadata_set_serial(modem_context_t* pThis, uint32_t serial)
     pThis->file_data.valid |= LMODEM_METADATA_SERIAL_VALID;
 }
 
+#if LMODEM_CFG_FILE_CRC
+#if LMODEM_CFG_TX
+void lmodem_set_file_crc(modem_context_t* pThis, bool offer)
+{
+    pThis->file_crc = offer;
+}
+#endif
+
+void lmodem_metadata_set_file_crc(modem_context_t* pThis, uint32_t crc)
+{
+    pThis->file_data.crc32 = crc;
+    pThis->file_data.valid |= LMODEM_METADATA_CRC32_VALID;
+}
+#endif
+
 
 bool lmodem_metadata_get_filename(modem_context_t* pThis, char* filename, uint32_t size)
 {
@@ -192,3 +394,23 @@ bool lmodem_metadata_get_serial(modem_context_t* pThis, uint32_t* serial)
 
     return bOk;
 }
+
+#if LMODEM_CFG_FILE_CRC
+bool lmodem_metadata_get_file_crc(modem_context_t* pThis, uint32_t* crc)
+{
+    bool bOk;
+    bOk = false;
+    if ((pThis->file_data.valid & LMODEM_METADATA_CRC32_VALID) == LMODEM_METADATA_CRC32_VALID)
+    {
+        if (crc != NULL)
+        {
+            *crc = pThis->file_data.crc32;
+            bOk = true;
+        }
+    }
+
+    return bOk;
+}
+#endif
+
+#endif /* LMODEM_CFG_YMODEM */
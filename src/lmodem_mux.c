@@ -0,0 +1,261 @@
+#include "lmodem.h"
+#include "lmodem_mux.h"
+#include <string.h>
+
+bool lmodem_mux_init(lmodem_mux* pThis, uint32_t maxPayload)
+{
+    if ((maxPayload == 0) || (maxPayload > LMODEM_MUX_MAX_PAYLOAD))
+    {
+        return false;
+    }
+
+    memset(pThis, 0, sizeof(lmodem_mux));
+    pThis->max_payload = maxPayload;
+    crc16_init(&pThis->crc16, CRC16_CCITT_POLYNOME);
+    pThis->rx_state = LMODEM_MUX_RX_SOF;
+    return true;
+}
+
+bool lmodem_mux_open_channel(lmodem_mux* pThis, uint8_t channel, uint8_t priority, uint8_t flags, uint8_t* txStorage,
+                             uint32_t txSize, lmodem_ring* pRxRing)
+{
+    lmodem_mux_channel* pChannel;
+
+    if (channel >= LMODEM_MUX_MAX_CHANNELS)
+    {
+        return false;
+    }
+    pChannel = &pThis->channels[channel];
+    if (!lmodem_ring_init(&pChannel->tx_ring, txStorage, txSize))
+    {
+        return false;
+    }
+    pChannel->priority = priority;
+    pChannel->flags = flags;
+    pChannel->rx_ring = pRxRing;
+    memset(&pChannel->stats, 0, sizeof(lmodem_mux_channel_stats));
+    pChannel->open = true;
+    return true;
+}
+
+void lmodem_mux_set_user_data(lmodem_mux* pThis, void* userData)
+{
+    pThis->user_data = userData;
+}
+
+void* lmodem_mux_get_user_data(lmodem_mux* pThis)
+{
+    return pThis->user_data;
+}
+
+void lmodem_mux_set_deliver_cb(lmodem_mux* pThis, void (*deliver)(lmodem_mux* pThis, uint8_t channel, const uint8_t* data, uint32_t size))
+{
+    //called from lmodem_mux_input with the payload of each frame of a channel without rx ring
+    pThis->deliver = deliver;
+}
+
+uint32_t lmodem_mux_send(lmodem_mux* pThis, uint8_t channel, const uint8_t* data, uint32_t size)
+{
+    if ((channel >= LMODEM_MUX_MAX_CHANNELS) || (!pThis->channels[channel].open))
+    {
+        return 0;
+    }
+    return lmodem_ring_push(&pThis->channels[channel].tx_ring, data, size);
+}
+
+// next frame of the most urgent channel with bytes, false when all the channels are empty
+static bool lmodem_mux_build_frame(lmodem_mux* pThis)
+{
+    lmodem_mux_channel* pChannel;
+    uint32_t selected;
+    uint32_t count;
+    uint32_t i;
+    uint16_t crc;
+
+    selected = LMODEM_MUX_MAX_CHANNELS;
+    for (i = 0; i < LMODEM_MUX_MAX_CHANNELS; i++)
+    {
+        pChannel = &pThis->channels[i];
+        if ((pChannel->open) && (lmodem_ring_get_count(&pChannel->tx_ring) > 0)
+                && ((selected == LMODEM_MUX_MAX_CHANNELS) || (pChannel->priority < pThis->channels[selected].priority)))
+        {
+            selected = i;
+        }
+    }
+    if (selected == LMODEM_MUX_MAX_CHANNELS)
+    {
+        return false;
+    }
+
+    pChannel = &pThis->channels[selected];
+    count = lmodem_ring_pop(&pChannel->tx_ring, &pThis->tx_frame[LMODEM_MUX_HEADER_SIZE], pThis->max_payload);
+    pThis->tx_frame[0] = LMODEM_MUX_SOF;
+    pThis->tx_frame[1] = (uint8_t) selected;
+    pThis->tx_frame[2] = (uint8_t) count;
+    pThis->tx_frame[3] = (uint8_t) (selected ^ count ^ 0xFF);
+    crc = crc16_doCalcul(&pThis->crc16, &pThis->tx_frame[1], 2, 0, 0);
+    crc = crc16_doCalcul(&pThis->crc16, &pThis->tx_frame[LMODEM_MUX_HEADER_SIZE], count, crc, 0);
+    pThis->tx_frame[LMODEM_MUX_HEADER_SIZE + count] = (uint8_t) (crc >> 8);
+    pThis->tx_frame[LMODEM_MUX_HEADER_SIZE + count + 1] = (uint8_t) crc;
+    pThis->tx_size = LMODEM_MUX_HEADER_SIZE + count + LMODEM_MUX_TRAILER_SIZE;
+    pThis->tx_offset = 0;
+    pChannel->stats.tx_frames++;
+    pChannel->stats.tx_bytes += count;
+    return true;
+}
+
+uint32_t lmodem_mux_pull(lmodem_mux* pThis, uint8_t* data, uint32_t size)
+{
+    uint32_t nbPulled;
+    uint32_t n;
+
+    nbPulled = 0;
+    while (nbPulled < size)
+    {
+        //the channel is only chosen between two frames
+        if ((pThis->tx_offset == pThis->tx_size) && (!lmodem_mux_build_frame(pThis)))
+        {
+            break;
+        }
+        n = pThis->tx_size - pThis->tx_offset;
+        n = (n < (size - nbPulled)) ? n : (size - nbPulled);
+        memcpy(&data[nbPulled], &pThis->tx_frame[pThis->tx_offset], n);
+        pThis->tx_offset += n;
+        nbPulled += n;
+    }
+    return nbPulled;
+}
+
+static void lmodem_mux_deliver_frame(lmodem_mux* pThis)
+{
+    lmodem_mux_channel* pChannel;
+    uint32_t payloadSize;
+    uint32_t n;
+    uint16_t crc;
+    uint8_t channel;
+
+    channel = pThis->rx_frame[1];
+    payloadSize = pThis->rx_frame[2];
+    pChannel = &pThis->channels[channel];
+    crc = crc16_doCalcul(&pThis->crc16, &pThis->rx_frame[1], 2, 0, 0);
+    crc = crc16_doCalcul(&pThis->crc16, &pThis->rx_frame[LMODEM_MUX_HEADER_SIZE], payloadSize, crc, 0);
+    if ((pThis->rx_frame[LMODEM_MUX_HEADER_SIZE + payloadSize] != (uint8_t) (crc >> 8))
+            || (pThis->rx_frame[LMODEM_MUX_HEADER_SIZE + payloadSize + 1] != (uint8_t) crc))
+    {
+        pChannel->stats.rx_corrupted++;
+        if ((pChannel->flags & LMODEM_MUX_KEEP_CORRUPTED) == 0)
+        {
+            return;
+        }
+    }
+
+    pChannel->stats.rx_frames++;
+    pChannel->stats.rx_bytes += payloadSize;
+    if (pChannel->rx_ring != NULL)
+    {
+        n = lmodem_ring_push(pChannel->rx_ring, &pThis->rx_frame[LMODEM_MUX_HEADER_SIZE], payloadSize);
+        pChannel->stats.rx_overflows += payloadSize - n;
+    }
+    else if (pThis->deliver != NULL)
+    {
+        pThis->deliver(pThis, channel, &pThis->rx_frame[LMODEM_MUX_HEADER_SIZE], payloadSize);
+    }
+}
+
+void lmodem_mux_input(lmodem_mux* pThis, const uint8_t* data, uint32_t size)
+{
+    uint32_t i;
+    uint8_t c;
+
+    for (i = 0; i < size; i++)
+    {
+        c = data[i];
+        switch (pThis->rx_state)
+        {
+            case LMODEM_MUX_RX_SOF:
+                if (c == LMODEM_MUX_SOF)
+                {
+                    pThis->rx_frame[0] = c;
+                    pThis->rx_size = 1;
+                    pThis->rx_state = LMODEM_MUX_RX_CHANNEL;
+                }
+                else
+                {
+                    pThis->rx_skipped++;
+                }
+                break;
+
+            case LMODEM_MUX_RX_CHANNEL:
+                pThis->rx_frame[pThis->rx_size++] = c;
+                //a channel not opened here is a corrupted header, look for the next SOF
+                pThis->rx_state = ((c < LMODEM_MUX_MAX_CHANNELS) && (pThis->channels[c].open)) ? LMODEM_MUX_RX_LENGTH : LMODEM_MUX_RX_SOF;
+                break;
+
+            case LMODEM_MUX_RX_LENGTH:
+                pThis->rx_frame[pThis->rx_size++] = c;
+                pThis->rx_expected = LMODEM_MUX_HEADER_SIZE + c + LMODEM_MUX_TRAILER_SIZE;
+                pThis->rx_state = LMODEM_MUX_RX_HEADER_CHECK;
+                break;
+
+            case LMODEM_MUX_RX_HEADER_CHECK:
+                pThis->rx_frame[pThis->rx_size++] = c;
+                pThis->rx_state = LMODEM_MUX_RX_PAYLOAD;
+                if ((c != (uint8_t) (pThis->rx_frame[1] ^ pThis->rx_frame[2] ^ 0xFF)) || (pThis->rx_frame[2] == 0))
+                {
+                    pThis->rx_header_errors++;
+                    pThis->rx_state = LMODEM_MUX_RX_SOF;
+                }
+                break;
+
+            case LMODEM_MUX_RX_PAYLOAD:
+                pThis->rx_frame[pThis->rx_size++] = c;
+                if (pThis->rx_size == pThis->rx_expected - LMODEM_MUX_TRAILER_SIZE)
+                {
+                    pThis->rx_state = LMODEM_MUX_RX_CRC;
+                }
+                break;
+
+            case LMODEM_MUX_RX_CRC:
+            default:
+                pThis->rx_frame[pThis->rx_size++] = c;
+                if (pThis->rx_size == pThis->rx_expected)
+                {
+                    lmodem_mux_deliver_frame(pThis);
+                    pThis->rx_state = LMODEM_MUX_RX_SOF;
+                }
+                break;
+        }
+    }
+}
+
+const lmodem_mux_channel_stats* lmodem_mux_get_stats(lmodem_mux* pThis, uint8_t channel)
+{
+    return (channel < LMODEM_MUX_MAX_CHANNELS) ? &pThis->channels[channel].stats : NULL;
+}
+
+bool lmodem_set_mux(modem_context_t* pThis, lmodem_mux* pMux, uint8_t channel, uint64_t timeoutNs, void (*idle)(modem_context_t* pThis))
+{
+    if ((channel >= LMODEM_MUX_MAX_CHANNELS) || (!pMux->channels[channel].open) || (pMux->channels[channel].rx_ring == NULL))
+    {
+        return false;
+    }
+
+    pThis->mux = pMux;
+    pThis->mux_channel = channel;
+    lmodem_set_rx_ring(pThis, pMux->channels[channel].rx_ring, timeoutNs, idle);
+    pThis->putchar = lmodem_mux_putchar;
+    return true;
+}
+
+void lmodem_mux_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    uint32_t nbQueued;
+
+    nbQueued = lmodem_mux_send(pThis->mux, pThis->mux_channel, data, size);
+    while ((nbQueued < size) && (pThis->rx_idle != NULL))
+    {
+        //the line side empties the channel meanwhile
+        pThis->rx_idle(pThis);
+        nbQueued += lmodem_mux_send(pThis->mux, pThis->mux_channel, &data[nbQueued], size - nbQueued);
+    }
+}
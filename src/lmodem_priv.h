@@ -3,6 +3,7 @@
 #define LXMODEM_PRIV_H
 
 #include "lmodem.h"
+#include <string.h>
 
 #define SOH       (001)
 #define STX       (002)
@@ -27,10 +28,14 @@
 #define LMODEM_METADATA_MODIFDATE_VALID   (0x04)
 #define LMODEM_METADATA_PERMISSION_VALID  (0x08)
 #define LMODEM_METADATA_SERIAL_VALID      (0x10)
+#define LMODEM_METADATA_CRC32_VALID       (0x20)
+
+// answer of a receiver which already has the file described in block 0, instead of the 'C'. at least 3 bits away
+// from the other answers (C, D, Z, ACK, NAK, CAN): a corrupted 'C' must not skip the file
+#define LMODEM_FILE_CRC_SKIP           ('v')
 
 #ifdef LMODEM_TRACE
 #include <stdio.h>
-#include <time.h>
 #define DBG(...) fprintf(stderr, __VA_ARGS__)
 #else
 #define DBG(...)
@@ -38,47 +43,306 @@
 
 #define min(a,b)      (((a)<(b))?(a):(b))
 
-static inline void lmodem_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+// 32 bits fields of the protocol extensions, little endian
+static inline uint32_t lmodem_get_le32(const uint8_t* p)
 {
-#ifdef LMODEM_TRACE
-    int32_t i;
-    time_t t = time(NULL);
-    DBG("(%ld) send %d byte(s): ", t, size);
-    for (i = 0; i < (int32_t) (size - 1); i++)
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void lmodem_put_le32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+    p[2] = (uint8_t) (value >> 16);
+    p[3] = (uint8_t) (value >> 24);
+}
+
+static inline uint64_t lmodem_now(modem_context_t* pThis)
+{
+    return (pThis->clock_ns != NULL) ? pThis->clock_ns(pThis) : 0;
+}
+
+// one store of 16 bytes in the ring, nothing when no trace buffer is set
+static inline void lmodem_trace(modem_context_t* pThis, lmodem_trace_type type, uint8_t data, uint32_t value)
+{
+    lmodem_trace_event* pEvent;
+    if (pThis->trace.events != NULL)
     {
-        DBG("0x%.2x-", data[i] & 0xFF);
+        pEvent = &pThis->trace.events[pThis->trace.head & pThis->trace.mask];
+        pEvent->time_ns = lmodem_now(pThis);
+        pEvent->type = type;
+        pEvent->data = data;
+        pEvent->reserved = 0;
+        pEvent->value = value;
+        pThis->trace.head++;
     }
-    DBG("0x%.2x\n", data[i] & 0xFF);
-#endif /* MODEM_TRACE */
-    pThis->putchar(pThis, data, size);
 }
 
-static inline bool lmodem_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+static inline void lmodem_stats_start(modem_context_t* pThis)
 {
-    bool b;
-    b = pThis->getchar(pThis, data, size);
-#ifdef LMODEM_TRACE
-    if (b)
+    memset(&pThis->stats, 0, sizeof(lmodem_stats));
+    pThis->stats.start_time_ns = lmodem_now(pThis);
+    lmodem_trace(pThis, LMODEM_TRACE_STATE, LMODEM_STATE_HANDSHAKE, 0);
+}
+
+static inline void lmodem_stats_stop(modem_context_t* pThis)
+{
+    if (pThis->clock_ns != NULL)
     {
-        int32_t i;
-        time_t t = time(NULL);
-        DBG("(%ld) get %d byte(s): ", t, size);
-        for (i = 0; i < (int32_t) (size - 1); i++)
+        pThis->stats.transfer_time_ns = lmodem_now(pThis) - pThis->stats.start_time_ns;
+    }
+    lmodem_trace(pThis, LMODEM_TRACE_STATE, LMODEM_STATE_DONE, 0);
+}
+
+static inline void lmodem_stats_handshake_done(modem_context_t* pThis)
+{
+    if (!pThis->stats.handshake_done)
+    {
+        pThis->stats.handshake_done = true;
+        lmodem_trace(pThis, LMODEM_TRACE_STATE, LMODEM_STATE_DATA, 0);
+        if (pThis->clock_ns != NULL)
+        {
+            pThis->stats.handshake_time_ns = lmodem_now(pThis) - pThis->stats.start_time_ns;
+        }
+    }
+}
+
+static inline void lmodem_stats_ack_rtt(modem_context_t* pThis, uint64_t sendTime)
+{
+    uint64_t rtt;
+    if (pThis->clock_ns != NULL)
+    {
+        rtt = lmodem_now(pThis) - sendTime;
+        if ((pThis->stats.ack_rtt_count == 0) || (rtt < pThis->stats.ack_rtt_min_ns))
+        {
+            pThis->stats.ack_rtt_min_ns = rtt;
+        }
+        if (rtt > pThis->stats.ack_rtt_max_ns)
+        {
+            pThis->stats.ack_rtt_max_ns = rtt;
+        }
+        pThis->stats.ack_rtt_total_ns += rtt;
+        pThis->stats.ack_rtt_count++;
+    }
+}
+
+// weight of the last sample in the smoothed throughput: 1/(1 << shift)
+#define LMODEM_PROGRESS_EWMA_SHIFT     (2)
+
+static inline void lmodem_progress_start(modem_context_t* pThis, uint64_t bytesTotal)
+{
+    memset(&pThis->progress_state, 0, sizeof(lmodem_progress));
+    pThis->progress_state.bytes_total = bytesTotal;
+    pThis->progress_last_ns = pThis->stats.start_time_ns;
+}
+
+// only called when a progress callback is set
+static inline void lmodem_progress_update(modem_context_t* pThis, uint32_t nbBytes)
+{
+    lmodem_progress* pProgress;
+    uint64_t now;
+    uint64_t delta;
+
+    pProgress = &pThis->progress_state;
+    pProgress->bytes_done += nbBytes;
+    pProgress->retries = pThis->stats.naks_sent + pThis->stats.retransmissions;
+
+    if (pThis->clock_ns != NULL)
+    {
+        now = lmodem_now(pThis);
+        delta = now - pThis->progress_last_ns;
+        pThis->progress_last_ns = now;
+        pProgress->elapsed_ns = now - pThis->stats.start_time_ns;
+        if (delta > 0)
+        {
+            pProgress->instant_bps = ((uint64_t) nbBytes * 1000000000ULL) / delta;
+            if (pProgress->smoothed_bps == 0)
+            {
+                pProgress->smoothed_bps = pProgress->instant_bps;
+            }
+            else
+            {
+                pProgress->smoothed_bps = pProgress->smoothed_bps - (pProgress->smoothed_bps >> LMODEM_PROGRESS_EWMA_SHIFT)
+                                          + (pProgress->instant_bps >> LMODEM_PROGRESS_EWMA_SHIFT);
+            }
+        }
+
+        pProgress->eta_ns = 0;
+        if ((pProgress->bytes_total > pProgress->bytes_done) && (pProgress->smoothed_bps > 0))
         {
-            DBG("0x%.2x-", data[i] & 0xFF);
+            pProgress->eta_ns = ((pProgress->bytes_total - pProgress->bytes_done) * 1000000000ULL) / pProgress->smoothed_bps;
         }
-        DBG("0x%.2x\n", data[i] & 0xFF);
+    }
+
+    pThis->progress(pThis, pProgress);
+}
+
+static inline void lmodem_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    lmodem_trace(pThis, LMODEM_TRACE_TX, data[0], size);
+    pThis->stats.bytes_on_wire_tx += size;
+    pThis->putchar(pThis, data, size);
+}
+
+static inline void lmodem_getchar_done(modem_context_t* pThis, uint8_t* data, uint32_t size, bool b)
+{
+    if (b)
+    {
+        pThis->stats.bytes_on_wire_rx += size;
+        lmodem_trace(pThis, LMODEM_TRACE_RX, data[0], size);
     }
     else
     {
-        time_t t = time(NULL);
-        DBG("(%ld) get 0 byte\n", t);
+        pThis->stats.timeouts++;
+        lmodem_trace(pThis, LMODEM_TRACE_TIMEOUT, 0, size);
     }
-#endif /* MODEM_TRACE */
+}
+
+static inline bool lmodem_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    bool b;
+    b = pThis->getchar(pThis, data, size);
+    lmodem_getchar_done(pThis, data, size, b);
     return b;
 }
 
+// set by lmodem_rx_dma_complete in rx_dma_result, with the nb of bytes received
+#define LMODEM_DMA_DONE                (0x80000000u)
+
+// an index (or the DMA result) written by one side is read with acquire by the other one, so the bytes written
+// before it are seen
+#if LMODEM_RING_USE_C11_ATOMICS
+#define lmodem_ring_load_relaxed(p)      atomic_load_explicit(p, memory_order_relaxed)
+#define lmodem_ring_load_acquire(p)      atomic_load_explicit(p, memory_order_acquire)
+#define lmodem_ring_store_release(p, v)  atomic_store_explicit(p, v, memory_order_release)
+#elif defined(__GNUC__)
+#define lmodem_ring_load_relaxed(p)      __atomic_load_n(p, __ATOMIC_RELAXED)
+#define lmodem_ring_load_acquire(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define lmodem_ring_store_release(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+#define lmodem_ring_load_relaxed(p)      (*(p))
+#define lmodem_ring_load_acquire(p)      (*(p))
+#define lmodem_ring_store_release(p, v)  (*(p) = (v))
+#endif
+
+// protothreads (see lmodem_step.h). the variables used across a wait are in the frame pF, a wait returns
+// LMODEM_PT_WAITING and the function resumes on the case of the wait line: no wait inside a nested switch.
+#if defined(__GNUC__) && (__GNUC__ >= 7)
+#define LMODEM_FALLTHROUGH             __attribute__ ((fallthrough))
+#else
+#define LMODEM_FALLTHROUGH
+#endif
+
+#define LMODEM_PT_BEGIN(pF)            switch ((pF)->lc) { case 0:
+#define LMODEM_PT_END(pF)              } (pF)->lc = 0; return LMODEM_PT_ENDED
+
+// wait for size bytes, bReceived is false on timeout
+#define LMODEM_PT_GETCHAR(pThis, pF, data, size, bReceived)                 \
+    do                                                                      \
+    {                                                                       \
+        lmodem_io_request_start((pThis), (data), (size));                   \
+        (pF)->lc = __LINE__;                                                \
+        return LMODEM_PT_WAITING;                                           \
+        case __LINE__:                                                      \
+        (bReceived) = (pThis)->step.io.result;                              \
+    }                                                                       \
+    while (0)
+
+// wait for 1 to size bytes (a DMA reception stopped by an idle line), nbReceived is 0 on timeout
+#define LMODEM_PT_RECEIVE_UP_TO(pThis, pF, data, size, nbReceived)          \
+    do                                                                      \
+    {                                                                       \
+        lmodem_io_request_start((pThis), (data), (size));                   \
+        (pThis)->step.io.up_to = true;                                      \
+        (pF)->lc = __LINE__;                                                \
+        return LMODEM_PT_WAITING;                                           \
+        case __LINE__:                                                      \
+        (nbReceived) = ((pThis)->step.io.result) ? (pThis)->step.io.done : 0; \
+    }                                                                       \
+    while (0)
+
+// run a child protothread until its end, its arguments are evaluated again on each resume
+#define LMODEM_PT_CALL(pF, call)                                            \
+    do                                                                      \
+    {                                                                       \
+        (pF)->lc = __LINE__;                                                \
+        LMODEM_FALLTHROUGH;                                                 \
+        case __LINE__:                                                      \
+        if ((call) == LMODEM_PT_WAITING)                                    \
+        {                                                                   \
+            return LMODEM_PT_WAITING;                                       \
+        }                                                                   \
+    }                                                                       \
+    while (0)
+
+static inline void lmodem_io_request_start(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    pThis->step.io.data = data;
+    pThis->step.io.size = size;
+    pThis->step.io.done = 0;
+    pThis->step.io.pending = true;
+    pThis->step.io.up_to = false;
+}
+
+#if LMODEM_CFG_CRC
+// set by lmodem_crc_complete in crc_result, with the crc
+#define LMODEM_CRC_DONE                (0x80000000u)
+// longest wait for lmodem_crc_complete when no rx timeout is set
+#define LMODEM_CRC_TIMEOUT_NS          (1000000000ULL)
+
+static inline uint64_t lmodem_crc_timeout(modem_context_t* pThis)
+{
+    return (pThis->rx_timeout_ns > 0) ? pThis->rx_timeout_ns : LMODEM_CRC_TIMEOUT_NS;
+}
+
+static inline uint16_t lmodem_crc_init(modem_context_t* pThis)
+{
+    return pThis->crc_provider->init(pThis);
+}
+
+static inline uint16_t lmodem_crc_final(modem_context_t* pThis, uint16_t crc)
+{
+    return pThis->crc_provider->final(pThis, crc);
+}
+
+// false when the provider completes the update later (lmodem_crc_complete)
+static inline bool lmodem_crc_update_start(modem_context_t* pThis, uint8_t* data, uint32_t size, uint16_t* pCrc)
+{
+    bool bDone;
+
+    lmodem_ring_store_release(&pThis->crc_result, 0);
+    bDone = pThis->crc_provider->update(pThis, data, size, pCrc);
+    pThis->step.crc_pending = !bDone;
+    return bDone;
+}
+
+// true when the asynchronous update is complete, its result in *pCrc
+extern bool lmodem_crc_poll(modem_context_t* pThis, uint16_t* pCrc);
+// polls like lmodem_ring_getchar polls the ring (rx_idle between the polls) up to lmodem_crc_timeout, once without clock
+extern bool lmodem_crc_wait(modem_context_t* pThis, uint16_t* pCrc);
+// crc of a whole block through the provider, outside of the protothreads (the wait is lmodem_crc_wait)
+extern bool lmodem_crc_block(modem_context_t* pThis, uint8_t* data, uint32_t size, uint16_t* pCrc);
+
+// add size bytes to crc through the provider, waits when it is asynchronous
+#define LMODEM_PT_CRC(pThis, pF, data, size, crc)                           \
+    do                                                                      \
+    {                                                                       \
+        if (!lmodem_crc_update_start((pThis), (data), (size), &(crc)))      \
+        {                                                                   \
+            (pF)->lc = __LINE__;                                            \
+            return LMODEM_PT_WAITING;                                       \
+            case __LINE__:                                                  \
+            (crc) = (pThis)->step.crc_value;                                \
+        }                                                                   \
+    }                                                                       \
+    while (0)
+#endif
+
+extern void lmodem_step_begin(modem_context_t* pThis, lmodem_pt_status (*task)(modem_context_t* pThis));
+extern int32_t lmodem_step_run(modem_context_t* pThis);
+
 extern void lxmodem_build_and_send_cancel(modem_context_t* pThis);
 extern uint8_t lxmodem_calcul_chksum(uint8_t* buffer, uint32_t size);
+extern void lxmode_get_block_format(modem_context_t* pThis, lmodem_protocol protocol, uint32_t* pDefaultBlksize, bool* pWithCrc);
 
 #endif /* LXMODEM_PRIV_H */
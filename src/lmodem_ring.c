@@ -0,0 +1,183 @@
+#include "lmodem.h"
+#include "lmodem_ring.h"
+#include "lmodem_priv.h"
+#include <string.h>
+
+bool lmodem_ring_init(lmodem_ring* pThis, uint8_t* buffer, uint32_t size)
+{
+    if ((buffer == NULL) || (size == 0) || ((size & (size - 1)) != 0))
+    {
+        return false;
+    }
+
+    pThis->buffer = buffer;
+    pThis->mask = size - 1;
+#if LMODEM_RING_USE_C11_ATOMICS
+    atomic_init(&pThis->head, 0);
+    atomic_init(&pThis->tail, 0);
+#else
+    pThis->head = 0;
+    pThis->tail = 0;
+#endif
+    return true;
+}
+
+uint32_t lmodem_ring_get_free(lmodem_ring* pThis)
+{
+    return pThis->mask + 1 - (lmodem_ring_load_relaxed(&pThis->head) - lmodem_ring_load_acquire(&pThis->tail));
+}
+
+uint32_t lmodem_ring_get_count(lmodem_ring* pThis)
+{
+    return lmodem_ring_load_acquire(&pThis->head) - lmodem_ring_load_relaxed(&pThis->tail);
+}
+
+uint32_t lmodem_ring_get_write_span(lmodem_ring* pThis, uint8_t** ppSpan)
+{
+    uint32_t head;
+    uint32_t nbFree;
+    uint32_t untilEnd;
+
+    head = lmodem_ring_load_relaxed(&pThis->head);
+    nbFree = pThis->mask + 1 - (head - lmodem_ring_load_acquire(&pThis->tail));
+    untilEnd = pThis->mask + 1 - (head & pThis->mask);
+    *ppSpan = &pThis->buffer[head & pThis->mask];
+    return (nbFree < untilEnd) ? nbFree : untilEnd;
+}
+
+void lmodem_ring_commit(lmodem_ring* pThis, uint32_t size)
+{
+    lmodem_ring_store_release(&pThis->head, lmodem_ring_load_relaxed(&pThis->head) + size);
+}
+
+uint32_t lmodem_ring_get_read_span(lmodem_ring* pThis, uint8_t** ppSpan)
+{
+    uint32_t tail;
+    uint32_t count;
+    uint32_t untilEnd;
+
+    tail = lmodem_ring_load_relaxed(&pThis->tail);
+    count = lmodem_ring_load_acquire(&pThis->head) - tail;
+    untilEnd = pThis->mask + 1 - (tail & pThis->mask);
+    *ppSpan = &pThis->buffer[tail & pThis->mask];
+    return (count < untilEnd) ? count : untilEnd;
+}
+
+void lmodem_ring_release(lmodem_ring* pThis, uint32_t size)
+{
+    lmodem_ring_store_release(&pThis->tail, lmodem_ring_load_relaxed(&pThis->tail) + size);
+}
+
+uint32_t lmodem_ring_push(lmodem_ring* pThis, const uint8_t* data, uint32_t size)
+{
+    uint8_t* pSpan;
+    uint32_t nbPushed;
+    uint32_t n;
+
+    //at most two spans when the ring wraps
+    nbPushed = 0;
+    while (nbPushed < size)
+    {
+        n = lmodem_ring_get_write_span(pThis, &pSpan);
+        if (n == 0)
+        {
+            break;
+        }
+        n = (n < (size - nbPushed)) ? n : (size - nbPushed);
+        memcpy(pSpan, &data[nbPushed], n);
+        lmodem_ring_commit(pThis, n);
+        nbPushed += n;
+    }
+    return nbPushed;
+}
+
+bool lmodem_ring_push_byte(lmodem_ring* pThis, uint8_t c)
+{
+    uint32_t head;
+
+    head = lmodem_ring_load_relaxed(&pThis->head);
+    if ((head - lmodem_ring_load_acquire(&pThis->tail)) > pThis->mask)
+    {
+        return false;
+    }
+    pThis->buffer[head & pThis->mask] = c;
+    lmodem_ring_store_release(&pThis->head, head + 1);
+    return true;
+}
+
+uint32_t lmodem_ring_pop(lmodem_ring* pThis, uint8_t* data, uint32_t size)
+{
+    uint8_t* pSpan;
+    uint32_t nbPopped;
+    uint32_t n;
+
+    nbPopped = 0;
+    while (nbPopped < size)
+    {
+        n = lmodem_ring_get_read_span(pThis, &pSpan);
+        if (n == 0)
+        {
+            break;
+        }
+        n = (n < (size - nbPopped)) ? n : (size - nbPopped);
+        memcpy(&data[nbPopped], pSpan, n);
+        lmodem_ring_release(pThis, n);
+        nbPopped += n;
+    }
+    return nbPopped;
+}
+
+void lmodem_set_rx_ring(modem_context_t* pThis, lmodem_ring* pRing, uint64_t timeoutNs, void (*idle)(modem_context_t* pThis))
+{
+    //the received bytes are pushed in pRing (e.g. by the uart interrupt) and read by lmodem_ring_getchar.
+    //the inter-byte timeout needs the clock callback, idle is called while the ring is empty (e.g. wait for interrupt)
+    pThis->rx_ring = pRing;
+    pThis->rx_timeout_ns = timeoutNs;
+    pThis->rx_idle = idle;
+    pThis->getchar = lmodem_ring_getchar;
+}
+
+bool lmodem_ring_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    uint64_t deadline;
+    uint64_t now;
+    uint32_t nbRead;
+    uint32_t n;
+    bool bDeadlineSet;
+
+    nbRead = 0;
+    deadline = 0;
+    bDeadlineSet = false;
+    while (nbRead < size)
+    {
+        n = lmodem_ring_pop(pThis->rx_ring, &data[nbRead], size - nbRead);
+        if (n > 0)
+        {
+            nbRead += n;
+            bDeadlineSet = false;
+            continue;
+        }
+
+        //without clock the ring is only polled once
+        if (pThis->clock_ns == NULL)
+        {
+            return false;
+        }
+        now = pThis->clock_ns(pThis);
+        if (!bDeadlineSet)
+        {
+            deadline = now + pThis->rx_timeout_ns;
+            bDeadlineSet = true;
+        }
+        else if (now >= deadline)
+        {
+            return false;
+        }
+
+        if (pThis->rx_idle != NULL)
+        {
+            pThis->rx_idle(pThis);
+        }
+    }
+    return true;
+}
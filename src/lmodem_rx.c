@@ -5,151 +5,369 @@
 #include <assert.h>
 #include <stdlib.h>
 
-typedef enum
+//helpers shared with the emission
+
+#if LMODEM_CFG_XMODEM_CHKSUM
+uint8_t lxmodem_calcul_chksum(uint8_t* buffer, uint32_t size)
+{
+    uint8_t t;
+    t = 0;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        t += buffer[i];
+    }
+
+    return t;
+}
+
+#endif
+
+void lxmodem_build_and_send_cancel(modem_context_t* pThis)
 {
-    LXMODEM_RECV_OK,
-    LXMODEM_RECV_PREVIOUS_BLOCK,
-    LXMODEM_RECV_ERROR
-} lxmodem_reception_status;
+    uint8_t buffer[2];
+    buffer[0] = CAN;
+    buffer[1] = CAN;
+    lmodem_trace(pThis, LMODEM_TRACE_STATE, LMODEM_STATE_CANCEL, 0);
+    lmodem_putchar(pThis, buffer, 2);
+}
+
+#if LMODEM_CFG_RX
+
+// size of the chunks used to stream a payload to the ramfile in low memory mode
+#define LXMODEM_STREAM_CHUNK_SIZE      LXMODEM_BLOCK_SIZE_128
 
-static int32_t lxmodem_receive(modem_context_t* pThis);
-static int32_t lymodem_receive(modem_context_t* pThis);
+static lmodem_pt_status lmodem_receive_task(modem_context_t* pThis);
+static lmodem_pt_status lxmodem_receive(modem_context_t* pThis, int32_t* pReceivedBytes);
+static lmodem_pt_status lxmodem_purge_line(modem_context_t* pThis);
 static void lxmodem_build_and_send_preambule(modem_context_t* pThis);
-static lxmodem_reception_status lxmodem_receive_block(modem_context_t* pThis, uint8_t expectedBlkNumber, uint32_t expectedBlksize);
-static lxmodem_reception_status lxmodem_check_block_no_and_crc(modem_context_t* pThis, uint8_t expectedBlkNumber,
+static lmodem_pt_status lxmodem_receive_block(modem_context_t* pThis, uint8_t expectedBlkNumber, uint32_t requestedBlksize,
+        uint8_t** ppPayload, lxmodem_reception_status* pStatus);
+#if LMODEM_CFG_1K_BLOCKS
+static lmodem_pt_status lxmodem_receive_streamed_payload(modem_context_t* pThis, uint8_t* pPayload, uint32_t requestedBlksize,
+        uint16_t* pCrc, bool* pReceived);
+#endif
+#if LMODEM_CFG_DMA
+static lmodem_pt_status lxmodem_receive_frame(modem_context_t* pThis, uint8_t expectedBlkNumber, uint8_t* pHeader,
+        uint32_t* pNbHeaders, uint8_t** ppPayload, lxmodem_reception_status* pStatus);
+#endif
+static uint32_t lxmodem_get_trailer_size(modem_context_t* pThis, uint32_t requestedBlksize);
+static lmodem_pt_status lxmodem_check_block_no_and_crc(modem_context_t* pThis, uint8_t* pBlkNo, uint8_t expectedBlkNumber,
+        uint8_t* pPayload, uint8_t* pTrailer, uint32_t requestedBlksize, lxmodem_reception_status* pStatus);
+static lxmodem_reception_status lxmodem_check_block_no(modem_context_t* pThis, uint8_t* pBlkNo, uint8_t expectedBlkNumber);
+static lxmodem_reception_status lxmodem_check_chksum(modem_context_t* pThis, uint8_t* pPayload, uint8_t* pTrailer,
         uint32_t requestedBlksize);
-static lxmodem_reception_status lxmodem_check_crc(modem_context_t* pThis, uint32_t requestedBlksize);
+#if LMODEM_CFG_CRC
+static lxmodem_reception_status lxmodem_check_crc_value(modem_context_t* pThis, uint16_t crc, uint8_t* pTrailer);
+#endif
 static void lxmodem_build_and_send_reply(modem_context_t* pThis, lxmodem_reception_status rcvStatus);
-static bool lymodem_get_meta_data(modem_context_t* pThis);
+#if LMODEM_CFG_YMODEM
+static lmodem_pt_status lymodem_receive(modem_context_t* pThis, int32_t* pReceivedBytes);
+static bool lymodem_get_meta_data(modem_context_t* pThis, uint8_t* pPayload, uint32_t blksize);
 static uint32_t lymodem_getValue(bool* isValid, char* pString, int32_t mode);
-static lxmodem_reception_status lymodem_receive_block0(modem_context_t* pThis, uint32_t blksize);
-static void lymodem_block_next_file(modem_context_t* pThis);
-static bool lymodem_decode_block0(modem_context_t* pThis);
+static void lymodem_reply_block0(modem_context_t* pThis, lxmodem_reception_status rxStatus);
+static lmodem_pt_status lymodem_block_next_file(modem_context_t* pThis);
+static bool lymodem_decode_block0(modem_context_t* pThis, uint8_t* pPayload, uint32_t blksize);
+static char* lymodem_get_extension(uint8_t* pPayload, uint32_t blksize);
+static void lymodem_decode_extension(modem_context_t* pThis, char* pString, char* pEndString);
 char* lymodem_get_next_meta_data_string(char** pString, char* pEndString);
+#endif
+#if LMODEM_CFG_DELTA
+static lmodem_pt_status lymodem_send_delta_hashes(modem_context_t* pThis, bool* pAcked);
+static uint32_t lymodem_build_delta_hashes(modem_context_t* pThis, uint32_t* pOffset);
+#endif
+#if LMODEM_CFG_COMPRESS || LMODEM_CFG_DELTA
+static bool lxmodem_is_payload_encoded(modem_context_t* pThis);
+#endif
+#if LMODEM_CFG_FILE_CRC || LMODEM_CFG_DELTA
+static bool lxmodem_is_ramfile_kept(modem_context_t* pThis);
+#endif
+#if LMODEM_CFG_FILE_CRC
+static void lymodem_update_file_crc(modem_context_t* pThis, int32_t receivedBytes);
+static bool lymodem_is_file_crc_ok(modem_context_t* pThis);
+static void lymodem_send_skip(modem_context_t* pThis);
+#endif
 
 int32_t lmodem_receive(modem_context_t* pThis, lmodem_protocol protocol)
 {
-    int32_t receivedBytes;
-    receivedBytes = -1;
+    lmodem_start_receive(pThis, protocol);
+    return lmodem_step_run(pThis);
+}
 
+bool lmodem_start_receive(modem_context_t* pThis, lmodem_protocol protocol)
+{
     pThis->protocol = protocol;
-    switch (protocol)
-    {
-        case XMODEM:
-            receivedBytes = lxmodem_receive(pThis);
-            break;
+#if LMODEM_CFG_COMPRESS
+    pThis->compressed = false;
+#endif
+#if LMODEM_CFG_DELTA
+    pThis->delta = false;
+#endif
+#if LMODEM_CFG_FILE_CRC
+    pThis->skipped = false;
+    pThis->file_crc_check = false;
+#endif
+    lmodem_stats_start(pThis);
+    lmodem_progress_start(pThis, 0);
+    lmodem_step_begin(pThis, lmodem_receive_task);
+    return true;
+}
 
-        case YMODEM:
-            receivedBytes = lymodem_receive(pThis);
-            break;
+static lmodem_pt_status lmodem_receive_task(modem_context_t* pThis)
+{
+    lmodem_step_state* pF;
+    pF = &pThis->step;
 
-        default:
-            break;
+    LMODEM_PT_BEGIN(pF);
+    if (pThis->protocol == XMODEM)
+    {
+        LMODEM_PT_CALL(pF, lxmodem_receive(pThis, &pF->result));
     }
-
-    return receivedBytes;
+#if LMODEM_CFG_YMODEM
+    else if (pThis->protocol == YMODEM)
+    {
+        LMODEM_PT_CALL(pF, lymodem_receive(pThis, &pF->result));
+    }
+#endif
+    LMODEM_PT_END(pF);
 }
 
 
-static int32_t lxmodem_receive(modem_context_t* pThis)
+static lmodem_pt_status lxmodem_receive(modem_context_t* pThis, int32_t* pReceivedBytes)
 {
-    uint32_t receivedBytes;
-    bool bFinished;
-    bool bReceived;
-    lxmodem_reception_status rcvStatus;
-    uint8_t header;
-    uint8_t expectedBlkNumber;
-    uint32_t blksize;
-    uint32_t canCharReceived;
-    uint32_t nbRetry;
+    lmodem_frame_xmodem_rx* pF;
+    pF = &pThis->step.frames.rx.xmodem;
 
-    nbRetry = 0;
-    canCharReceived = 0;
-    receivedBytes = 0;
-    expectedBlkNumber = 1;
+    LMODEM_PT_BEGIN(pF);
+    pF->nbRetry = 0;
+    pF->canCharReceived = 0;
+    pF->receivedBytes = 0;
+    pF->expectedBlkNumber = 1;
+    pF->bFinished = false;
 
     //send that we are ready
-    lxmodem_build_and_send_preambule(pThis);
+#if LMODEM_CFG_FILE_CRC
+    if (pThis->skipped)
+    {
+        //the file of block 0 is already here, the sender goes to the end of batch
+        lymodem_send_skip(pThis);
+        pF->receivedBytes = (int32_t) pThis->file_data.size;
+        pF->bFinished = true;
+    }
+    else
+#endif
+#if LMODEM_CFG_DELTA
+    if (pThis->delta)
+    {
+        //the delta offered in block 0 is accepted, the hashes of the previous version replace the preambule
+        LMODEM_PT_CALL(pF, lymodem_send_delta_hashes(pThis, &pF->bReceived));
+        if (!pF->bReceived)
+        {
+            DBG("delta hashes not acknowledged -> abort\n");
+            pF->receivedBytes = -1;
+            pF->bFinished = true;
+            lxmodem_build_and_send_cancel(pThis);
+        }
+    }
+    else
+#endif
+#if LMODEM_CFG_COMPRESS
+    if (pThis->compressed)
+    {
+        //the compression offered in block 0 is accepted
+        pF->header = LMODEM_COMPRESS_ACCEPT;
+        lmodem_putchar(pThis, &pF->header, 1);
+    }
+    else
+#endif
+    {
+        lxmodem_build_and_send_preambule(pThis);
+    }
 
-    bFinished = false;
-    while (!bFinished)
+    while (!pF->bFinished)
     {
-        rcvStatus = LXMODEM_RECV_ERROR;
+        pF->rcvStatus = LXMODEM_RECV_ERROR;
+        pF->pPayload = NULL;
+        pF->bReadBlock = false;
+        pF->bPurge = false;
         //receive block by block
-        bReceived = lmodem_getchar(pThis, &header, 1);
-        if (bReceived)
+#if LMODEM_CFG_DMA
+        pF->bFramed = (pThis->rx_dma_start != NULL);
+        if (pF->bFramed)
         {
-            switch (header)
+            LMODEM_PT_CALL(pF, lxmodem_receive_frame(pThis, pF->expectedBlkNumber, &pF->header, &pF->nbHeaders, &pF->pPayload,
+                           &pF->frameStatus));
+            pF->bReceived = (pF->nbHeaders > 0);
+        }
+        else
+#else
+        pF->bFramed = false;
+#endif
+        {
+            pF->nbHeaders = 1;
+            LMODEM_PT_GETCHAR(pThis, pF, &pF->header, 1, pF->bReceived);
+        }
+        if (pF->bReceived)
+        {
+            switch (pF->header)
             {
                 case SOH:
                     //read 128 blzsize
-                    canCharReceived = 0;
-                    blksize = LXMODEM_BLOCK_SIZE_128;
-                    rcvStatus = lxmodem_receive_block(pThis, expectedBlkNumber, blksize);
+                    pF->canCharReceived = 0;
+                    pF->blksize = LXMODEM_BLOCK_SIZE_128;
+                    pF->bReadBlock = true;
                     break;
 
                 case STX:
                     //read 1k blzsize
-                    canCharReceived = 0;
+                    pF->canCharReceived = 0;
                     DBG("request 1k\n");
+#if LMODEM_CFG_1K_BLOCKS
                     if ((pThis->opts == lxmodem_1k) || (pThis->protocol == YMODEM))
                     {
-                        blksize = LXMODEM_BLOCK_SIZE_1024;
-                        rcvStatus = lxmodem_receive_block(pThis, expectedBlkNumber, blksize);
+                        pF->blksize = LXMODEM_BLOCK_SIZE_1024;
+                        pF->bReadBlock = true;
                     }
+#endif
                     break;
 
                 case EOT:
                     //end of transfert
-                    canCharReceived = 0;
-                    rcvStatus = LXMODEM_RECV_OK;
-                    blksize = 0;
-                    bFinished = true;
+                    pF->canCharReceived = 0;
+                    pF->rcvStatus = LXMODEM_RECV_OK;
+                    pF->blksize = 0;
+                    pF->bFinished = true;
+#if LMODEM_CFG_FILE_CRC
+                    if (!lymodem_is_file_crc_ok(pThis))
+                    {
+                        pF->rcvStatus = LXMODEM_RECV_FILE_CHECK_ERROR;
+                    }
+#endif
                     break;
 
                 case CAN:
-                    canCharReceived++;
-                    if (canCharReceived >= 2)
+                    pThis->stats.cans_received += pF->nbHeaders;
+                    pF->canCharReceived += pF->nbHeaders;
+                    if (pF->canCharReceived >= 2)
                     {
-                        bFinished = true;
-                        receivedBytes = -1;
+                        pF->bFinished = true;
+                        pF->receivedBytes = -1;
                         DBG("two CAN received -> abort\n");
                     }
                     break;
 
                 default:
+                    //line noise or the rest of a block whose header has been corrupted:
+                    //wait for the end of the block before the NAK, otherwise each byte would get a reply
+                    DBG("unexpected char 0x%.2x, purge the line\n", pF->header);
+                    pF->bPurge = true;
                     break;
             }
 
-            lxmodem_build_and_send_reply(pThis, rcvStatus);
-            if (rcvStatus == LXMODEM_RECV_OK)
+            //the waits are out of the switch on the header
+            if ((pF->bReadBlock) && (pF->bFramed))
+            {
+                pF->rcvStatus = pF->frameStatus;
+            }
+            else if (pF->bReadBlock)
+            {
+                LMODEM_PT_CALL(pF, lxmodem_receive_block(pThis, pF->expectedBlkNumber, pF->blksize, &pF->pPayload, &pF->rcvStatus));
+            }
+            else if (pF->bPurge)
+            {
+                LMODEM_PT_CALL(pF, lxmodem_purge_line(pThis));
+            }
+
+            if (pF->rcvStatus == LXMODEM_RECV_NO_SPACE)
+            {
+                DBG("no space to receive the block -> abort\n");
+                pF->bFinished = true;
+                pF->receivedBytes = -1;
+                lxmodem_build_and_send_cancel(pThis);
+            }
+            else if (pF->rcvStatus == LXMODEM_RECV_FILE_CHECK_ERROR)
+            {
+                //the cancel replaces the ACK of the EOT, the sender fails too
+                DBG("file differs from the crc32 of block 0 -> abort\n");
+                pF->receivedBytes = -1;
+                lxmodem_build_and_send_cancel(pThis);
+            }
+            else
+            {
+                lxmodem_build_and_send_reply(pThis, pF->rcvStatus);
+            }
+
+            if (pF->rcvStatus == LXMODEM_RECV_OK)
             {
                 int32_t nbPutInRamFile;
-                nbPutInRamFile = lmodem_buffer_write(&pThis->ramfile, pThis->blk_buffer.buffer + 2, blksize);
-                if (nbPutInRamFile != (int32_t) blksize)
+                int32_t nbData;
+                nbData = pF->blksize;
+#if LMODEM_CFG_DELTA
+                if (pThis->delta)
+                {
+                    //the records patch the previous version in place
+                    nbData = lmodem_delta_apply(&pThis->delta_decoder, pF->pPayload, pF->blksize, pThis->ramfile.buffer);
+                    nbPutInRamFile = (nbData >= 0) ? (int32_t) pF->blksize : -1;
+                }
+                else
+#endif
+#if LMODEM_CFG_COMPRESS
+                if (pThis->compressed)
+                {
+                    //the history of the decompression is the data already in the ramfile
+                    nbData = lmodem_decompress(&pThis->decompressor, pF->pPayload, pF->blksize, pThis->ramfile.buffer,
+                                               &pThis->ramfile.write_offset, pThis->ramfile.max_size);
+                    nbPutInRamFile = (nbData >= 0) ? (int32_t) pF->blksize : -1;
+                }
+                else
+#endif
+                if ((pF->pPayload >= pThis->blk_buffer.buffer) && (pF->pPayload < (pThis->blk_buffer.buffer + pThis->blk_buffer.max_size)))
+                {
+                    nbPutInRamFile = lmodem_buffer_write(&pThis->ramfile, pF->pPayload, pF->blksize);
+                }
+                else
+                {
+                    //payload has been received in place, only commit it
+                    lmodem_buffer_commit_write(&pThis->ramfile, pF->blksize);
+                    nbPutInRamFile = pF->blksize;
+                }
+                if (nbPutInRamFile != (int32_t) pF->blksize)
                 {
                     DBG("enable to put into ramfile -> abort\n");
-                    bFinished = true;
-                    receivedBytes = -1;
-                    uint8_t buffer[2];
-                    buffer[0] = CAN;
-                    buffer[1] = CAN;
-                    lmodem_putchar(pThis, buffer, 2);
+                    pF->bFinished = true;
+                    pF->receivedBytes = -1;
+                    lxmodem_build_and_send_cancel(pThis);
                 }
                 else
                 {
-                    expectedBlkNumber++;
-                    receivedBytes += blksize;
-                    nbRetry = 0;
+                    pF->expectedBlkNumber++;
+                    pF->receivedBytes += nbData;
+                    pF->nbRetry = 0;
+#if LMODEM_CFG_FILE_CRC
+                    if (pThis->file_crc_check)
+                    {
+                        lymodem_update_file_crc(pThis, pF->receivedBytes);
+                    }
+#endif
+                    if (pF->blksize > 0)
+                    {
+                        lmodem_stats_handshake_done(pThis);
+                        pThis->stats.blocks_received++;
+                        pThis->stats.payload_bytes += nbData;
+                        lmodem_trace(pThis, LMODEM_TRACE_BLOCK, pF->expectedBlkNumber - 1, pF->blksize);
+                        if (pThis->progress != NULL)
+                        {
+                            lmodem_progress_update(pThis, nbData);
+                        }
+                    }
                 }
             }
-            else
+            else if ((pF->rcvStatus != LXMODEM_RECV_NO_SPACE) && (pF->rcvStatus != LXMODEM_RECV_FILE_CHECK_ERROR))
             {
-                nbRetry++;
-                if (nbRetry >= 10)
+                pF->nbRetry++;
+                if (pF->nbRetry >= 10)
                 {
-                    receivedBytes = -1;
-                    bFinished = true;
+                    pF->receivedBytes = -1;
+                    pF->bFinished = true;
                     lxmodem_build_and_send_cancel(pThis);
                     DBG("max retry reached -> abort\n");
                 }
@@ -157,24 +375,85 @@ static int32_t lxmodem_receive(modem_context_t* pThis)
         }
         else
         {
-            nbRetry++;
-            if (nbRetry >= 10)
+            pF->nbRetry++;
+            if (pF->nbRetry >= 10)
             {
-                receivedBytes = -1;
-                bFinished = true;
+                pF->receivedBytes = -1;
+                pF->bFinished = true;
                 lxmodem_build_and_send_cancel(pThis);
                 DBG("max retry reached -> abort\n");
             }
         }
     }
 
-    return receivedBytes;
+    *pReceivedBytes = pF->receivedBytes;
+    LMODEM_PT_END(pF);
+}
+
+#if LMODEM_CFG_COMPRESS || LMODEM_CFG_DELTA
+// the payloads are not the file bytes, they are decoded from the line buffer
+static bool lxmodem_is_payload_encoded(modem_context_t* pThis)
+{
+#if LMODEM_CFG_COMPRESS
+    if (pThis->compressed)
+    {
+        return true;
+    }
+#endif
+#if LMODEM_CFG_DELTA
+    if (pThis->delta)
+    {
+        return true;
+    }
+#endif
+    return false;
+}
+#endif
+
+#if LMODEM_CFG_FILE_CRC || LMODEM_CFG_DELTA
+// the ramfile holds a file which must not be overwritten by a block received in place
+static bool lxmodem_is_ramfile_kept(modem_context_t* pThis)
+{
+#if LMODEM_CFG_FILE_CRC
+    if (pThis->present)
+    {
+        return true;
+    }
+#endif
+#if LMODEM_CFG_DELTA
+    if (pThis->delta_base)
+    {
+        return true;
+    }
+#endif
+    return false;
+}
+#endif
+
+static lmodem_pt_status lxmodem_purge_line(modem_context_t* pThis)
+{
+    lmodem_frame_purge* pF;
+    pF = &pThis->step.frames.rx.purge;
+
+    LMODEM_PT_BEGIN(pF);
+    //drop everything until the line is silent for one getchar timeout, or at most the largest frame: a line
+    //which never goes silent (noise, a sender repeating faster than the timeout) still gets a reply
+    pF->nbPurged = 0;
+    do
+    {
+        LMODEM_PT_GETCHAR(pThis, pF, &pF->c, 1, pF->bReceived);
+        pF->nbPurged++;
+    }
+    while ((pF->bReceived) && (pF->nbPurged < LXMODEM_1K_BUFFER_MIN_SIZE));
+    LMODEM_PT_END(pF);
 }
 
 void lxmodem_build_and_send_preambule(modem_context_t* pThis)
 {
     char p;
 
+    //checksum unless the variant asks for the crc, p is set on every path
+    p = NAK;
     if (pThis->protocol == XMODEM)
     {
         switch (pThis->opts)
@@ -201,46 +480,213 @@ void lxmodem_build_and_send_preambule(modem_context_t* pThis)
     lmodem_putchar(pThis, (uint8_t*) &p, 1);
 }
 
-static lxmodem_reception_status lxmodem_receive_block(modem_context_t* pThis, uint8_t expectedBlkNumber, uint32_t requestedBlksize)
+static lmodem_pt_status lxmodem_receive_block(modem_context_t* pThis, uint8_t expectedBlkNumber, uint32_t requestedBlksize,
+        uint8_t** ppPayload, lxmodem_reception_status* pStatus)
 {
-    bool bReceived;
-    lxmodem_reception_status blockCorrectlyRetrieved;
-    uint32_t requestedData;
+    lmodem_frame_block* pF;
+    pF = &pThis->step.frames.rx.block;
+
+    LMODEM_PT_BEGIN(pF);
+    pF->status = LXMODEM_RECV_ERROR;
+    pF->trailerSize = lxmodem_get_trailer_size(pThis, requestedBlksize);
+
+    //zero copy: payload goes directly in the free area of the ramfile, it is committed only if the block is valid
+    pF->pPayload = NULL;
+#if LMODEM_CFG_COMPRESS || LMODEM_CFG_DELTA
+    //a compressed or delta payload is decoded from the line buffer into the ramfile
+    if (!lxmodem_is_payload_encoded(pThis))
+#endif
+#if LMODEM_CFG_FILE_CRC || LMODEM_CFG_DELTA
+    //the blocks go to the line buffer when it holds them: the file already present is kept when skipped, the previous
+    //version of a delta is kept until block 0 is decoded and its hashes are sent
+    if ((!lxmodem_is_ramfile_kept(pThis))
+        || (pThis->blk_buffer.max_size < (LXMODEM_HEADER_SIZE + requestedBlksize + pF->trailerSize)))
+#endif
+    {
+        pF->pPayload = lmodem_buffer_get_write_pointer(&pThis->ramfile, requestedBlksize);
+    }
+    if (pF->pPayload != NULL)
+    {
+        pF->pTrailer = pThis->blk_buffer.buffer + LXMODEM_HEADER_SIZE;
+        LMODEM_PT_GETCHAR(pThis, pF, pThis->blk_buffer.buffer, LXMODEM_HEADER_SIZE, pF->bReceived);
+#if LMODEM_CFG_1K_BLOCKS
+        if ((pThis->lowMemoryRx) && (pF->trailerSize == LXMODEM_CRC16_SIZE))
+        {
+            if (pF->bReceived)
+            {
+                LMODEM_PT_CALL(pF, lxmodem_receive_streamed_payload(pThis, pF->pPayload, requestedBlksize, &pF->crc, &pF->bReceived));
+            }
+            if (pF->bReceived)
+            {
+                LMODEM_PT_GETCHAR(pThis, pF, pF->pTrailer, pF->trailerSize, pF->bReceived);
+            }
+            if (pF->bReceived)
+            {
+                pF->status = lxmodem_check_block_no(pThis, pThis->blk_buffer.buffer, expectedBlkNumber);
+                if (pF->status == LXMODEM_RECV_OK)
+                {
+                    pF->status = lxmodem_check_crc_value(pThis, pF->crc, pF->pTrailer);
+                }
+            }
+            pF->bReceived = false;
+        }
+        else
+#endif
+        {
+            if (pF->bReceived)
+            {
+                LMODEM_PT_GETCHAR(pThis, pF, pF->pPayload, requestedBlksize, pF->bReceived);
+            }
+            if (pF->bReceived)
+            {
+                LMODEM_PT_GETCHAR(pThis, pF, pF->pTrailer, pF->trailerSize, pF->bReceived);
+            }
+        }
+    }
+    else if (pThis->blk_buffer.max_size >= (LXMODEM_HEADER_SIZE + requestedBlksize + pF->trailerSize))
+    {
+        pF->pPayload = pThis->blk_buffer.buffer + LXMODEM_HEADER_SIZE;
+        pF->pTrailer = pF->pPayload + requestedBlksize;
+        LMODEM_PT_GETCHAR(pThis, pF, pThis->blk_buffer.buffer, LXMODEM_HEADER_SIZE + requestedBlksize + pF->trailerSize, pF->bReceived);
+    }
+    else
+    {
+        DBG("line buffer too small for a block of %d bytes\n", requestedBlksize);
+        pF->bReceived = false;
+        pF->status = LXMODEM_RECV_NO_SPACE;
+    }
 
-    blockCorrectlyRetrieved = LXMODEM_RECV_ERROR;
-    requestedData = requestedBlksize + LXMODEM_HEADER_SIZE;
+    if (pF->bReceived)
+    {
+        LMODEM_PT_CALL(pF, lxmodem_check_block_no_and_crc(pThis, pThis->blk_buffer.buffer, expectedBlkNumber, pF->pPayload, pF->pTrailer,
+                       requestedBlksize, &pF->status));
+    }
 
-    if ((pThis->withCrc == true) || (pThis->protocol == YMODEM) || (requestedBlksize > LXMODEM_BLOCK_SIZE_128))
+    *ppPayload = pF->pPayload;
+    *pStatus = pF->status;
+    LMODEM_PT_END(pF);
+}
+
+#if LMODEM_CFG_1K_BLOCKS
+static lmodem_pt_status lxmodem_receive_streamed_payload(modem_context_t* pThis, uint8_t* pPayload, uint32_t requestedBlksize,
+        uint16_t* pCrc, bool* pReceived)
+{
+    lmodem_frame_stream* pF;
+    pF = &pThis->step.frames.rx.stream;
+
+    LMODEM_PT_BEGIN(pF);
+    //each chunk goes to the ramfile and into the crc as soon as it is received, only the trailer remains to check
+    pF->bReceived = true;
+    pF->offset = 0;
+    pF->crc = lmodem_crc_init(pThis);
+    while ((pF->bReceived) && (pF->offset < requestedBlksize))
     {
-        requestedData += LXMODEM_CRC16_SIZE;
+        pF->chunkSize = min(LXMODEM_STREAM_CHUNK_SIZE, requestedBlksize - pF->offset);
+        LMODEM_PT_GETCHAR(pThis, pF, pPayload + pF->offset, pF->chunkSize, pF->bReceived);
+        if (pF->bReceived)
+        {
+            LMODEM_PT_CRC(pThis, pF, pPayload + pF->offset, pF->chunkSize, pF->crc);
+            pF->offset += pF->chunkSize;
+        }
     }
-    else
+
+    *pCrc = lmodem_crc_final(pThis, pF->crc);
+    *pReceived = pF->bReceived;
+    LMODEM_PT_END(pF);
+}
+#endif
+
+#if LMODEM_CFG_DMA
+static lmodem_pt_status lxmodem_receive_frame(modem_context_t* pThis, uint8_t expectedBlkNumber, uint8_t* pHeader,
+        uint32_t* pNbHeaders, uint8_t** ppPayload, lxmodem_reception_status* pStatus)
+{
+    lmodem_frame_dma* pF;
+    uint8_t* pFrame;
+    uint32_t nbHeaders;
+    pF = &pThis->step.frames.rx.frame;
+    pFrame = pThis->blk_buffer.buffer;
+
+    LMODEM_PT_BEGIN(pF);
+    //DMA: header, block number, payload and trailer in one reception, which ends early on an idle line after a
+    //shorter frame (128 bytes block, EOT, CAN)
+    pF->status = LXMODEM_RECV_ERROR;
+    LMODEM_PT_RECEIVE_UP_TO(pThis, pF, pFrame, LMODEM_LINE_BUFFER_MIN_SIZE, pF->nbReceived);
+    if ((pF->nbReceived > 0) && ((pFrame[0] == SOH) || (pFrame[0] == STX)))
     {
-        requestedData += LXMODEM_CHKSUM_SIZE;
+        pF->blksize = (pFrame[0] == SOH) ? LXMODEM_BLOCK_SIZE_128 : LXMODEM_BLOCK_SIZE_1024;
+        pF->frameSize = 1 + LXMODEM_HEADER_SIZE + pF->blksize + lxmodem_get_trailer_size(pThis, pF->blksize);
+        if (pF->frameSize <= LMODEM_LINE_BUFFER_MIN_SIZE)
+        {
+            pF->bReceived = true;
+            if (pF->nbReceived < pF->frameSize)
+            {
+                //the line has been idle in the middle of the block
+                LMODEM_PT_GETCHAR(pThis, pF, pFrame + pF->nbReceived, pF->frameSize - pF->nbReceived, pF->bReceived);
+            }
+            if (pF->bReceived)
+            {
+                LMODEM_PT_CALL(pF, lxmodem_check_block_no_and_crc(pThis, pFrame + 1, expectedBlkNumber, pFrame + 1 + LXMODEM_HEADER_SIZE,
+                               pFrame + 1 + LXMODEM_HEADER_SIZE + pF->blksize, pF->blksize, &pF->status));
+            }
+        }
     }
 
-    bReceived = lmodem_getchar(pThis, pThis->blk_buffer.buffer, requestedData);
-    if (bReceived)
+    //control characters may come in a row (CAN CAN)
+    nbHeaders = (pF->nbReceived > 0) ? 1 : 0;
+    while ((nbHeaders < pF->nbReceived) && (pFrame[nbHeaders] == pFrame[0]) && (pFrame[0] != SOH) && (pFrame[0] != STX))
     {
-        blockCorrectlyRetrieved  = lxmodem_check_block_no_and_crc(pThis, expectedBlkNumber, requestedBlksize);
+        nbHeaders++;
     }
 
-    return blockCorrectlyRetrieved;
+    *pHeader = pFrame[0];
+    *pNbHeaders = nbHeaders;
+    *ppPayload = ((pFrame[0] == SOH) || (pFrame[0] == STX)) ? (pFrame + 1 + LXMODEM_HEADER_SIZE) : NULL;
+    *pStatus = pF->status;
+    LMODEM_PT_END(pF);
 }
+#endif
 
-uint8_t lxmodem_calcul_chksum(uint8_t* buffer, uint32_t size)
+static uint32_t lxmodem_get_trailer_size(modem_context_t* pThis, uint32_t requestedBlksize)
 {
-    uint8_t t;
-    t = 0;
-    for (uint32_t i = 0; i < size; i++)
+    if ((pThis->withCrc == true) || (pThis->protocol == YMODEM) || (requestedBlksize > LXMODEM_BLOCK_SIZE_128))
     {
-        t += buffer[i];
+        return LXMODEM_CRC16_SIZE;
     }
+    return LXMODEM_CHKSUM_SIZE;
+}
 
-    return t;
+static lmodem_pt_status lxmodem_check_block_no_and_crc(modem_context_t* pThis, uint8_t* pBlkNo, uint8_t expectedBlkNumber,
+        uint8_t* pPayload, uint8_t* pTrailer, uint32_t requestedBlksize, lxmodem_reception_status* pStatus)
+{
+    lmodem_frame_check* pF;
+    pF = &pThis->step.frames.rx.check;
+
+    LMODEM_PT_BEGIN(pF);
+    pF->status = lxmodem_check_block_no(pThis, pBlkNo, expectedBlkNumber);
+    if (pF->status == LXMODEM_RECV_OK)
+    {
+        if (lxmodem_get_trailer_size(pThis, requestedBlksize) == LXMODEM_CRC16_SIZE)
+        {
+#if LMODEM_CFG_CRC
+            //the crc provider may compute it in background
+            pF->crc = lmodem_crc_init(pThis);
+            LMODEM_PT_CRC(pThis, pF, pPayload, requestedBlksize, pF->crc);
+            pF->status = lxmodem_check_crc_value(pThis, lmodem_crc_final(pThis, pF->crc), pTrailer);
+#else
+            pF->status = LXMODEM_RECV_ERROR;
+#endif
+        }
+        else
+        {
+            pF->status = lxmodem_check_chksum(pThis, pPayload, pTrailer, requestedBlksize);
+        }
+    }
+
+    *pStatus = pF->status;
+    LMODEM_PT_END(pF);
 }
 
-static lxmodem_reception_status lxmodem_check_block_no_and_crc(modem_context_t* pThis, uint8_t expectedBlkNumber, uint32_t requestedBlksize)
+static lxmodem_reception_status lxmodem_check_block_no(modem_context_t* pThis, uint8_t* pBlkNo, uint8_t expectedBlkNumber)
 {
     lxmodem_reception_status rcvStatus;
     uint8_t complement;
@@ -248,8 +694,8 @@ static lxmodem_reception_status lxmodem_check_block_no_and_crc(modem_context_t*
     complement =  ~expectedBlkNumber;
     rcvStatus = LXMODEM_RECV_ERROR;
 
-    if ((pThis->blk_buffer.buffer[0] == expectedBlkNumber) &&
-        (pThis->blk_buffer.buffer[1] == complement))
+    if ((pBlkNo[0] == expectedBlkNumber) &&
+        (pBlkNo[1] == complement))
     {
         rcvStatus = LXMODEM_RECV_OK;
     }
@@ -257,66 +703,77 @@ static lxmodem_reception_status lxmodem_check_block_no_and_crc(modem_context_t*
     {
         uint8_t previousBlkNumber = expectedBlkNumber - 1;
         complement =  ~previousBlkNumber;
-        if ((pThis->blk_buffer.buffer[0] == previousBlkNumber) &&
-            (pThis->blk_buffer.buffer[1] == complement))
+        if ((pBlkNo[0] == previousBlkNumber) &&
+            (pBlkNo[1] == complement))
         {
             rcvStatus = LXMODEM_RECV_PREVIOUS_BLOCK;
+            pThis->stats.duplicate_blocks++;
             DBG("reception of retry block %d\n", previousBlkNumber);
         }
         else
         {
-            DBG("wrong blknumber %d received, expected %d\n", pThis->blk_buffer.buffer[0], expectedBlkNumber);
+            pThis->stats.block_number_errors++;
+            DBG("wrong blknumber %d received, expected %d\n", pBlkNo[0], expectedBlkNumber);
         }
     }
 
-    if (rcvStatus == LXMODEM_RECV_OK)
-    {
-        rcvStatus = lxmodem_check_crc(pThis, requestedBlksize);
-    }
-
     return rcvStatus;
 }
 
 
-static lxmodem_reception_status lxmodem_check_crc(modem_context_t* pThis, uint32_t requestedBlksize)
+static lxmodem_reception_status lxmodem_check_chksum(modem_context_t* pThis, uint8_t* pPayload, uint8_t* pTrailer,
+        uint32_t requestedBlksize)
 {
-    lxmodem_reception_status crcOrChecksumOk;
-    crcOrChecksumOk = LXMODEM_RECV_ERROR;
+    lxmodem_reception_status checksumOk;
+    checksumOk = LXMODEM_RECV_ERROR;
 
-    if ((pThis->withCrc == true) || (pThis->protocol == YMODEM) || (requestedBlksize > LXMODEM_BLOCK_SIZE_128))
+#if LMODEM_CFG_XMODEM_CHKSUM
+    uint8_t chksum;
+    chksum = lxmodem_calcul_chksum(pPayload, requestedBlksize);
+    if (chksum == pTrailer[0])
+    {
+        DBG("checksum ok for block %d\n", pThis->blk_buffer.buffer[0]);
+        checksumOk = LXMODEM_RECV_OK;
+    }
+    else
     {
-        uint16_t crc;
-        uint8_t hiCrc;
-        uint8_t loCrc;
+        pThis->stats.checksum_errors++;
+    }
+#else
+    (void) pThis;
+    (void) pPayload;
+    (void) pTrailer;
+    (void) requestedBlksize;
+#endif
+    return checksumOk;
+}
 
-        crc = crc16_doCalcul(&pThis->crc16, pThis->blk_buffer.buffer + LXMODEM_HEADER_SIZE, requestedBlksize,
-                             LXMODEM_CRC16_INIT_VALUE, LXMODEM_CRC16_XOR_FINAL);
-        hiCrc = ((crc & 0xFF00) >> 8);
-        loCrc = (crc & 0xFF);
+#if LMODEM_CFG_CRC
 
-        if ((hiCrc == pThis->blk_buffer.buffer[LXMODEM_HEADER_SIZE + requestedBlksize]) &&
-            (loCrc == pThis->blk_buffer.buffer[LXMODEM_HEADER_SIZE + requestedBlksize + 1]))
-        {
-            DBG("crc ok for block %d\n", pThis->blk_buffer.buffer[0]);
-            crcOrChecksumOk = LXMODEM_RECV_OK;
-        }
-        else
-        {
-            DBG("wrong crc: calculated: 0x%.2x, received: 0x%.2x\n", crc,  ((hiCrc << 8) | loCrc));
-        }
+static lxmodem_reception_status lxmodem_check_crc_value(modem_context_t* pThis, uint16_t crc, uint8_t* pTrailer)
+{
+    lxmodem_reception_status crcOk;
+    uint8_t hiCrc;
+    uint8_t loCrc;
+
+    crcOk = LXMODEM_RECV_ERROR;
+    hiCrc = ((crc & 0xFF00) >> 8);
+    loCrc = (crc & 0xFF);
+
+    if ((hiCrc == pTrailer[0]) && (loCrc == pTrailer[1]))
+    {
+        DBG("crc ok for block %d\n", pThis->blk_buffer.buffer[0]);
+        crcOk = LXMODEM_RECV_OK;
     }
     else
     {
-        uint8_t chksum;
-        chksum = lxmodem_calcul_chksum(pThis->blk_buffer.buffer + LXMODEM_HEADER_SIZE, requestedBlksize);
-        if (chksum == pThis->blk_buffer.buffer[requestedBlksize + LXMODEM_HEADER_SIZE])
-        {
-            DBG("checksum ok for block %d\n", pThis->blk_buffer.buffer[0]);
-            crcOrChecksumOk = LXMODEM_RECV_OK;
-        }
+        pThis->stats.crc_errors++;
+        DBG("wrong crc: calculated: 0x%.2x, received: 0x%.2x\n", crc, ((pTrailer[0] << 8) | pTrailer[1]));
     }
-    return crcOrChecksumOk;
+
+    return crcOk;
 }
+#endif
 
 static void lxmodem_build_and_send_reply(modem_context_t* pThis, lxmodem_reception_status rcvStatus)
 {
@@ -328,157 +785,175 @@ static void lxmodem_build_and_send_reply(modem_context_t* pThis, lxmodem_recepti
     else
     {
         ack = NAK;
+        pThis->stats.naks_sent++;
+        lmodem_trace(pThis, LMODEM_TRACE_NAK, 0, 0);
     }
     lmodem_putchar(pThis, &ack, 1);
 }
 
-void lxmodem_build_and_send_cancel(modem_context_t* pThis)
-{
-    uint8_t buffer[2];
-    buffer[0] = CAN;
-    buffer[1] = CAN;
-    lmodem_putchar(pThis, buffer, 2);
-}
+#if LMODEM_CFG_YMODEM
 
-static int32_t lymodem_receive(modem_context_t* pThis)
+static lmodem_pt_status lymodem_receive(modem_context_t* pThis, int32_t* pReceivedBytes)
 {
-    uint32_t timeout;
-    uint8_t startBlock0;
-    bool bReceived;
-    uint32_t receivedBytes;
-    lxmodem_reception_status rxStatus;
+    lmodem_frame_ymodem_rx* pF;
+    bool bBlock0Ok;
+    pF = &pThis->step.frames.rx.ymodem;
 
-    rxStatus = LXMODEM_RECV_ERROR;
-    receivedBytes = -1;
+    LMODEM_PT_BEGIN(pF);
+    pF->rxStatus = LXMODEM_RECV_ERROR;
+    pF->receivedBytes = -1;
+    pF->pPayload = NULL;
+    pF->blksize = 0;
 
     lxmodem_build_and_send_preambule(pThis);
 
-    bReceived = false;
-    timeout = 0;
-    while ((bReceived == false) && (timeout < 10))
+    pF->bFinished = false;
+    pF->timeout = 0;
+    while ((pF->bFinished == false) && (pF->timeout < 10))
     {
-        //wait preambule
-        bReceived = lmodem_getchar(pThis, &startBlock0, 1);
-        if (bReceived)
+        //wait block 0, timeouts and wrong blocks are retried up to 10 times
+        LMODEM_PT_GETCHAR(pThis, pF, &pF->startBlock0, 1, pF->bReceived);
+        if (pF->bReceived)
         {
-            switch (startBlock0)
+            if ((pF->startBlock0 == SOH) || (pF->startBlock0 == STX))
             {
-                case SOH:
-                    rxStatus = lymodem_receive_block0(pThis, 128);
-                    break;
-
-                case STX:
-                    rxStatus = lymodem_receive_block0(pThis, 1024);
-                    break;
-
-                default:
-                    break;
+                //one attempt, the header of a retransmitted block is read again here
+                pF->blksize = (pF->startBlock0 == SOH) ? LXMODEM_BLOCK_SIZE_128 : LXMODEM_BLOCK_SIZE_1024;
+                LMODEM_PT_CALL(pF, lxmodem_receive_block(pThis, 0, pF->blksize, &pF->pPayload, &pF->rxStatus));
+                lymodem_reply_block0(pThis, pF->rxStatus);
+            }
+            else
+            {
+                DBG("unexpected char 0x%.2x before block 0, purge the line\n", pF->startBlock0);
+                LMODEM_PT_CALL(pF, lxmodem_purge_line(pThis));
+                lxmodem_build_and_send_reply(pThis, LXMODEM_RECV_ERROR);
             }
+            pF->bFinished = (pF->rxStatus == LXMODEM_RECV_OK) || (pF->rxStatus == LXMODEM_RECV_NO_SPACE);
         }
-        timeout++;
+        pF->timeout++;
+    }
+    if (pF->bFinished == false)
+    {
+        lxmodem_build_and_send_cancel(pThis);
     }
 
-    if (rxStatus == LXMODEM_RECV_OK)
+    if (pF->rxStatus == LXMODEM_RECV_OK)
     {
-        bool bBlock0Ok;
-        bBlock0Ok = lymodem_decode_block0(pThis);
+        bBlock0Ok = lymodem_decode_block0(pThis, pF->pPayload, pF->blksize);
         if (bBlock0Ok == true)
         {
-            receivedBytes = lxmodem_receive(pThis);
+            if ((pThis->file_data.valid & LMODEM_METADATA_FILESIZE_VALID) == LMODEM_METADATA_FILESIZE_VALID)
+            {
+                pThis->progress_state.bytes_total = pThis->file_data.size;
+            }
+            LMODEM_PT_CALL(pF, lxmodem_receive(pThis, &pF->receivedBytes));
+#if LMODEM_CFG_COMPRESS
+            if ((pThis->compressed) && (pF->receivedBytes >= 0) && (!lmodem_decompress_is_ended(&pThis->decompressor)))
+            {
+                DBG("compressed stream without its end\n");
+                pF->receivedBytes = -1;
+            }
+#endif
+#if LMODEM_CFG_DELTA
+            if ((pThis->delta) && (pF->receivedBytes >= 0) && (!lmodem_delta_is_ended(&pThis->delta_decoder)))
+            {
+                DBG("delta stream without its end\n");
+                pF->receivedBytes = -1;
+            }
+#endif
             //dont accept another file...
-            lymodem_block_next_file(pThis);
+            LMODEM_PT_CALL(pF, lymodem_block_next_file(pThis));
         }
     }
 
-    if (receivedBytes > 0)
+    if (pF->receivedBytes != 0)
     {
+#if LMODEM_CFG_FILE_CRC
+        //a skipped file is not in the buffer
+        if (pThis->skipped)
+        {
+            DBG("file already present, skipped\n");
+        }
+        else
+#endif
         if ((pThis->file_data.valid & LMODEM_METADATA_FILESIZE_VALID) == LMODEM_METADATA_FILESIZE_VALID)
         {
             lmodem_buffer_set_write_offset(&pThis->ramfile, pThis->file_data.size);
         }
     }
 
-    return receivedBytes;
+    *pReceivedBytes = pF->receivedBytes;
+    LMODEM_PT_END(pF);
 }
 
-static lxmodem_reception_status lymodem_receive_block0(modem_context_t* pThis, uint32_t blksize)
+static void lymodem_reply_block0(modem_context_t* pThis, lxmodem_reception_status rxStatus)
 {
-    bool bReceived;
-    bool bFinished;
-    uint32_t retry;
-    bReceived = false;
-    bFinished = false;
-    lxmodem_reception_status rxStatus;
-
-    retry = 0;
-    while (bFinished == false)
+    if (rxStatus == LXMODEM_RECV_NO_SPACE)
     {
-        bReceived = lmodem_getchar(pThis, pThis->blk_buffer.buffer, 2 + blksize + 2);
-        if (bReceived == true)
+        lxmodem_build_and_send_cancel(pThis);
+    }
+    else
+    {
+        lxmodem_build_and_send_reply(pThis, rxStatus);
+        if (rxStatus == LXMODEM_RECV_OK)
         {
-            rxStatus = lxmodem_check_block_no_and_crc(pThis, 0, blksize);
-            lxmodem_build_and_send_reply(pThis, rxStatus);
-            if (rxStatus == LXMODEM_RECV_OK)
-            {
-                bFinished = true;
-                break;
-            }
-            else
-            {
-                retry++;
-                if (retry >= 10)
-                {
-                    lxmodem_build_and_send_cancel(pThis);
-                    bFinished = true;
-                }
-            }
+            lmodem_stats_handshake_done(pThis);
         }
     }
-
-    return rxStatus;
 }
 
-static void lymodem_block_next_file(modem_context_t* pThis)
+static lmodem_pt_status lymodem_block_next_file(modem_context_t* pThis)
 {
-    uint8_t startBlock0;
-    uint32_t timeout;
-    bool bReceived;
-
-    lxmodem_build_and_send_preambule(pThis);
-    bReceived = false;
-    timeout = 0;
-    while ((bReceived == false) && (timeout < 10))
+    lmodem_frame_ymodem_rx* pF;
+    pF = &pThis->step.frames.rx.next_file;
+
+    LMODEM_PT_BEGIN(pF);
+#if LMODEM_CFG_FILE_CRC
+    //after a skip the answer already sent asks for the end of batch block, a 'C' would be taken for a preambule
+    if (!pThis->skipped)
+#endif
     {
-        bReceived = lmodem_getchar(pThis, &startBlock0, 1);
-        if (bReceived == true)
+        lxmodem_build_and_send_preambule(pThis);
+    }
+    pF->bReceived = false;
+    pF->timeout = 0;
+    while ((pF->bReceived == false) && (pF->timeout < 10))
+    {
+        LMODEM_PT_GETCHAR(pThis, pF, &pF->startBlock0, 1, pF->bReceived);
+#if LMODEM_CFG_FILE_CRC
+        if ((!pF->bReceived) && (pThis->skipped))
+        {
+            //the skip answer has been lost
+            lymodem_send_skip(pThis);
+        }
+#endif
+        if (pF->bReceived == true)
         {
-            switch (startBlock0)
+            pF->rxStatus = LXMODEM_RECV_ERROR;
+            if ((pF->startBlock0 == SOH) || (pF->startBlock0 == STX))
             {
-                case SOH:
-                    bReceived = lmodem_getchar(pThis, pThis->blk_buffer.buffer, 128 + 2 + 2);
-                    break;
-
-                case STX:
-                    bReceived = lmodem_getchar(pThis, pThis->blk_buffer.buffer, 1024 + 2 + 2);
-                    break;
-                default:
-                    break;
+                pF->blksize = (pF->startBlock0 == SOH) ? LXMODEM_BLOCK_SIZE_128 : LXMODEM_BLOCK_SIZE_1024;
+                LMODEM_PT_CALL(pF, lxmodem_receive_block(pThis, 0, pF->blksize, &pF->pPayload, &pF->rxStatus));
             }
 
-            if (bReceived == true)
+            if ((pF->rxStatus == LXMODEM_RECV_OK) && (pF->pPayload[0] == '\0'))
             {
-                if (pThis->blk_buffer.buffer[2] == '\0')
-                {
-                    lxmodem_build_and_send_reply(pThis, LXMODEM_RECV_OK);
-                }
-                else
-                {
-                    lxmodem_build_and_send_cancel(pThis);
-                }
+                lxmodem_build_and_send_reply(pThis, LXMODEM_RECV_OK);
+            }
+            else if (pF->rxStatus == LXMODEM_RECV_ERROR)
+            {
+                //ask again the end of batch block
+                lxmodem_build_and_send_reply(pThis, pF->rxStatus);
+                pF->bReceived = false;
+            }
+            else
+            {
+                lxmodem_build_and_send_cancel(pThis);
             }
         }
-        timeout++;
+        pF->timeout++;
     }
+    LMODEM_PT_END(pF);
 }
 
 void lmodem_metadata_clean(lmodem_file_characteristics* pMetaData)
@@ -487,15 +962,17 @@ void lmodem_metadata_clean(lmodem_file_characteristics* pMetaData)
     pMetaData->modif_date = 0;
     pMetaData->permission = 0;
     pMetaData->serial_number = 0;
+    pMetaData->crc32 = 0;
     pMetaData->size = 0;
     pMetaData->valid = 0;
 }
 
-bool lymodem_decode_block0(modem_context_t* pThis)
+bool lymodem_decode_block0(modem_context_t* pThis, uint8_t* pPayload, uint32_t blksize)
 {
+    char* pExtension;
     char* pString;
     bool bResult = false;
-    pString = (char*) (pThis->blk_buffer.buffer + 2);
+    pString = (char*) pPayload;
 
     lmodem_metadata_clean(&pThis->file_data);
 
@@ -512,12 +989,244 @@ bool lymodem_decode_block0(modem_context_t* pThis)
         pThis->file_data.valid |= LMODEM_METADATA_FILENAME_VALID;
 
         DBG("reception of file '%s'\n", pThis->file_data.filename);
-        bResult = lymodem_get_meta_data(pThis);
+        //found before the metadata fields are split in place
+        pExtension = lymodem_get_extension(pPayload, blksize);
+        bResult = lymodem_get_meta_data(pThis, pPayload, blksize);
+        if ((bResult) && (pExtension != NULL))
+        {
+            lymodem_decode_extension(pThis, pExtension, (char*) pPayload + blksize);
+        }
     }
     return bResult;
 }
 
-bool lymodem_get_meta_data(modem_context_t* pThis)
+// after the filename and the metadata, each one ended by '\0', NULL without metadata or extension
+char* lymodem_get_extension(uint8_t* pPayload, uint32_t blksize)
+{
+    char* pString;
+    char* pEndString;
+    char* pEnd;
+    uint32_t i;
+
+    pString = (char*) pPayload;
+    pEndString = (char*) pPayload + blksize;
+    for (i = 0; i < 2; i++)
+    {
+        pEnd = memchr(pString, '\0', pEndString - pString);
+        if ((pEnd == NULL) || (pEnd + 1 >= pEndString) || (pEnd[1] == '\0'))
+        {
+            return NULL;
+        }
+        pString = pEnd + 1;
+    }
+    return pString;
+}
+
+// space separated "key:value" fields, the unknown ones are ignored
+void lymodem_decode_extension(modem_context_t* pThis, char* pString, char* pEndString)
+{
+    char* pField;
+    bool bValid;
+    uint32_t value;
+
+    pEndString = pString + strnlen(pString, pEndString - pString);
+    while ((pField = lymodem_get_next_meta_data_string(&pString, pEndString)) != NULL)
+    {
+#if LMODEM_CFG_COMPRESS
+        if (strncmp(pField, "lz:", 3) == 0)
+        {
+            value = lymodem_getValue(&bValid, pField + 3, 10);
+            //the blocks are decompressed from the line buffer
+            if ((bValid) && (value == LMODEM_COMPRESS_VERSION) && (pThis->decompression) && (!pThis->lowMemoryRx)
+                    && (pThis->blk_buffer.max_size >= LXMODEM_1K_BUFFER_MIN_SIZE))
+            {
+                DBG("compressed data blocks\n");
+                lmodem_decompress_init(&pThis->decompressor);
+                pThis->compressed = true;
+            }
+        }
+#endif
+#if LMODEM_CFG_DELTA
+        if (strncmp(pField, "dl:", 3) == 0)
+        {
+            value = lymodem_getValue(&bValid, pField + 3, 10);
+            //the records are read from the line buffer and patch the file buffer up to the file size
+            if ((bValid) && (value == LMODEM_DELTA_VERSION) && (pThis->delta_base) && (!pThis->lowMemoryRx)
+                    && (pThis->blk_buffer.max_size >= LXMODEM_1K_BUFFER_MIN_SIZE)
+                    && ((pThis->file_data.valid & LMODEM_METADATA_FILESIZE_VALID) == LMODEM_METADATA_FILESIZE_VALID)
+                    && (pThis->file_data.size <= pThis->ramfile.max_size))
+            {
+                DBG("delta data blocks\n");
+                lmodem_delta_decode_init(&pThis->delta_decoder, pThis->file_data.size);
+                pThis->delta = true;
+            }
+        }
+#endif
+#if LMODEM_CFG_FILE_CRC
+        if (strncmp(pField, "crc32:", 6) == 0)
+        {
+            value = lymodem_getValue(&bValid, pField + 6, 16);
+            //the file is checked up to its size
+            if ((bValid) && ((pThis->file_data.valid & LMODEM_METADATA_FILESIZE_VALID) == LMODEM_METADATA_FILESIZE_VALID))
+            {
+                pThis->file_data.crc32 = value;
+                pThis->file_data.valid |= LMODEM_METADATA_CRC32_VALID;
+                pThis->file_crc_check = true;
+                pThis->file_crc_offset = 0;
+                pThis->file_crc_value = 0;
+                pThis->skipped = (pThis->present) && (!pThis->lowMemoryRx) && (pThis->present_size == pThis->file_data.size)
+                                 && (pThis->present_crc == value);
+            }
+        }
+#endif
+#if !(LMODEM_CFG_COMPRESS || LMODEM_CFG_DELTA || LMODEM_CFG_FILE_CRC)
+        (void) pThis;
+        (void) pField;
+        (void) bValid;
+        (void) value;
+#endif
+    }
+#if LMODEM_CFG_COMPRESS && LMODEM_CFG_DELTA
+    //the unchanged blocks are not sent at all
+    if (pThis->delta)
+    {
+        pThis->compressed = false;
+    }
+#endif
+#if LMODEM_CFG_FILE_CRC
+    //no data block at all
+    if (pThis->skipped)
+    {
+#if LMODEM_CFG_COMPRESS
+        pThis->compressed = false;
+#endif
+#if LMODEM_CFG_DELTA
+        pThis->delta = false;
+#endif
+    }
+#endif
+}
+
+#if LMODEM_CFG_FILE_CRC
+// hashes the file bytes committed since the last block, the padding of the last block is not part of the file
+static void lymodem_update_file_crc(modem_context_t* pThis, int32_t receivedBytes)
+{
+    const uint8_t* pFile;
+    uint32_t end;
+
+    //the file starts at the first byte written, a delta patches it in place from the start of the buffer
+    pFile = &pThis->ramfile.buffer[pThis->ramfile.write_offset - receivedBytes];
+#if LMODEM_CFG_DELTA
+    if (pThis->delta)
+    {
+        pFile = pThis->ramfile.buffer;
+    }
+#endif
+    end = min((uint32_t) receivedBytes, pThis->file_data.size);
+    if (end > pThis->file_crc_offset)
+    {
+        pThis->file_crc_value = crc32_update(pThis->file_crc_value, &pFile[pThis->file_crc_offset], end - pThis->file_crc_offset);
+        pThis->file_crc_offset = end;
+    }
+}
+
+// instead of the 'C' after block 0, until the end of batch block comes
+static void lymodem_send_skip(modem_context_t* pThis)
+{
+    uint8_t c;
+
+    c = LMODEM_FILE_CRC_SKIP;
+    lmodem_putchar(pThis, &c, 1);
+}
+
+static bool lymodem_is_file_crc_ok(modem_context_t* pThis)
+{
+    if (!pThis->file_crc_check)
+    {
+        return true;
+    }
+    return (pThis->file_crc_offset == pThis->file_data.size) && (pThis->file_crc_value == pThis->file_data.crc32);
+}
+#endif
+
+#if LMODEM_CFG_DELTA
+// hashes of the previous version, until the sender acknowledges them
+static lmodem_pt_status lymodem_send_delta_hashes(modem_context_t* pThis, bool* pAcked)
+{
+    lmodem_frame_delta_rx* pF;
+    pF = &pThis->step.frames.rx.delta;
+
+    LMODEM_PT_BEGIN(pF);
+    pF->bAcked = false;
+    pF->retry = 0;
+    while ((!pF->bAcked) && (pF->retry < 10))
+    {
+        //accept char, nb of hashes, hashes and crc, the crc goes through the provider like the one of a block
+        pF->crc = lmodem_crc_init(pThis);
+        pThis->blk_buffer.buffer[0] = LMODEM_DELTA_ACCEPT;
+        lmodem_put_le32(&pThis->blk_buffer.buffer[1], (pThis->delta_base_size + LMODEM_DELTA_BLOCK_SIZE - 1) / LMODEM_DELTA_BLOCK_SIZE);
+        LMODEM_PT_CRC(pThis, pF, &pThis->blk_buffer.buffer[1], 4, pF->crc);
+        lmodem_putchar(pThis, pThis->blk_buffer.buffer, 1 + 4);
+        pF->offset = 0;
+        while (pF->offset < pThis->delta_base_size)
+        {
+            pF->size = lymodem_build_delta_hashes(pThis, &pF->offset);
+            LMODEM_PT_CRC(pThis, pF, pThis->blk_buffer.buffer, pF->size, pF->crc);
+            lmodem_putchar(pThis, pThis->blk_buffer.buffer, pF->size);
+        }
+        pF->crc = lmodem_crc_final(pThis, pF->crc);
+        pThis->blk_buffer.buffer[0] = (uint8_t) (pF->crc >> 8);
+        pThis->blk_buffer.buffer[1] = (uint8_t) pF->crc;
+        lmodem_putchar(pThis, pThis->blk_buffer.buffer, 2);
+
+        //the sender answers after the whole list, which may take several timeouts on a slow line
+        pF->bReceived = false;
+        for (pF->timeout = 0; (!pF->bReceived) && (pF->timeout < 10); pF->timeout++)
+        {
+            LMODEM_PT_GETCHAR(pThis, pF, &pF->reply, 1, pF->bReceived);
+        }
+        pF->bAcked = (pF->bReceived) && (pF->reply == ACK);
+        if ((pF->bReceived) && ((pF->reply == SOH) || (pF->reply == STX)))
+        {
+            //the ACK was corrupted and the sender is already on the first data block: the hashes are taken as
+            //acknowledged, the block is dropped and asked again
+            pF->bAcked = true;
+        }
+        if ((pF->bReceived) && (pF->reply != ACK) && (pF->reply != NAK))
+        {
+            //noise or the rest of a block: the line is silent before the NAK or the next list
+            LMODEM_PT_CALL(pF, lxmodem_purge_line(pThis));
+        }
+        if ((pF->bAcked) && (pF->reply != ACK))
+        {
+            pF->reply = NAK;
+            lmodem_putchar(pThis, &pF->reply, 1);
+        }
+        pF->retry++;
+    }
+    *pAcked = pF->bAcked;
+    LMODEM_PT_END(pF);
+}
+
+// the hashes from *pOffset which hold in the line buffer, the list is sent by chunks of it
+static uint32_t lymodem_build_delta_hashes(modem_context_t* pThis, uint32_t* pOffset)
+{
+    uint32_t blockSize;
+    uint32_t n;
+
+    n = 0;
+    while ((*pOffset < pThis->delta_base_size) && (n + 4 <= pThis->blk_buffer.max_size))
+    {
+        blockSize = min(LMODEM_DELTA_BLOCK_SIZE, pThis->delta_base_size - *pOffset);
+        lmodem_put_le32(&pThis->blk_buffer.buffer[n], lmodem_delta_hash(&pThis->ramfile.buffer[*pOffset], blockSize));
+        *pOffset += blockSize;
+        n += 4;
+    }
+    return n;
+}
+#endif
+
+bool lymodem_get_meta_data(modem_context_t* pThis, uint8_t* pPayload, uint32_t blksize)
 {
     char* pString;
     char* pEndString;
@@ -525,8 +1234,8 @@ bool lymodem_get_meta_data(modem_context_t* pThis)
 
     bResult = true;
     //set pString at the end of filename
-    pString = (char*) (pThis->blk_buffer.buffer + 2 + strlen(pThis->file_data.filename));
-    pEndString = (pString + pThis->blk_buffer.max_size);
+    pString = (char*) (pPayload + strlen(pThis->file_data.filename));
+    pEndString = (char*) (pPayload + blksize);
 
     while ((*pString == '\0') && (pString < pEndString))
     {
@@ -535,6 +1244,8 @@ bool lymodem_get_meta_data(modem_context_t* pThis)
 
     if (pString < pEndString)
     {
+        //the fields end with their string, the block 0 extension after it is decoded apart
+        pEndString = pString + strnlen(pString, pEndString - pString);
         //decode another fields
         uint32_t nbFields;
         nbFields = 0;
@@ -637,3 +1348,23 @@ char* lymodem_get_next_meta_data_string(char** pString, char* pEndString)
 
     return pResult;
 }
+
+#endif /* LMODEM_CFG_YMODEM */
+
+#else
+
+int32_t lmodem_receive(modem_context_t* pThis, lmodem_protocol protocol)
+{
+    (void) pThis;
+    (void) protocol;
+    return -1;
+}
+
+bool lmodem_start_receive(modem_context_t* pThis, lmodem_protocol protocol)
+{
+    (void) pThis;
+    (void) protocol;
+    return false;
+}
+
+#endif /* LMODEM_CFG_RX */
@@ -0,0 +1,251 @@
+#include "lmodem.h"
+#include "lmodem_priv.h"
+#include <string.h>
+
+// drivers of the transfer protothreads: lmodem_step_run answers each wait with the getchar callback (blocking
+// api), lmodem_step answers it from the rx ring or by DMA and returns while the bytes are not there.
+
+void lmodem_step_begin(modem_context_t* pThis, lmodem_pt_status (*task)(modem_context_t* pThis))
+{
+    memset(&pThis->step, 0, sizeof(lmodem_step_state));
+    pThis->step.task = task;
+    pThis->step.result = -1;
+    pThis->step.running = true;
+}
+
+#if LMODEM_CFG_CRC
+// true when the asynchronous crc update is complete, its result is in crc_value, or has timed out (*pTimeout)
+static bool lmodem_step_poll_crc(modem_context_t* pThis, bool* pTimeout)
+{
+    *pTimeout = false;
+    if (lmodem_crc_poll(pThis, &pThis->step.crc_value))
+    {
+        pThis->step.crc_pending = false;
+        return true;
+    }
+    //same deadline as the received bytes, set when the protocol started to wait
+    if ((pThis->clock_ns != NULL) && (lmodem_now(pThis) >= pThis->step.io.deadline_ns))
+    {
+        pThis->stats.timeouts++;
+        lmodem_trace(pThis, LMODEM_TRACE_TIMEOUT, 0, 0);
+        *pTimeout = true;
+        return true;
+    }
+    return false;
+}
+#endif
+
+static void lmodem_step_end(modem_context_t* pThis)
+{
+    pThis->step.running = false;
+    pThis->step.io.pending = false;
+    lmodem_stats_stop(pThis);
+}
+
+int32_t lmodem_step_run(modem_context_t* pThis)
+{
+    lmodem_io_request* pIo;
+
+    pIo = &pThis->step.io;
+    while (pThis->step.task(pThis) == LMODEM_PT_WAITING)
+    {
+#if LMODEM_CFG_CRC
+        if (pThis->step.crc_pending)
+        {
+            if (!lmodem_crc_wait(pThis, &pThis->step.crc_value))
+            {
+                //the provider never completed: the transfer fails instead of hanging
+                lxmodem_build_and_send_cancel(pThis);
+                pThis->step.result = -1;
+                break;
+            }
+            pThis->step.crc_pending = false;
+            continue;
+        }
+#endif
+        //getchar has no idle line detection, a frame of unknown size is read from its first byte
+        if (pIo->up_to)
+        {
+            pIo->size = 1;
+        }
+        pIo->result = lmodem_getchar(pThis, pIo->data, pIo->size);
+        pIo->done = (pIo->result) ? pIo->size : 0;
+        pIo->pending = false;
+    }
+    lmodem_step_end(pThis);
+    return pThis->step.result;
+}
+
+#if LMODEM_CFG_DMA
+bool lmodem_set_rx_dma(modem_context_t* pThis, void (*start)(modem_context_t* pThis, uint8_t* data, uint32_t size),
+                       uint64_t timeoutNs)
+{
+    if ((pThis->blk_buffer.buffer == NULL) || (pThis->blk_buffer.max_size < LMODEM_LINE_BUFFER_MIN_SIZE)
+            || (((uintptr_t) pThis->blk_buffer.buffer % LMODEM_DMA_ALIGNMENT) != 0))
+    {
+        return false;
+    }
+
+    pThis->rx_dma_start = start;
+    pThis->rx_timeout_ns = timeoutNs;
+    lmodem_ring_store_release(&pThis->rx_dma_result, 0);
+    return true;
+}
+
+void lmodem_rx_dma_complete(modem_context_t* pThis, uint32_t nbReceived)
+{
+    lmodem_ring_store_release(&pThis->rx_dma_result, LMODEM_DMA_DONE | nbReceived);
+}
+
+// the DMA is armed as soon as the protocol waits, before the reply it has just sent gets an answer
+static void lmodem_step_arm_dma(modem_context_t* pThis)
+{
+    lmodem_io_request* pIo;
+
+    pIo = &pThis->step.io;
+    if ((pThis->rx_dma_start != NULL) && (pIo->pending) && (!pIo->armed))
+    {
+        lmodem_ring_store_release(&pThis->rx_dma_result, 0);
+        pIo->armed = true;
+        pThis->rx_dma_start(pThis, pIo->data + pIo->done, pIo->size - pIo->done);
+    }
+}
+
+// nb of bytes of a completed DMA reception, 0 while it runs
+static uint32_t lmodem_step_poll_dma(modem_context_t* pThis)
+{
+    uint32_t dmaResult;
+
+    if (!pThis->step.io.armed)
+    {
+        return 0;
+    }
+
+    dmaResult = lmodem_ring_load_acquire(&pThis->rx_dma_result);
+    if ((dmaResult & LMODEM_DMA_DONE) == 0)
+    {
+        return 0;
+    }
+    pThis->step.io.armed = false;
+    return dmaResult & ~LMODEM_DMA_DONE;
+}
+#endif
+
+// true when the request is complete or has timed out
+static bool lmodem_step_receive(modem_context_t* pThis)
+{
+    lmodem_io_request* pIo;
+    uint32_t nbRead;
+    uint64_t now;
+
+    pIo = &pThis->step.io;
+#if LMODEM_CFG_DMA
+    if (pThis->rx_dma_start != NULL)
+    {
+        nbRead = lmodem_step_poll_dma(pThis);
+    }
+    else
+#endif
+    {
+        nbRead = lmodem_ring_pop(pThis->rx_ring, pIo->data + pIo->done, pIo->size - pIo->done);
+    }
+    now = lmodem_now(pThis);
+    if (nbRead > 0)
+    {
+        //inter-byte timeout, like lmodem_ring_getchar
+        pIo->done += nbRead;
+        pIo->deadline_ns = now + pThis->rx_timeout_ns;
+    }
+
+    if ((pIo->done == pIo->size) || ((pIo->up_to) && (pIo->done > 0)))
+    {
+        pIo->result = true;
+    }
+    else if ((pThis->clock_ns != NULL) && (now >= pIo->deadline_ns))
+    {
+        pIo->result = false;
+#if LMODEM_CFG_DMA
+        if (pIo->armed)
+        {
+            pThis->rx_dma_start(pThis, NULL, 0);
+            pIo->armed = false;
+        }
+#endif
+    }
+    else
+    {
+#if LMODEM_CFG_DMA
+        //partial DMA reception (idle line), the remaining bytes are requested again
+        lmodem_step_arm_dma(pThis);
+#endif
+        return false;
+    }
+
+    pIo->pending = false;
+    lmodem_getchar_done(pThis, pIo->data, (pIo->result) ? pIo->done : pIo->size, pIo->result);
+    return true;
+}
+
+lmodem_step_status lmodem_step(modem_context_t* pThis)
+{
+    lmodem_step_state* pStep;
+#if LMODEM_CFG_CRC
+    bool bTimeout;
+#endif
+
+    pStep = &pThis->step;
+#if LMODEM_CFG_DMA
+    if ((!pStep->running) || ((pThis->rx_ring == NULL) && (pThis->rx_dma_start == NULL)))
+#else
+    if ((!pStep->running) || (pThis->rx_ring == NULL))
+#endif
+    {
+        return ((!pStep->running) && (pStep->task != NULL) && (pStep->result >= 0)) ? LMODEM_STEP_DONE : LMODEM_STEP_ERROR;
+    }
+
+    //bounded work: the completion of one wait, then the protocol runs until its next wait
+    if ((pStep->io.pending) && (!lmodem_step_receive(pThis)))
+    {
+        return LMODEM_STEP_WOULD_BLOCK;
+    }
+#if LMODEM_CFG_CRC
+    if (pStep->crc_pending)
+    {
+        if (!lmodem_step_poll_crc(pThis, &bTimeout))
+        {
+            return LMODEM_STEP_WOULD_BLOCK;
+        }
+        if (bTimeout)
+        {
+            //the provider never completed: the transfer fails instead of waiting forever, like lmodem_step_run
+            lxmodem_build_and_send_cancel(pThis);
+            pStep->result = -1;
+            lmodem_step_end(pThis);
+            return LMODEM_STEP_ERROR;
+        }
+    }
+#endif
+
+    if (pStep->task(pThis) == LMODEM_PT_WAITING)
+    {
+        pStep->io.deadline_ns = lmodem_now(pThis) + pThis->rx_timeout_ns;
+#if LMODEM_CFG_CRC
+        if (pStep->crc_pending)
+        {
+            pStep->io.deadline_ns = lmodem_now(pThis) + lmodem_crc_timeout(pThis);
+        }
+#endif
+#if LMODEM_CFG_DMA
+        lmodem_step_arm_dma(pThis);
+#endif
+        return LMODEM_STEP_WOULD_BLOCK;
+    }
+
+    lmodem_step_end(pThis);
+    return (pStep->result >= 0) ? LMODEM_STEP_DONE : LMODEM_STEP_ERROR;
+}
+
+int32_t lmodem_get_result(modem_context_t* pThis)
+{
+    return pThis->step.result;
+}
@@ -0,0 +1,60 @@
+#include "lmodem_trace.h"
+#include <stddef.h>
+
+static const char* const lmodem_trace_type_names[LMODEM_TRACE_NB_TYPES] =
+{
+    "tx",
+    "rx",
+    "timeout",
+    "block",
+    "nak",
+    "state",
+};
+
+static const char* const lmodem_trace_state_names[LMODEM_STATE_NB] =
+{
+    "handshake",
+    "data",
+    "done",
+    "cancel",
+};
+
+void lmodem_trace_reset(lmodem_trace_ring* pThis)
+{
+    pThis->head = 0;
+}
+
+uint32_t lmodem_trace_get_count(lmodem_trace_ring* pThis)
+{
+    uint32_t count;
+    count = 0;
+    if (pThis->events != NULL)
+    {
+        count = (pThis->head > pThis->mask) ? (pThis->mask + 1) : pThis->head;
+    }
+    return count;
+}
+
+const lmodem_trace_event* lmodem_trace_get_event(lmodem_trace_ring* pThis, uint32_t index)
+{
+    const lmodem_trace_event* pEvent;
+    uint32_t count;
+
+    pEvent = NULL;
+    count = lmodem_trace_get_count(pThis);
+    if (index < count)
+    {
+        pEvent = &pThis->events[(pThis->head - count + index) & pThis->mask];
+    }
+    return pEvent;
+}
+
+const char* lmodem_trace_type_name(uint8_t type)
+{
+    return (type < LMODEM_TRACE_NB_TYPES) ? lmodem_trace_type_names[type] : "unknown";
+}
+
+const char* lmodem_trace_state_name(uint8_t state)
+{
+    return (state < LMODEM_STATE_NB) ? lmodem_trace_state_names[state] : "unknown";
+}
@@ -4,80 +4,187 @@
 #include <string.h>
 #include <stdio.h>
 
-static  int32_t lxmodem_emit(modem_context_t* pThis);
-static int32_t lymodem_emit(modem_context_t* pThis);
+#if LMODEM_CFG_TX
+
+static lmodem_pt_status lmodem_emit_task(modem_context_t* pThis);
+static lmodem_pt_status lxmodem_emit(modem_context_t* pThis, int32_t* pEmittedBytes);
 static bool lxmodem_decode_preambule(modem_context_t* pThis, uint8_t preambule);
-static int32_t lxmode_send_data_blocks(modem_context_t* pThis);
-static bool lxmode_build_and_send_one_data_block(modem_context_t* pThis, uint8_t blkNo, uint32_t defaultBlksize, bool withCrc,
-        int32_t* nbEmitted);
-static void lxmode_reemit_previous_block(modem_context_t* pThis);
-static bool lymodem_build_and_send_block0(modem_context_t* pThis);
-static void lymodem_send_end_of_bach(modem_context_t* pThis);
-static bool lmodem_wait_reception_of(modem_context_t* pThis, uint8_t cntrlChar);
-static bool lmodem_wait_reception(modem_context_t* pThis, uint8_t* pReceived);
+static lmodem_pt_status lxmode_send_data_blocks(modem_context_t* pThis, int32_t* pEmittedBytes);
+static int32_t lxmode_build_one_data_block(modem_context_t* pThis, lmodem_linebuffer* pLine, uint8_t blkNo, uint32_t defaultBlksize,
+        int32_t* pRawSize);
+static lmodem_pt_status lxmode_add_trailer(modem_context_t* pThis, lmodem_linebuffer* pLine, uint32_t effectiveBlksize, bool withCrc);
+static int32_t lxmode_read_block_data(modem_context_t* pThis, uint8_t* data, uint32_t size);
+static int32_t lxmode_read_raw_data(modem_context_t* pThis, uint8_t* data, uint32_t size);
+static uint32_t lxmode_frame_payload(uint8_t* pBlock, uint32_t bytesRead, uint8_t blkNo);
+static int32_t lxmode_get_cached_block(modem_context_t* pThis, uint32_t index, const uint8_t** ppBlock, uint32_t* pBlockSize);
+static void lxmode_reemit_previous_block(modem_context_t* pThis, const uint8_t* pBlock, uint32_t blockSize);
+static bool lmodem_is_line_buffer_large_enough(modem_context_t* pThis, const lmodem_linebuffer* pLine);
+#if LMODEM_CFG_YMODEM
+static lmodem_pt_status lymodem_emit(modem_context_t* pThis, int32_t* pEmittedBytes);
+static uint32_t lymodem_build_block0(modem_context_t* pThis);
+static int32_t lymodem_build_block0_extension(modem_context_t* pThis, char* pStart, char* pEnd);
+static void lymodem_build_end_of_bach(modem_context_t* pThis);
+static lmodem_pt_status lmodem_wait_reception_of(modem_context_t* pThis, uint8_t cntrlChar, bool* pOk);
+static lmodem_pt_status lmodem_wait_reception(modem_context_t* pThis, uint8_t* pReceived);
+#endif
+#if LMODEM_CFG_COMPRESS
+static bool lymodem_is_compression_offered(modem_context_t* pThis);
+#endif
+#if LMODEM_CFG_DELTA
+static bool lymodem_is_delta_offered(modem_context_t* pThis);
+static lmodem_pt_status lymodem_receive_delta_hashes(modem_context_t* pThis);
+#endif
+#if LMODEM_CFG_FILE_CRC
+static bool lymodem_get_file_crc(modem_context_t* pThis, uint32_t* pCrc);
+#endif
+#if LMODEM_CFG_COMPRESS || LMODEM_CFG_DELTA
+static int32_t lxmode_read_encoder_source(void* pArg, uint8_t* data, uint32_t size);
+static bool lxmode_get_encoder_raw_bytes(modem_context_t* pThis, uint64_t* pRawBytes);
+#endif
 
 int32_t lmodem_emit(modem_context_t* pThis, lmodem_protocol protocol)
 {
-    int32_t emittedBytes;
-    emittedBytes = -1;
+    if (!lmodem_start_emit(pThis, protocol))
+    {
+        return -1;
+    }
+    return lmodem_step_run(pThis);
+}
+
+bool lmodem_start_emit(modem_context_t* pThis, lmodem_protocol protocol)
+{
+    uint64_t bytesTotal;
 
     pThis->protocol = protocol;
-    switch (protocol)
+    pThis->step.running = false;
+    pThis->step.result = -1;
+#if LMODEM_CFG_COMPRESS
+    pThis->compressed = false;
+#endif
+#if LMODEM_CFG_DELTA
+    pThis->delta = false;
+#endif
+#if LMODEM_CFG_FILE_CRC
+    pThis->file_crc_offered = false;
+    pThis->skipped = false;
+#endif
+    if (!lmodem_is_line_buffer_large_enough(pThis, &pThis->blk_buffer))
     {
-        case XMODEM:
-            emittedBytes = lxmodem_emit(pThis);
-            break;
-
-        case YMODEM:
-            emittedBytes = lymodem_emit(pThis);
-            break;
+        //e.g. line buffer set for a low memory reception
+        DBG("line buffer too small for emission\n");
+        return false;
+    }
 
-        default:
-            break;
+    bytesTotal = lmodem_buffer_get_size(&pThis->ramfile);
+    if (pThis->read_data != NULL)
+    {
+        bytesTotal = 0;
+#if LMODEM_CFG_YMODEM
+        if ((pThis->file_data.valid & LMODEM_METADATA_FILESIZE_VALID) == LMODEM_METADATA_FILESIZE_VALID)
+        {
+            bytesTotal = pThis->file_data.size;
+        }
+#endif
     }
 
-    return emittedBytes;
+    lmodem_stats_start(pThis);
+    lmodem_progress_start(pThis, bytesTotal);
+    lmodem_step_begin(pThis, lmodem_emit_task);
+    return true;
+}
+
+static lmodem_pt_status lmodem_emit_task(modem_context_t* pThis)
+{
+    lmodem_step_state* pF;
+    pF = &pThis->step;
+
+    LMODEM_PT_BEGIN(pF);
+    if (pThis->protocol == XMODEM)
+    {
+        LMODEM_PT_CALL(pF, lxmodem_emit(pThis, &pF->result));
+    }
+#if LMODEM_CFG_YMODEM
+    else if (pThis->protocol == YMODEM)
+    {
+        LMODEM_PT_CALL(pF, lymodem_emit(pThis, &pF->result));
+    }
+#endif
+    LMODEM_PT_END(pF);
 }
 
+static bool lmodem_is_line_buffer_large_enough(modem_context_t* pThis, const lmodem_linebuffer* pLine)
+{
+    uint32_t expectedSize;
+
+    if ((pThis->protocol == YMODEM) || (pThis->opts == lxmodem_1k))
+    {
+        expectedSize = LXMODEM_1K_BUFFER_MIN_SIZE;
+    }
+    else if (pThis->opts == lxmodem_128_with_crc)
+    {
+        expectedSize = LXMODEM_128_CRC_BUFFER_MIN_SIZE;
+    }
+    else
+    {
+        expectedSize = LXMODEM_128_CHKSUM_BUFFER_MIN_SIZE;
+    }
+
+    return (pLine->max_size >= expectedSize);
+}
 
-static int32_t lxmodem_emit(modem_context_t* pThis)
+static lmodem_pt_status lxmodem_emit(modem_context_t* pThis, int32_t* pEmittedBytes)
 {
-    uint32_t timeout;
-    uint32_t emittedBytes;
-    uint8_t preambule;
-    bool bReceived;
+    lmodem_frame_xmodem_tx* pF;
+    bool bCanContinue;
+    pF = &pThis->step.frames.tx.xmodem;
 
-    emittedBytes = 0;
-    bReceived = false;
-    timeout = 0;
-    while ((bReceived == false) && (timeout < 10))
+    LMODEM_PT_BEGIN(pF);
+    pF->emittedBytes = 0;
+    pF->bReceived = false;
+    pF->timeout = 0;
+    while ((pF->bReceived == false) && (pF->timeout < 10))
     {
         //wait preambule
-        bReceived = lmodem_getchar(pThis, &preambule, 1);
-        if (bReceived)
+        LMODEM_PT_GETCHAR(pThis, pF, &pF->preambule, 1, pF->bReceived);
+        if (pF->bReceived)
         {
             break;
         }
-        timeout++;
+        pF->timeout++;
     }
 
-    if (bReceived)
+    if (pF->bReceived)
     {
-        bool bCanContinue;
-        bCanContinue = lxmodem_decode_preambule(pThis, preambule);
+        lmodem_stats_handshake_done(pThis);
+#if LMODEM_CFG_DELTA
+        if ((pF->preambule == LMODEM_DELTA_ACCEPT) && (pThis->protocol == YMODEM) && (lymodem_is_delta_offered(pThis)))
+        {
+            //the hashes of the receiver come before the data blocks
+            LMODEM_PT_CALL(pF, lymodem_receive_delta_hashes(pThis));
+        }
+#endif
+        bCanContinue = lxmodem_decode_preambule(pThis, pF->preambule);
         if (!bCanContinue)
         {
             DBG("options are not compatible stop...\n");
             lxmodem_build_and_send_cancel(pThis);
-            emittedBytes = -1;
+            pF->emittedBytes = -1;
+        }
+#if LMODEM_CFG_FILE_CRC
+        else if (pThis->skipped)
+        {
+            //the receiver already has the file, it ends the transfer as if it was sent
+            pF->emittedBytes = (int32_t) pThis->file_data.size;
         }
+#endif
         else
         {
-            emittedBytes = lxmode_send_data_blocks(pThis);
+            LMODEM_PT_CALL(pF, lxmode_send_data_blocks(pThis, &pF->emittedBytes));
         }
     }
 
-    return emittedBytes;
+    *pEmittedBytes = pF->emittedBytes;
+    LMODEM_PT_END(pF);
 }
 
 
@@ -100,343 +207,659 @@ static bool lxmodem_decode_preambule(modem_context_t* pThis, uint8_t preambule)
                 bCanContinue = true;
             }
             break;
+
+#if LMODEM_CFG_COMPRESS
+        case LMODEM_COMPRESS_ACCEPT:
+            //answer of a receiver to the offer of block 0
+            if ((pThis->protocol == YMODEM) && (lymodem_is_compression_offered(pThis)))
+            {
+                lmodem_compress_init(pThis->compressor);
+                pThis->compressed = true;
+                bCanContinue = true;
+            }
+            break;
+#endif
+
+#if LMODEM_CFG_DELTA
+        case LMODEM_DELTA_ACCEPT:
+            //the hashes of the receiver have been received
+            bCanContinue = pThis->delta;
+            break;
+#endif
+
+#if LMODEM_CFG_FILE_CRC
+        case LMODEM_FILE_CRC_SKIP:
+            //the receiver has a file of the size and crc32 of block 0
+            if ((pThis->protocol == YMODEM) && (pThis->file_crc_offered))
+            {
+                pThis->skipped = true;
+                bCanContinue = true;
+            }
+            break;
+#endif
     }
     return bCanContinue;
 }
 
-static int32_t lxmode_send_data_blocks(modem_context_t* pThis)
+static lmodem_pt_status lxmode_send_data_blocks(modem_context_t* pThis, int32_t* pEmittedBytes)
 {
-    bool bFinished;
-    bool withCrc;
-    uint32_t defaultBlksize;
-    uint8_t blkNo;
-    uint32_t emittedBytes;
-    int32_t nbEmitted;
-
-    defaultBlksize = 128;
-    emittedBytes = 0;
-    withCrc = false;
-
-    if (pThis->protocol == XMODEM)
+    lmodem_frame_blocks_tx* pF;
+    pF = &pThis->step.frames.tx.blocks;
+
+    LMODEM_PT_BEGIN(pF);
+    pF->emittedBytes = 0;
+    lxmode_get_block_format(pThis, pThis->protocol, &pF->defaultBlksize, &pF->withCrc);
+
+    pF->blkNo = 1;
+    pF->blkIndex = 0;
+    pF->bFinished = false;
+    pF->timeout = 0;
+    pF->retry = 0;
+    pF->isLastBlock = false;
+    pF->bNextReady = false;
+    pF->nbNextEmitted = 0;
+    //cached blocks are ready, nothing to build during the ACK wait
+    pF->bDoubleBuffer = (pThis->get_block == NULL) && lmodem_is_line_buffer_large_enough(pThis, &pThis->next_blk_buffer);
+
+    while (!pF->bFinished)
     {
-        switch (pThis->opts)
+        if (pF->retry == 0)
         {
-            case lxmodem_128_with_chksum:
-                defaultBlksize = 128;
-                withCrc = false;
-                break;
-
-            case lxmodem_128_with_crc:
-                defaultBlksize = 128;
-                withCrc = true;
-                break;
+            if (pF->bNextReady)
+            {
+                //the block built during the ACK wait goes out immediately
+                lmodem_linebuffer previous = pThis->blk_buffer;
+                pThis->blk_buffer = pThis->next_blk_buffer;
+                pThis->next_blk_buffer = previous;
+                pF->nbEmitted = pF->nbNextEmitted;
+                pF->nbRaw = pF->nbNextRaw;
+                pF->bNextReady = false;
+            }
+            else if (pThis->get_block != NULL)
+            {
+                pF->nbEmitted = lxmode_get_cached_block(pThis, pF->blkIndex, &pF->pBlock, &pF->blockSize);
+                pF->nbRaw = pF->nbEmitted;
+            }
+            else
+            {
+                pF->nbEmitted = lxmode_build_one_data_block(pThis, &pThis->blk_buffer, pF->blkNo, pF->defaultBlksize, &pF->nbRaw);
+                if (pF->nbEmitted > 0)
+                {
+                    LMODEM_PT_CALL(pF, lxmode_add_trailer(pThis, &pThis->blk_buffer, pF->nbEmitted, pF->withCrc));
+                }
+            }
+            if ((pThis->get_block == NULL) || (pF->nbEmitted == 0))
+            {
+                pF->pBlock = pThis->blk_buffer.buffer;
+                pF->blockSize = pThis->blk_buffer.current_size;
+            }
 
-            case lxmodem_1k:
-                defaultBlksize = 1024;
-                withCrc = true;
+            if (pF->nbEmitted < 0)
+            {
+                DBG("data source error, cancel\n");
+                lxmodem_build_and_send_cancel(pThis);
+                pF->emittedBytes = -1;
                 break;
+            }
 
-            default:
-                break;
+            pF->isLastBlock = (pF->nbEmitted == 0);
+            lmodem_putchar(pThis, (uint8_t*) pF->pBlock, pF->blockSize);
+            if (pF->isLastBlock == false)
+            {
+                pThis->stats.blocks_sent++;
+            }
         }
-    }
-    else if (pThis->protocol == YMODEM)
-    {
-        defaultBlksize = 1024;
-        withCrc = true;
-    }
-
-    blkNo = 1;
-    bFinished = false;
-    uint8_t ackBytes;
-    uint32_t retry;
-    uint32_t timeout;
-    bool bAckReceived;
-    bool isLastBlock;
-
-    timeout = 0;
-    retry = 0;
-
-    while (!bFinished)
-    {
-        if (retry == 0)
+        else
         {
-            isLastBlock = lxmode_build_and_send_one_data_block(pThis, blkNo, defaultBlksize, withCrc, &nbEmitted);
+            lxmode_reemit_previous_block(pThis, pF->pBlock, pF->blockSize);
         }
-        else
+        pF->sendTime = lmodem_now(pThis);
+
+        if ((pF->bDoubleBuffer) && (!pF->bNextReady) && (!pF->isLastBlock))
         {
-            lxmode_reemit_previous_block(pThis);
+            //read, pad and crc of the next block overlap the round trip of the current one
+            pF->nbNextEmitted = lxmode_build_one_data_block(pThis, &pThis->next_blk_buffer, pF->blkNo + 1, pF->defaultBlksize,
+                                &pF->nbNextRaw);
+            if (pF->nbNextEmitted > 0)
+            {
+                LMODEM_PT_CALL(pF, lxmode_add_trailer(pThis, &pThis->next_blk_buffer, pF->nbNextEmitted, pF->withCrc));
+            }
+            pF->bNextReady = true;
         }
 
-        bAckReceived = false;
-        timeout = 0;
-        while ((bAckReceived == false) && (timeout < 10))
+        pF->bAckReceived = false;
+#if LMODEM_CFG_DELTA
+        pF->bHashesAgain = false;
+#endif
+        pF->timeout = 0;
+        while ((pF->bAckReceived == false) && (pF->timeout < 10))
         {
-            bAckReceived = lmodem_getchar(pThis, &ackBytes, 1);
-            timeout++;
+            LMODEM_PT_GETCHAR(pThis, pF, &pF->ackBytes, 1, pF->bAckReceived);
+            pF->timeout++;
         }
 
-        if (bAckReceived)
+        if (pF->bAckReceived)
         {
-            switch (ackBytes)
+            switch (pF->ackBytes)
             {
                 case ACK:
-                    blkNo++;
-                    if (isLastBlock == false)
+                    pF->blkNo++;
+                    pF->blkIndex++;
+                    lmodem_stats_ack_rtt(pThis, pF->sendTime);
+                    if (pF->isLastBlock == false)
                     {
-                        emittedBytes += nbEmitted;
+                        pF->emittedBytes += pF->nbRaw;
+                        pThis->stats.payload_bytes += pF->nbRaw;
+                        lmodem_trace(pThis, LMODEM_TRACE_BLOCK, pF->blkNo - 1, pF->nbEmitted);
+                        if (pThis->progress != NULL)
+                        {
+                            lmodem_progress_update(pThis, pF->nbRaw);
+                        }
                     }
                     else
                     {
-                        bFinished = true;//we have send the last block
+                        pF->bFinished = true;//we have send the last block
                     }
-                    retry = 0;
+                    pF->retry = 0;
                     break;
 
                 case NAK:
-                    retry++;
+                    pThis->stats.naks_received++;
+                    lmodem_trace(pThis, LMODEM_TRACE_NAK, pF->blkNo, 0);
+                    pF->retry++;
                     break;
 
                 case CAN:
-                default:
-                    retry++;
-                    if (retry >= 2)
+                    pThis->stats.cans_received++;
+                    lmodem_trace(pThis, LMODEM_TRACE_STATE, LMODEM_STATE_CANCEL, 0);
+                    pF->retry++;
+                    if (pF->retry >= 2)
                     {
-                        emittedBytes = -1;
-                        bFinished = true;
+                        pF->emittedBytes = -1;
+                        pF->bFinished = true;
                     }
                     break;
+
+                default:
+                    //corrupted reply, the block is emitted again (a duplicate is acknowledged by the receiver)
+#if LMODEM_CFG_DELTA
+                    pF->bHashesAgain = (pThis->delta) && (pF->blkIndex == 0) && (pF->ackBytes == LMODEM_DELTA_ACCEPT);
+#endif
+                    pF->retry++;
+                    break;
+            }
+#if LMODEM_CFG_DELTA
+            //the wait is out of the switch on the reply
+            if (pF->bHashesAgain)
+            {
+                //the ACK of the hashes was corrupted: the list is acknowledged again, then the first block is emitted again
+                LMODEM_PT_CALL(pF, lymodem_receive_delta_hashes(pThis));
             }
+#endif
         }
         else
         {
-            retry++;
+            pF->retry++;
         }
-        if (retry >= 10)
+        if (pF->retry >= 10)
         {
-            emittedBytes = -1;
-            bFinished = true;
+            pF->emittedBytes = -1;
+            pF->bFinished = true;
         }
     }
 
-    return emittedBytes;
+    *pEmittedBytes = pF->emittedBytes;
+    LMODEM_PT_END(pF);
 }
 
-bool lxmode_build_and_send_one_data_block(modem_context_t* pThis, uint8_t blkNo, uint32_t defaultBlksize,  bool withCrc,
-        int32_t* nbEmitted)
+static int32_t lxmode_read_block_data(modem_context_t* pThis, uint8_t* data, uint32_t size)
 {
-    uint32_t remainingBytes;
-    uint32_t bytesToRead;
-    uint32_t effectiveBlksize;
-    uint32_t datablockSize;
+#if LMODEM_CFG_COMPRESS
+    if (pThis->compressed)
+    {
+        //the compressor reads the source, each block is filled with compressed bytes
+        return lmodem_compress_read(pThis->compressor, lxmode_read_encoder_source, pThis, data, size);
+    }
+#endif
+#if LMODEM_CFG_DELTA
+    if (pThis->delta)
+    {
+        //the blocks which differ from the ones of the receiver, with their offsets
+        return lmodem_delta_read(pThis->delta_encoder, lxmode_read_encoder_source, pThis, data, size);
+    }
+#endif
+    return lxmode_read_raw_data(pThis, data, size);
+}
 
-    effectiveBlksize = defaultBlksize;
-    *nbEmitted = 0;
-    bytesToRead = 0;
-    remainingBytes = lmodem_buffer_get_size(&pThis->ramfile);
+#if LMODEM_CFG_COMPRESS || LMODEM_CFG_DELTA
+static int32_t lxmode_read_encoder_source(void* pArg, uint8_t* data, uint32_t size)
+{
+    return lxmode_read_raw_data((modem_context_t*) pArg, data, size);
+}
 
-    bytesToRead = min(defaultBlksize, remainingBytes);
-    if (bytesToRead == 0)
+// source bytes read by the compressor or the delta encoder, false when the blocks are raw
+static bool lxmode_get_encoder_raw_bytes(modem_context_t* pThis, uint64_t* pRawBytes)
+{
+#if LMODEM_CFG_COMPRESS
+    if (pThis->compressed)
     {
-        pThis->blk_buffer.buffer[0] = EOT;
-        lmodem_putchar(pThis,  pThis->blk_buffer.buffer, 1);
-        pThis->blk_buffer.current_size = 1;
+        *pRawBytes = pThis->compressor->raw_bytes;
+        return true;
     }
-    else
+#endif
+#if LMODEM_CFG_DELTA
+    if (pThis->delta)
+    {
+        *pRawBytes = pThis->delta_encoder->raw_bytes;
+        return true;
+    }
+#endif
+    return false;
+}
+#endif
+
+static int32_t lxmode_read_raw_data(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    int32_t nbRead;
+    int32_t n;
+
+    if (pThis->read_data == NULL)
+    {
+        return lmodem_buffer_read(&pThis->ramfile, data, size);
+    }
+
+    //the source may return less than asked, the block is filled until the end of the data
+    nbRead = 0;
+    while (nbRead < (int32_t) size)
     {
-        if (bytesToRead <= 128)
+        n = pThis->read_data(pThis, data + nbRead, size - nbRead);
+        if (n < 0)
         {
-            pThis->blk_buffer.buffer[0] = SOH;
-            effectiveBlksize = 128;
+            return -1;
         }
-        else
+        if (n == 0)
         {
-            pThis->blk_buffer.buffer[0] = STX;
-            effectiveBlksize = 1024;
+            break;
         }
+        nbRead += n;
+    }
+    return nbRead;
+}
 
-        pThis->blk_buffer.buffer[1] = blkNo;
-        pThis->blk_buffer.buffer[2] = ~blkNo;
+// returns the payload size of the block built in pLine (its trailer is added by lxmode_add_trailer), 0 for the
+// EOT, -1 on a data source error. *pRawSize is the payload size, or the file bytes it stands for once decoded.
+static int32_t lxmode_build_one_data_block(modem_context_t* pThis, lmodem_linebuffer* pLine, uint8_t blkNo, uint32_t defaultBlksize,
+        int32_t* pRawSize)
+{
+    int32_t bytesRead;
+    int32_t effectiveBlksize;
+#if LMODEM_CFG_COMPRESS || LMODEM_CFG_DELTA
+    uint64_t rawBefore;
+    uint64_t rawAfter;
+
+    rawBefore = 0;
+    lxmode_get_encoder_raw_bytes(pThis, &rawBefore);
+#endif
+
+    *pRawSize = 0;
+    bytesRead = lxmode_read_block_data(pThis, pLine->buffer + 3, defaultBlksize);
+    if (bytesRead < 0)
+    {
+        return -1;
+    }
 
-        lmodem_buffer_read(&pThis->ramfile, pThis->blk_buffer.buffer + 3, bytesToRead);
+    if (bytesRead == 0)
+    {
+        pLine->buffer[0] = EOT;
+        pLine->current_size = 1;
+        return 0;
+    }
 
-        if (remainingBytes < effectiveBlksize)
-        {
-            memset(pThis->blk_buffer.buffer + 3 + bytesToRead, SUB, effectiveBlksize - remainingBytes);
-        }
+    effectiveBlksize = lxmode_frame_payload(pLine->buffer, bytesRead, blkNo);
+    *pRawSize = effectiveBlksize;
+#if LMODEM_CFG_COMPRESS || LMODEM_CFG_DELTA
+    if (lxmode_get_encoder_raw_bytes(pThis, &rawAfter))
+    {
+        *pRawSize = (int32_t) (rawAfter - rawBefore);
+    }
+#endif
+    return effectiveBlksize;
+}
 
-        datablockSize = 3 + effectiveBlksize + 1;
-        if (withCrc)
-        {
-            uint16_t crc;
-            crc = crc16_doCalcul(&pThis->crc16, pThis->blk_buffer.buffer + 3, effectiveBlksize, LXMODEM_CRC16_INIT_VALUE, LXMODEM_CRC16_XOR_FINAL);
-            pThis->blk_buffer.buffer[3 + effectiveBlksize] = (crc & 0xFF00) >> 8;
-            pThis->blk_buffer.buffer[3 + effectiveBlksize + 1] = (crc & 0x00FF);
-            datablockSize += 1;
-        }
-        else
+// header and padding around the bytesRead bytes of payload already in pBlock, returns the payload size
+static uint32_t lxmode_frame_payload(uint8_t* pBlock, uint32_t bytesRead, uint8_t blkNo)
+{
+    uint32_t effectiveBlksize;
+
+    if (bytesRead <= 128)
+    {
+        pBlock[0] = SOH;
+        effectiveBlksize = 128;
+    }
+    else
+    {
+        pBlock[0] = STX;
+        effectiveBlksize = 1024;
+    }
+
+    pBlock[1] = blkNo;
+    pBlock[2] = ~blkNo;
+
+    if (bytesRead < effectiveBlksize)
+    {
+        memset(pBlock + 3 + bytesRead, SUB, effectiveBlksize - bytesRead);
+    }
+
+    return effectiveBlksize;
+}
+
+// writes the crc given, or the checksum, after the payload of the block, returns the size of the block
+static uint32_t lxmode_put_trailer(uint8_t* pBlock, uint32_t effectiveBlksize, bool withCrc, uint16_t crc)
+{
+    uint32_t blockSize;
+
+    blockSize = 3 + effectiveBlksize + 1;
+    if (withCrc)
+    {
+        pBlock[3 + effectiveBlksize] = (crc & 0xFF00) >> 8;
+        pBlock[3 + effectiveBlksize + 1] = (crc & 0x00FF);
+        blockSize += 1;
+    }
+    else
+    {
+#if LMODEM_CFG_XMODEM_CHKSUM
+        pBlock[3 + effectiveBlksize] = lxmodem_calcul_chksum(pBlock + 3, effectiveBlksize);
+#endif
+    }
+    return blockSize;
+}
+
+// crc (through the provider, which may compute it in background) or checksum of the block built in pLine
+static lmodem_pt_status lxmode_add_trailer(modem_context_t* pThis, lmodem_linebuffer* pLine, uint32_t effectiveBlksize, bool withCrc)
+{
+    lmodem_frame_trailer* pF;
+    pF = &pThis->step.frames.tx.trailer;
+
+    LMODEM_PT_BEGIN(pF);
+    pF->crc = 0;
+#if LMODEM_CFG_CRC
+    if (withCrc)
+    {
+        pF->crc = lmodem_crc_init(pThis);
+        LMODEM_PT_CRC(pThis, pF, pLine->buffer + 3, effectiveBlksize, pF->crc);
+        pF->crc = lmodem_crc_final(pThis, pF->crc);
+    }
+#endif
+    pLine->current_size = lxmode_put_trailer(pLine->buffer, effectiveBlksize, withCrc, pF->crc);
+    LMODEM_PT_END(pF);
+}
+
+// returns the payload size of the cached data block index, 0 for the EOT built in the line buffer after the last one
+static int32_t lxmode_get_cached_block(modem_context_t* pThis, uint32_t index, const uint8_t** ppBlock, uint32_t* pBlockSize)
+{
+    *ppBlock = pThis->get_block(pThis, index, pBlockSize);
+    if (*ppBlock == NULL)
+    {
+        pThis->blk_buffer.buffer[0] = EOT;
+        pThis->blk_buffer.current_size = 1;
+        return 0;
+    }
+    return ((*ppBlock)[0] == STX) ? LXMODEM_BLOCK_SIZE_1024 : LXMODEM_BLOCK_SIZE_128;
+}
+
+void lxmode_get_block_format(modem_context_t* pThis, lmodem_protocol protocol, uint32_t* pDefaultBlksize, bool* pWithCrc)
+{
+    *pDefaultBlksize = 128;
+    *pWithCrc = false;
+
+    if (protocol == XMODEM)
+    {
+        switch (pThis->opts)
         {
-            uint8_t chksum;
-            chksum = lxmodem_calcul_chksum(pThis->blk_buffer.buffer + 3, effectiveBlksize);
-            pThis->blk_buffer.buffer[3 + effectiveBlksize] = (chksum & 0x00FF);
+            case lxmodem_128_with_chksum:
+                *pDefaultBlksize = 128;
+                *pWithCrc = false;
+                break;
+
+            case lxmodem_128_with_crc:
+                *pDefaultBlksize = 128;
+                *pWithCrc = true;
+                break;
+
+            case lxmodem_1k:
+                *pDefaultBlksize = 1024;
+                *pWithCrc = true;
+                break;
+
+            default:
+                break;
         }
+    }
+    else if (protocol == YMODEM)
+    {
+        *pDefaultBlksize = 1024;
+        *pWithCrc = true;
+    }
+}
+
+uint32_t lmodem_build_block(modem_context_t* pThis, lmodem_protocol protocol, uint32_t index, uint8_t* pBlock)
+{
+    uint32_t defaultBlksize;
+    uint32_t offset;
+    uint32_t payloadSize;
+    uint32_t effectiveBlksize;
+    uint16_t crc;
+    bool withCrc;
 
-        lmodem_putchar(pThis,  pThis->blk_buffer.buffer, datablockSize);
-        pThis->blk_buffer.current_size = datablockSize;
-        *nbEmitted += effectiveBlksize;
+    lxmode_get_block_format(pThis, protocol, &defaultBlksize, &withCrc);
+    offset = index * defaultBlksize;
+    if (offset >= pThis->ramfile.write_offset)
+    {
+        return 0;
     }
 
-    return (bytesToRead == 0) ? true : false;
+    //same framing as the emission, the file buffer is only read
+    payloadSize = min(defaultBlksize, pThis->ramfile.write_offset - offset);
+    memcpy(pBlock + 3, &pThis->ramfile.buffer[offset], payloadSize);
+    effectiveBlksize = lxmode_frame_payload(pBlock, payloadSize, (uint8_t) (index + 1));
+    crc = 0;
+#if LMODEM_CFG_CRC
+    if ((withCrc) && (!lmodem_crc_block(pThis, pBlock + 3, effectiveBlksize, &crc)))
+    {
+        return 0;
+    }
+#endif
+    return lxmode_put_trailer(pBlock, effectiveBlksize, withCrc, crc);
 }
 
-void lxmode_reemit_previous_block(modem_context_t* pThis)
+void lxmode_reemit_previous_block(modem_context_t* pThis, const uint8_t* pBlock, uint32_t blockSize)
 {
-    lmodem_putchar(pThis,  pThis->blk_buffer.buffer, pThis->blk_buffer.current_size);
+    pThis->stats.retransmissions++;
+    lmodem_putchar(pThis, (uint8_t*) pBlock, blockSize);
 }
 
-static int32_t lymodem_emit(modem_context_t* pThis)
+#if LMODEM_CFG_YMODEM
+
+static lmodem_pt_status lymodem_emit(modem_context_t* pThis, int32_t* pEmittedBytes)
 {
-    uint32_t nbEmitted;
-    uint8_t receivedChar;
-    uint32_t retry;
-    bool bOk;
-    bool bDone;
+    lmodem_frame_ymodem_tx* pF;
+    pF = &pThis->step.frames.tx.ymodem;
 
-    receivedChar = 0;
-    nbEmitted = -1;
-    bOk = false;
+    LMODEM_PT_BEGIN(pF);
+    pF->receivedChar = 0;
+    pF->nbEmitted = -1;
+    pF->bOk = false;
 
-    bOk = lmodem_wait_reception_of(pThis, 'C');
-    if (bOk)
+    LMODEM_PT_CALL(pF, lmodem_wait_reception_of(pThis, 'C', &pF->bOk));
+    if (pF->bOk)
     {
-        lymodem_build_and_send_block0(pThis);
+        lmodem_stats_handshake_done(pThis);
+        pF->blksize = lymodem_build_block0(pThis);
+        if (pF->blksize > 0)
+        {
+            LMODEM_PT_CALL(pF, lxmode_add_trailer(pThis, &pThis->blk_buffer, pF->blksize, true));
+            lmodem_putchar(pThis, pThis->blk_buffer.buffer, pThis->blk_buffer.current_size);
+        }
 
-        bDone = false;
-        retry = 0;
-        while ((!bDone) && (retry < 10))
+        pF->bDone = false;
+        pF->retry = 0;
+        while ((!pF->bDone) && (pF->retry < 10))
         {
-            lmodem_wait_reception(pThis, &receivedChar);
-            switch (receivedChar)
+            LMODEM_PT_CALL(pF, lmodem_wait_reception(pThis, &pF->receivedChar));
+            switch (pF->receivedChar)
             {
                 case ACK:
-                    bOk = true;
-                    bDone = true;
+                    pF->bOk = true;
+                    pF->bDone = true;
                     break;
 
                 case CAN:
-                    bDone = true;
-                    bOk = false;
+                    pThis->stats.cans_received++;
+                    pF->bDone = true;
+                    pF->bOk = false;
                     break;
 
                 case NAK:
-                    lxmode_reemit_previous_block(pThis);
-                    retry++;
+                    pThis->stats.naks_received++;
+                    lmodem_trace(pThis, LMODEM_TRACE_NAK, 0, 0);
+                    lxmode_reemit_previous_block(pThis, pThis->blk_buffer.buffer, pThis->blk_buffer.current_size);
+                    pF->retry++;
+                    break;
+
+                default:
+                    //corrupted reply or no reply (the last char is kept), the block is emitted again
+                    lxmode_reemit_previous_block(pThis, pThis->blk_buffer.buffer, pThis->blk_buffer.current_size);
+                    pF->retry++;
                     break;
             }
         }
     }
 
-    if (bOk)
+    if (pF->bOk)
     {
-        nbEmitted = lxmodem_emit(pThis);
+        LMODEM_PT_CALL(pF, lxmodem_emit(pThis, &pF->nbEmitted));
     }
 
-    if (bOk && (nbEmitted > 0))
+    //the end of batch only follows a file sent, an empty one (0) included: after a failure (-1) the transfer was
+    //cancelled or the receiver stopped answering, and it ends there
+    if (pF->nbEmitted < 0)
     {
-        bOk = lmodem_wait_reception_of(pThis, 'C');
+        pF->bOk = false;
+    }
+
+    if (pF->bOk)
+    {
+#if LMODEM_CFG_FILE_CRC
+        //the skip answer is also the request for the end of batch block, a repeated one gets it again
+        if (!pThis->skipped)
+#endif
+        {
+            LMODEM_PT_CALL(pF, lmodem_wait_reception_of(pThis, 'C', &pF->bOk));
+        }
     }
 
-    if (bOk)
+    if (pF->bOk)
     {
-        lymodem_send_end_of_bach(pThis);
-        bDone = false;
-        retry = 0;
-        while ((!bDone) && (retry < 10))
+        lymodem_build_end_of_bach(pThis);
+        LMODEM_PT_CALL(pF, lxmode_add_trailer(pThis, &pThis->blk_buffer, 128, true));
+        lmodem_putchar(pThis, pThis->blk_buffer.buffer, pThis->blk_buffer.current_size);
+        pF->bDone = false;
+        pF->retry = 0;
+        while ((!pF->bDone) && (pF->retry < 10))
         {
-            lmodem_wait_reception(pThis, &receivedChar);
-            switch (receivedChar)
+            LMODEM_PT_CALL(pF, lmodem_wait_reception(pThis, &pF->receivedChar));
+            switch (pF->receivedChar)
             {
                 case ACK:
-                    bOk = true;
-                    bDone = true;
+                    pF->bOk = true;
+                    pF->bDone = true;
                     break;
 
                 case CAN:
-                    bDone = true;
-                    bOk = false;
+                    pThis->stats.cans_received++;
+                    pF->bDone = true;
+                    pF->bOk = false;
                     break;
 
                 case NAK:
-                    lxmode_reemit_previous_block(pThis);
-                    retry++;
+                    pThis->stats.naks_received++;
+                    lmodem_trace(pThis, LMODEM_TRACE_NAK, 0, 0);
+                    lxmode_reemit_previous_block(pThis, pThis->blk_buffer.buffer, pThis->blk_buffer.current_size);
+                    pF->retry++;
+                    break;
+
+                default:
+                    //corrupted reply or no reply (the last char is kept), the block is emitted again
+                    lxmode_reemit_previous_block(pThis, pThis->blk_buffer.buffer, pThis->blk_buffer.current_size);
+                    pF->retry++;
                     break;
             }
         }
-        if (!bOk)
+        if (!pF->bOk)
         {
-            nbEmitted = -1;
+            pF->nbEmitted = -1;
         }
 
     }
 
-    return nbEmitted;
+    *pEmittedBytes = pF->nbEmitted;
+    LMODEM_PT_END(pF);
 }
 
-static bool lmodem_wait_reception_of(modem_context_t* pThis, uint8_t cntrlChar)
+static lmodem_pt_status lmodem_wait_reception_of(modem_context_t* pThis, uint8_t cntrlChar, bool* pOk)
 {
-    uint32_t timeout;
-    bool bReceived;
-    bool isReceivedOk;
-    uint8_t receivedChar;
-    isReceivedOk = false;
-
-    bReceived = false;
-    timeout = 0;
-    while ((isReceivedOk == false) && (timeout < 10))
+    lmodem_frame_wait* pF;
+    pF = &pThis->step.frames.tx.wait;
+
+    LMODEM_PT_BEGIN(pF);
+    pF->isReceivedOk = false;
+    pF->bReceived = false;
+    pF->timeout = 0;
+    while ((pF->isReceivedOk == false) && (pF->timeout < 10))
     {
         //wait preambule
-        bReceived = lmodem_getchar(pThis, &receivedChar, 1);
-        if ((bReceived) && (receivedChar == cntrlChar))
+        LMODEM_PT_GETCHAR(pThis, pF, &pF->receivedChar, 1, pF->bReceived);
+        if ((pF->bReceived) && (pF->receivedChar == cntrlChar))
         {
-            isReceivedOk = true;
+            pF->isReceivedOk = true;
             break;
         }
-        timeout++;
+        pF->timeout++;
     }
 
-    return isReceivedOk;
+    *pOk = pF->isReceivedOk;
+    LMODEM_PT_END(pF);
 }
 
-static bool lmodem_wait_reception(modem_context_t* pThis, uint8_t* pReceived)
+static lmodem_pt_status lmodem_wait_reception(modem_context_t* pThis, uint8_t* pReceived)
 {
-    uint32_t timeout;
-    bool bReceived;
-    bool isReceivedOk;
-    char receivedChar;
-    isReceivedOk = false;
-
-    bReceived = false;
-    timeout = 0;
-    while ((isReceivedOk == false) && (timeout < 10))
+    lmodem_frame_wait* pF;
+    pF = &pThis->step.frames.tx.wait;
+
+    LMODEM_PT_BEGIN(pF);
+    pF->isReceivedOk = false;
+    pF->bReceived = false;
+    pF->timeout = 0;
+    while ((pF->isReceivedOk == false) && (pF->timeout < 10))
     {
         //wait preambule
-        bReceived = lmodem_getchar(pThis, (uint8_t*) &receivedChar, 1);
-        if (bReceived)
+        LMODEM_PT_GETCHAR(pThis, pF, &pF->receivedChar, 1, pF->bReceived);
+        if (pF->bReceived)
         {
             if (pReceived != NULL)
             {
-                *pReceived = receivedChar;
+                *pReceived = pF->receivedChar;
             }
-            isReceivedOk = true;
+            pF->isReceivedOk = true;
             break;
         }
-        timeout++;
+        pF->timeout++;
     }
 
-    return isReceivedOk;
+    LMODEM_PT_END(pF);
 }
 
-static const char* lymodem_format[] =
+static const char* const lymodem_format[] =
 {
     "%d",
     "%d %o",
@@ -445,11 +868,12 @@ static const char* lymodem_format[] =
 };
 
 
-bool lymodem_build_and_send_block0(modem_context_t* pThis)
+// returns the payload size of block 0, 0 without filename (nothing to send)
+uint32_t lymodem_build_block0(modem_context_t* pThis)
 {
-    bool bOk;
+    uint32_t effectiveBlksize;
 
-    bOk = false;
+    effectiveBlksize = 0;
 
     memset(pThis->blk_buffer.buffer, 0, pThis->blk_buffer.max_size);
     //block 0
@@ -519,44 +943,220 @@ bool lymodem_build_and_send_block0(modem_context_t* pThis)
                 break;
         }
 
-        bOk = true;
         uint32_t max_size = 3 + sizeFilename + 1 + nbWritten + 1;
-        uint32_t nbDataToSend;
-        uint32_t effectiveBlksize;
-        uint16_t crc;
+        //extensions after the end of the metadata: a receiver reads at most the 4 positional fields, with fewer it
+        //would take the extension for the next one
+        char* pExtension = pStartMetaData + nbWritten + 1;
+        if ((nbMetaDataTocpy == LMODEM_METADATA_NB - 1) && (pExtension < pEndBuffer))
+        {
+            int32_t nbExtension;
+            nbExtension = lymodem_build_block0_extension(pThis, pExtension, pEndBuffer);
+            if (nbExtension > 0)
+            {
+                max_size += nbExtension + 1;
+            }
+        }
         if (max_size < 128)
         {
             pThis->blk_buffer.buffer[0] = SOH;
             effectiveBlksize = 128;
-            nbDataToSend = 1 + 2 + 128 + 2;
         }
         else
         {
             pThis->blk_buffer.buffer[0] = STX;
             effectiveBlksize = 1024;
-            nbDataToSend = 1 + 2 + 1024 + 2;
         }
+    }
+
+    return effectiveBlksize;
+}
+
+// space separated "key:value" fields, returns their length
+static int32_t lymodem_build_block0_extension(modem_context_t* pThis, char* pStart, char* pEnd)
+{
+    int32_t nbWritten;
+#if LMODEM_CFG_FILE_CRC
+    uint32_t crc;
+#endif
+
+    nbWritten = 0;
+#if LMODEM_CFG_COMPRESS
+    if (lymodem_is_compression_offered(pThis))
+    {
+        nbWritten += snprintf(pStart + nbWritten, pEnd - (pStart + nbWritten), "%slz:%u", (nbWritten > 0) ? " " : "",
+                              LMODEM_COMPRESS_VERSION);
+    }
+#endif
+#if LMODEM_CFG_DELTA
+    if (lymodem_is_delta_offered(pThis))
+    {
+        nbWritten += snprintf(pStart + nbWritten, pEnd - (pStart + nbWritten), "%sdl:%u", (nbWritten > 0) ? " " : "",
+                              LMODEM_DELTA_VERSION);
+    }
+#endif
+#if LMODEM_CFG_FILE_CRC
+    if (lymodem_get_file_crc(pThis, &crc))
+    {
+        pThis->file_crc_offered = true;
+        nbWritten += snprintf(pStart + nbWritten, pEnd - (pStart + nbWritten), "%scrc32:%08x", (nbWritten > 0) ? " " : "",
+                              (unsigned int) crc);
+    }
+#endif
+#if !(LMODEM_CFG_COMPRESS || LMODEM_CFG_DELTA || LMODEM_CFG_FILE_CRC)
+    (void) pThis;
+    (void) pStart;
+#endif
+    return min(nbWritten, pEnd - pStart - 1);
+}
 
-        crc = crc16_doCalcul(&pThis->crc16, pThis->blk_buffer.buffer + 3, effectiveBlksize, LXMODEM_CRC16_INIT_VALUE, LXMODEM_CRC16_XOR_FINAL);
-        pThis->blk_buffer.buffer[3 + effectiveBlksize] = (crc & 0xFF00) >> 8;
-        pThis->blk_buffer.buffer[3 + effectiveBlksize + 1] = (crc & 0xFF);
-        lmodem_putchar(pThis, pThis->blk_buffer.buffer, nbDataToSend);
-        pThis->blk_buffer.current_size = nbDataToSend;
+#if LMODEM_CFG_COMPRESS
+static bool lymodem_is_compression_offered(modem_context_t* pThis)
+{
+    //the receiver ends the file with its size, a block source gives raw blocks already framed
+    return (pThis->compressor != NULL) && (pThis->get_block == NULL)
+           && ((pThis->file_data.valid & LMODEM_METADATA_FILESIZE_VALID) == LMODEM_METADATA_FILESIZE_VALID);
+}
+#endif
+
+#if LMODEM_CFG_FILE_CRC
+// the crc32 set by the application, else the one of the file buffer when it holds the whole file
+static bool lymodem_get_file_crc(modem_context_t* pThis, uint32_t* pCrc)
+{
+    if (!pThis->file_crc)
+    {
+        //legacy receivers may not skip an unknown field, it is only sent when asked for
+        return false;
     }
+    if ((pThis->file_data.valid & LMODEM_METADATA_FILESIZE_VALID) != LMODEM_METADATA_FILESIZE_VALID)
+    {
+        //the receiver checks the file up to its size
+        return false;
+    }
+    if (lmodem_metadata_get_file_crc(pThis, pCrc))
+    {
+        return true;
+    }
+    if ((pThis->read_data == NULL) && (lmodem_buffer_get_size(&pThis->ramfile) >= (int32_t) pThis->file_data.size))
+    {
+        *pCrc = crc32_update(0, &pThis->ramfile.buffer[pThis->ramfile.read_offset], pThis->file_data.size);
+        return true;
+    }
+    return false;
+}
+#endif
 
-    return bOk;
+#if LMODEM_CFG_DELTA
+static bool lymodem_is_delta_offered(modem_context_t* pThis)
+{
+    //the receiver patches up to the file size, a block source gives raw blocks already framed
+    return (pThis->delta_encoder != NULL) && (pThis->get_block == NULL)
+           && ((pThis->file_data.valid & LMODEM_METADATA_FILESIZE_VALID) == LMODEM_METADATA_FILESIZE_VALID);
 }
 
-void lymodem_send_end_of_bach(modem_context_t* pThis)
+// the accept char has been read: nb of hashes, hashes and crc, answered by ACK, or NAK and the receiver sends them
+// again. pThis->delta is set once they are received, a list received again while it is set is only acknowledged.
+static lmodem_pt_status lymodem_receive_delta_hashes(modem_context_t* pThis)
+{
+    lmodem_frame_delta_tx* pF;
+    lmodem_delta_encoder* pEncoder;
+    uint8_t reply;
+    pF = &pThis->step.frames.tx.delta;
+    pEncoder = pThis->delta_encoder;
+
+    LMODEM_PT_BEGIN(pF);
+    pF->bOk = false;
+    pF->retry = 0;
+    pF->bReceived = true;
+    while ((!pF->bOk) && (pF->retry < 10))
+    {
+        if (pF->retry > 0)
+        {
+            LMODEM_PT_GETCHAR(pThis, pF, pF->bytes, 1, pF->bReceived);
+            pF->bReceived = (pF->bReceived) && (pF->bytes[0] == LMODEM_DELTA_ACCEPT);
+        }
+        if (pF->bReceived)
+        {
+            LMODEM_PT_GETCHAR(pThis, pF, pF->bytes, 4, pF->bReceived);
+        }
+        if (pF->bReceived)
+        {
+            pF->nbHashes = lmodem_get_le32(pF->bytes);
+            pF->crc = lmodem_crc_init(pThis);
+            LMODEM_PT_CRC(pThis, pF, pF->bytes, 4, pF->crc);
+            //the hashes after the end of the file of the sender are not kept
+            for (pF->index = 0; (pF->index < pF->nbHashes) && (pF->bReceived); pF->index++)
+            {
+                LMODEM_PT_GETCHAR(pThis, pF, pF->bytes, 4, pF->bReceived);
+                LMODEM_PT_CRC(pThis, pF, pF->bytes, 4, pF->crc);
+                if (pF->index < pEncoder->max_hashes)
+                {
+                    pEncoder->hashes[pF->index] = lmodem_get_le32(pF->bytes);
+                }
+            }
+        }
+        if (pF->bReceived)
+        {
+            LMODEM_PT_GETCHAR(pThis, pF, pF->bytes, 2, pF->bReceived);
+            pF->crc = lmodem_crc_final(pThis, pF->crc);
+        }
+
+        if ((pF->bReceived) && (pF->bytes[0] == (uint8_t) (pF->crc >> 8)) && (pF->bytes[1] == (uint8_t) pF->crc))
+        {
+            pEncoder->nb_hashes = min(pF->nbHashes, pEncoder->max_hashes);
+            pF->bOk = true;
+        }
+        else
+        {
+            DBG("delta hashes corrupted, ask them again\n");
+            //until the line is silent, or at most a whole list: a line which never goes silent still gets the NAK
+            pF->nbPurged = 0;
+            do
+            {
+                LMODEM_PT_GETCHAR(pThis, pF, pF->bytes, 1, pF->bReceived);
+                pF->nbPurged++;
+            }
+            while ((pF->bReceived) && (pF->nbPurged < (1 + 4 + (4 * pEncoder->max_hashes) + 2)));
+            pF->retry++;
+        }
+        reply = (pF->bOk) ? ACK : NAK;
+        lmodem_putchar(pThis, &reply, 1);
+    }
+
+    //a list sent again during the first data block leaves the encoder as it is
+    if ((pF->bOk) && (!pThis->delta))
+    {
+        lmodem_delta_encode_init(pEncoder);
+        pThis->delta = true;
+    }
+    LMODEM_PT_END(pF);
+}
+#endif
+
+// empty block 0, its crc is added by lxmode_add_trailer
+void lymodem_build_end_of_bach(modem_context_t* pThis)
 {
-    uint16_t crc;
     memset(pThis->blk_buffer.buffer, 0, pThis->blk_buffer.max_size);
     pThis->blk_buffer.buffer[0] = SOH;
     pThis->blk_buffer.buffer[1] = 0;
     pThis->blk_buffer.buffer[2] = ~0;
-    crc = crc16_doCalcul(&pThis->crc16, pThis->blk_buffer.buffer + 3, 128, LXMODEM_CRC16_INIT_VALUE, LXMODEM_CRC16_XOR_FINAL);
-    pThis->blk_buffer.buffer[3 + 128] = (crc & 0xFF00) >> 8;
-    pThis->blk_buffer.buffer[3 + 128 + 1] = (crc & 0xFF);
-    lmodem_putchar(pThis, pThis->blk_buffer.buffer, 3 + 128 + 2);
-    pThis->blk_buffer.current_size = 3 + 128 + 2;
 }
+
+#endif /* LMODEM_CFG_YMODEM */
+
+#else
+
+int32_t lmodem_emit(modem_context_t* pThis, lmodem_protocol protocol)
+{
+    (void) pThis;
+    (void) protocol;
+    return -1;
+}
+
+bool lmodem_start_emit(modem_context_t* pThis, lmodem_protocol protocol)
+{
+    (void) pThis;
+    (void) protocol;
+    return false;
+}
+
+#endif /* LMODEM_CFG_TX */
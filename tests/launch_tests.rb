@@ -2,6 +2,25 @@
 
 RZSZ_EXEC_DEBUG="../build-linux-debug/tools/rzsz"
 RZSZ_EXEC_RELEASE="../build-linux-release/tools/rzsz"
+SIM_EXEC_DEBUG="../build-linux-debug/tools/lmodem_sim"
+SIM_EXEC_RELEASE="../build-linux-release/tools/lmodem_sim"
+RING_EXEC_DEBUG="../build-linux-debug/tools/bench_ring"
+RING_EXEC_RELEASE="../build-linux-release/tools/bench_ring"
+ESCAPE_EXEC_DEBUG="../build-linux-debug/tools/bench_escape"
+ESCAPE_EXEC_RELEASE="../build-linux-release/tools/bench_escape"
+STRESS_EXEC_DEBUG="../build-linux-debug/tools/stress_contexts"
+STRESS_EXEC_RELEASE="../build-linux-release/tools/stress_contexts"
+BROADCAST_EXEC_DEBUG="../build-linux-debug/tools/lmodem_broadcast"
+BROADCAST_EXEC_RELEASE="../build-linux-release/tools/lmodem_broadcast"
+PROVISION_EXEC_DEBUG="../build-linux-debug/tools/lmodem_provision"
+PROVISION_EXEC_RELEASE="../build-linux-release/tools/lmodem_provision"
+BOND_EXEC_DEBUG="../build-linux-debug/tools/lmodem_bond"
+BOND_EXEC_RELEASE="../build-linux-release/tools/lmodem_bond"
+MUX_EXEC_DEBUG="../build-linux-debug/tools/lmodem_mux_sim"
+MUX_EXEC_RELEASE="../build-linux-release/tools/lmodem_mux_sim"
+REPLAY_EXEC_DEBUG="../build-linux-debug/tools/lmodem_replay"
+REPLAY_EXEC_RELEASE="../build-linux-release/tools/lmodem_replay"
+SIM_LOG_FILE = "simulation.log"
 LOG_FILE = "tests.log"
 
 $pts = Array.new
@@ -61,8 +80,21 @@ def process_test(options_tx, options_rx, send_file, expected_file, result_file)
 end
 
 
+def process_sim_test(options, exec = $sim_exec)
+
+  puts "#{exec} #{options} >> #{SIM_LOG_FILE} 2>&1"
+  `#{exec} #{options} >> #{SIM_LOG_FILE} 2>&1`
+  if $?.exitstatus.zero?
+    puts "test ok"
+    true
+  else
+    puts "test failed, see #{SIM_LOG_FILE}"
+    false
+  end
+end
+
 def delete_all_previous_log_file
-  `rm -f socat.log emission.log reception.log #{LOG_FILE} `
+  `rm -f socat.log emission.log reception.log #{LOG_FILE} #{SIM_LOG_FILE} `
   `rm -f tests_results/*`
   `touch tests_results/KEEP`
 end
@@ -105,41 +137,184 @@ $nominal_tests_ymodem = [
 { options_tx: "--protocol 1", options_rx: "--protocol 1",
   send_file: "files/test_32800bytes.txt", expected_file: "files/test_32800bytes.txt", result_file: "tests_results/15-test_32800bytes.txt" },
 { options_tx: "--protocol 1", options_rx: "--protocol 1",
-  send_file: "files/test_263000bytes.bin", expected_file: "files/test_263000bytes.bin", result_file: "tests_results/16-test_263000bytes.bin" }
+  send_file: "files/test_263000bytes.bin", expected_file: "files/test_263000bytes.bin", result_file: "tests_results/16-test_263000bytes.bin" },
+{ options_tx: "--protocol 1 --prefetch", options_rx: "--protocol 1",
+  send_file: "files/test_263000bytes.bin", expected_file: "files/test_263000bytes.bin", result_file: "tests_results/17-test_263000bytes.bin" },
+{ options_tx: "--protocol 1", options_rx: "--protocol 1 --pipeline",
+  send_file: "files/test_263000bytes.bin", expected_file: "files/test_263000bytes.bin", result_file: "tests_results/18-test_263000bytes.bin" }
+]
+
+# link simulator: no serial line needed, same seed gives the same transfer
+$sim_tests = [
+  "--protocol 0 --size 1254",
+  "--protocol 0 --crc --size 32800",
+  "--protocol 0 --1k --size 263000",
+  "--protocol 1 --size 263000",
+  "--protocol 1 --size 32800 --low-memory",
+  # an empty file: the end of batch block waits for the 'C' which follows the EOT
+  "--protocol 1 --size 0",
+  "--protocol 1 --size 0 --step",
+  # retry and NAK reception
+  "--protocol 0 --ber 1e-4 --seed 1",
+  "--protocol 0 --crc --ber 1e-4 --seed 2",
+  "--protocol 0 --1k --ber 1e-5 --drop 1e-4 --seed 3",
+  "--protocol 1 --burst-rate 1e-4 --burst-len 16 --seed 4",
+  "--protocol 0 --crc --ber 2e-4 --size 65536 --seed 8",
+  "--protocol 1 --ber 5e-4 --size 100 --seed 1",
+  "--protocol 1 --ber 5e-4 --size 100 --seed 25",
+  "--protocol 1 --stall-rate 1e-3 --stall-ms 300 --seed 5",
+  "--protocol 1 --ber 1e-5 --low-memory --seed 6",
+  "--protocol 0 --crc --ber 1e-4 --latency-us 50000 --seed 7",
+  # next block built during the ACK wait, data read from a source callback
+  "--protocol 0 --crc --double-buffer --ber 1e-4 --seed 8",
+  "--protocol 1 --double-buffer --data-source --ber 1e-5 --drop 1e-4 --seed 9",
+  # non-blocking transfers driven by lmodem_step
+  "--protocol 0 --crc --step --ber 1e-4 --seed 10",
+  "--protocol 1 --step --low-memory --double-buffer --ber 1e-5 --drop 1e-4 --seed 11",
+  # blocks received by a simulated DMA, partial frames on line stalls
+  "--protocol 0 --crc --dma --ber 1e-4 --seed 12",
+  "--protocol 1 --dma --stall-rate 1e-3 --stall-ms 300 --drop 1e-4 --seed 13",
+  # crc computed by a mock of a crc peripheral, in the call or completed later by a thread
+  "--protocol 0 --1k --crc-offload --ber 1e-5 --seed 14",
+  "--protocol 1 --crc-async --step --double-buffer --ber 1e-4 --seed 15",
+  "--protocol 1 --crc-async --dma --drop 1e-4 --seed 16",
+  "--protocol 1 --crc-async --low-memory --ber 1e-5 --seed 17",
+  # blocks compressed when the receiver accepts the block 0 offer, raw on a low memory receiver
+  "--protocol 1 --compress --content firmware --size 100000",
+  "--protocol 1 --compress --content log --step --double-buffer --ber 1e-5 --seed 18",
+  "--protocol 1 --compress --content random --data-source --drop 1e-4 --seed 19",
+  "--protocol 1 --compress --content firmware --low-memory",
+  # block 0 with the name only, the size only or all the fields: the offer needs all of them
+  "--protocol 1 --metadata 0 --size 3000",
+  "--protocol 1 --metadata 1 --compress --content firmware",
+  "--protocol 1 --metadata 2 --compress --low-memory --ber 1e-5 --seed 23",
+  "--protocol 1 --metadata 4 --compress --content log",
+  # only the blocks which differ from the previous version held by the receiver
+  "--protocol 1 --delta 5 --content firmware --size 263000",
+  "--protocol 1 --delta 4 --step --double-buffer --ber 1e-5 --drop 1e-4 --seed 20",
+  "--protocol 1 --delta 3 --compress --data-source --ber 3e-5 --seed 21",
+  "--protocol 1 --delta 3 --low-memory",
+  # an unchanged previous version: block 0 must not overwrite it, only the block after its end is sent
+  "--protocol 1 --delta 0 --size 65536",
+  "--protocol 1 --delta 0 --size 65536 --step --dma",
+  # the ACK of the hashes corrupted (the receiver sends them again) or dropped (the first block comes instead)
+  "--protocol 1 --delta 3 --content firmware --ber 1e-4 --seed 130",
+  "--protocol 1 --delta 3 --content firmware --drop 1e-3 --seed 130 --step",
+  # the crc of the hash list through an asynchronous provider
+  "--protocol 1 --delta 3 --content firmware --crc-async --step",
+  "--protocol 1 --delta 3 --content firmware --crc-async",
+  # crc32 of the file in block 0 when asked for: skipped when the receiver has it, cancelled when it differs
+  "--protocol 1 --present --size 263000",
+  "--protocol 1 --present --delta 2 --compress --step --dma",
+  "--protocol 1 --present --low-memory",
+  # the skip answer dropped: sent again, the sender answers it with the end of batch block
+  "--protocol 1 --present --drop 2e-3 --seed 814",
+  "--protocol 1 --present --drop 2e-3 --seed 814 --step",
+  "--protocol 1 --file-crc --data-source --ber 3e-5 --seed 22",
+  "--protocol 1 --file-crc --metadata 1",
+  # one bit flipped in the 'C' of the receiver: not taken for a skip, the transfer fails as for any lost 'C'
+  "--protocol 1 --file-crc --ber 5e-4 --size 100 --seed 228 --expect-failure",
+  "--protocol 1 --bad-file-crc --expect-failure",
+  "--protocol 1 --bad-file-crc --delta 2 --expect-failure",
+  # abort on a dead line
+  "--protocol 0 --crc --drop 1 --clean-ack --expect-failure",
+  "--protocol 1 --drop 1 --expect-failure",
+  # abort on a line which never goes silent (the receiver purge is bounded)
+  "--protocol 0 --crc --jabber-ms 100 --expect-failure",
+  "--protocol 0 --crc --step --jabber-ms 100 --expect-failure"
 ]
 
 def main
 
   is_debug = false
   is_release = false
+  sim_only = false
 
   ARGV.each do |arg|
+    sim_only = true if arg == '--sim-only'
     is_debug = true if arg == '--debug'
     is_release = true if arg == '--release'
-    break if is_debug or is_release
     if (arg == '--help')
       puts 'usage:'
       puts "#{$PROGRAM_NAME} --debug for test in debug mode"
       puts "#{$PROGRAM_NAME} --release for test in release mode"
+      puts "#{$PROGRAM_NAME} --sim-only to run only the link simulator tests (no socat)"
       exit(1)
     end
   end
 
   if is_release
     $rzsz_exec = RZSZ_EXEC_RELEASE
+    $sim_exec = SIM_EXEC_RELEASE
+    $ring_exec = RING_EXEC_RELEASE
+    $escape_exec = ESCAPE_EXEC_RELEASE
+    $stress_exec = STRESS_EXEC_RELEASE
+    $broadcast_exec = BROADCAST_EXEC_RELEASE
+    $provision_exec = PROVISION_EXEC_RELEASE
+    $bond_exec = BOND_EXEC_RELEASE
+    $mux_exec = MUX_EXEC_RELEASE
+    $replay_exec = REPLAY_EXEC_RELEASE
     puts "test in release mode"
   else
     is_debug = true
     $rzsz_exec = RZSZ_EXEC_DEBUG
+    $sim_exec = SIM_EXEC_DEBUG
+    $ring_exec = RING_EXEC_DEBUG
+    $escape_exec = ESCAPE_EXEC_DEBUG
+    $stress_exec = STRESS_EXEC_DEBUG
+    $broadcast_exec = BROADCAST_EXEC_DEBUG
+    $provision_exec = PROVISION_EXEC_DEBUG
+    $bond_exec = BOND_EXEC_DEBUG
+    $mux_exec = MUX_EXEC_DEBUG
+    $replay_exec = REPLAY_EXEC_DEBUG
     puts "test in debug mode"
   end
 
   delete_all_previous_log_file
+
+  s = true
+  # lock-free ring between two threads
+  s = process_sim_test("--stress", $ring_exec)
+  # vectorized escape kernels against the scalar ones: tails, offsets, decode split after a ZDLE
+  s = process_sim_test("--check", $escape_exec) if (s)
+  # independent contexts in parallel threads
+  s = process_sim_test("--pairs 32", $stress_exec) if (s)
+  # one image to several ports, blocks framed once, a dead port does not stop the others
+  s = process_sim_test("--sim 8 --protocol 1 --ber 1e-5 --dead 1 --seed 20", $broadcast_exec) if (s)
+  s = process_sim_test("--sim 4 --protocol 0 --crc --dead 1 --seed 21", $broadcast_exec) if (s)
+  # block table framed by a thread pool, saved then mapped by the next run
+  s = process_sim_test("--sim 4 --protocol 1 --ber 1e-5 --prebuild --threads 3 --seed 22", $broadcast_exec) if (s)
+  s = process_sim_test("--sim 2 --protocol 0 --1k --size 263000 --table tests_results/broadcast.lmbt --seed 23", $broadcast_exec) if (s)
+  s = process_sim_test("--sim 2 --protocol 0 --1k --size 263000 --table tests_results/broadcast.lmbt --ber 1e-5 --seed 23", $broadcast_exec) if (s)
+  # jobs spread over ports of different speeds, idle ports steal the jobs of the busy ones, failed jobs retried
+  s = process_sim_test("--sim 24 --baud 115200,57600,19200 --size 8192 --fail-rate 0.2 --seed 4", $provision_exec) if (s)
+  s = process_sim_test("--sim 12 --protocol 1 --baud 115200,9600 --fail-rate 0.1 --seed 5", $provision_exec) if (s)
+  # one file striped over several links, reassembled from the stripe headers, faster than one link
+  s = process_sim_test("--sim --size 263000 --min-speedup 1.8 --seed 6", $bond_exec) if (s)
+  s = process_sim_test("--sim --protocol 1 --baud 115200,115200,57600,19200 --size 200000 --ber 1e-5 --min-speedup 2 --seed 7", $bond_exec) if (s)
+  s = process_sim_test("--sim --crc --baud 57600,57600,57600 --size 5000 --seed 8", $bond_exec) if (s)
+  # transfer, console and rpc sharing one line, the rpc waits at most one frame of the transfer
+  s = process_sim_test("--size 100000 --1k --max-rpc-ms 20 --seed 9", $mux_exec) if (s)
+  s = process_sim_test("--protocol 1 --size 100000 --ber 1e-5 --seed 1", $mux_exec) if (s)
+  s = process_sim_test("--crc --baud 9600 --frame 32 --size 20000 --max-rpc-ms 100 --seed 10", $mux_exec) if (s)
+  # reception recorded on the virtual clock, replayed in a fresh context: same bytes, same result, same block times
+  s = process_sim_test("--protocol 0 --crc --ber 1e-4 --seed 2 --record tests_results/sim_xmodem.lmcp") if (s)
+  s = process_sim_test("--max-latency-ratio 1.01 tests_results/sim_xmodem.lmcp", $replay_exec) if (s)
+  s = process_sim_test("--protocol 1 --low-memory --ber 1e-5 --latency-us 20000 --seed 3 --record tests_results/sim_ymodem.lmcp") if (s)
+  s = process_sim_test("--max-latency-ratio 1.01 tests_results/sim_ymodem.lmcp", $replay_exec) if (s)
+  $sim_tests.each do |test|
+    s = process_sim_test(test) if (s)
+  end
+
+  if (sim_only)
+    puts (s ? "all tests ok" : "at least one test failed")
+    exit(s ? 0 : 1)
+  end
+
   launch_socat_process
 
   sleep(1)
 
-  s = true
   $nominal_tests_xmodem.each do |test|
     s = process_test(test[:options_tx], test[:options_rx], test[:send_file], test[:expected_file], test[:result_file]) if (s)
   end
@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "lmodem_escape.h"
+
+// throughput of the escape kernels, or with --check their comparison with the scalar ones:
+// every size up to BENCH_CHECK_MAX_SIZE (the tails of the vectors), the source at each offset of a vector, the
+// encoded bytes compared with the scalar encoder and the decode split at every point of the encoded bytes (a ZDLE
+// pending at the end of a call).
+
+#define BENCH_BUFFER_SIZE       (1024*1024)
+#define BENCH_NB_LOOP           (64)
+#define BENCH_CHECK_MAX_SIZE    (200)
+#define BENCH_CHECK_MAX_OFFSET  (32)
+
+typedef uint32_t (*encode_fn)(uint8_t* dst, uint8_t* src, uint32_t size);
+typedef uint32_t (*decode_fn)(lmodem_escape_decoder* pThis, uint8_t* dst, uint8_t* src, uint32_t size);
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_fill(uint8_t* buffer, uint32_t size, uint32_t escapePerMille, uint32_t seed)
+{
+    static const uint8_t escaped[] = { 0x10, 0x11, 0x13, 0x18, 0x90, 0x91, 0x93, 0x98 };
+    uint32_t i;
+
+    srand(seed);
+    for (i = 0; i < size; i++)
+    {
+        if ((uint32_t) (rand() % 1000) < escapePerMille)
+        {
+            buffer[i] = escaped[rand() % sizeof(escaped)];
+        }
+        else
+        {
+            do
+            {
+                buffer[i] = rand() & 0xFF;
+            }
+            while (lmodem_escape_is_needed(buffer[i]));
+        }
+    }
+}
+
+// decode of encoded in two calls, cut at split
+static uint32_t bench_decode_split(decode_fn decode, uint8_t* dst, uint8_t* encoded, uint32_t encodedSize, uint32_t split)
+{
+    lmodem_escape_decoder decoder;
+    uint32_t decodedSize;
+
+    lmodem_escape_decoder_init(&decoder);
+    decodedSize = decode(&decoder, dst, encoded, split);
+    decodedSize += decode(&decoder, dst + decodedSize, encoded + split, encodedSize - split);
+    return decodedSize;
+}
+
+// nb of mismatches between the kernel and the scalar functions for one source
+static uint32_t bench_check_one(uint8_t* src, uint32_t size, uint8_t* expected, uint8_t* encoded, uint8_t* decoded)
+{
+    uint32_t expectedSize;
+    uint32_t encodedSize;
+    uint32_t split;
+    uint32_t nbErrors;
+
+    nbErrors = 0;
+    expectedSize = lmodem_escape_encode_scalar(expected, src, size);
+    encodedSize = lmodem_escape_encode(encoded, src, size);
+    if ((encodedSize != expectedSize) || (memcmp(encoded, expected, expectedSize) != 0))
+    {
+        fprintf(stdout, "  encode differs from the scalar one, size %u\n", size);
+        nbErrors++;
+    }
+
+    for (split = 0; split <= expectedSize; split++)
+    {
+        if ((bench_decode_split(lmodem_escape_decode, decoded, expected, expectedSize, split) != size)
+                || (memcmp(decoded, src, size) != 0))
+        {
+            fprintf(stdout, "  decode failed, size %u, split at %u of %u\n", size, split, expectedSize);
+            nbErrors++;
+        }
+        if ((bench_decode_split(lmodem_escape_decode_scalar, decoded, expected, expectedSize, split) != size)
+                || (memcmp(decoded, src, size) != 0))
+        {
+            fprintf(stdout, "  scalar decode failed, size %u, split at %u of %u\n", size, split, expectedSize);
+            nbErrors++;
+        }
+    }
+    return nbErrors;
+}
+
+static bool bench_check(const uint32_t* densities, uint32_t nbDensities)
+{
+    static uint8_t src[BENCH_CHECK_MAX_OFFSET + BENCH_CHECK_MAX_SIZE];
+    static uint8_t expected[LMODEM_ESCAPE_MAX_SIZE(BENCH_CHECK_MAX_SIZE)];
+    static uint8_t encoded[LMODEM_ESCAPE_MAX_SIZE(BENCH_CHECK_MAX_SIZE)];
+    static uint8_t decoded[BENCH_CHECK_MAX_SIZE];
+    uint32_t nbErrors;
+    uint32_t i;
+    uint32_t size;
+    uint32_t offset;
+
+    nbErrors = 0;
+    for (i = 0; i < nbDensities; i++)
+    {
+        for (size = 0; size <= BENCH_CHECK_MAX_SIZE; size++)
+        {
+            offset = size % BENCH_CHECK_MAX_OFFSET;
+            bench_fill(&src[offset], size, densities[i], size + 1);
+            nbErrors += bench_check_one(&src[offset], size, expected, encoded, decoded);
+        }
+    }
+    fprintf(stdout, "escape kernel %s: %u sizes x %u densities, %u errors\n", lmodem_escape_kernel_name(),
+            BENCH_CHECK_MAX_SIZE + 1, nbDensities, nbErrors);
+    return nbErrors == 0;
+}
+
+static bool bench_run(const char* name, encode_fn encode, decode_fn decode, uint8_t* src, uint8_t* encoded, uint8_t* decoded,
+                      uint32_t size)
+{
+    lmodem_escape_decoder decoder;
+    uint32_t encodedSize;
+    uint32_t decodedSize;
+    double start;
+    double encodeTime;
+    double decodeTime;
+    uint32_t i;
+    bool bOk;
+
+    encodedSize = 0;
+    decodedSize = 0;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_NB_LOOP; i++)
+    {
+        encodedSize = encode(encoded, src, size);
+    }
+    encodeTime = bench_now() - start;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_NB_LOOP; i++)
+    {
+        lmodem_escape_decoder_init(&decoder);
+        decodedSize = decode(&decoder, decoded, encoded, encodedSize);
+    }
+    decodeTime = bench_now() - start;
+
+    bOk = (decodedSize == size) && (memcmp(src, decoded, size) == 0);
+    fprintf(stdout, "  %-8s encode: %8.1f MB/s, decode: %8.1f MB/s, expansion: %.4f, %s\n", name,
+            (double) size * BENCH_NB_LOOP / encodeTime / 1e6,
+            (double) encodedSize * BENCH_NB_LOOP / decodeTime / 1e6,
+            (double) encodedSize / size, bOk ? "round trip ok" : "ROUND TRIP FAILED");
+    return bOk;
+}
+
+int main(int argc, char* argv[])
+{
+    static const uint32_t densities[] = { 0, 1, 10, 40, 100 };
+    static const uint32_t checkDensities[] = { 0, 10, 100, 500, 1000 };
+    uint8_t* src;
+    uint8_t* encoded;
+    uint8_t* decoded;
+    uint32_t i;
+    bool bOk;
+
+    if ((argc > 1) && (strcmp(argv[1], "--check") == 0))
+    {
+        return bench_check(checkDensities, sizeof(checkDensities) / sizeof(checkDensities[0])) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    src = malloc(BENCH_BUFFER_SIZE);
+    encoded = malloc(LMODEM_ESCAPE_MAX_SIZE(BENCH_BUFFER_SIZE));
+    decoded = malloc(BENCH_BUFFER_SIZE);
+    if ((src == NULL) || (encoded == NULL) || (decoded == NULL))
+    {
+        fprintf(stderr, "unable to allocate bench buffers\n");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "escape kernel: %s, buffer: %d bytes x %d loops\n", lmodem_escape_kernel_name(), BENCH_BUFFER_SIZE,
+            BENCH_NB_LOOP);
+    bOk = true;
+    for (i = 0; i < sizeof(densities) / sizeof(densities[0]); i++)
+    {
+        fprintf(stdout, "escape density %d/1000:\n", densities[i]);
+        bench_fill(src, BENCH_BUFFER_SIZE, densities[i], 1);
+        bOk = bench_run("scalar", lmodem_escape_encode_scalar, lmodem_escape_decode_scalar, src, encoded, decoded,
+                        BENCH_BUFFER_SIZE) && bOk;
+        bOk = bench_run(lmodem_escape_kernel_name(), lmodem_escape_encode, lmodem_escape_decode, src, encoded, decoded,
+                        BENCH_BUFFER_SIZE) && bOk;
+    }
+
+    free(src);
+    free(encoded);
+    free(decoded);
+    return bOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,397 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include "lmodem.h"
+#include "linksim.h"
+
+// end-to-end throughput of each mode over the link simulator, for a matrix of baud rates, round trip times,
+// bit error rates and file sizes. one csv line per run, a given seed always gives the same results.
+
+#define BENCH_MAX_VALUES       (16)
+#define BENCH_FILENAME_SIZE    (256)
+#define BENCH_PADDING          (0x1A)
+
+typedef struct
+{
+    const char* name;
+    lmodem_protocol protocol;
+    lxmodem_opts opts;
+    bool lowMemoryRx;
+} bench_mode;
+
+static const bench_mode bench_modes[] =
+{
+    { "xmodem-chksum-128", XMODEM, lxmodem_128_with_chksum, false },
+    { "xmodem-crc-128", XMODEM, lxmodem_128_with_crc, false },
+    { "xmodem-1k", XMODEM, lxmodem_1k, false },
+    { "xmodem-1k-low-memory", XMODEM, lxmodem_1k, true },
+    { "ymodem", YMODEM, lxmodem_1k, false },
+    { "ymodem-low-memory", YMODEM, lxmodem_1k, true },
+};
+
+#define BENCH_NB_MODES         (sizeof(bench_modes) / sizeof(bench_modes[0]))
+
+typedef struct
+{
+    double values[BENCH_MAX_VALUES];
+    uint32_t count;
+} bench_list;
+
+typedef enum
+{
+    OPTS_MODES,
+    OPTS_BAUDS,
+    OPTS_RTTS,
+    OPTS_BERS,
+    OPTS_SIZES,
+    OPTS_SEED,
+    OPTS_RUNS,
+    OPTS_OUTPUT,
+    OPTS_UNKNOWN = '?'
+} OPTS;
+
+typedef struct
+{
+    char* modes;
+    bench_list bauds;
+    bench_list rtts_ms;
+    bench_list bers;
+    bench_list sizes;
+    uint64_t seed;
+    uint32_t runs;
+    char* output;
+} options_t;
+
+static options_t options;
+
+static struct option long_options[] =
+{
+    {"modes", required_argument, 0, OPTS_MODES},
+    {"baud", required_argument, 0, OPTS_BAUDS},
+    {"rtt-ms", required_argument, 0, OPTS_RTTS},
+    {"ber", required_argument, 0, OPTS_BERS},
+    {"size", required_argument, 0, OPTS_SIZES},
+    {"seed", required_argument, 0, OPTS_SEED},
+    {"runs", required_argument, 0, OPTS_RUNS},
+    {"output", required_argument, 0, OPTS_OUTPUT},
+    {0, 0, 0, 0}
+};
+
+static linksim sim;
+static uint8_t bench_line_buffers[LINKSIM_NB_SIDES][LXMODEM_1K_BUFFER_MIN_SIZE];
+static char bench_filenames[LINKSIM_NB_SIDES][BENCH_FILENAME_SIZE];
+static lmodem_protocol bench_protocol;
+
+static bool parse_list(bench_list* pList, const char* arg)
+{
+    char* pEnd;
+    pList->count = 0;
+    while ((*arg != '\0') && (pList->count < BENCH_MAX_VALUES))
+    {
+        pList->values[pList->count++] = strtod(arg, &pEnd);
+        if (pEnd == arg)
+        {
+            return false;
+        }
+        arg = (*pEnd == ',') ? (pEnd + 1) : pEnd;
+    }
+    return (pList->count > 0);
+}
+
+static void set_list(bench_list* pList, const double* pValues, uint32_t count)
+{
+    memcpy(pList->values, pValues, count * sizeof(double));
+    pList->count = count;
+}
+
+static bool is_mode_selected(const char* name)
+{
+    const char* p;
+    size_t len;
+
+    if (options.modes == NULL)
+    {
+        return true;
+    }
+    len = strlen(name);
+    for (p = strstr(options.modes, name); p != NULL; p = strstr(p + 1, name))
+    {
+        if (((p == options.modes) || (p[-1] == ',')) && ((p[len] == '\0') || (p[len] == ',')))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int32_t bench_emit(modem_context_t* pThis)
+{
+    return lmodem_emit(pThis, bench_protocol);
+}
+
+static int32_t bench_receive(modem_context_t* pThis)
+{
+    return lmodem_receive(pThis, bench_protocol);
+}
+
+static void bench_setup_context(modem_context_t* pCtx, const bench_mode* pMode, uint8_t* pFile, uint32_t fileSize, bool bRx)
+{
+    uint32_t side;
+
+    side = bRx ? LINKSIM_SIDE_B : LINKSIM_SIDE_A;
+    lmodem_init(pCtx, pMode->opts);
+    if ((bRx) && (pMode->lowMemoryRx))
+    {
+        lmodem_set_low_memory_rx(pCtx, true);
+        lmodem_set_line_buffer(pCtx, bench_line_buffers[side], LXMODEM_LOW_MEMORY_RX_BUFFER_MIN_SIZE);
+    }
+    else
+    {
+        lmodem_set_line_buffer(pCtx, bench_line_buffers[side], LXMODEM_1K_BUFFER_MIN_SIZE);
+    }
+    lmodem_set_file_buffer(pCtx, pFile, fileSize);
+    lmodem_set_filename_buffer(pCtx, bench_filenames[side], BENCH_FILENAME_SIZE);
+    if (!bRx)
+    {
+        lmodem_buffer_set_write_offset(&pCtx->ramfile, fileSize);
+        if (pMode->protocol == YMODEM)
+        {
+            lmodem_metadata_set_filename(pCtx, "bench.bin");
+            lmodem_metadata_set_filesize(pCtx, fileSize);
+        }
+    }
+}
+
+static bool bench_check(const bench_mode* pMode, uint8_t* pSent, uint32_t size, modem_context_t* pRx, int32_t nbReceived)
+{
+    uint32_t receivedSize;
+    uint32_t i;
+    bool bOk;
+
+    receivedSize = pRx->ramfile.write_offset;
+    bOk = (nbReceived >= 0) && (receivedSize >= size) && (memcmp(pSent, pRx->ramfile.buffer, size) == 0);
+    for (i = size; (bOk) && (i < receivedSize); i++)
+    {
+        bOk = (pRx->ramfile.buffer[i] == BENCH_PADDING);
+    }
+    if ((bOk) && (pMode->protocol == YMODEM))
+    {
+        bOk = (receivedSize == size);
+    }
+    return bOk;
+}
+
+static void bench_run(FILE* out, const bench_mode* pMode, uint32_t baud, double rttMs, double ber, uint32_t size, uint64_t seed,
+                      uint8_t* pSent, uint8_t* pReceived)
+{
+    linksim_config config;
+    modem_context_t* pTx;
+    modem_context_t* pRx;
+    const lmodem_stats* pTxStats;
+    const lmodem_stats* pRxStats;
+    uint64_t rng;
+    uint64_t elapsed;
+    double goodput;
+    uint32_t i;
+    bool bCompleted;
+    bool bOk;
+
+    memset(&config, 0, sizeof(config));
+    config.baud = baud;
+    config.latency_ns = (uint64_t) (rttMs * 1e6 / 2);
+    config.ber = ber;
+    //a lost reply costs at least one round trip
+    config.timeout_ns = LINKSIM_DEFAULT_TIMEOUT_NS + 2 * config.latency_ns;
+    linksim_init(&sim, &config, &config, seed);
+
+    rng = seed;
+    for (i = 0; i < size; i++)
+    {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        pSent[i] = (uint8_t) (rng >> 56);
+    }
+
+    bench_protocol = pMode->protocol;
+    pTx = linksim_get_context(&sim, LINKSIM_SIDE_A);
+    pRx = linksim_get_context(&sim, LINKSIM_SIDE_B);
+    bench_setup_context(pTx, pMode, pSent, size, false);
+    bench_setup_context(pRx, pMode, pReceived, size + LXMODEM_1K_BUFFER_MIN_SIZE, true);
+    bOk = linksim_run(&sim, bench_emit, bench_receive);
+    bCompleted = bOk && (linksim_get_result(&sim, LINKSIM_SIDE_A) >= 0) && (linksim_get_result(&sim, LINKSIM_SIDE_B) >= 0);
+    bOk = bCompleted && bench_check(pMode, pSent, size, pRx, linksim_get_result(&sim, LINKSIM_SIDE_B));
+
+    elapsed = linksim_get_time_ns(&sim);
+    pTxStats = lmodem_get_stats(pTx);
+    pRxStats = lmodem_get_stats(pRx);
+    goodput = (bOk && (elapsed > 0)) ? (size * 1e9 / elapsed) : 0.0;
+
+    //result: ok, corrupted (transfer completed with an undetected error) or aborted.
+    //efficiency: goodput against the raw line capacity (10 bits per byte)
+    fprintf(out, "%s,%u,%g,%g,%u,%" PRIu64 ",%s,%.6f,%.1f,%.4f,%" PRIu64 ",%" PRIu64 ",%u,%u,%u\n",
+            pMode->name, baud, rttMs, ber, size, seed, bOk ? "ok" : (bCompleted ? "corrupted" : "aborted"), elapsed / 1e9, goodput,
+            goodput / (baud / 10.0), pTxStats->bytes_on_wire_tx, pRxStats->bytes_on_wire_tx,
+            pTxStats->retransmissions, pRxStats->naks_sent, pTxStats->timeouts + pRxStats->timeouts);
+    linksim_destroy(&sim);
+}
+
+static bool parse_options(int argc, char* argv[])
+{
+    static const double defaultBauds[] = { 9600, 115200, 921600 };
+    static const double defaultRtts[] = { 0, 20, 200 };
+    static const double defaultBers[] = { 0, 1e-6, 1e-5, 1e-4 };
+    // sizes of tests/files
+    static const double defaultSizes[] = { 128, 1254, 32800, 263000 };
+    int opt_index;
+    OPTS c;
+    bool bOk;
+
+    bOk = true;
+    memset(&options, 0, sizeof(options_t));
+    set_list(&options.bauds, defaultBauds, sizeof(defaultBauds) / sizeof(double));
+    set_list(&options.rtts_ms, defaultRtts, sizeof(defaultRtts) / sizeof(double));
+    set_list(&options.bers, defaultBers, sizeof(defaultBers) / sizeof(double));
+    set_list(&options.sizes, defaultSizes, sizeof(defaultSizes) / sizeof(double));
+    options.seed = 1;
+    options.runs = 1;
+
+    while (bOk)
+    {
+        c = getopt_long(argc, argv, "", long_options, &opt_index);
+        if ((int32_t) c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case OPTS_MODES:
+                options.modes = optarg;
+                break;
+
+            case OPTS_BAUDS:
+                bOk = parse_list(&options.bauds, optarg);
+                break;
+
+            case OPTS_RTTS:
+                bOk = parse_list(&options.rtts_ms, optarg);
+                break;
+
+            case OPTS_BERS:
+                bOk = parse_list(&options.bers, optarg);
+                break;
+
+            case OPTS_SIZES:
+                bOk = parse_list(&options.sizes, optarg);
+                break;
+
+            case OPTS_SEED:
+                options.seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case OPTS_RUNS:
+                options.runs = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_OUTPUT:
+                options.output = optarg;
+                break;
+
+            case OPTS_UNKNOWN:
+            default:
+                bOk = false;
+                break;
+        }
+    }
+
+    if (!bOk)
+    {
+        fprintf(stderr, "usage: %s [--modes m1,m2] [--baud b1,b2] [--rtt-ms r1,r2] [--ber e1,e2] [--size s1,s2] [--seed n] "
+                "[--runs n] [--output file.csv]\n", argv[0]);
+    }
+    return bOk;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* out;
+    uint8_t* pSent;
+    uint8_t* pReceived;
+    uint32_t maxSize;
+    uint32_t m;
+    uint32_t b;
+    uint32_t r;
+    uint32_t e;
+    uint32_t s;
+    uint32_t run;
+
+    if (!parse_options(argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+
+    maxSize = 0;
+    for (s = 0; s < options.sizes.count; s++)
+    {
+        if ((uint32_t) options.sizes.values[s] > maxSize)
+        {
+            maxSize = (uint32_t) options.sizes.values[s];
+        }
+    }
+    pSent = malloc(maxSize + 1);
+    pReceived = malloc(maxSize + LXMODEM_1K_BUFFER_MIN_SIZE);
+    if ((pSent == NULL) || (pReceived == NULL))
+    {
+        fprintf(stderr, "unable to allocate %u bytes\n", maxSize);
+        return EXIT_FAILURE;
+    }
+
+    out = stdout;
+    if (options.output != NULL)
+    {
+        out = fopen(options.output, "w");
+        if (out == NULL)
+        {
+            fprintf(stderr, "unable to create '%s'\n", options.output);
+            free(pSent);
+            free(pReceived);
+            return EXIT_FAILURE;
+        }
+    }
+
+    fprintf(out, "mode,baud,rtt_ms,ber,size,seed,result,time_s,goodput_Bps,efficiency,wire_bytes_tx,wire_bytes_rx,"
+            "retransmissions,naks,timeouts\n");
+    for (m = 0; m < BENCH_NB_MODES; m++)
+    {
+        if (!is_mode_selected(bench_modes[m].name))
+        {
+            continue;
+        }
+        for (b = 0; b < options.bauds.count; b++)
+        {
+            for (r = 0; r < options.rtts_ms.count; r++)
+            {
+                for (e = 0; e < options.bers.count; e++)
+                {
+                    for (s = 0; s < options.sizes.count; s++)
+                    {
+                        for (run = 0; run < options.runs; run++)
+                        {
+                            bench_run(out, &bench_modes[m], (uint32_t) options.bauds.values[b], options.rtts_ms.values[r],
+                                      options.bers.values[e], (uint32_t) options.sizes.values[s], options.seed + run, pSent, pReceived);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    free(pSent);
+    free(pReceived);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <inttypes.h>
+#include "lmodem_ring.h"
+
+// stress test and throughput of lmodem_ring between two threads.
+// stress: the producer pushes a pseudo random byte sequence in random sizes with push, push_byte and write spans,
+// the consumer pops it in random sizes with pop and read spans and checks every byte.
+// throughput: fixed chunk sizes, one producer thread and one consumer thread.
+
+#define BENCH_RING_SIZE             (64*1024)
+#define BENCH_STRESS_BYTES          (64ULL*1024*1024)
+#define BENCH_THROUGHPUT_BYTES      (512ULL*1024*1024)
+#define BENCH_MAX_CHUNK             (8192)
+
+typedef struct
+{
+    lmodem_ring ring;
+    uint64_t nb_bytes;
+    uint32_t chunk;                 // 0: random sizes and access modes
+    uint64_t seed;
+    uint64_t errors;
+} bench_ring_run;
+
+static uint8_t ring_buffer[BENCH_RING_SIZE];
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t bench_rand(uint64_t* pState)
+{
+    //xorshift64*
+    *pState ^= *pState >> 12;
+    *pState ^= *pState << 25;
+    *pState ^= *pState >> 27;
+    return *pState * 0x2545F4914F6CDD1DULL;
+}
+
+// byte n of the stream
+static inline uint8_t bench_byte(uint64_t n)
+{
+    return (uint8_t) ((n * 0x9E3779B1ULL) >> 13);
+}
+
+// a full or empty ring gives the cpu to the other side (the test also runs on a single core)
+static inline void bench_wait_if_idle(uint32_t nbDone)
+{
+    if (nbDone == 0)
+    {
+        sched_yield();
+    }
+}
+
+static void* bench_producer(void* arg)
+{
+    bench_ring_run* pRun;
+    uint8_t chunk[BENCH_MAX_CHUNK];
+    uint8_t* pSpan;
+    uint64_t rng;
+    uint64_t sent;
+    uint32_t size;
+    uint32_t mode;
+    uint32_t n;
+    uint32_t i;
+    uint32_t j;
+
+    pRun = (bench_ring_run*) arg;
+    rng = pRun->seed * 2 + 1;
+    sent = 0;
+    while (sent < pRun->nb_bytes)
+    {
+        size = (pRun->chunk > 0) ? pRun->chunk : (1 + (bench_rand(&rng) % BENCH_MAX_CHUNK));
+        if (size > pRun->nb_bytes - sent)
+        {
+            size = pRun->nb_bytes - sent;
+        }
+        mode = (pRun->chunk > 0) ? 0 : (bench_rand(&rng) % 3);
+
+        switch (mode)
+        {
+            case 0:
+                for (i = 0; i < size; i++)
+                {
+                    chunk[i] = bench_byte(sent + i);
+                }
+                n = 0;
+                while (n < size)
+                {
+                    i = lmodem_ring_push(&pRun->ring, &chunk[n], size - n);
+                    bench_wait_if_idle(i);
+                    n += i;
+                }
+                break;
+
+            case 1:
+                //like an interrupt handler, one byte at a time
+                for (i = 0; i < size; i++)
+                {
+                    while (!lmodem_ring_push_byte(&pRun->ring, bench_byte(sent + i)))
+                    {
+                        bench_wait_if_idle(0);
+                    }
+                }
+                break;
+
+            default:
+                //like a dma or a read(), directly in the ring
+                n = 0;
+                while (n < size)
+                {
+                    i = lmodem_ring_get_write_span(&pRun->ring, &pSpan);
+                    i = (i < (size - n)) ? i : (size - n);
+                    for (j = 0; j < i; j++)
+                    {
+                        pSpan[j] = bench_byte(sent + n + j);
+                    }
+                    lmodem_ring_commit(&pRun->ring, i);
+                    bench_wait_if_idle(i);
+                    n += i;
+                }
+                break;
+        }
+        sent += size;
+    }
+    return NULL;
+}
+
+static void* bench_consumer(void* arg)
+{
+    bench_ring_run* pRun;
+    uint8_t chunk[BENCH_MAX_CHUNK];
+    uint8_t* pSpan;
+    uint64_t rng;
+    uint64_t received;
+    uint32_t size;
+    uint32_t n;
+    uint32_t i;
+    bool bCheck;
+
+    pRun = (bench_ring_run*) arg;
+    rng = pRun->seed * 2 + 2;
+    received = 0;
+    bCheck = (pRun->chunk == 0);
+    while (received < pRun->nb_bytes)
+    {
+        size = (pRun->chunk > 0) ? pRun->chunk : (1 + (bench_rand(&rng) % BENCH_MAX_CHUNK));
+        if ((bCheck) && (bench_rand(&rng) & 1))
+        {
+            n = lmodem_ring_get_read_span(&pRun->ring, &pSpan);
+            n = (n < size) ? n : size;
+            for (i = 0; i < n; i++)
+            {
+                if (pSpan[i] != bench_byte(received + i))
+                {
+                    pRun->errors++;
+                }
+            }
+            lmodem_ring_release(&pRun->ring, n);
+        }
+        else
+        {
+            n = lmodem_ring_pop(&pRun->ring, chunk, size);
+            for (i = 0; (bCheck) && (i < n); i++)
+            {
+                if (chunk[i] != bench_byte(received + i))
+                {
+                    pRun->errors++;
+                }
+            }
+        }
+        bench_wait_if_idle(n);
+        received += n;
+    }
+    return NULL;
+}
+
+static bool bench_run(bench_ring_run* pRun, uint32_t ringSize, double* pSeconds)
+{
+    pthread_t producer;
+    pthread_t consumer;
+    double start;
+
+    if (!lmodem_ring_init(&pRun->ring, ring_buffer, ringSize))
+    {
+        return false;
+    }
+
+    start = bench_now();
+    if (pthread_create(&consumer, NULL, bench_consumer, pRun) != 0)
+    {
+        return false;
+    }
+    if (pthread_create(&producer, NULL, bench_producer, pRun) != 0)
+    {
+        //the consumer waits forever without producer
+        exit(EXIT_FAILURE);
+    }
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    *pSeconds = bench_now() - start;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    static const uint32_t ringSizes[] = { 16, 256, 4096, BENCH_RING_SIZE };
+    static const uint32_t chunks[] = { 1, 16, 128, 1024, 4096 };
+    bench_ring_run run;
+    double seconds;
+    bool bStressOnly;
+    bool bOk;
+    uint32_t i;
+
+    bStressOnly = (argc > 1) && (strcmp(argv[1], "--stress") == 0);
+    bOk = true;
+
+    for (i = 0; i < sizeof(ringSizes) / sizeof(ringSizes[0]); i++)
+    {
+        memset(&run, 0, sizeof(run));
+        run.nb_bytes = BENCH_STRESS_BYTES / (bStressOnly ? 4 : 1);
+        run.seed = i + 1;
+        bOk = bench_run(&run, ringSizes[i], &seconds) && bOk;
+        fprintf(stdout, "stress ring %6u bytes: %" PRIu64 " bytes, %" PRIu64 " errors, %.3f s\n", ringSizes[i], run.nb_bytes,
+                run.errors, seconds);
+        bOk = bOk && (run.errors == 0);
+    }
+
+    if (!bStressOnly)
+    {
+        for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+        {
+            memset(&run, 0, sizeof(run));
+            run.nb_bytes = BENCH_THROUGHPUT_BYTES / ((chunks[i] == 1) ? 16 : 1);
+            run.chunk = chunks[i];
+            bOk = bench_run(&run, BENCH_RING_SIZE, &seconds) && bOk;
+            fprintf(stdout, "throughput chunk %5u bytes: %8.1f MB/s\n", chunks[i], run.nb_bytes / seconds / 1e6);
+        }
+    }
+
+    fprintf(stdout, "%s\n", bOk ? "test ok" : "test failed");
+    return bOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "block_cache.h"
+
+#define BLOCK_CACHE_MAGIC          (0x4C4D4254u)   // LMBT
+#define BLOCK_CACHE_VERSION        (1)
+// blocks framed by a worker at a time
+#define BLOCK_CACHE_CHUNK          (64)
+
+// header of a saved table, followed by the blocks
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t protocol;
+    uint32_t opts;
+    uint32_t image_size;
+    uint32_t image_hash;                // FNV-1a of the image
+    uint32_t stride;
+    uint32_t nb_blocks;
+    uint32_t trailer_size;
+    uint32_t reserved;
+} block_cache_file_header;
+
+typedef struct
+{
+    block_cache* pCache;
+    atomic_uint next;
+} block_cache_pool;
+
+static void block_cache_fill_header(block_cache* pThis, block_cache_file_header* pHeader)
+{
+    memset(pHeader, 0, sizeof(block_cache_file_header));
+    pHeader->magic = BLOCK_CACHE_MAGIC;
+    pHeader->version = BLOCK_CACHE_VERSION;
+    pHeader->protocol = pThis->table.protocol;
+    pHeader->opts = pThis->framer.opts;
+    pHeader->image_size = pThis->framer.ramfile.write_offset;
+    pHeader->image_hash = lmodem_fnv1a(LMODEM_FNV1A_INIT, pThis->framer.ramfile.buffer, pThis->framer.ramfile.write_offset);
+    pHeader->stride = pThis->table.stride;
+    pHeader->nb_blocks = pThis->table.nb_blocks;
+    pHeader->trailer_size = pThis->table.trailer_size;
+}
+
+bool block_cache_init(block_cache* pThis, uint8_t* data, uint32_t size, lxmodem_opts opts, lmodem_protocol protocol)
+{
+    uint32_t tableSize;
+    uint32_t i;
+
+    memset(pThis, 0, sizeof(block_cache));
+    lmodem_init(&pThis->framer, opts);
+    lmodem_set_file_buffer(&pThis->framer, data, size);
+    lmodem_buffer_set_write_offset(&pThis->framer.ramfile, size);
+    tableSize = lmodem_block_table_init(&pThis->framer, protocol, &pThis->table);
+
+    pThis->table.blocks = malloc((size_t) tableSize + 1);
+    pThis->built = calloc(pThis->table.nb_blocks + 1, sizeof(atomic_uchar));
+    if ((pThis->table.blocks == NULL) || (pThis->built == NULL))
+    {
+        free(pThis->table.blocks);
+        free(pThis->built);
+        return false;
+    }
+    for (i = 0; i < pThis->table.nb_blocks; i++)
+    {
+        atomic_init(&pThis->built[i], 0);
+    }
+    atomic_init(&pThis->nb_built, 0);
+    pthread_mutex_init(&pThis->lock, NULL);
+    return true;
+}
+
+static void* block_cache_worker(void* arg)
+{
+    block_cache_pool* pPool;
+    block_cache* pCache;
+    uint32_t first;
+
+    pPool = (block_cache_pool*) arg;
+    pCache = pPool->pCache;
+    //the workers take the chunks in turn, each block is framed by one of them
+    first = atomic_fetch_add(&pPool->next, BLOCK_CACHE_CHUNK);
+    while (first < pCache->table.nb_blocks)
+    {
+        lmodem_block_table_build(&pCache->framer, &pCache->table, first, BLOCK_CACHE_CHUNK);
+        first = atomic_fetch_add(&pPool->next, BLOCK_CACHE_CHUNK);
+    }
+    return NULL;
+}
+
+bool block_cache_prebuild(block_cache* pThis, uint32_t nbThreads)
+{
+    block_cache_pool pool;
+    pthread_t* threads;
+    uint32_t nbStarted;
+    uint32_t i;
+
+    pool.pCache = pThis;
+    atomic_init(&pool.next, 0);
+    threads = calloc(nbThreads + 1, sizeof(pthread_t));
+    if (threads == NULL)
+    {
+        return false;
+    }
+    for (nbStarted = 0; nbStarted < nbThreads; nbStarted++)
+    {
+        if (pthread_create(&threads[nbStarted], NULL, block_cache_worker, &pool) != 0)
+        {
+            break;
+        }
+    }
+    //the calling thread works too, it finishes the table alone if no thread could start
+    block_cache_worker(&pool);
+    for (i = 0; i < nbStarted; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    atomic_store(&pThis->nb_built, pThis->table.nb_blocks);
+    pThis->complete = true;
+    return true;
+}
+
+bool block_cache_save(block_cache* pThis, const char* filename)
+{
+    block_cache_file_header header;
+    FILE* f;
+    size_t tableSize;
+    bool bOk;
+
+    if (!pThis->complete)
+    {
+        return false;
+    }
+
+    f = fopen(filename, "wb");
+    if (f == NULL)
+    {
+        return false;
+    }
+    block_cache_fill_header(pThis, &header);
+    tableSize = (size_t) pThis->table.nb_blocks * pThis->table.stride;
+    bOk = (fwrite(&header, sizeof(header), 1, f) == 1) && (fwrite(pThis->table.blocks, 1, tableSize, f) == tableSize);
+    bOk = (fclose(f) == 0) && bOk;
+    return bOk;
+}
+
+bool block_cache_map(block_cache* pThis, const char* filename)
+{
+    block_cache_file_header expected;
+    block_cache_file_header* pHeader;
+    struct stat st;
+    uint8_t* pMap;
+    size_t tableSize;
+    int fd;
+    bool bOk;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    block_cache_fill_header(pThis, &expected);
+    tableSize = (size_t) pThis->table.nb_blocks * pThis->table.stride;
+    pMap = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && ((size_t) st.st_size == sizeof(expected) + tableSize))
+    {
+        pMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (pMap == MAP_FAILED)
+    {
+        return false;
+    }
+
+    //a table of another image or of other options is not used
+    pHeader = (block_cache_file_header*) pMap;
+    bOk = (memcmp(pHeader, &expected, sizeof(expected)) == 0);
+    if (!bOk)
+    {
+        munmap(pMap, st.st_size);
+        return false;
+    }
+
+    free(pThis->table.blocks);
+    pThis->table.blocks = pMap + sizeof(block_cache_file_header);
+    pThis->mapped = true;
+    pThis->mapped_size = st.st_size;
+    atomic_store(&pThis->nb_built, 0);
+    pThis->complete = true;
+    return true;
+}
+
+const uint8_t* block_cache_get(block_cache* pThis, uint32_t index, uint32_t* pSize)
+{
+    if ((!pThis->complete) && (index < pThis->table.nb_blocks)
+            && (!atomic_load_explicit(&pThis->built[index], memory_order_acquire)))
+    {
+        //first context at this block, the others wait for it only during its framing
+        pthread_mutex_lock(&pThis->lock);
+        if (!atomic_load_explicit(&pThis->built[index], memory_order_relaxed))
+        {
+            lmodem_block_table_build(&pThis->framer, &pThis->table, index, 1);
+            atomic_fetch_add_explicit(&pThis->nb_built, 1, memory_order_relaxed);
+            atomic_store_explicit(&pThis->built[index], 1, memory_order_release);
+        }
+        pthread_mutex_unlock(&pThis->lock);
+    }
+
+    return lmodem_block_table_get(&pThis->table, index, pSize);
+}
+
+void block_cache_destroy(block_cache* pThis)
+{
+    if (pThis->mapped)
+    {
+        munmap(pThis->table.blocks - sizeof(block_cache_file_header), pThis->mapped_size);
+    }
+    else
+    {
+        free(pThis->table.blocks);
+    }
+    free(pThis->built);
+    pthread_mutex_destroy(&pThis->lock);
+    pThis->table.blocks = NULL;
+    pThis->built = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "lmodem.h"
+
+// framed blocks of one image shared by several emitting contexts (lmodem_set_block_source_cb), kept in an
+// lmodem_block_table. either each block is framed by the first context which needs it and the others read it (the
+// blocks do not change once built, only the build takes the lock), or the whole table is framed beforehand by a
+// pool of threads, or mapped from a file saved by a previous run.
+
+typedef struct
+{
+    modem_context_t framer;             // frames the blocks of the image, never used for a transfer
+    lmodem_block_table table;
+    atomic_uchar* built;
+    atomic_uint nb_built;
+    bool complete;                      // every block built (prebuild or mapped file), no more lock
+    bool mapped;
+    size_t mapped_size;
+    pthread_mutex_t lock;
+} block_cache;
+
+extern bool block_cache_init(block_cache* pThis, uint8_t* data, uint32_t size, lxmodem_opts opts, lmodem_protocol protocol);
+// frames the whole table with nbThreads threads
+extern bool block_cache_prebuild(block_cache* pThis, uint32_t nbThreads);
+// the file holds the table and what it was built from, block_cache_map fails when it does not match the image
+extern bool block_cache_save(block_cache* pThis, const char* filename);
+extern bool block_cache_map(block_cache* pThis, const char* filename);
+// same contract as the block source callback: the framed block index and its size, NULL after the last one
+extern const uint8_t* block_cache_get(block_cache* pThis, uint32_t index, uint32_t* pSize);
+extern void block_cache_destroy(block_cache* pThis);
+
+#endif /* BLOCK_CACHE_H */
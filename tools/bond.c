@@ -0,0 +1,605 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include "lmodem.h"
+#include "linksim.h"
+#include "serial.h"
+#include "stripe.h"
+
+// one file over several links at once: the file is split in stripes proportional to the baud rates of the links and
+// each link runs its own XMODEM/YMODEM session carrying a stripe header and the bytes of its stripe (tools/stripe.h).
+// the receiver takes a session on each of its ports and rebuilds the file from the headers, in any port order.
+// --sim runs both sides over simulated links and compares the time with the whole file over the fastest link alone.
+
+#define BOND_MAX_LINKS          (16)
+#define BOND_FILENAME_SIZE      (256)
+#define BOND_DEFAULT_MAX_SIZE   (1024*1024)
+
+typedef enum
+{
+    OPTS_PROTOCOL,
+    OPTS_CRC,
+    OPTS_1K,
+    OPTS_TX,
+    OPTS_RX,
+    OPTS_FILE,
+    OPTS_DEVICE,
+    OPTS_NB_STOP,
+    OPTS_MAX_SIZE,
+    OPTS_SIM,
+    OPTS_BAUD,
+    OPTS_SIZE,
+    OPTS_BER,
+    OPTS_SEED,
+    OPTS_MIN_SPEEDUP,
+    OPTS_UNKNOWN = '?'
+} OPTS;
+
+typedef struct
+{
+    lmodem_protocol protocol;
+    uint32_t crc;
+    uint32_t xmodem_blksize;
+    uint32_t tx;
+    uint32_t rx;
+    char* file;
+    char* devices[BOND_MAX_LINKS];
+    uint32_t bauds[BOND_MAX_LINKS];
+    uint32_t nb_links;
+    uint32_t nb_stop;
+    uint32_t max_size;
+    uint32_t sim;
+    uint32_t size;
+    double ber;
+    uint64_t seed;
+    double min_speedup;
+} options_t;
+
+typedef struct
+{
+    uint32_t index;
+    uint32_t baud;
+    int32_t serial_fd;
+    uint8_t* session;                   // stripe header and stripe (emission)
+    uint32_t session_size;
+    uint8_t* received;                  // session received (reception)
+    uint32_t received_size;
+    uint8_t line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    uint8_t rx_line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    char filename[BOND_FILENAME_SIZE];
+    char rx_filename[BOND_FILENAME_SIZE];
+    char stripe_name[BOND_FILENAME_SIZE];
+    int32_t result;
+    bool bOk;
+    uint64_t time_ns;                   // virtual time (--sim)
+    pthread_t thread;
+} bond_link;
+
+static options_t options;
+static lxmodem_opts bond_opts;
+static uint8_t* bond_data;
+static uint32_t bond_size;
+static char* bond_name;
+static bond_link bond_links[BOND_MAX_LINKS];
+
+static struct option long_options[] =
+{
+    {"protocol", required_argument, 0, OPTS_PROTOCOL},
+    {"crc", no_argument, 0, OPTS_CRC},
+    {"1k", no_argument, 0, OPTS_1K},
+    {"tx", no_argument, 0, OPTS_TX},
+    {"rx", no_argument, 0, OPTS_RX},
+    {"file", required_argument, 0, OPTS_FILE},
+    {"device", required_argument, 0, OPTS_DEVICE},
+    {"nb-stop", required_argument, 0, OPTS_NB_STOP},
+    {"max-size", required_argument, 0, OPTS_MAX_SIZE},
+    {"sim", no_argument, 0, OPTS_SIM},
+    {"baud", required_argument, 0, OPTS_BAUD},
+    {"size", required_argument, 0, OPTS_SIZE},
+    {"ber", required_argument, 0, OPTS_BER},
+    {"seed", required_argument, 0, OPTS_SEED},
+    {"min-speedup", required_argument, 0, OPTS_MIN_SPEEDUP},
+    {0, 0, 0, 0}
+};
+
+static bool parse_options(int argc, char* argv[]);
+
+static void bond_setup_sender(bond_link* pLink, modem_context_t* pCtx, uint8_t* data, uint32_t size, char* name)
+{
+    lmodem_init(pCtx, bond_opts);
+    lmodem_set_user_data(pCtx, pLink);
+    lmodem_set_line_buffer(pCtx, pLink->line_buffer, LXMODEM_1K_BUFFER_MIN_SIZE);
+    lmodem_set_filename_buffer(pCtx, pLink->filename, BOND_FILENAME_SIZE);
+    lmodem_set_file_buffer(pCtx, data, size);
+    lmodem_buffer_set_write_offset(&pCtx->ramfile, size);
+    if (options.protocol == YMODEM)
+    {
+        lmodem_metadata_set_filename(pCtx, name);
+        lmodem_metadata_set_filesize(pCtx, size);
+    }
+}
+
+static void bond_setup_receiver(bond_link* pLink, modem_context_t* pCtx, uint32_t maxSize)
+{
+    lmodem_init(pCtx, bond_opts);
+    lmodem_set_user_data(pCtx, pLink);
+    lmodem_set_line_buffer(pCtx, pLink->rx_line_buffer, LXMODEM_1K_BUFFER_MIN_SIZE);
+    lmodem_set_filename_buffer(pCtx, pLink->rx_filename, BOND_FILENAME_SIZE);
+    lmodem_set_file_buffer(pCtx, pLink->received, maxSize);
+}
+
+// the header and the bytes of the stripe of the link, in one buffer sent as a file
+static bool bond_build_sessions(void)
+{
+    stripe_header header;
+    uint32_t offsets[BOND_MAX_LINKS];
+    uint32_t sizes[BOND_MAX_LINKS];
+    bond_link* pLink;
+    uint32_t i;
+
+    stripe_split(bond_size, options.bauds, options.nb_links, offsets, sizes);
+    header.count = options.nb_links;
+    header.total = bond_size;
+    header.file_hash = lmodem_fnv1a(LMODEM_FNV1A_INIT, bond_data, bond_size);
+    for (i = 0; i < options.nb_links; i++)
+    {
+        pLink = &bond_links[i];
+        header.index = i;
+        header.offset = offsets[i];
+        header.size = sizes[i];
+        pLink->session_size = STRIPE_HEADER_SIZE + sizes[i];
+        pLink->session = malloc(pLink->session_size);
+        if (pLink->session == NULL)
+        {
+            return false;
+        }
+        stripe_header_write(&header, pLink->session);
+        memcpy(&pLink->session[STRIPE_HEADER_SIZE], &bond_data[offsets[i]], sizes[i]);
+        snprintf(pLink->stripe_name, BOND_FILENAME_SIZE, "%s.%u", bond_name, i);
+    }
+    return true;
+}
+
+static int32_t bond_sim_emit(modem_context_t* pThis)
+{
+    return lmodem_emit(pThis, options.protocol);
+}
+
+static int32_t bond_sim_receive(modem_context_t* pThis)
+{
+    return lmodem_receive(pThis, options.protocol);
+}
+
+// virtual time of one session of size bytes over a link, both sides in the simulator
+static bool bond_sim_session(bond_link* pLink, uint8_t* data, uint32_t size, char* name, uint64_t seed)
+{
+    linksim sim;
+    linksim_config config;
+    modem_context_t* pRx;
+    bool bOk;
+
+    memset(&config, 0, sizeof(config));
+    config.baud = pLink->baud;
+    config.ber = options.ber;
+    linksim_init(&sim, &config, &config, seed);
+    bond_setup_sender(pLink, linksim_get_context(&sim, LINKSIM_SIDE_A), data, size, name);
+    pRx = linksim_get_context(&sim, LINKSIM_SIDE_B);
+    bond_setup_receiver(pLink, pRx, size + LXMODEM_1K_BUFFER_MIN_SIZE);
+
+    bOk = linksim_run(&sim, bond_sim_emit, bond_sim_receive);
+    pLink->result = linksim_get_result(&sim, LINKSIM_SIDE_A);
+    pLink->received_size = pRx->ramfile.write_offset;
+    pLink->time_ns = linksim_get_time_ns(&sim);
+    bOk = bOk && (pLink->result >= 0) && (linksim_get_result(&sim, LINKSIM_SIDE_B) >= 0);
+    linksim_destroy(&sim);
+    return bOk;
+}
+
+static void* bond_sim_thread(void* arg)
+{
+    bond_link* pLink;
+
+    pLink = (bond_link*) arg;
+    pLink->bOk = bond_sim_session(pLink, pLink->session, pLink->session_size, pLink->stripe_name, options.seed + pLink->index);
+    return NULL;
+}
+
+static bool bond_serial_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    bond_link* pLink;
+    pLink = (bond_link*) lmodem_get_user_data(pThis);
+    return serial_read(pLink->serial_fd, data, size);
+}
+
+static void bond_serial_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    bond_link* pLink;
+    pLink = (bond_link*) lmodem_get_user_data(pThis);
+    serial_write(pLink->serial_fd, data, size);
+}
+
+static void* bond_serial_thread(void* arg)
+{
+    modem_context_t ctx;
+    bond_link* pLink;
+
+    pLink = (bond_link*) arg;
+    if (options.tx > 0)
+    {
+        bond_setup_sender(pLink, &ctx, pLink->session, pLink->session_size, pLink->stripe_name);
+    }
+    else
+    {
+        bond_setup_receiver(pLink, &ctx, options.max_size);
+    }
+    lmodem_set_getchar_cb(&ctx, bond_serial_getchar);
+    lmodem_set_putchar_cb(&ctx, bond_serial_putchar);
+    pLink->result = (options.tx > 0) ? lmodem_emit(&ctx, options.protocol) : lmodem_receive(&ctx, options.protocol);
+    pLink->received_size = ctx.ramfile.write_offset;
+    pLink->bOk = (pLink->result >= 0);
+    serial_close(pLink->serial_fd);
+    return NULL;
+}
+
+static bool bond_load(void)
+{
+    FILE* f;
+    long size;
+    uint64_t rng;
+    uint32_t i;
+
+    if (options.sim > 0)
+    {
+        bond_size = options.size;
+        bond_name = "bond.bin";
+        bond_data = malloc(bond_size + 1);
+        if (bond_data == NULL)
+        {
+            return false;
+        }
+        rng = options.seed + 1;
+        for (i = 0; i < bond_size; i++)
+        {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            bond_data[i] = (uint8_t) (rng >> 56);
+        }
+        return true;
+    }
+
+    f = fopen(options.file, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "unable to open '%s'\n", options.file);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bond_data = malloc(size + 1);
+    bond_size = (uint32_t) size;
+    bond_name = basename(options.file);
+    if ((bond_data == NULL) || (fread(bond_data, 1, size, f) != (size_t) size))
+    {
+        fprintf(stderr, "unable to read '%s'\n", options.file);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+// the stripes in the order of their offsets, whatever the link they came from
+static bool bond_reassemble(stripe_assembly* pAssembly)
+{
+    bond_link* pLink;
+    uint32_t i;
+    bool bOk;
+
+    bOk = true;
+    stripe_assembly_init(pAssembly);
+    for (i = 0; i < options.nb_links; i++)
+    {
+        pLink = &bond_links[i];
+        if ((!pLink->bOk) || (!stripe_assembly_add(pAssembly, pLink->received, pLink->received_size)))
+        {
+            fprintf(stdout, "link %u: no valid stripe\n", i);
+            bOk = false;
+        }
+    }
+    return bOk && stripe_assembly_complete(pAssembly);
+}
+
+static bool bond_run_sim(void)
+{
+    stripe_assembly assembly;
+    stripe_header header;
+    bond_link baseline;
+    uint64_t bondTime;
+    uint32_t fastest;
+    uint32_t i;
+    double speedup;
+    bool bOk;
+
+    bOk = bond_build_sessions();
+    for (i = 0; (bOk) && (i < options.nb_links); i++)
+    {
+        bond_links[i].received = malloc(bond_links[i].session_size + LXMODEM_1K_BUFFER_MIN_SIZE);
+        bOk = (bond_links[i].received != NULL) && (pthread_create(&bond_links[i].thread, NULL, bond_sim_thread, &bond_links[i]) == 0);
+        if (!bOk)
+        {
+            options.nb_links = i;
+        }
+    }
+
+    bondTime = 0;
+    fastest = 0;
+    for (i = 0; i < options.nb_links; i++)
+    {
+        pthread_join(bond_links[i].thread, NULL);
+        stripe_header_read(&header, bond_links[i].session, bond_links[i].session_size);
+        fprintf(stdout, "link %u (%u baud): stripe %u, offset %u, %u bytes, %s, virtual time %.3f s\n", i, bond_links[i].baud,
+                header.index, header.offset, header.size, bond_links[i].bOk ? "ok" : "failed", bond_links[i].time_ns / 1e9);
+        //the links run concurrently, the slowest gives the time of the transfer
+        bondTime = (bond_links[i].time_ns > bondTime) ? bond_links[i].time_ns : bondTime;
+        fastest = (bond_links[i].baud > bond_links[fastest].baud) ? i : fastest;
+    }
+
+    bOk = bOk && bond_reassemble(&assembly) && (assembly.total == bond_size) && (memcmp(assembly.data, bond_data, bond_size) == 0);
+    stripe_assembly_destroy(&assembly);
+
+    //the whole file without stripe header over the fastest link alone
+    memset(&baseline, 0, sizeof(baseline));
+    baseline.baud = bond_links[fastest].baud;
+    baseline.received = malloc(bond_size + LXMODEM_1K_BUFFER_MIN_SIZE);
+    if ((baseline.received != NULL) && (bond_sim_session(&baseline, bond_data, bond_size, bond_name, options.seed)))
+    {
+        speedup = (bondTime > 0) ? ((double) baseline.time_ns / bondTime) : 0.0;
+        fprintf(stdout, "%u bytes over %u links: %.3f s, %.0f B/s, over link %u alone: %.3f s, speedup %.2f\n", bond_size,
+                options.nb_links, bondTime / 1e9, (bondTime > 0) ? (bond_size * 1e9 / bondTime) : 0.0, fastest,
+                baseline.time_ns / 1e9, speedup);
+        if ((options.min_speedup > 0) && (speedup < options.min_speedup))
+        {
+            fprintf(stdout, "speedup below %.2f\n", options.min_speedup);
+            bOk = false;
+        }
+    }
+    free(baseline.received);
+
+    for (i = 0; i < options.nb_links; i++)
+    {
+        free(bond_links[i].session);
+        free(bond_links[i].received);
+    }
+    return bOk;
+}
+
+static bool bond_run_serial(void)
+{
+    stripe_assembly assembly;
+    FILE* f;
+    uint32_t i;
+    bool bOk;
+
+    bOk = (options.tx == 0) || bond_build_sessions();
+    for (i = 0; (bOk) && (i < options.nb_links); i++)
+    {
+        if (options.rx > 0)
+        {
+            bond_links[i].received = malloc(options.max_size);
+            bOk = (bond_links[i].received != NULL);
+        }
+        bond_links[i].serial_fd = serial_setup(options.devices[i], options.bauds[i], SERIAL_PARITY_OFF, SERIAL_RTSCTS_OFF, options.nb_stop);
+        if (bond_links[i].serial_fd < 0)
+        {
+            fprintf(stderr, "unable to open '%s'\n", options.devices[i]);
+            bOk = false;
+        }
+        else
+        {
+            bOk = bOk && (pthread_create(&bond_links[i].thread, NULL, bond_serial_thread, &bond_links[i]) == 0);
+        }
+        if (!bOk)
+        {
+            options.nb_links = i;
+        }
+    }
+
+    for (i = 0; i < options.nb_links; i++)
+    {
+        pthread_join(bond_links[i].thread, NULL);
+        fprintf(stdout, "%s: %s %d, %s\n", options.devices[i], (options.tx > 0) ? "emitted" : "received", bond_links[i].result,
+                bond_links[i].bOk ? "ok" : "failed");
+        bOk = bOk && bond_links[i].bOk;
+    }
+
+    if ((bOk) && (options.rx > 0))
+    {
+        bOk = bond_reassemble(&assembly);
+        f = bOk ? fopen(options.file, "wb") : NULL;
+        if (f != NULL)
+        {
+            bOk = (fwrite(assembly.data, 1, assembly.total, f) == assembly.total);
+            fclose(f);
+            fprintf(stdout, "%u bytes from %u stripes written to '%s'\n", assembly.total, assembly.count, options.file);
+        }
+        else
+        {
+            bOk = false;
+        }
+        stripe_assembly_destroy(&assembly);
+    }
+
+    for (i = 0; i < options.nb_links; i++)
+    {
+        free(bond_links[i].session);
+        free(bond_links[i].received);
+    }
+    return bOk;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t i;
+    bool bOk;
+
+    bOk = parse_options(argc, argv) && ((options.rx > 0) || bond_load());
+    if (!bOk)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    bond_opts = lxmodem_128_with_chksum;
+    if ((options.protocol == YMODEM) || (options.xmodem_blksize > 0))
+    {
+        bond_opts = lxmodem_1k;
+    }
+    else if (options.crc > 0)
+    {
+        bond_opts = lxmodem_128_with_crc;
+    }
+
+    for (i = 0; i < options.nb_links; i++)
+    {
+        bond_links[i].index = i;
+        bond_links[i].baud = options.bauds[i];
+    }
+    bOk = (options.sim > 0) ? bond_run_sim() : bond_run_serial();
+    free(bond_data);
+    fprintf(stdout, "%s\n", bOk ? "test ok" : "test failed");
+    return bOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool parse_options(int argc, char* argv[])
+{
+    char* pBaud;
+    uint32_t nbBauds;
+    uint32_t i;
+    int opt_index;
+    OPTS c;
+
+    memset(&options, 0, sizeof(options_t));
+    options.nb_stop = 1;
+    options.max_size = BOND_DEFAULT_MAX_SIZE;
+    options.size = 64 * 1024;
+    options.seed = 1;
+    nbBauds = 0;
+
+    while (1)
+    {
+        c = getopt_long(argc, argv, "", long_options, &opt_index);
+        if ((int32_t) c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case OPTS_PROTOCOL:
+                options.protocol = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_CRC:
+                options.crc = 1;
+                break;
+
+            case OPTS_1K:
+                options.xmodem_blksize = 1;
+                break;
+
+            case OPTS_TX:
+                options.tx = 1;
+                break;
+
+            case OPTS_RX:
+                options.rx = 1;
+                break;
+
+            case OPTS_FILE:
+                options.file = optarg;
+                break;
+
+            case OPTS_DEVICE:
+                //<device>[:<baud>]
+                if (options.nb_links >= BOND_MAX_LINKS)
+                {
+                    fprintf(stdout, "device: at most %u links\n", BOND_MAX_LINKS);
+                    return false;
+                }
+                pBaud = strchr(optarg, ':');
+                options.bauds[options.nb_links] = (pBaud != NULL) ? strtoul(pBaud + 1, NULL, 0) : 115200;
+                if (pBaud != NULL)
+                {
+                    *pBaud = '\0';
+                }
+                options.devices[options.nb_links++] = optarg;
+                break;
+
+            case OPTS_NB_STOP:
+                options.nb_stop = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_MAX_SIZE:
+                options.max_size = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_SIM:
+                options.sim = 1;
+                break;
+
+            case OPTS_BAUD:
+                //one simulated link per baud rate: --baud 115200,115200,57600
+                for (pBaud = strtok(optarg, ","); (pBaud != NULL) && (nbBauds < BOND_MAX_LINKS); pBaud = strtok(NULL, ","))
+                {
+                    options.bauds[nbBauds++] = strtoul(pBaud, NULL, 0);
+                }
+                break;
+
+            case OPTS_SIZE:
+                options.size = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_BER:
+                options.ber = strtod(optarg, NULL);
+                break;
+
+            case OPTS_SEED:
+                options.seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case OPTS_MIN_SPEEDUP:
+                options.min_speedup = strtod(optarg, NULL);
+                break;
+
+            case OPTS_UNKNOWN:
+            default:
+                fprintf(stdout, "unknow options\n");
+                return false;
+        }
+    }
+
+    if ((options.protocol != XMODEM) && (options.protocol != YMODEM))
+    {
+        fprintf(stdout, "protocol: unknown\n");
+        return false;
+    }
+
+    if (options.sim > 0)
+    {
+        options.nb_links = (nbBauds > 0) ? nbBauds : 2;
+        for (i = nbBauds; i < options.nb_links; i++)
+        {
+            options.bauds[i] = 115200;
+        }
+    }
+    else if ((options.nb_links == 0) || (options.file == NULL) || ((options.tx > 0) == (options.rx > 0)))
+    {
+        fprintf(stdout, "usage: %s --tx|--rx --file <file> --device <device>[:<baud>] [--device ...] or --sim "
+                "[--baud b1,b2,...] [--size n] [--ber e] [--seed n] [--min-speedup r]\n", argv[0]);
+        return false;
+    }
+    return true;
+}
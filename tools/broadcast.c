@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include "lmodem.h"
+#include "linksim.h"
+#include "serial.h"
+#include "block_cache.h"
+
+// one image sent to several devices at once, one thread and one context per port: every block is framed once in
+// a shared cache, each port keeps its own ACK/NAK/retry state so a slow or dead device does not hold back the
+// others. --sim replaces the serial ports by receivers over the link simulator. --prebuild frames the whole image
+// beforehand with a pool of --threads threads, --table <file> maps the table saved by a previous run (built and
+// saved when the file is missing or was built from another image).
+
+#define BROADCAST_MAX_PORTS        (64)
+#define BROADCAST_FILENAME_SIZE    (256)
+#define BROADCAST_PADDING          (0x1A)
+
+typedef enum
+{
+    OPTS_PROTOCOL,
+    OPTS_CRC,
+    OPTS_1K,
+    OPTS_FILE,
+    OPTS_DEVICE,
+    OPTS_SPEED,
+    OPTS_NB_STOP,
+    OPTS_SIM,
+    OPTS_SIZE,
+    OPTS_BER,
+    OPTS_DEAD,
+    OPTS_SEED,
+    OPTS_PREBUILD,
+    OPTS_THREADS,
+    OPTS_TABLE,
+    OPTS_UNKNOWN = '?'
+} OPTS;
+
+typedef struct
+{
+    lmodem_protocol protocol;
+    uint32_t crc;
+    uint32_t xmodem_blksize;
+    char* file;
+    char* devices[BROADCAST_MAX_PORTS];
+    uint32_t nb_devices;
+    uint32_t speed;
+    uint32_t nb_stop;
+    uint32_t sim;
+    uint32_t size;
+    double ber;
+    uint32_t dead;
+    uint64_t seed;
+    uint32_t prebuild;
+    uint32_t threads;
+    char* table;
+} options_t;
+
+// state of one port, given to the callbacks through the user data
+typedef struct
+{
+    uint32_t index;
+    modem_context_t ctx;                // serial port
+    linksim sim;                        // simulated port, the contexts are in the simulator
+    int32_t serial_fd;
+    uint8_t line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    uint8_t rx_line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    char filename[BROADCAST_FILENAME_SIZE];
+    uint8_t* received;
+    uint64_t blocks_served;
+    int32_t result;
+    bool bOk;
+    pthread_t thread;
+} broadcast_port;
+
+static options_t options;
+static lxmodem_opts broadcast_opts;
+static block_cache broadcast_cache;
+static uint8_t* broadcast_data;
+static uint32_t broadcast_size;
+static char* broadcast_name;
+
+static struct option long_options[] =
+{
+    {"protocol", required_argument, 0, OPTS_PROTOCOL},
+    {"crc", no_argument, 0, OPTS_CRC},
+    {"1k", no_argument, 0, OPTS_1K},
+    {"file", required_argument, 0, OPTS_FILE},
+    {"device", required_argument, 0, OPTS_DEVICE},
+    {"speed", required_argument, 0, OPTS_SPEED},
+    {"nb-stop", required_argument, 0, OPTS_NB_STOP},
+    {"sim", required_argument, 0, OPTS_SIM},
+    {"size", required_argument, 0, OPTS_SIZE},
+    {"ber", required_argument, 0, OPTS_BER},
+    {"dead", required_argument, 0, OPTS_DEAD},
+    {"seed", required_argument, 0, OPTS_SEED},
+    {"prebuild", no_argument, 0, OPTS_PREBUILD},
+    {"threads", required_argument, 0, OPTS_THREADS},
+    {"table", required_argument, 0, OPTS_TABLE},
+    {0, 0, 0, 0}
+};
+
+static bool parse_options(int argc, char* argv[]);
+
+static const uint8_t* broadcast_get_block(modem_context_t* pThis, uint32_t index, uint32_t* pSize)
+{
+    broadcast_port* pPort;
+    const uint8_t* pBlock;
+
+    pPort = (broadcast_port*) lmodem_get_user_data(pThis);
+    pBlock = block_cache_get(&broadcast_cache, index, pSize);
+    if (pBlock != NULL)
+    {
+        pPort->blocks_served++;
+    }
+    return pBlock;
+}
+
+static void broadcast_setup_sender(broadcast_port* pPort, modem_context_t* pCtx)
+{
+    lmodem_init(pCtx, broadcast_opts);
+    lmodem_set_user_data(pCtx, pPort);
+    lmodem_set_line_buffer(pCtx, pPort->line_buffer, LXMODEM_1K_BUFFER_MIN_SIZE);
+    lmodem_set_filename_buffer(pCtx, pPort->filename, BROADCAST_FILENAME_SIZE);
+    //the image is only read through the cache, the file buffer gives the size to the progress
+    lmodem_set_file_buffer(pCtx, broadcast_data, broadcast_size);
+    lmodem_buffer_set_write_offset(&pCtx->ramfile, broadcast_size);
+    lmodem_set_block_source_cb(pCtx, broadcast_get_block);
+    if (options.protocol == YMODEM)
+    {
+        lmodem_metadata_set_filename(pCtx, broadcast_name);
+        lmodem_metadata_set_filesize(pCtx, broadcast_size);
+    }
+}
+
+static int32_t broadcast_sim_emit(modem_context_t* pThis)
+{
+    return lmodem_emit(pThis, options.protocol);
+}
+
+static int32_t broadcast_sim_receive(modem_context_t* pThis)
+{
+    return lmodem_receive(pThis, options.protocol);
+}
+
+static bool broadcast_sim_check(broadcast_port* pPort)
+{
+    modem_context_t* pRx;
+    uint32_t receivedSize;
+    uint32_t i;
+    bool bOk;
+
+    pRx = linksim_get_context(&pPort->sim, LINKSIM_SIDE_B);
+    receivedSize = pRx->ramfile.write_offset;
+    bOk = (linksim_get_result(&pPort->sim, LINKSIM_SIDE_B) >= 0) && (receivedSize >= broadcast_size)
+          && (memcmp(broadcast_data, pPort->received, broadcast_size) == 0);
+    for (i = broadcast_size; (bOk) && (i < receivedSize); i++)
+    {
+        bOk = (pPort->received[i] == BROADCAST_PADDING);
+    }
+    if ((bOk) && (options.protocol == YMODEM))
+    {
+        bOk = (receivedSize == broadcast_size);
+    }
+    return bOk;
+}
+
+static void* broadcast_sim_thread(void* arg)
+{
+    broadcast_port* pPort;
+    linksim_config config;
+    modem_context_t* pRx;
+
+    pPort = (broadcast_port*) arg;
+    memset(&config, 0, sizeof(config));
+    config.baud = 115200;
+    config.ber = options.ber;
+    //the first ports have a dead line, they must fail without delaying the others
+    config.drop_rate = (pPort->index < options.dead) ? 1.0 : 0.0;
+    linksim_init(&pPort->sim, &config, &config, options.seed + pPort->index);
+
+    broadcast_setup_sender(pPort, linksim_get_context(&pPort->sim, LINKSIM_SIDE_A));
+    pRx = linksim_get_context(&pPort->sim, LINKSIM_SIDE_B);
+    lmodem_init(pRx, broadcast_opts);
+    lmodem_set_user_data(pRx, pPort);
+    lmodem_set_line_buffer(pRx, pPort->rx_line_buffer, LXMODEM_1K_BUFFER_MIN_SIZE);
+    lmodem_set_filename_buffer(pRx, pPort->filename, BROADCAST_FILENAME_SIZE);
+    lmodem_set_file_buffer(pRx, pPort->received, broadcast_size + LXMODEM_1K_BUFFER_MIN_SIZE);
+
+    pPort->bOk = linksim_run(&pPort->sim, broadcast_sim_emit, broadcast_sim_receive) && broadcast_sim_check(pPort);
+    pPort->result = linksim_get_result(&pPort->sim, LINKSIM_SIDE_A);
+    fprintf(stdout, "port %u%s: emitted %d, %s, virtual time %.3f s, %" PRIu64 " blocks from the cache\n", pPort->index,
+            (pPort->index < options.dead) ? " (dead line)" : "", pPort->result, pPort->bOk ? "data ok" : "failed",
+            linksim_get_time_ns(&pPort->sim) / 1e9, pPort->blocks_served);
+    linksim_destroy(&pPort->sim);
+    return NULL;
+}
+
+static bool broadcast_serial_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    broadcast_port* pPort;
+    pPort = (broadcast_port*) lmodem_get_user_data(pThis);
+    return serial_read(pPort->serial_fd, data, size);
+}
+
+static void broadcast_serial_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    broadcast_port* pPort;
+    pPort = (broadcast_port*) lmodem_get_user_data(pThis);
+    serial_write(pPort->serial_fd, data, size);
+}
+
+static void* broadcast_serial_thread(void* arg)
+{
+    broadcast_port* pPort;
+
+    pPort = (broadcast_port*) arg;
+    broadcast_setup_sender(pPort, &pPort->ctx);
+    lmodem_set_getchar_cb(&pPort->ctx, broadcast_serial_getchar);
+    lmodem_set_putchar_cb(&pPort->ctx, broadcast_serial_putchar);
+    pPort->result = lmodem_emit(&pPort->ctx, options.protocol);
+    pPort->bOk = (pPort->result >= 0);
+    serial_close(pPort->serial_fd);
+    fprintf(stdout, "%s: emitted %d, %s, %" PRIu64 " blocks from the cache\n", options.devices[pPort->index], pPort->result,
+            pPort->bOk ? "ok" : "failed", pPort->blocks_served);
+    return NULL;
+}
+
+static bool broadcast_load(void)
+{
+    FILE* f;
+    long size;
+    uint64_t rng;
+    uint32_t i;
+
+    if (options.sim > 0)
+    {
+        broadcast_size = options.size;
+        broadcast_name = "broadcast.bin";
+        broadcast_data = malloc(broadcast_size + 1);
+        if (broadcast_data == NULL)
+        {
+            return false;
+        }
+        rng = options.seed + 1;
+        for (i = 0; i < broadcast_size; i++)
+        {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            broadcast_data[i] = (uint8_t) (rng >> 56);
+        }
+        return true;
+    }
+
+    f = fopen(options.file, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "unable to open '%s'\n", options.file);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    broadcast_data = malloc(size + 1);
+    broadcast_size = (uint32_t) size;
+    broadcast_name = basename(options.file);
+    if ((broadcast_data == NULL) || (fread(broadcast_data, 1, size, f) != (size_t) size))
+    {
+        fprintf(stderr, "unable to read '%s'\n", options.file);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    broadcast_port* ports;
+    uint32_t nbPorts;
+    uint32_t nbOk;
+    uint32_t i;
+    bool bOk;
+
+    bOk = parse_options(argc, argv) && broadcast_load();
+    if (!bOk)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    broadcast_opts = lxmodem_128_with_chksum;
+    if ((options.protocol == YMODEM) || (options.xmodem_blksize > 0))
+    {
+        broadcast_opts = lxmodem_1k;
+    }
+    else if (options.crc > 0)
+    {
+        broadcast_opts = lxmodem_128_with_crc;
+    }
+
+    nbPorts = (options.sim > 0) ? options.sim : options.nb_devices;
+    ports = calloc(nbPorts, sizeof(broadcast_port));
+    if ((ports == NULL) || (!block_cache_init(&broadcast_cache, broadcast_data, broadcast_size, broadcast_opts, options.protocol)))
+    {
+        fprintf(stderr, "unable to allocate the ports\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((options.table != NULL) && (block_cache_map(&broadcast_cache, options.table)))
+    {
+        fprintf(stdout, "%u blocks mapped from '%s'\n", broadcast_cache.table.nb_blocks, options.table);
+    }
+    else if ((options.prebuild) || (options.table != NULL))
+    {
+        block_cache_prebuild(&broadcast_cache, options.threads);
+        fprintf(stdout, "%u blocks framed by %u threads\n", broadcast_cache.table.nb_blocks, options.threads + 1);
+        if ((options.table != NULL) && (!block_cache_save(&broadcast_cache, options.table)))
+        {
+            fprintf(stderr, "unable to save the table in '%s'\n", options.table);
+        }
+    }
+
+    for (i = 0; (bOk) && (i < nbPorts); i++)
+    {
+        ports[i].index = i;
+        if (options.sim > 0)
+        {
+            ports[i].received = malloc(broadcast_size + LXMODEM_1K_BUFFER_MIN_SIZE);
+            bOk = (ports[i].received != NULL)
+                  && (pthread_create(&ports[i].thread, NULL, broadcast_sim_thread, &ports[i]) == 0);
+        }
+        else
+        {
+            ports[i].serial_fd = serial_setup(options.devices[i], options.speed, SERIAL_PARITY_OFF, SERIAL_RTSCTS_OFF, options.nb_stop);
+            if (ports[i].serial_fd < 0)
+            {
+                fprintf(stderr, "unable to open '%s'\n", options.devices[i]);
+                bOk = false;
+            }
+            else
+            {
+                bOk = (pthread_create(&ports[i].thread, NULL, broadcast_serial_thread, &ports[i]) == 0);
+            }
+        }
+        if (!bOk)
+        {
+            nbPorts = i;
+        }
+    }
+
+    nbOk = 0;
+    for (i = 0; i < nbPorts; i++)
+    {
+        pthread_join(ports[i].thread, NULL);
+        if (ports[i].bOk)
+        {
+            nbOk++;
+        }
+        //with --sim, the dead lines must have been aborted
+        if ((options.sim > 0) && ((i < options.dead) == ports[i].bOk))
+        {
+            bOk = false;
+        }
+        if ((options.sim == 0) && (!ports[i].bOk))
+        {
+            bOk = false;
+        }
+        free(ports[i].received);
+    }
+
+    //every block is framed at most once whatever the nb of ports
+    fprintf(stdout, "%u/%u ports ok, %u/%u blocks framed once in the cache\n", nbOk, nbPorts,
+            atomic_load(&broadcast_cache.nb_built), broadcast_cache.table.nb_blocks);
+    bOk = bOk && (atomic_load(&broadcast_cache.nb_built) <= broadcast_cache.table.nb_blocks);
+
+    block_cache_destroy(&broadcast_cache);
+    free(ports);
+    free(broadcast_data);
+    fprintf(stdout, "%s\n", bOk ? "test ok" : "test failed");
+    return bOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool parse_options(int argc, char* argv[])
+{
+    int opt_index;
+    OPTS c;
+
+    memset(&options, 0, sizeof(options_t));
+    options.speed = 115200;
+    options.nb_stop = 1;
+    options.size = 32 * 1024;
+    options.seed = 1;
+    options.threads = 4;
+
+    while (1)
+    {
+        c = getopt_long(argc, argv, "", long_options, &opt_index);
+        if ((int32_t) c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case OPTS_PROTOCOL:
+                options.protocol = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_CRC:
+                options.crc = 1;
+                break;
+
+            case OPTS_1K:
+                options.xmodem_blksize = 1;
+                break;
+
+            case OPTS_FILE:
+                options.file = optarg;
+                break;
+
+            case OPTS_DEVICE:
+                if (options.nb_devices >= BROADCAST_MAX_PORTS)
+                {
+                    fprintf(stdout, "device: at most %u ports\n", BROADCAST_MAX_PORTS);
+                    return false;
+                }
+                options.devices[options.nb_devices++] = optarg;
+                break;
+
+            case OPTS_SPEED:
+                options.speed = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_NB_STOP:
+                options.nb_stop = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_SIM:
+                options.sim = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_SIZE:
+                options.size = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_BER:
+                options.ber = strtod(optarg, NULL);
+                break;
+
+            case OPTS_DEAD:
+                options.dead = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_SEED:
+                options.seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case OPTS_PREBUILD:
+                options.prebuild = 1;
+                break;
+
+            case OPTS_THREADS:
+                options.threads = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_TABLE:
+                options.table = optarg;
+                break;
+
+            case OPTS_UNKNOWN:
+            default:
+                fprintf(stdout, "unknow options\n");
+                return false;
+        }
+    }
+
+    if ((options.protocol != XMODEM) && (options.protocol != YMODEM))
+    {
+        fprintf(stdout, "protocol: unknown\n");
+        return false;
+    }
+
+    if ((options.sim > BROADCAST_MAX_PORTS) || ((options.sim == 0) && ((options.nb_devices == 0) || (options.file == NULL))))
+    {
+        fprintf(stdout, "usage: %s --file <file> --device <dev> [--device <dev>...] or --sim <nb ports> [--size n] "
+                "[--ber e] [--dead n] [--seed n]\n", argv[0]);
+        return false;
+    }
+    return true;
+}
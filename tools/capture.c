@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture.h"
+
+typedef struct
+{
+    FILE* f;
+    uint64_t start_ns;
+    uint64_t last_ns;
+    uint64_t bytes_done;
+    bool bError;
+    bool (*getchar)(modem_context_t* pThis, uint8_t* data, uint32_t size);
+    void (*putchar)(modem_context_t* pThis, uint8_t* data, uint32_t size);
+    void (*progress)(modem_context_t* pThis, const lmodem_progress* pProgress);
+} capture_state;
+
+static capture_state capture;
+
+// the clock of the context when it has one (e.g. the virtual time of a simulated link)
+static uint64_t capture_now(modem_context_t* pThis)
+{
+    struct timespec ts;
+    if (pThis->clock_ns != NULL)
+    {
+        return pThis->clock_ns(pThis);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void capture_write_varint(uint64_t value)
+{
+    uint8_t buffer[10];
+    uint32_t n;
+
+    n = 0;
+    do
+    {
+        buffer[n] = value & 0x7F;
+        value >>= 7;
+        if (value != 0)
+        {
+            buffer[n] |= 0x80;
+        }
+        n++;
+    }
+    while (value != 0);
+
+    if (fwrite(buffer, 1, n, capture.f) != n)
+    {
+        capture.bError = true;
+    }
+}
+
+static void capture_write_record(capture_record_type type, uint64_t now)
+{
+    uint8_t t;
+    t = type;
+    if (fwrite(&t, 1, 1, capture.f) != 1)
+    {
+        capture.bError = true;
+    }
+    capture_write_varint(now - capture.last_ns);
+    capture.last_ns = now;
+}
+
+static void capture_write_data(uint8_t* data, uint32_t size)
+{
+    if ((size > 0) && (fwrite(data, 1, size, capture.f) != size))
+    {
+        capture.bError = true;
+    }
+}
+
+static bool capture_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    uint64_t start;
+    uint64_t now;
+    bool b;
+
+    start = capture_now(pThis);
+    b = capture.getchar(pThis, data, size);
+    now = capture_now(pThis);
+    capture_write_record(b ? CAPTURE_GET : CAPTURE_TIMEOUT, now);
+    capture_write_varint(size);
+    capture_write_varint(now - start);
+    if (b)
+    {
+        capture_write_data(data, size);
+    }
+    return b;
+}
+
+static void capture_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    capture_write_record(CAPTURE_PUT, capture_now(pThis));
+    capture_write_varint(size);
+    capture_write_data(data, size);
+    capture.putchar(pThis, data, size);
+}
+
+static void capture_progress(modem_context_t* pThis, const lmodem_progress* pProgress)
+{
+    capture_write_record(CAPTURE_BLOCK, capture_now(pThis));
+    capture_write_varint(pProgress->bytes_done - capture.bytes_done);
+    capture.bytes_done = pProgress->bytes_done;
+    if (capture.progress != NULL)
+    {
+        capture.progress(pThis, pProgress);
+    }
+}
+
+bool capture_start(const char* filename, modem_context_t* pCtx, lmodem_protocol protocol, bool rx)
+{
+    capture_header header;
+
+    memset(&capture, 0, sizeof(capture_state));
+    capture.f = fopen(filename, "wb");
+    if (capture.f == NULL)
+    {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, 4);
+    header.version = CAPTURE_VERSION;
+    header.protocol = protocol;
+    header.opts = pCtx->opts;
+    header.rx = rx ? 1 : 0;
+    header.low_memory_rx = pCtx->lowMemoryRx ? 1 : 0;
+    if (fwrite(&header, sizeof(header), 1, capture.f) != 1)
+    {
+        capture.bError = true;
+    }
+
+    capture.getchar = pCtx->getchar;
+    capture.putchar = pCtx->putchar;
+    capture.progress = pCtx->progress;
+    capture.start_ns = capture_now(pCtx);
+    capture.last_ns = capture.start_ns;
+    lmodem_set_getchar_cb(pCtx, capture_getchar);
+    lmodem_set_putchar_cb(pCtx, capture_putchar);
+    lmodem_set_progress_cb(pCtx, capture_progress);
+    return true;
+}
+
+bool capture_stop(modem_context_t* pCtx, int32_t result)
+{
+    bool bOk;
+
+    capture_write_record(CAPTURE_END, capture_now(pCtx));
+    //zigzag encoding of the signed result
+    capture_write_varint(((uint64_t) ((uint32_t) result << 1)) ^ (uint64_t) (uint32_t) (result >> 31));
+
+    lmodem_set_getchar_cb(pCtx, capture.getchar);
+    lmodem_set_putchar_cb(pCtx, capture.putchar);
+    lmodem_set_progress_cb(pCtx, capture.progress);
+    bOk = !capture.bError;
+    if (fclose(capture.f) != 0)
+    {
+        bOk = false;
+    }
+    capture.f = NULL;
+    return bOk;
+}
+
+static bool capture_read_varint(uint8_t** ppRead, uint8_t* pEnd, uint64_t* pValue)
+{
+    uint32_t shift;
+    uint8_t c;
+
+    *pValue = 0;
+    shift = 0;
+    do
+    {
+        if ((*ppRead >= pEnd) || (shift > 63))
+        {
+            return false;
+        }
+        c = *(*ppRead)++;
+        *pValue |= (uint64_t) (c & 0x7F) << shift;
+        shift += 7;
+    }
+    while (c & 0x80);
+    return true;
+}
+
+bool capture_load(capture_trace* pThis, const char* filename)
+{
+    FILE* f;
+    long fileSize;
+    uint8_t* pRead;
+    uint8_t* pEnd;
+    capture_record* pRecord;
+    uint64_t value;
+    uint64_t time;
+    uint32_t capacity;
+    bool bOk;
+
+    memset(pThis, 0, sizeof(capture_trace));
+    f = fopen(filename, "rb");
+    if (f == NULL)
+    {
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    pThis->file = malloc((fileSize > 0) ? fileSize : 1);
+    bOk = (pThis->file != NULL) && (fileSize >= (long) sizeof(capture_header))
+          && (fread(pThis->file, 1, fileSize, f) == (size_t) fileSize);
+    fclose(f);
+
+    if (bOk)
+    {
+        memcpy(&pThis->header, pThis->file, sizeof(capture_header));
+        bOk = (memcmp(pThis->header.magic, CAPTURE_MAGIC, 4) == 0) && (pThis->header.version == CAPTURE_VERSION);
+    }
+
+    pRead = pThis->file + sizeof(capture_header);
+    pEnd = pThis->file + fileSize;
+    time = 0;
+    capacity = 0;
+    while ((bOk) && (pRead < pEnd))
+    {
+        if (pThis->nb_records == capacity)
+        {
+            capture_record* pRecords;
+            capacity = (capacity == 0) ? 1024 : (capacity * 2);
+            pRecords = realloc(pThis->records, capacity * sizeof(capture_record));
+            if (pRecords == NULL)
+            {
+                bOk = false;
+                break;
+            }
+            pThis->records = pRecords;
+        }
+
+        pRecord = &pThis->records[pThis->nb_records];
+        memset(pRecord, 0, sizeof(capture_record));
+        pRecord->type = *pRead++;
+        bOk = capture_read_varint(&pRead, pEnd, &value);
+        time += value;
+        pRecord->time_ns = time;
+
+        switch (pRecord->type)
+        {
+            case CAPTURE_PUT:
+            case CAPTURE_GET:
+            case CAPTURE_TIMEOUT:
+                bOk = bOk && capture_read_varint(&pRead, pEnd, &value);
+                pRecord->size = value;
+                if ((bOk) && (pRecord->type != CAPTURE_PUT))
+                {
+                    bOk = capture_read_varint(&pRead, pEnd, &pRecord->duration_ns);
+                }
+                if ((bOk) && (pRecord->type != CAPTURE_TIMEOUT))
+                {
+                    bOk = ((uint64_t) (pEnd - pRead) >= pRecord->size);
+                    pRecord->data = pRead;
+                    pRead += pRecord->size;
+                }
+                break;
+
+            case CAPTURE_BLOCK:
+                bOk = bOk && capture_read_varint(&pRead, pEnd, &value);
+                pRecord->size = value;
+                break;
+
+            case CAPTURE_END:
+                bOk = bOk && capture_read_varint(&pRead, pEnd, &value);
+                pRecord->result = (int32_t) ((value >> 1) ^ (~(value & 1) + 1));
+                break;
+
+            default:
+                bOk = false;
+                break;
+        }
+
+        if (bOk)
+        {
+            pThis->nb_records++;
+        }
+    }
+
+    if (!bOk)
+    {
+        capture_free(pThis);
+    }
+    return bOk;
+}
+
+void capture_free(capture_trace* pThis)
+{
+    free(pThis->records);
+    free(pThis->file);
+    pThis->records = NULL;
+    pThis->file = NULL;
+    pThis->nb_records = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "lmodem.h"
+
+// record of the getchar/putchar traffic of a context, with timestamps, and its replay.
+// file: header followed by records, a record is a type byte, the time since the previous record in ns
+// and the fields of the type, integers are LEB128 varints:
+//   PUT     size, data
+//   GET     size, call duration, data
+//   TIMEOUT requested size, call duration
+//   BLOCK   payload size (block committed or acknowledged, from the progress callback)
+//   END     transfer result (zigzag)
+
+#define CAPTURE_MAGIC          "LMCP"
+#define CAPTURE_VERSION        (1)
+
+typedef enum
+{
+    CAPTURE_PUT,
+    CAPTURE_GET,
+    CAPTURE_TIMEOUT,
+    CAPTURE_BLOCK,
+    CAPTURE_END
+} capture_record_type;
+
+typedef struct
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t protocol;
+    uint8_t opts;
+    uint8_t rx;                     // 1: reception, 0: emission
+    uint8_t low_memory_rx;
+    uint8_t reserved[3];
+} capture_header;
+
+typedef struct
+{
+    uint8_t type;
+    uint64_t time_ns;               // since the start of the capture
+    uint32_t size;
+    uint64_t duration_ns;
+    int32_t result;
+    uint8_t* data;                  // PUT and GET, points into the loaded file
+} capture_record;
+
+typedef struct
+{
+    capture_header header;
+    uint8_t* file;
+    capture_record* records;
+    uint32_t nb_records;
+} capture_trace;
+
+// the callbacks of the context are wrapped until capture_stop, one capture at a time: the wrappers keep
+// their state in the capture module, the user data of the context stays the one of the application.
+// must be called after the getchar/putchar (and progress) callbacks are set. the times come from the clock callback
+// of the context when it is set, from CLOCK_MONOTONIC otherwise.
+extern bool capture_start(const char* filename, modem_context_t* pCtx, lmodem_protocol protocol, bool rx);
+extern bool capture_stop(modem_context_t* pCtx, int32_t result);
+
+extern bool capture_load(capture_trace* pThis, const char* filename);
+extern void capture_free(capture_trace* pThis);
+
+#endif /* CAPTURE_H */
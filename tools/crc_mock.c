@@ -0,0 +1,139 @@
+#include <string.h>
+#include "crc_mock.h"
+
+#define CRC_MOCK_POLYNOME      (0x1021)
+
+static uint16_t crc_mock_calcul(uint8_t* data, uint32_t size, uint16_t crc)
+{
+    uint32_t i;
+    uint32_t bit;
+
+    for (i = 0; i < size; i++)
+    {
+        crc ^= (uint16_t) (data[i] << 8);
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ CRC_MOCK_POLYNOME) : (uint16_t) (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t crc_mock_init(modem_context_t* pThis)
+{
+    (void) pThis;
+    return 0;
+}
+
+static bool crc_mock_update(modem_context_t* pThis, uint8_t* data, uint32_t size, uint16_t* pCrc)
+{
+    crc_mock* pMock;
+
+    pMock = (crc_mock*) pThis->crc_provider;
+    pMock->updates++;
+    pMock->bytes += size;
+    if (!pMock->async)
+    {
+        *pCrc = crc_mock_calcul(data, size, *pCrc);
+        return true;
+    }
+
+    pthread_mutex_lock(&pMock->lock);
+    pMock->pending_ctx = pThis;
+    pMock->pending_data = data;
+    pMock->pending_size = size;
+    pMock->pending_crc = *pCrc;
+    pthread_cond_broadcast(&pMock->cond);
+    pthread_mutex_unlock(&pMock->lock);
+    return false;
+}
+
+static uint16_t crc_mock_final(modem_context_t* pThis, uint16_t crc)
+{
+    (void) pThis;
+    return crc;
+}
+
+static void* crc_mock_thread(void* arg)
+{
+    crc_mock* pThis;
+    uint16_t crc;
+
+    pThis = (crc_mock*) arg;
+    pthread_mutex_lock(&pThis->lock);
+    while (!pThis->stop)
+    {
+        if (pThis->pending_ctx == NULL)
+        {
+            pthread_cond_wait(&pThis->cond, &pThis->lock);
+            continue;
+        }
+
+        //the data belong to the job until its completion is reported
+        crc = crc_mock_calcul(pThis->pending_data, pThis->pending_size, pThis->pending_crc);
+        lmodem_crc_complete(pThis->pending_ctx, crc);
+        pThis->pending_ctx = NULL;
+        pThis->async_completions++;
+        pthread_cond_broadcast(&pThis->cond);
+    }
+    pthread_mutex_unlock(&pThis->lock);
+    return NULL;
+}
+
+bool crc_mock_start(crc_mock* pThis, bool async)
+{
+    memset(pThis, 0, sizeof(crc_mock));
+    pThis->provider.init = crc_mock_init;
+    pThis->provider.update = crc_mock_update;
+    pThis->provider.final = crc_mock_final;
+    pThis->async = async;
+    if (!async)
+    {
+        return true;
+    }
+
+    pthread_mutex_init(&pThis->lock, NULL);
+    pthread_cond_init(&pThis->cond, NULL);
+    if (pthread_create(&pThis->thread, NULL, crc_mock_thread, pThis) != 0)
+    {
+        pthread_cond_destroy(&pThis->cond);
+        pthread_mutex_destroy(&pThis->lock);
+        return false;
+    }
+    return true;
+}
+
+bool crc_mock_wait_idle(crc_mock* pThis)
+{
+    bool bBusy;
+
+    if (!pThis->async)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&pThis->lock);
+    bBusy = (pThis->pending_ctx != NULL);
+    while (pThis->pending_ctx != NULL)
+    {
+        pthread_cond_wait(&pThis->cond, &pThis->lock);
+    }
+    pthread_mutex_unlock(&pThis->lock);
+    return bBusy;
+}
+
+void crc_mock_stop(crc_mock* pThis)
+{
+    if (!pThis->async)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pThis->lock);
+    pThis->stop = true;
+    pthread_cond_broadcast(&pThis->cond);
+    pthread_mutex_unlock(&pThis->lock);
+    pthread_join(pThis->thread, NULL);
+    pthread_cond_destroy(&pThis->cond);
+    pthread_mutex_destroy(&pThis->lock);
+}
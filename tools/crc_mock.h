@@ -0,0 +1,36 @@
+#ifndef CRC_MOCK_H
+#define CRC_MOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "lmodem.h"
+
+// software stand-in for a CRC peripheral, to test lmodem_set_crc_provider without the hardware: a bitwise
+// CRC-16 CCITT (independent of the table of the library), computed in the call or, in asynchronous mode, by a
+// worker thread which reports it with lmodem_crc_complete like the end of transfer interrupt of a CRC DMA.
+// one mock per context, the provider is its first member.
+
+typedef struct
+{
+    lmodem_crc_provider provider;
+    bool async;
+    modem_context_t* pending_ctx;       // job of the worker thread, NULL when idle
+    uint8_t* pending_data;
+    uint32_t pending_size;
+    uint16_t pending_crc;
+    bool stop;
+    uint64_t updates;
+    uint64_t bytes;
+    uint64_t async_completions;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} crc_mock;
+
+extern bool crc_mock_start(crc_mock* pThis, bool async);
+// waits for the end of the running asynchronous update, false when there was none
+extern bool crc_mock_wait_idle(crc_mock* pThis);
+extern void crc_mock_stop(crc_mock* pThis);
+
+#endif /* CRC_MOCK_H */
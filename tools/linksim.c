@@ -0,0 +1,375 @@
+#include <string.h>
+#include <math.h>
+#include "linksim.h"
+
+#define LINKSIM_DEFAULT_BAUD     (115200)
+#define LINKSIM_BITS_PER_BYTE    (10)
+
+static bool linksim_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size);
+static uint32_t linksim_read(modem_context_t* pThis, uint8_t* data, uint32_t size, uint64_t idleNs);
+static void linksim_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size);
+static uint64_t linksim_clock_ns(modem_context_t* pThis);
+static void* linksim_thread(void* arg);
+
+static uint64_t linksim_rand(linksim_channel* pThis)
+{
+    //xorshift64*
+    pThis->rng ^= pThis->rng >> 12;
+    pThis->rng ^= pThis->rng << 25;
+    pThis->rng ^= pThis->rng >> 27;
+    return pThis->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static double linksim_rand_double(linksim_channel* pThis)
+{
+    return (linksim_rand(pThis) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static bool linksim_happens(linksim_channel* pThis, double probability)
+{
+    return (probability > 0) && (linksim_rand_double(pThis) < probability);
+}
+
+static void linksim_channel_init(linksim_channel* pThis, const linksim_config* pConfig, uint64_t seed)
+{
+    memset(pThis, 0, sizeof(linksim_channel));
+    if (pConfig != NULL)
+    {
+        pThis->config = *pConfig;
+    }
+    else
+    {
+        pThis->config.baud = LINKSIM_DEFAULT_BAUD;
+    }
+
+    if (pThis->config.timeout_ns == 0)
+    {
+        pThis->config.timeout_ns = LINKSIM_DEFAULT_TIMEOUT_NS;
+    }
+    if (pThis->config.baud > 0)
+    {
+        pThis->byte_ns = (LINKSIM_BITS_PER_BYTE * 1000000000ULL) / pThis->config.baud;
+    }
+    if ((pThis->byte_ns == 0) && (pThis->config.latency_ns == 0))
+    {
+        //a byte must never arrive at the time it is sent, otherwise the run depends on the thread scheduling
+        pThis->config.latency_ns = 1;
+    }
+    pThis->byte_error_rate = 1.0 - pow(1.0 - pThis->config.ber, 8);
+    pThis->rng = (seed != 0) ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+void linksim_init(linksim* pThis, const linksim_config* pAtoB, const linksim_config* pBtoA, uint64_t seed)
+{
+    uint32_t side;
+
+    memset(pThis, 0, sizeof(linksim));
+    pthread_mutex_init(&pThis->lock, NULL);
+    pthread_cond_init(&pThis->cond, NULL);
+    linksim_channel_init(&pThis->channel[LINKSIM_SIDE_A], pAtoB, seed * 2 + 1);
+    linksim_channel_init(&pThis->channel[LINKSIM_SIDE_B], pBtoA, seed * 2 + 2);
+    for (side = 0; side < LINKSIM_NB_SIDES; side++)
+    {
+        pThis->endpoint[side].pSim = pThis;
+        pThis->endpoint[side].side = side;
+    }
+}
+
+void linksim_destroy(linksim* pThis)
+{
+    pthread_cond_destroy(&pThis->cond);
+    pthread_mutex_destroy(&pThis->lock);
+}
+
+modem_context_t* linksim_get_context(linksim* pThis, uint32_t side)
+{
+    return &pThis->endpoint[side].ctx;
+}
+
+bool linksim_run(linksim* pThis, int32_t (*transferA)(modem_context_t* pThis), int32_t (*transferB)(modem_context_t* pThis))
+{
+    bool bOk;
+    uint32_t side;
+    uint32_t nbStarted;
+
+    bOk = true;
+    pThis->endpoint[LINKSIM_SIDE_A].transfer = transferA;
+    pThis->endpoint[LINKSIM_SIDE_B].transfer = transferB;
+    //both sides are ready before the first thread looks at the other side
+    for (side = 0; side < LINKSIM_NB_SIDES; side++)
+    {
+        linksim_endpoint* pEndpoint = &pThis->endpoint[side];
+        lmodem_set_getchar_cb(&pEndpoint->ctx, linksim_getchar);
+        lmodem_set_putchar_cb(&pEndpoint->ctx, linksim_putchar);
+        lmodem_set_clock_cb(&pEndpoint->ctx, linksim_clock_ns);
+        pEndpoint->result = -1;
+        pEndpoint->done = false;
+        pEndpoint->blocked = false;
+    }
+    for (nbStarted = 0; (bOk) && (nbStarted < LINKSIM_NB_SIDES); nbStarted++)
+    {
+        linksim_endpoint* pEndpoint = &pThis->endpoint[nbStarted];
+        if (pthread_create(&pEndpoint->thread, NULL, linksim_thread, pEndpoint) != 0)
+        {
+            bOk = false;
+            nbStarted--;
+        }
+    }
+
+    if (!bOk)
+    {
+        //the side which has been started stops on timeouts
+        pthread_mutex_lock(&pThis->lock);
+        pThis->endpoint[nbStarted].done = true;
+        pthread_cond_broadcast(&pThis->cond);
+        pthread_mutex_unlock(&pThis->lock);
+    }
+
+    for (side = 0; side < nbStarted; side++)
+    {
+        pthread_join(pThis->endpoint[side].thread, NULL);
+    }
+
+    return bOk;
+}
+
+int32_t linksim_get_result(linksim* pThis, uint32_t side)
+{
+    return pThis->endpoint[side].result;
+}
+
+const linksim_channel_stats* linksim_get_channel_stats(linksim* pThis, uint32_t side)
+{
+    return &pThis->channel[side].stats;
+}
+
+uint64_t linksim_get_time_ns(linksim* pThis)
+{
+    uint64_t now;
+    pthread_mutex_lock(&pThis->lock);
+    now = pThis->now_ns;
+    pthread_mutex_unlock(&pThis->lock);
+    return now;
+}
+
+static void* linksim_thread(void* arg)
+{
+    linksim_endpoint* pEndpoint;
+    int32_t result;
+
+    pEndpoint = (linksim_endpoint*) arg;
+    result = pEndpoint->transfer(&pEndpoint->ctx);
+
+    pthread_mutex_lock(&pEndpoint->pSim->lock);
+    pEndpoint->result = result;
+    pEndpoint->done = true;
+    pthread_cond_broadcast(&pEndpoint->pSim->cond);
+    pthread_mutex_unlock(&pEndpoint->pSim->lock);
+    return NULL;
+}
+
+// called with the lock held by a side which has nothing to do before its wakeup time.
+// virtual time moves only when no side can run, to the earliest wakeup.
+static void linksim_wait(linksim* pThis, linksim_endpoint* pEndpoint, uint64_t wakeupNs)
+{
+    uint64_t next;
+    bool bAllBlocked;
+    uint32_t side;
+
+    pEndpoint->blocked = true;
+    pEndpoint->wakeup_ns = wakeupNs;
+
+    bAllBlocked = true;
+    next = UINT64_MAX;
+    for (side = 0; side < LINKSIM_NB_SIDES; side++)
+    {
+        linksim_endpoint* pOther = &pThis->endpoint[side];
+        if (!pOther->done)
+        {
+            if ((!pOther->blocked) || (pOther->wakeup_ns <= pThis->now_ns))
+            {
+                bAllBlocked = false;
+            }
+            else if (pOther->wakeup_ns < next)
+            {
+                next = pOther->wakeup_ns;
+            }
+        }
+    }
+
+    if (bAllBlocked)
+    {
+        pThis->now_ns = next;
+        pthread_cond_broadcast(&pThis->cond);
+    }
+    else
+    {
+        pthread_cond_wait(&pThis->cond, &pThis->lock);
+    }
+    pEndpoint->blocked = false;
+}
+
+static bool linksim_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    //like a serial read timeout, the bytes already received are consumed
+    return (linksim_read(pThis, data, size, 0) == size);
+}
+
+uint32_t linksim_dma_read(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    linksim_endpoint* pEndpoint;
+    uint64_t idleNs;
+
+    //idle line detection of a UART: no byte for two byte times after the first one
+    pEndpoint = (linksim_endpoint*) pThis;
+    idleNs = 2 * pEndpoint->pSim->channel[LINKSIM_NB_SIDES - 1 - pEndpoint->side].byte_ns;
+    if (idleNs < LINKSIM_MIN_IDLE_NS)
+    {
+        idleNs = LINKSIM_MIN_IDLE_NS;
+    }
+    return linksim_read(pThis, data, size, idleNs);
+}
+
+// broken line: a garbage byte follows the last one, the reader never sees a silence
+static void linksim_jabber(linksim* pSim, linksim_channel* pChannel)
+{
+    linksim_byte* pByte;
+    uint64_t start;
+
+    start = (pChannel->line_free_ns > pSim->now_ns) ? pChannel->line_free_ns : pSim->now_ns;
+    pChannel->line_free_ns = start + ((pChannel->byte_ns != 0) ? pChannel->byte_ns : 1);
+    pByte = &pChannel->fifo[pChannel->write_index % LINKSIM_CHANNEL_SIZE];
+    pByte->data = (uint8_t) linksim_rand(pChannel);
+    pByte->arrival_ns = pChannel->line_free_ns + pChannel->config.latency_ns;
+    pChannel->write_index++;
+    pChannel->stats.bytes_corrupted++;
+}
+
+// idleNs 0: the getchar timeout between the bytes, otherwise the read stops when the line is idle after a byte
+static uint32_t linksim_read(modem_context_t* pThis, uint8_t* data, uint32_t size, uint64_t idleNs)
+{
+    linksim_endpoint* pEndpoint;
+    linksim* pSim;
+    linksim_channel* pChannel;
+    uint64_t deadline;
+    uint64_t wakeup;
+    uint32_t nbRead;
+
+    pEndpoint = (linksim_endpoint*) pThis;
+    pSim = pEndpoint->pSim;
+    pChannel = &pSim->channel[LINKSIM_NB_SIDES - 1 - pEndpoint->side];
+    nbRead = 0;
+
+    pthread_mutex_lock(&pSim->lock);
+    deadline = pSim->now_ns + pChannel->config.timeout_ns;
+    while (true)
+    {
+        if ((pChannel->config.jabber_ns != 0) && (pSim->now_ns >= pChannel->config.jabber_ns)
+                && (pChannel->read_index == pChannel->write_index))
+        {
+            linksim_jabber(pSim, pChannel);
+        }
+        while ((nbRead < size) && (pChannel->read_index != pChannel->write_index)
+                && (pChannel->fifo[pChannel->read_index % LINKSIM_CHANNEL_SIZE].arrival_ns <= pSim->now_ns))
+        {
+            data[nbRead++] = pChannel->fifo[pChannel->read_index % LINKSIM_CHANNEL_SIZE].data;
+            pChannel->read_index++;
+            //inter-byte timeout, like a serial read
+            deadline = pSim->now_ns + ((idleNs != 0) ? idleNs : pChannel->config.timeout_ns);
+        }
+
+        if ((nbRead == size) || (pSim->now_ns >= deadline))
+        {
+            break;
+        }
+
+        wakeup = deadline;
+        if ((pChannel->read_index != pChannel->write_index)
+                && (pChannel->fifo[pChannel->read_index % LINKSIM_CHANNEL_SIZE].arrival_ns < wakeup))
+        {
+            wakeup = pChannel->fifo[pChannel->read_index % LINKSIM_CHANNEL_SIZE].arrival_ns;
+        }
+        linksim_wait(pSim, pEndpoint, wakeup);
+    }
+    pthread_mutex_unlock(&pSim->lock);
+
+    return nbRead;
+}
+
+static void linksim_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    linksim_endpoint* pEndpoint;
+    linksim_endpoint* pPeer;
+    linksim* pSim;
+    linksim_channel* pChannel;
+    linksim_byte* pByte;
+    uint64_t start;
+    uint8_t c;
+    uint32_t i;
+
+    pEndpoint = (linksim_endpoint*) pThis;
+    pSim = pEndpoint->pSim;
+    pChannel = &pSim->channel[pEndpoint->side];
+    pPeer = &pSim->endpoint[LINKSIM_NB_SIDES - 1 - pEndpoint->side];
+
+    pthread_mutex_lock(&pSim->lock);
+    for (i = 0; i < size; i++)
+    {
+        c = data[i];
+        start = (pChannel->line_free_ns > pSim->now_ns) ? pChannel->line_free_ns : pSim->now_ns;
+        if (linksim_happens(pChannel, pChannel->config.stall_rate))
+        {
+            start += pChannel->config.stall_ns;
+            pChannel->stats.stalls++;
+        }
+        pChannel->line_free_ns = start + pChannel->byte_ns;
+        pChannel->stats.bytes_sent++;
+
+        if (linksim_happens(pChannel, pChannel->config.drop_rate))
+        {
+            pChannel->stats.bytes_dropped++;
+            continue;
+        }
+
+        if ((pChannel->burst_remaining == 0) && (linksim_happens(pChannel, pChannel->config.burst_rate)))
+        {
+            pChannel->burst_remaining = pChannel->config.burst_len;
+            pChannel->stats.bursts++;
+        }
+        if (pChannel->burst_remaining > 0)
+        {
+            c ^= (uint8_t) (1 + (linksim_rand(pChannel) % 255));
+            pChannel->burst_remaining--;
+            pChannel->stats.bytes_corrupted++;
+        }
+        else if (linksim_happens(pChannel, pChannel->byte_error_rate))
+        {
+            c ^= (uint8_t) (1 << (linksim_rand(pChannel) % 8));
+            pChannel->stats.bytes_corrupted++;
+        }
+
+        if ((pChannel->write_index - pChannel->read_index) >= LINKSIM_CHANNEL_SIZE)
+        {
+            pChannel->stats.overflows++;
+            continue;
+        }
+
+        pByte = &pChannel->fifo[pChannel->write_index % LINKSIM_CHANNEL_SIZE];
+        pByte->data = c;
+        pByte->arrival_ns = pChannel->line_free_ns + pChannel->config.latency_ns;
+        pChannel->write_index++;
+
+        //a waiting peer must see the new byte before the time moves past its arrival
+        if ((pPeer->blocked) && (pByte->arrival_ns < pPeer->wakeup_ns))
+        {
+            pPeer->wakeup_ns = pByte->arrival_ns;
+        }
+    }
+    pthread_cond_broadcast(&pSim->cond);
+    pthread_mutex_unlock(&pSim->lock);
+}
+
+static uint64_t linksim_clock_ns(modem_context_t* pThis)
+{
+    return linksim_get_time_ns(((linksim_endpoint*) pThis)->pSim);
+}
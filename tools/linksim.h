@@ -0,0 +1,110 @@
+#ifndef LINKSIM_H
+#define LINKSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "lmodem.h"
+
+// in-process serial link simulator: two modem contexts (side A and side B) run in two threads and exchange
+// bytes through two simulated channels (A->B and B->A).
+// time is virtual: it only moves forward when both sides are waiting for data, so a run does not depend on
+// the host speed nor on the thread scheduling, the same seed always gives the same transfer.
+
+#define LINKSIM_SIDE_A             (0)
+#define LINKSIM_SIDE_B             (1)
+#define LINKSIM_NB_SIDES           (2)
+
+// bytes in flight on one channel, the following ones are lost (counted in overflows)
+#define LINKSIM_CHANNEL_SIZE       (64*1024)
+
+#define LINKSIM_DEFAULT_TIMEOUT_NS (1000000000ULL)
+// idle line detection of linksim_dma_read when the link has no transmission time
+#define LINKSIM_MIN_IDLE_NS        (10000ULL)
+
+typedef struct
+{
+    uint32_t baud;                  // 10 bits per byte, 0: no transmission time
+    uint64_t latency_ns;            // propagation delay added to each byte
+    double ber;                     // bit error rate, one random bit flipped in a corrupted byte
+    double drop_rate;               // probability of losing a byte
+    double burst_rate;              // probability for a byte to start an error burst
+    uint32_t burst_len;             // nb of bytes replaced by garbage in a burst
+    double stall_rate;              // probability for a byte to be delayed by a line stall
+    uint64_t stall_ns;
+    uint64_t timeout_ns;            // getchar inter-byte timeout of the side reading this channel (0: default)
+    uint64_t jabber_ns;             // from this time the line never goes silent, garbage comes at each byte time (0: never)
+} linksim_config;
+
+typedef struct
+{
+    uint64_t bytes_sent;
+    uint64_t bytes_dropped;
+    uint64_t bytes_corrupted;
+    uint64_t overflows;
+    uint32_t bursts;
+    uint32_t stalls;
+} linksim_channel_stats;
+
+typedef struct
+{
+    uint8_t data;
+    uint64_t arrival_ns;
+} linksim_byte;
+
+typedef struct
+{
+    linksim_config config;
+    uint64_t byte_ns;
+    double byte_error_rate;
+    uint64_t rng;
+    uint64_t line_free_ns;
+    uint32_t burst_remaining;
+    linksim_byte fifo[LINKSIM_CHANNEL_SIZE];
+    uint32_t read_index;
+    uint32_t write_index;
+    linksim_channel_stats stats;
+} linksim_channel;
+
+typedef struct linksim linksim;
+
+typedef struct
+{
+    modem_context_t ctx;            // first member: the callbacks get back the endpoint from the context pointer
+    linksim* pSim;
+    uint32_t side;
+    int32_t (*transfer)(modem_context_t* pThis);
+    int32_t result;
+    bool blocked;
+    bool done;
+    uint64_t wakeup_ns;
+    pthread_t thread;
+} linksim_endpoint;
+
+struct linksim
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t now_ns;
+    linksim_channel channel[LINKSIM_NB_SIDES];     // channel[side] holds the bytes written by side
+    linksim_endpoint endpoint[LINKSIM_NB_SIDES];
+};
+
+// pAtoB/pBtoA NULL: perfect link at 115200 bauds. each channel gets its own random generator derived from seed
+extern void linksim_init(linksim* pThis, const linksim_config* pAtoB, const linksim_config* pBtoA, uint64_t seed);
+extern void linksim_destroy(linksim* pThis);
+
+// context of one side, to be initialised with lmodem_init and configured before linksim_run
+extern modem_context_t* linksim_get_context(linksim* pThis, uint32_t side);
+
+// set the getchar/putchar/clock callbacks of both contexts, run transferA and transferB in two threads and
+// wait for both. results are then available with linksim_get_result
+extern bool linksim_run(linksim* pThis, int32_t (*transferA)(modem_context_t* pThis), int32_t (*transferB)(modem_context_t* pThis));
+extern int32_t linksim_get_result(linksim* pThis, uint32_t side);
+extern const linksim_channel_stats* linksim_get_channel_stats(linksim* pThis, uint32_t side);
+extern uint64_t linksim_get_time_ns(linksim* pThis);
+// reception of a DMA transport for the transfers driven by lmodem_step (from the transfer thread of the side):
+// up to size bytes, ends when the line is idle after the first byte, 0 after the getchar timeout
+extern uint32_t linksim_dma_read(modem_context_t* pThis, uint8_t* data, uint32_t size);
+
+#endif /* LINKSIM_H */
@@ -0,0 +1,481 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "lmodem.h"
+#include "capture.h"
+
+// replay a capture made with rzsz --record in a fresh context: the received bytes are given back at their
+// recorded arrival time on a virtual clock, the emitted bytes are compared with the recorded ones and the
+// per-block latency of the replay is compared with the recorded one
+
+#define REPLAY_FILE_SIZE           (1024*1024)
+#define REPLAY_FILENAME_SIZE       (256)
+// rzsz serial read timeout, used when the capture has no timeout to measure it
+#define REPLAY_DEFAULT_TIMEOUT_NS  (500000000ULL)
+
+typedef enum
+{
+    OPTS_FILE,
+    OPTS_TIMEOUT,
+    OPTS_MAX_LATENCY_RATIO,
+    OPTS_VERBOSE,
+    OPTS_UNKNOWN = '?'
+} OPTS;
+
+typedef struct
+{
+    char* capture_filename;
+    char* filename;
+    uint64_t timeout_ns;
+    double max_latency_ratio;
+    uint32_t verbose;
+} options_t;
+
+typedef struct
+{
+    uint8_t* data;
+    uint64_t* arrival_ns;
+    uint32_t size;
+    uint32_t offset;
+} replay_stream;
+
+typedef struct
+{
+    uint64_t* time_ns;
+    uint32_t nb;
+} replay_blocks;
+
+typedef struct
+{
+    uint32_t nb;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} replay_latency;
+
+static options_t options;
+
+static struct option long_options[] =
+{
+    {"file", required_argument, 0, OPTS_FILE},
+    {"timeout-ms", required_argument, 0, OPTS_TIMEOUT},
+    {"max-latency-ratio", required_argument, 0, OPTS_MAX_LATENCY_RATIO},
+    {"verbose", no_argument, 0, OPTS_VERBOSE},
+    {0, 0, 0, 0}
+};
+
+static capture_trace trace;
+static replay_stream rx_stream;
+static replay_stream tx_stream;
+static replay_blocks recorded_blocks;
+static replay_blocks replay_blocks_done;
+static uint64_t replay_now_ns;
+static uint64_t divergence_offset;
+static bool bDiverged;
+static uint8_t replay_line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+static char replay_filename_buffer[REPLAY_FILENAME_SIZE];
+
+static bool parse_options(int argc, char* argv[]);
+static bool load_streams(int32_t* pRecordedResult);
+static bool setup_context(modem_context_t* pCtx, uint8_t** ppFile);
+static bool replay_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size);
+static void replay_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size);
+static uint64_t replay_clock_ns(modem_context_t* pThis);
+static void replay_progress(modem_context_t* pThis, const lmodem_progress* pProgress);
+static void compute_latency(replay_latency* pLatency, const replay_blocks* pBlocks);
+
+static uint64_t host_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[])
+{
+    modem_context_t ctx;
+    replay_latency recorded;
+    replay_latency replayed;
+    uint8_t* pFile;
+    int32_t recordedResult;
+    int32_t result;
+    uint64_t hostStart;
+    uint64_t hostElapsed;
+    uint64_t maxDelta;
+    uint32_t maxDeltaBlock;
+    uint32_t i;
+    bool bOk;
+
+    bOk = parse_options(argc, argv) && capture_load(&trace, options.capture_filename);
+    if (!bOk)
+    {
+        fprintf(stdout, "unable to load capture\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pFile = NULL;
+    bOk = load_streams(&recordedResult) && setup_context(&ctx, &pFile);
+    if (!bOk)
+    {
+        capture_free(&trace);
+        exit(EXIT_FAILURE);
+    }
+
+    hostStart = host_clock_ns();
+    if (trace.header.rx)
+    {
+        result = lmodem_receive(&ctx, trace.header.protocol);
+    }
+    else
+    {
+        result = lmodem_emit(&ctx, trace.header.protocol);
+    }
+    hostElapsed = host_clock_ns() - hostStart;
+
+    if ((!bDiverged) && (tx_stream.offset != tx_stream.size))
+    {
+        bDiverged = true;
+        divergence_offset = tx_stream.offset;
+    }
+
+    fprintf(stdout, "result: recorded %d, replay %d\n", recordedResult, result);
+    if (bDiverged)
+    {
+        fprintf(stdout, "emitted bytes differ from byte %" PRIu64 " (%u bytes recorded)\n", divergence_offset, tx_stream.size);
+    }
+    else
+    {
+        fprintf(stdout, "emitted bytes identical (%u bytes)\n", tx_stream.size);
+    }
+
+    compute_latency(&recorded, &recorded_blocks);
+    compute_latency(&replayed, &replay_blocks_done);
+    fprintf(stdout, "blocks: recorded %u, replay %u\n", recorded_blocks.nb, replay_blocks_done.nb);
+    fprintf(stdout, "block latency: recorded avg %.3f ms max %.3f ms, replay avg %.3f ms max %.3f ms\n",
+            (recorded.nb > 0) ? (recorded.total_ns / 1e6 / recorded.nb) : 0.0, recorded.max_ns / 1e6,
+            (replayed.nb > 0) ? (replayed.total_ns / 1e6 / replayed.nb) : 0.0, replayed.max_ns / 1e6);
+
+    maxDelta = 0;
+    maxDeltaBlock = 0;
+    for (i = 0; (i < recorded_blocks.nb) && (i < replay_blocks_done.nb); i++)
+    {
+        uint64_t a = recorded_blocks.time_ns[i];
+        uint64_t b = replay_blocks_done.time_ns[i];
+        uint64_t delta = (a > b) ? (a - b) : (b - a);
+        if (options.verbose)
+        {
+            fprintf(stdout, "  block %u: recorded %.3f ms, replay %.3f ms\n", i, a / 1e6, b / 1e6);
+        }
+        if (delta > maxDelta)
+        {
+            maxDelta = delta;
+            maxDeltaBlock = i;
+        }
+    }
+    fprintf(stdout, "largest block time difference: %.3f ms (block %u)\n", maxDelta / 1e6, maxDeltaBlock);
+    fprintf(stdout, "host processing time: %.3f ms, %.3f us per block\n", hostElapsed / 1e6,
+            (replay_blocks_done.nb > 0) ? (hostElapsed / 1e3 / replay_blocks_done.nb) : 0.0);
+
+    bOk = (result == recordedResult) && (!bDiverged) && (recorded_blocks.nb == replay_blocks_done.nb);
+    if ((bOk) && (options.max_latency_ratio > 0) && (recorded.total_ns > 0))
+    {
+        bOk = (replayed.total_ns <= options.max_latency_ratio * recorded.total_ns);
+    }
+
+    free(pFile);
+    free(rx_stream.data);
+    free(rx_stream.arrival_ns);
+    free(tx_stream.data);
+    free(recorded_blocks.time_ns);
+    free(replay_blocks_done.time_ns);
+    capture_free(&trace);
+    fprintf(stdout, "%s\n", bOk ? "replay ok" : "replay differs");
+    return bOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool load_streams(int32_t* pRecordedResult)
+{
+    capture_record* pRecord;
+    uint64_t minTimeout;
+    uint32_t rxSize;
+    uint32_t txSize;
+    uint32_t nbBlocks;
+    uint32_t i;
+    uint32_t j;
+
+    rxSize = 0;
+    txSize = 0;
+    nbBlocks = 0;
+    minTimeout = UINT64_MAX;
+    *pRecordedResult = -1;
+    for (i = 0; i < trace.nb_records; i++)
+    {
+        pRecord = &trace.records[i];
+        switch (pRecord->type)
+        {
+            case CAPTURE_GET:
+                rxSize += pRecord->size;
+                break;
+            case CAPTURE_PUT:
+                txSize += pRecord->size;
+                break;
+            case CAPTURE_TIMEOUT:
+                //a call without any byte lasts exactly the read timeout
+                if (pRecord->duration_ns < minTimeout)
+                {
+                    minTimeout = pRecord->duration_ns;
+                }
+                break;
+            case CAPTURE_BLOCK:
+                nbBlocks++;
+                break;
+            case CAPTURE_END:
+                *pRecordedResult = pRecord->result;
+                break;
+        }
+    }
+
+    if (options.timeout_ns == 0)
+    {
+        options.timeout_ns = (minTimeout != UINT64_MAX) ? minTimeout : REPLAY_DEFAULT_TIMEOUT_NS;
+    }
+
+    rx_stream.data = malloc(rxSize + 1);
+    rx_stream.arrival_ns = malloc((rxSize + 1) * sizeof(uint64_t));
+    recorded_blocks.time_ns = malloc((nbBlocks + 1) * sizeof(uint64_t));
+    replay_blocks_done.time_ns = malloc((nbBlocks + 1) * sizeof(uint64_t));
+    tx_stream.data = malloc(txSize + 1);
+    if ((rx_stream.data == NULL) || (rx_stream.arrival_ns == NULL) || (recorded_blocks.time_ns == NULL)
+            || (replay_blocks_done.time_ns == NULL) || (tx_stream.data == NULL))
+    {
+        fprintf(stdout, "unable to allocate the streams\n");
+        return false;
+    }
+
+    for (i = 0; i < trace.nb_records; i++)
+    {
+        pRecord = &trace.records[i];
+        if (pRecord->type == CAPTURE_GET)
+        {
+            for (j = 0; j < pRecord->size; j++)
+            {
+                //the bytes of a read are known to be there at the end of the call
+                rx_stream.data[rx_stream.size] = pRecord->data[j];
+                rx_stream.arrival_ns[rx_stream.size] = pRecord->time_ns;
+                rx_stream.size++;
+            }
+        }
+        else if (pRecord->type == CAPTURE_PUT)
+        {
+            memcpy(&tx_stream.data[tx_stream.size], pRecord->data, pRecord->size);
+            tx_stream.size += pRecord->size;
+        }
+        else if (pRecord->type == CAPTURE_BLOCK)
+        {
+            recorded_blocks.time_ns[recorded_blocks.nb++] = pRecord->time_ns;
+        }
+    }
+
+    fprintf(stdout, "capture: %s %s, opts %u, low memory %u, %u bytes received, %u bytes emitted, %u blocks, timeout %.3f ms\n",
+            (trace.header.protocol == XMODEM) ? "xmodem" : "ymodem", trace.header.rx ? "reception" : "emission",
+            trace.header.opts, trace.header.low_memory_rx, rx_stream.size, tx_stream.size, nbBlocks, options.timeout_ns / 1e6);
+    return true;
+}
+
+static bool setup_context(modem_context_t* pCtx, uint8_t** ppFile)
+{
+    struct stat fileStat;
+    FILE* f;
+    uint32_t lineBufferSize;
+    bool bOk;
+
+    lmodem_init(pCtx, trace.header.opts);
+    lineBufferSize = LXMODEM_1K_BUFFER_MIN_SIZE;
+    if ((trace.header.rx) && (trace.header.low_memory_rx))
+    {
+        lmodem_set_low_memory_rx(pCtx, true);
+        lineBufferSize = LXMODEM_LOW_MEMORY_RX_BUFFER_MIN_SIZE;
+    }
+    bOk = lmodem_set_line_buffer(pCtx, replay_line_buffer, lineBufferSize);
+    lmodem_set_filename_buffer(pCtx, replay_filename_buffer, REPLAY_FILENAME_SIZE);
+    lmodem_set_getchar_cb(pCtx, replay_getchar);
+    lmodem_set_putchar_cb(pCtx, replay_putchar);
+    lmodem_set_clock_cb(pCtx, replay_clock_ns);
+    lmodem_set_progress_cb(pCtx, replay_progress);
+
+    if ((bOk) && (trace.header.rx))
+    {
+        *ppFile = malloc(REPLAY_FILE_SIZE);
+        bOk = (*ppFile != NULL);
+        lmodem_set_file_buffer(pCtx, *ppFile, REPLAY_FILE_SIZE);
+    }
+    else if (bOk)
+    {
+        //an emission is replayed from the emitted file
+        bOk = (options.filename != NULL) && (stat(options.filename, &fileStat) == 0);
+        if (!bOk)
+        {
+            fprintf(stdout, "the replay of an emission needs the emitted file (--file)\n");
+            return false;
+        }
+
+        *ppFile = malloc(fileStat.st_size + 1);
+        f = fopen(options.filename, "rb");
+        bOk = (*ppFile != NULL) && (f != NULL) && (fread(*ppFile, 1, fileStat.st_size, f) == (size_t) fileStat.st_size);
+        if (f != NULL)
+        {
+            fclose(f);
+        }
+        lmodem_set_file_buffer(pCtx, *ppFile, fileStat.st_size);
+        bOk = bOk && lmodem_buffer_set_write_offset(&pCtx->ramfile, fileStat.st_size);
+        if ((bOk) && (trace.header.protocol == YMODEM))
+        {
+            //same metadata as rzsz
+            lmodem_metadata_set_filename(pCtx, (strrchr(options.filename, '/') != NULL) ? (strrchr(options.filename, '/') + 1) : options.filename);
+            lmodem_metadata_set_filesize(pCtx, fileStat.st_size);
+            lmodem_metadata_set_modif_time(pCtx, fileStat.st_mtime);
+            lmodem_metadata_set_permission(pCtx, fileStat.st_mode);
+            lmodem_metadata_set_serial(pCtx, 0);
+        }
+    }
+
+    if (!bOk)
+    {
+        fprintf(stdout, "unable to set up the context\n");
+    }
+    return bOk;
+}
+
+static bool replay_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    uint32_t nbRead;
+    (void) pThis;
+
+    //inter-byte timeout, like the serial read: the bytes already read are consumed on a timeout
+    for (nbRead = 0; nbRead < size; nbRead++)
+    {
+        if ((rx_stream.offset == rx_stream.size)
+                || (rx_stream.arrival_ns[rx_stream.offset] > replay_now_ns + options.timeout_ns))
+        {
+            replay_now_ns += options.timeout_ns;
+            return false;
+        }
+        if (rx_stream.arrival_ns[rx_stream.offset] > replay_now_ns)
+        {
+            replay_now_ns = rx_stream.arrival_ns[rx_stream.offset];
+        }
+        data[nbRead] = rx_stream.data[rx_stream.offset++];
+    }
+    return true;
+}
+
+static void replay_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    uint32_t i;
+    (void) pThis;
+
+    for (i = 0; (i < size) && (!bDiverged); i++)
+    {
+        if ((tx_stream.offset == tx_stream.size) || (tx_stream.data[tx_stream.offset] != data[i]))
+        {
+            bDiverged = true;
+            divergence_offset = tx_stream.offset;
+        }
+        else
+        {
+            tx_stream.offset++;
+        }
+    }
+}
+
+static uint64_t replay_clock_ns(modem_context_t* pThis)
+{
+    (void) pThis;
+    return replay_now_ns;
+}
+
+static void replay_progress(modem_context_t* pThis, const lmodem_progress* pProgress)
+{
+    (void) pThis;
+    (void) pProgress;
+
+    //more blocks than recorded is a behavior change, reported by the count
+    if (replay_blocks_done.nb < recorded_blocks.nb)
+    {
+        replay_blocks_done.time_ns[replay_blocks_done.nb] = replay_now_ns;
+    }
+    replay_blocks_done.nb++;
+}
+
+static void compute_latency(replay_latency* pLatency, const replay_blocks* pBlocks)
+{
+    uint64_t previous;
+    uint64_t latency;
+    uint32_t i;
+
+    memset(pLatency, 0, sizeof(replay_latency));
+    previous = 0;
+    for (i = 0; (i < pBlocks->nb) && (i < recorded_blocks.nb); i++)
+    {
+        latency = pBlocks->time_ns[i] - previous;
+        previous = pBlocks->time_ns[i];
+        pLatency->total_ns += latency;
+        pLatency->nb++;
+        if (latency > pLatency->max_ns)
+        {
+            pLatency->max_ns = latency;
+        }
+    }
+}
+
+static bool parse_options(int argc, char* argv[])
+{
+    int opt_index;
+    OPTS c;
+
+    memset(&options, 0, sizeof(options_t));
+
+    while (1)
+    {
+        c = getopt_long(argc, argv, "", long_options, &opt_index);
+        if ((int32_t) c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case OPTS_FILE:
+                options.filename = optarg;
+                break;
+
+            case OPTS_TIMEOUT:
+                options.timeout_ns = strtoull(optarg, NULL, 0) * 1000000;
+                break;
+
+            case OPTS_MAX_LATENCY_RATIO:
+                options.max_latency_ratio = strtod(optarg, NULL);
+                break;
+
+            case OPTS_VERBOSE:
+                options.verbose = 1;
+                break;
+
+            case OPTS_UNKNOWN:
+            default:
+                fprintf(stdout, "unknow options\n");
+                return false;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        fprintf(stdout, "usage: %s [--file <emitted file>] [--timeout-ms <ms>] [--max-latency-ratio <r>] [--verbose] <capture>\n", argv[0]);
+        return false;
+    }
+    options.capture_filename = argv[optind];
+    return true;
+}
@@ -0,0 +1,936 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include "lmodem.h"
+#include "linksim.h"
+#include "crc_mock.h"
+#include "capture.h"
+
+// run an emission (side A) and a reception (side B) over the link simulator and check the received data
+
+#define SIM_FILENAME_SIZE      (256)
+#define SIM_PADDING            (0x1A)
+#define SIM_STEP_RING_SIZE     (1024)
+// size, modification time, mode and serial after the name of block 0
+#define SIM_METADATA_ALL       (4)
+#define SIM_MODIF_TIME         (1700000000)
+#define SIM_MODE               (0644)
+#define SIM_SERIAL             (7)
+// each line buffer starts on a DMA alignment
+#define SIM_LINE_BUFFER_SIZE   ((LXMODEM_1K_BUFFER_MIN_SIZE + LMODEM_DMA_ALIGNMENT - 1) / LMODEM_DMA_ALIGNMENT * LMODEM_DMA_ALIGNMENT)
+
+typedef enum
+{
+    OPTS_PROTOCOL,
+    OPTS_CRC,
+    OPTS_1K,
+    OPTS_LOW_MEMORY,
+    OPTS_SIZE,
+    OPTS_SEED,
+    OPTS_BAUD,
+    OPTS_LATENCY,
+    OPTS_BER,
+    OPTS_DROP,
+    OPTS_BURST_RATE,
+    OPTS_BURST_LEN,
+    OPTS_STALL_RATE,
+    OPTS_STALL,
+    OPTS_TIMEOUT,
+    OPTS_JABBER,
+    OPTS_CLEAN_ACK,
+    OPTS_EXPECT_FAILURE,
+    OPTS_STATS,
+    OPTS_DOUBLE_BUFFER,
+    OPTS_DATA_SOURCE,
+    OPTS_STEP,
+    OPTS_DMA,
+    OPTS_CRC_OFFLOAD,
+    OPTS_CRC_ASYNC,
+    OPTS_COMPRESS,
+    OPTS_CONTENT,
+    OPTS_DELTA,
+    OPTS_PRESENT,
+    OPTS_BAD_FILE_CRC,
+    OPTS_RECORD,
+    OPTS_METADATA,
+    OPTS_FILE_CRC,
+    OPTS_UNKNOWN = '?'
+} OPTS;
+
+typedef enum
+{
+    SIM_CONTENT_RANDOM,
+    SIM_CONTENT_FIRMWARE,
+    SIM_CONTENT_LOG
+} sim_content;
+
+typedef struct
+{
+    lmodem_protocol protocol;
+    uint32_t crc;
+    uint32_t xmodem_blksize;
+    uint32_t low_memory;
+    uint32_t size;
+    uint64_t seed;
+    linksim_config link;
+    uint32_t clean_ack;
+    uint32_t expect_failure;
+    uint32_t stats;
+    uint32_t double_buffer;
+    uint32_t data_source;
+    uint32_t step;
+    uint32_t dma;
+    uint32_t crc_offload;
+    uint32_t crc_async;
+    uint32_t compress;
+    sim_content content;
+    uint32_t delta;
+    uint32_t delta_regions;
+    uint32_t present;
+    uint32_t bad_file_crc;
+    char* record_filename;
+    uint32_t metadata;
+    uint32_t file_crc;
+} options_t;
+
+// non-blocking transfer of one side: the link bytes are pushed in the rx ring when lmodem_step would block
+typedef struct
+{
+    lmodem_ring ring;
+    uint8_t storage[SIM_STEP_RING_SIZE];
+    bool (*link_getchar)(modem_context_t* pThis, uint8_t* data, uint32_t size);
+    uint8_t* dma_data;                  // DMA reception armed by the library, dma_size 0 when stopped
+    uint32_t dma_size;
+    uint32_t dma_completions;
+} sim_stepper;
+
+static options_t options;
+
+static struct option long_options[] =
+{
+    {"protocol", required_argument, 0, OPTS_PROTOCOL },
+    {"crc", no_argument, 0, OPTS_CRC},
+    {"1k", no_argument, 0, OPTS_1K},
+    {"low-memory", no_argument, 0, OPTS_LOW_MEMORY},
+    {"size", required_argument, 0, OPTS_SIZE},
+    {"seed", required_argument, 0, OPTS_SEED},
+    {"baud", required_argument, 0, OPTS_BAUD},
+    {"latency-us", required_argument, 0, OPTS_LATENCY},
+    {"ber", required_argument, 0, OPTS_BER},
+    {"drop", required_argument, 0, OPTS_DROP},
+    {"burst-rate", required_argument, 0, OPTS_BURST_RATE},
+    {"burst-len", required_argument, 0, OPTS_BURST_LEN},
+    {"stall-rate", required_argument, 0, OPTS_STALL_RATE},
+    {"stall-ms", required_argument, 0, OPTS_STALL},
+    {"timeout-ms", required_argument, 0, OPTS_TIMEOUT},
+    {"jabber-ms", required_argument, 0, OPTS_JABBER},
+    {"clean-ack", no_argument, 0, OPTS_CLEAN_ACK},
+    {"expect-failure", no_argument, 0, OPTS_EXPECT_FAILURE},
+    {"stats", no_argument, 0, OPTS_STATS},
+    {"double-buffer", no_argument, 0, OPTS_DOUBLE_BUFFER},
+    {"data-source", no_argument, 0, OPTS_DATA_SOURCE},
+    {"step", no_argument, 0, OPTS_STEP},
+    {"dma", no_argument, 0, OPTS_DMA},
+    {"crc-offload", no_argument, 0, OPTS_CRC_OFFLOAD},
+    {"crc-async", no_argument, 0, OPTS_CRC_ASYNC},
+    {"compress", no_argument, 0, OPTS_COMPRESS},
+    {"content", required_argument, 0, OPTS_CONTENT},
+    {"delta", required_argument, 0, OPTS_DELTA},
+    {"present", no_argument, 0, OPTS_PRESENT},
+    {"bad-file-crc", no_argument, 0, OPTS_BAD_FILE_CRC},
+    {"record", required_argument, 0, OPTS_RECORD},
+    {"metadata", required_argument, 0, OPTS_METADATA},
+    {"file-crc", no_argument, 0, OPTS_FILE_CRC},
+    {0, 0, 0, 0}
+};
+
+static linksim sim;
+static crc_mock sim_crc_mocks[LINKSIM_NB_SIDES];
+static char sim_filename[SIM_FILENAME_SIZE];
+static char sim_rx_filename[SIM_FILENAME_SIZE];
+static uint8_t* sim_source;
+static uint32_t sim_source_offset;
+static lmodem_compressor sim_compressor;
+static lmodem_delta_encoder sim_delta_encoder;
+static uint32_t sim_previous_size;
+
+static bool parse_options(int argc, char* argv[]);
+static bool setup_context(modem_context_t* pCtx, uint8_t* pFile, uint32_t fileSize, bool bRx);
+static bool check_reception(uint8_t* pSent, modem_context_t* pRx, int32_t nbReceived);
+static bool check_metadata(modem_context_t* pRx);
+static void print_stats(const char* name, const lmodem_stats* pStats);
+static void generate_content(uint8_t* pData, uint32_t size, uint64_t seed);
+static uint32_t generate_previous_version(uint8_t* pPrevious, const uint8_t* pData, uint32_t size, uint32_t nbRegions, uint64_t seed);
+static uint32_t count_changed_blocks(uint32_t size, uint32_t previousSize);
+
+static int32_t sim_read_data(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    uint32_t n;
+    (void) pThis;
+
+    //short reads, like a slow storage
+    n = options.size - sim_source_offset;
+    n = (n < size) ? n : size;
+    n = (n < 100) ? n : 100;
+    memcpy(data, &sim_source[sim_source_offset], n);
+    sim_source_offset += n;
+    return n;
+}
+
+static void sim_dma_start(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    sim_stepper* pStepper;
+
+    pStepper = lmodem_get_user_data(pThis);
+    pStepper->dma_data = data;
+    pStepper->dma_size = size;
+}
+
+static int32_t sim_step(modem_context_t* pThis, bool bRx)
+{
+    static sim_stepper steppers[LINKSIM_NB_SIDES];
+    sim_stepper* pStepper;
+    crc_mock* pMock;
+    lmodem_step_status status;
+    uint64_t timeout;
+    uint32_t nbReceived;
+    uint8_t c;
+    bool bStarted;
+
+    pStepper = &steppers[bRx ? 1 : 0];
+    pMock = &sim_crc_mocks[bRx ? 1 : 0];
+    pStepper->link_getchar = pThis->getchar;
+    pStepper->dma_size = 0;
+    pStepper->dma_completions = 0;
+    lmodem_set_user_data(pThis, pStepper);
+    timeout = (options.link.timeout_ns != 0) ? options.link.timeout_ns : LINKSIM_DEFAULT_TIMEOUT_NS;
+    if (options.dma)
+    {
+        if (!lmodem_set_rx_dma(pThis, sim_dma_start, timeout))
+        {
+            fprintf(stderr, "line buffer not usable for dma\n");
+            return -1;
+        }
+    }
+    else
+    {
+        lmodem_ring_init(&pStepper->ring, pStepper->storage, SIM_STEP_RING_SIZE);
+        lmodem_set_rx_ring(pThis, &pStepper->ring, timeout, NULL);
+    }
+
+    bStarted = bRx ? lmodem_start_receive(pThis, options.protocol) : lmodem_start_emit(pThis, options.protocol);
+    if (!bStarted)
+    {
+        return -1;
+    }
+
+    status = lmodem_step(pThis);
+    while (status == LMODEM_STEP_WOULD_BLOCK)
+    {
+        //like a CRC end of transfer interrupt, the step waits for it before the bytes of the link
+        if ((options.crc_async) && (crc_mock_wait_idle(pMock)))
+        {
+        }
+        else if (options.dma)
+        {
+            //like the DMA end or idle line interrupt: a whole frame, a part of it or the timeout of the link
+            if (pStepper->dma_size > 0)
+            {
+                nbReceived = linksim_dma_read(pThis, pStepper->dma_data, pStepper->dma_size);
+                pStepper->dma_size = 0;
+                pStepper->dma_completions++;
+                lmodem_rx_dma_complete(pThis, nbReceived);
+            }
+        }
+        //like an uart interrupt, one byte or the timeout of the link (the virtual clock moves on)
+        else if ((lmodem_ring_get_count(&pStepper->ring) == 0) && (pStepper->link_getchar(pThis, &c, 1)))
+        {
+            lmodem_ring_push_byte(&pStepper->ring, c);
+        }
+        status = lmodem_step(pThis);
+    }
+
+    if ((options.dma) && (options.stats))
+    {
+        fprintf(stdout, "%s: %u dma completions\n", bRx ? "rx" : "tx", pStepper->dma_completions);
+    }
+    return lmodem_get_result(pThis);
+}
+
+static int32_t sim_emit(modem_context_t* pThis)
+{
+    if (options.step)
+    {
+        return sim_step(pThis, false);
+    }
+    return lmodem_emit(pThis, options.protocol);
+}
+
+static int32_t sim_receive(modem_context_t* pThis)
+{
+    int32_t result;
+
+    if (options.step)
+    {
+        return sim_step(pThis, true);
+    }
+    //the capture of the reception, on the virtual clock, can be checked with lmodem_replay
+    if ((options.record_filename != NULL) && (!capture_start(options.record_filename, pThis, options.protocol, true)))
+    {
+        fprintf(stderr, "unable to create capture '%s'\n", options.record_filename);
+        return -1;
+    }
+    result = lmodem_receive(pThis, options.protocol);
+    if ((options.record_filename != NULL) && (!capture_stop(pThis, result)))
+    {
+        fprintf(stderr, "unable to write capture '%s'\n", options.record_filename);
+        return -1;
+    }
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    linksim_config ackLink;
+    modem_context_t* pTx;
+    modem_context_t* pRx;
+    uint8_t* pSent;
+    uint8_t* pReceived;
+    uint32_t* pHashes;
+    uint64_t elapsed;
+    uint32_t i;
+    bool bOk;
+    bool bCompressed;
+
+    bOk = parse_options(argc, argv);
+    if (!bOk)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    ackLink = options.link;
+    //the data line only is broken
+    ackLink.jabber_ns = 0;
+    if (options.clean_ack)
+    {
+        ackLink.ber = 0;
+        ackLink.drop_rate = 0;
+        ackLink.burst_rate = 0;
+        ackLink.stall_rate = 0;
+    }
+    linksim_init(&sim, &options.link, &ackLink, options.seed);
+
+    pSent = malloc(options.size + 1);
+    pReceived = malloc(options.size + LXMODEM_1K_BUFFER_MIN_SIZE);
+    if ((pSent == NULL) || (pReceived == NULL))
+    {
+        fprintf(stderr, "unable to allocate %u bytes\n", options.size);
+        exit(EXIT_FAILURE);
+    }
+    generate_content(pSent, options.size, options.seed);
+
+    pTx = linksim_get_context(&sim, LINKSIM_SIDE_A);
+    pRx = linksim_get_context(&sim, LINKSIM_SIDE_B);
+    bOk = setup_context(pTx, pSent, options.size, false) && setup_context(pRx, pReceived, options.size + LXMODEM_1K_BUFFER_MIN_SIZE, true);
+    pHashes = NULL;
+    if (options.delta)
+    {
+        pHashes = malloc((options.size / LMODEM_DELTA_BLOCK_SIZE + 1) * sizeof(uint32_t));
+        bOk = bOk && (pHashes != NULL);
+        lmodem_set_delta(pTx, &sim_delta_encoder, pHashes, options.size / LMODEM_DELTA_BLOCK_SIZE + 1);
+        sim_previous_size = generate_previous_version(pReceived, pSent, options.size, options.delta_regions, options.seed);
+        lmodem_set_delta_base(pRx, true, sim_previous_size);
+    }
+    if (options.present)
+    {
+        //the receiver already holds the file
+        memcpy(pReceived, pSent, options.size);
+        lmodem_set_present_file(pRx, true, options.size, crc32_update(0, pSent, options.size));
+    }
+    for (i = 0; (bOk) && (options.crc_offload) && (i < LINKSIM_NB_SIDES); i++)
+    {
+        bOk = crc_mock_start(&sim_crc_mocks[i], options.crc_async);
+        lmodem_set_crc_provider(linksim_get_context(&sim, i), &sim_crc_mocks[i].provider);
+    }
+    if (bOk)
+    {
+        bOk = linksim_run(&sim, sim_emit, sim_receive);
+    }
+    for (i = 0; (options.crc_offload) && (i < LINKSIM_NB_SIDES); i++)
+    {
+        crc_mock_stop(&sim_crc_mocks[i]);
+    }
+
+    if ((bOk) && (options.present))
+    {
+        //a skipped file is not written, the application keeps its own. a receiver in low memory mode receives it again
+        bOk = (lmodem_is_skipped(pTx) == !options.low_memory) && (lmodem_is_skipped(pRx) == !options.low_memory);
+        if (lmodem_is_skipped(pRx))
+        {
+            lmodem_buffer_set_write_offset(&pRx->ramfile, options.size);
+        }
+        fprintf(stdout, "file %s\n", lmodem_is_skipped(pRx) ? "already present, skipped" : "received again");
+    }
+    if (bOk)
+    {
+        bOk = check_reception(pSent, pRx, linksim_get_result(&sim, LINKSIM_SIDE_B));
+        bOk = bOk && ((options.protocol != YMODEM) || (check_metadata(pRx)));
+        elapsed = linksim_get_time_ns(&sim);
+        fprintf(stdout, "emitted %d, received %d, %s, virtual time %.3f s, goodput %.1f B/s\n",
+                linksim_get_result(&sim, LINKSIM_SIDE_A), linksim_get_result(&sim, LINKSIM_SIDE_B),
+                bOk ? "data ok" : "DATA KO", elapsed / 1e9, (elapsed > 0) ? (options.size * 1e9 / elapsed) : 0.0);
+        fprintf(stdout, "link a->b: %" PRIu64 " bytes, %" PRIu64 " corrupted, %" PRIu64 " dropped, %u stalls\n",
+                linksim_get_channel_stats(&sim, LINKSIM_SIDE_A)->bytes_sent, linksim_get_channel_stats(&sim, LINKSIM_SIDE_A)->bytes_corrupted,
+                linksim_get_channel_stats(&sim, LINKSIM_SIDE_A)->bytes_dropped, linksim_get_channel_stats(&sim, LINKSIM_SIDE_A)->stalls);
+        fprintf(stdout, "link b->a: %" PRIu64 " bytes, %" PRIu64 " corrupted, %" PRIu64 " dropped, %u stalls\n",
+                linksim_get_channel_stats(&sim, LINKSIM_SIDE_B)->bytes_sent, linksim_get_channel_stats(&sim, LINKSIM_SIDE_B)->bytes_corrupted,
+                linksim_get_channel_stats(&sim, LINKSIM_SIDE_B)->bytes_dropped, linksim_get_channel_stats(&sim, LINKSIM_SIDE_B)->stalls);
+        if (options.compress)
+        {
+            //both sides must have agreed, a receiver in low memory mode declines the offer, a delta or a skip is preferred.
+            //it is only offered after all the positional fields of block 0
+            bCompressed = (!options.low_memory) && (!options.delta) && (!options.present) && (options.metadata == SIM_METADATA_ALL);
+            bOk = bOk && (lmodem_is_compressed(pTx) == bCompressed) && (lmodem_is_compressed(pRx) == bCompressed);
+            fprintf(stdout, "compression %s: %u bytes in %" PRIu64 " bytes of blocks (%.2fx)\n", lmodem_is_compressed(pTx) ? "on" : "off",
+                    options.size, sim_compressor.compressed_bytes,
+                    (sim_compressor.compressed_bytes > 0) ? ((double) options.size / sim_compressor.compressed_bytes) : 0.0);
+        }
+        if (options.delta)
+        {
+            bOk = bOk && (lmodem_is_delta(pTx) == (!options.low_memory && !options.present))
+                  && (lmodem_is_delta(pRx) == (!options.low_memory && !options.present));
+            if ((lmodem_is_delta(pTx)) && (options.delta_regions == 0))
+            {
+                //an unchanged previous version: only the blocks after its end are sent
+                bOk = bOk && (sim_delta_encoder.blocks_sent == count_changed_blocks(options.size, sim_previous_size));
+            }
+            fprintf(stdout, "delta %s: %u blocks sent, %u blocks kept\n", lmodem_is_delta(pTx) ? "on" : "off",
+                    sim_delta_encoder.blocks_sent, sim_delta_encoder.blocks_skipped);
+        }
+        if (options.stats)
+        {
+            print_stats("tx", lmodem_get_stats(pTx));
+            print_stats("rx", lmodem_get_stats(pRx));
+            for (i = 0; (options.crc_offload) && (i < LINKSIM_NB_SIDES); i++)
+            {
+                fprintf(stdout, "%s: crc offload %" PRIu64 " updates, %" PRIu64 " bytes, %" PRIu64 " async completions\n",
+                        (i == LINKSIM_SIDE_A) ? "tx" : "rx", sim_crc_mocks[i].updates, sim_crc_mocks[i].bytes,
+                        sim_crc_mocks[i].async_completions);
+            }
+        }
+    }
+
+    if (options.expect_failure)
+    {
+        //the transfer must be aborted cleanly on both sides, a sender which skipped the file took noise for an answer
+        bOk = (linksim_get_result(&sim, LINKSIM_SIDE_A) < 0) && (linksim_get_result(&sim, LINKSIM_SIDE_B) < 0)
+              && (!lmodem_is_skipped(pTx));
+    }
+
+    linksim_destroy(&sim);
+    free(pSent);
+    free(pReceived);
+    free(pHashes);
+    fprintf(stdout, "%s\n", bOk ? "test ok" : "test failed");
+    return bOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool setup_context(modem_context_t* pCtx, uint8_t* pFile, uint32_t fileSize, bool bRx)
+{
+    static uint8_t lineBuffers[LINKSIM_NB_SIDES][SIM_LINE_BUFFER_SIZE] __attribute__ ((aligned (LMODEM_DMA_ALIGNMENT)));
+    static uint8_t nextLineBuffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    lxmodem_opts opts;
+    uint32_t lineBufferSize;
+    bool bOk;
+
+    opts = lxmodem_128_with_chksum;
+    lineBufferSize = LXMODEM_1K_BUFFER_MIN_SIZE;
+    if ((options.protocol == YMODEM) || (options.xmodem_blksize > 0))
+    {
+        opts = lxmodem_1k;
+    }
+    else if (options.crc > 0)
+    {
+        opts = lxmodem_128_with_crc;
+    }
+
+    lmodem_init(pCtx, opts);
+    if ((bRx) && (options.low_memory))
+    {
+        lmodem_set_low_memory_rx(pCtx, true);
+        lineBufferSize = LXMODEM_LOW_MEMORY_RX_BUFFER_MIN_SIZE;
+    }
+    bOk = lmodem_set_line_buffer(pCtx, lineBuffers[bRx ? 1 : 0], lineBufferSize);
+    lmodem_set_file_buffer(pCtx, pFile, fileSize);
+    lmodem_set_filename_buffer(pCtx, bRx ? sim_rx_filename : sim_filename, SIM_FILENAME_SIZE);
+    if (!bRx)
+    {
+        lmodem_buffer_set_write_offset(&pCtx->ramfile, fileSize);
+        if (options.double_buffer)
+        {
+            lmodem_set_next_line_buffer(pCtx, nextLineBuffer, LXMODEM_1K_BUFFER_MIN_SIZE);
+        }
+        if (options.data_source)
+        {
+            sim_source = pFile;
+            lmodem_set_data_source_cb(pCtx, sim_read_data);
+        }
+        if (options.protocol == YMODEM)
+        {
+            //the first options.metadata positional fields after the name
+            lmodem_metadata_set_filename(pCtx, "lmodem_sim.bin");
+            if (options.metadata >= 1)
+            {
+                lmodem_metadata_set_filesize(pCtx, fileSize);
+            }
+            if (options.metadata >= 2)
+            {
+                lmodem_metadata_set_modif_time(pCtx, SIM_MODIF_TIME);
+            }
+            if (options.metadata >= 3)
+            {
+                lmodem_metadata_set_permission(pCtx, SIM_MODE);
+            }
+            if (options.metadata >= 4)
+            {
+                lmodem_metadata_set_serial(pCtx, SIM_SERIAL);
+            }
+            if (options.file_crc)
+            {
+                lmodem_set_file_crc(pCtx, true);
+            }
+            if ((options.data_source) || (options.bad_file_crc))
+            {
+                //the library only computes it from a file buffer, a wrong one must cancel the transfer
+                lmodem_metadata_set_file_crc(pCtx, crc32_update(0, pFile, fileSize) ^ options.bad_file_crc);
+            }
+        }
+        if (options.compress)
+        {
+            lmodem_set_compression(pCtx, &sim_compressor);
+        }
+    }
+    else if (options.compress)
+    {
+        lmodem_set_decompression(pCtx, true);
+    }
+    return bOk;
+}
+
+// the previous build held by the receiver: the file without its end, with nbRegions small changes, returns its size
+static uint32_t generate_previous_version(uint8_t* pPrevious, const uint8_t* pData, uint32_t size, uint32_t nbRegions, uint64_t seed)
+{
+    uint64_t rng;
+    uint32_t previousSize;
+    uint32_t offset;
+    uint32_t i;
+    uint32_t j;
+
+    previousSize = size - size / 64;
+    memcpy(pPrevious, pData, previousSize);
+    rng = seed * 3 + 1;
+    for (i = 0; (i < nbRegions) && (previousSize > 0); i++)
+    {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        offset = (uint32_t) (rng >> 33) % previousSize;
+        for (j = 0; (j < 32) && (offset + j < previousSize); j++)
+        {
+            pPrevious[offset + j] ^= 0x5A;
+        }
+    }
+    return previousSize;
+}
+
+// blocks of the file which differ from a previous version made of its first previousSize bytes
+static uint32_t count_changed_blocks(uint32_t size, uint32_t previousSize)
+{
+    uint32_t nbChanged;
+    uint32_t offset;
+    uint32_t end;
+
+    nbChanged = 0;
+    for (offset = 0; offset < size; offset += LMODEM_DELTA_BLOCK_SIZE)
+    {
+        end = offset + LMODEM_DELTA_BLOCK_SIZE;
+        if ((offset >= previousSize) || (((end < size) ? end : size) != ((end < previousSize) ? end : previousSize)))
+        {
+            nbChanged++;
+        }
+    }
+    return nbChanged;
+}
+
+// random bytes, or data which compress like the images and logs of a device
+static void generate_content(uint8_t* pData, uint32_t size, uint64_t seed)
+{
+    static const char* const messages[] =
+    {
+        "sensor %u: temperature %u.%u C ok\n",
+        "radio: rssi -%u dBm, retries %u, queue %u\n",
+        "power: battery %u mV, load %u.%u mA\n",
+        "flash: block %u erased in %u.%u ms\n"
+    };
+    uint8_t routines[8][32];
+    uint64_t rng;
+    uint32_t kind;
+    uint32_t routine;
+    uint32_t n;
+    uint32_t i;
+    uint32_t j;
+    char line[96];
+
+    rng = seed + 1;
+    for (i = 0; i < sizeof(routines); i++)
+    {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        routines[i / 32][i % 32] = (uint8_t) (rng >> 56);
+    }
+    i = 0;
+    routine = 0;
+    while (i < size)
+    {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (options.content == SIM_CONTENT_RANDOM)
+        {
+            pData[i++] = (uint8_t) (rng >> 56);
+        }
+        else if (options.content == SIM_CONTENT_LOG)
+        {
+            n = snprintf(line, sizeof(line), "[%8u.%03u] ", i / 64, (uint32_t) (rng >> 40) % 1000);
+            n += snprintf(line + n, sizeof(line) - n, messages[(rng >> 60) & 3], (uint32_t) (rng >> 32) % 16,
+                          (uint32_t) (rng >> 24) % 100, (uint32_t) (rng >> 16) % 10);
+            for (j = 0; (j < n) && (i < size); j++)
+            {
+                pData[i++] = line[j];
+            }
+        }
+        else
+        {
+            //chunks of code (a few routines with another constant each time), zeros, erased flash or tables
+            kind = (rng >> 56) % 20;
+            for (j = 0; (j < 256) && (i < size); j++)
+            {
+                rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+                if ((j % 32) == 0)
+                {
+                    routine = (rng >> 40) % 8;
+                }
+                if (kind < 12)
+                {
+                    pData[i++] = ((j % 32) == 6) ? (uint8_t) (rng >> 56) : routines[routine][j % 32];
+                }
+                else if (kind < 15)
+                {
+                    pData[i++] = 0;
+                }
+                else if (kind < 18)
+                {
+                    pData[i++] = 0xFF;
+                }
+                else
+                {
+                    pData[i++] = (uint8_t) (rng >> 56);
+                }
+            }
+        }
+    }
+}
+
+static bool check_reception(uint8_t* pSent, modem_context_t* pRx, int32_t nbReceived)
+{
+    uint32_t receivedSize;
+    uint32_t i;
+    bool bOk;
+
+    bOk = false;
+    receivedSize = pRx->ramfile.write_offset;
+    if ((nbReceived >= 0) && (receivedSize >= options.size))
+    {
+        bOk = (memcmp(pSent, pRx->ramfile.buffer, options.size) == 0);
+        //xmodem pads the last block, so does ymodem without file size
+        for (i = options.size; (bOk) && (i < receivedSize); i++)
+        {
+            bOk = (pRx->ramfile.buffer[i] == SIM_PADDING);
+        }
+        if ((bOk) && (options.protocol == YMODEM) && (options.metadata >= 1))
+        {
+            bOk = (receivedSize == options.size);
+        }
+    }
+    return bOk;
+}
+
+// the receiver decoded the fields sent, the others stay 0
+static bool check_metadata(modem_context_t* pRx)
+{
+    char filename[SIM_FILENAME_SIZE];
+    uint32_t size;
+    uint32_t modifTime;
+    uint32_t mode;
+    uint32_t serial;
+    uint32_t crc;
+
+    //the crc32 is only offered when asked for, after all the positional fields
+    if (lmodem_metadata_get_file_crc(pRx, &crc) != ((options.file_crc) && (options.metadata == SIM_METADATA_ALL)))
+    {
+        return false;
+    }
+    if ((!lmodem_metadata_get_filename(pRx, filename, SIM_FILENAME_SIZE)) || (!lmodem_metadata_get_filesize(pRx, &size))
+            || (!lmodem_metadata_get_modif_time(pRx, &modifTime)) || (!lmodem_metadata_get_permission(pRx, &mode))
+            || (!lmodem_metadata_get_serial(pRx, &serial)))
+    {
+        return false;
+    }
+    return (strcmp(filename, "lmodem_sim.bin") == 0)
+           && (size == ((options.metadata >= 1) ? options.size : 0))
+           && (modifTime == ((options.metadata >= 2) ? SIM_MODIF_TIME : 0))
+           && (mode == ((options.metadata >= 3) ? SIM_MODE : 0))
+           && (serial == ((options.metadata >= 4) ? SIM_SERIAL : 0));
+}
+
+static void print_stats(const char* name, const lmodem_stats* pStats)
+{
+    fprintf(stdout, "%s: blocks %u/%u, naks %u/%u, retransmissions %u, crc errors %u, chksum errors %u, "
+            "blk no errors %u, duplicates %u, timeouts %u, cans %u, ack rtt avg %.3f ms\n", name,
+            pStats->blocks_sent, pStats->blocks_received, pStats->naks_sent, pStats->naks_received, pStats->retransmissions,
+            pStats->crc_errors, pStats->checksum_errors, pStats->block_number_errors, pStats->duplicate_blocks, pStats->timeouts,
+            pStats->cans_received, lmodem_stats_get_ack_rtt_avg_ns(pStats) / 1e6);
+}
+
+static bool parse_options(int argc, char* argv[])
+{
+    int opt_index;
+    OPTS c;
+
+    memset(&options, 0, sizeof(options_t));
+    options.size = 32 * 1024;
+    options.seed = 1;
+    options.metadata = SIM_METADATA_ALL;
+    options.link.baud = 115200;
+    options.link.burst_len = 16;
+
+    while (1)
+    {
+        c = getopt_long(argc, argv, "", long_options, &opt_index);
+        if ((int32_t) c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case OPTS_PROTOCOL:
+                options.protocol = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_CRC:
+                options.crc = 1;
+                break;
+
+            case OPTS_1K:
+                options.xmodem_blksize = 1;
+                break;
+
+            case OPTS_LOW_MEMORY:
+                options.low_memory = 1;
+                break;
+
+            case OPTS_SIZE:
+                options.size = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_SEED:
+                options.seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case OPTS_BAUD:
+                options.link.baud = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_LATENCY:
+                options.link.latency_ns = strtoull(optarg, NULL, 0) * 1000;
+                break;
+
+            case OPTS_BER:
+                options.link.ber = strtod(optarg, NULL);
+                break;
+
+            case OPTS_DROP:
+                options.link.drop_rate = strtod(optarg, NULL);
+                break;
+
+            case OPTS_BURST_RATE:
+                options.link.burst_rate = strtod(optarg, NULL);
+                break;
+
+            case OPTS_BURST_LEN:
+                options.link.burst_len = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_STALL_RATE:
+                options.link.stall_rate = strtod(optarg, NULL);
+                break;
+
+            case OPTS_STALL:
+                options.link.stall_ns = strtoull(optarg, NULL, 0) * 1000000;
+                break;
+
+            case OPTS_TIMEOUT:
+                options.link.timeout_ns = strtoull(optarg, NULL, 0) * 1000000;
+                break;
+
+            case OPTS_JABBER:
+                options.link.jabber_ns = strtoull(optarg, NULL, 0) * 1000000;
+                break;
+
+            case OPTS_CLEAN_ACK:
+                options.clean_ack = 1;
+                break;
+
+            case OPTS_EXPECT_FAILURE:
+                options.expect_failure = 1;
+                break;
+
+            case OPTS_STATS:
+                options.stats = 1;
+                break;
+
+            case OPTS_DOUBLE_BUFFER:
+                options.double_buffer = 1;
+                break;
+
+            case OPTS_DATA_SOURCE:
+                options.data_source = 1;
+                break;
+
+            case OPTS_STEP:
+                options.step = 1;
+                break;
+
+            case OPTS_DMA:
+                options.step = 1;
+                options.dma = 1;
+                break;
+
+            case OPTS_CRC_OFFLOAD:
+                options.crc_offload = 1;
+                break;
+
+            case OPTS_CRC_ASYNC:
+                options.crc_offload = 1;
+                options.crc_async = 1;
+                break;
+
+            case OPTS_COMPRESS:
+                options.compress = 1;
+                break;
+
+            case OPTS_CONTENT:
+                if (strcmp(optarg, "firmware") == 0)
+                {
+                    options.content = SIM_CONTENT_FIRMWARE;
+                }
+                else if (strcmp(optarg, "log") == 0)
+                {
+                    options.content = SIM_CONTENT_LOG;
+                }
+                else if (strcmp(optarg, "random") != 0)
+                {
+                    fprintf(stdout, "content: random, firmware or log\n");
+                    return false;
+                }
+                break;
+
+            case OPTS_DELTA:
+                options.delta = 1;
+                options.delta_regions = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_PRESENT:
+                options.present = 1;
+                options.file_crc = 1;
+                break;
+
+            case OPTS_BAD_FILE_CRC:
+                options.bad_file_crc = 1;
+                options.file_crc = 1;
+                break;
+
+            case OPTS_RECORD:
+                options.record_filename = optarg;
+                break;
+
+            case OPTS_METADATA:
+                options.metadata = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_FILE_CRC:
+                options.file_crc = 1;
+                break;
+
+            case OPTS_UNKNOWN:
+            default:
+                fprintf(stdout, "unknow options\n");
+                return false;
+        }
+    }
+
+    if ((options.dma) && (options.low_memory))
+    {
+        fprintf(stdout, "dma: the blocks are received in the line buffer, not in low memory mode\n");
+        return false;
+    }
+
+    if ((options.record_filename != NULL) && (options.step))
+    {
+        fprintf(stdout, "record: the capture wraps the getchar callback of the blocking reception, not with step or dma\n");
+        return false;
+    }
+
+    if ((options.protocol != XMODEM) && (options.protocol != YMODEM))
+    {
+        fprintf(stdout, "protocol: unknown\n");
+        return false;
+    }
+
+    if ((options.compress) && (options.protocol != YMODEM))
+    {
+        fprintf(stdout, "compress: offered in the ymodem block 0\n");
+        return false;
+    }
+
+    if ((options.delta) && (options.protocol != YMODEM))
+    {
+        fprintf(stdout, "delta: offered in the ymodem block 0\n");
+        return false;
+    }
+
+    if ((options.file_crc) && (options.protocol != YMODEM))
+    {
+        fprintf(stdout, "file-crc, present, bad-file-crc: the crc32 of the file is in the ymodem block 0\n");
+        return false;
+    }
+
+    if ((options.metadata > SIM_METADATA_ALL) || ((options.metadata < SIM_METADATA_ALL) && (options.protocol != YMODEM)))
+    {
+        fprintf(stdout, "metadata: 0 to %u fields after the name of the ymodem block 0\n", SIM_METADATA_ALL);
+        return false;
+    }
+
+    if ((options.metadata < SIM_METADATA_ALL) && ((options.delta) || (options.present) || (options.bad_file_crc)))
+    {
+        fprintf(stdout, "delta, present, bad-file-crc: offered after all the metadata fields of block 0\n");
+        return false;
+    }
+
+    fprintf(stdout, "%s: protocol %s, crc %u, 1k %u, low memory %u, double buffer %u, data source %u, step %u, dma %u, crc offload %u/%u, compress %u, delta %u/%u, file crc %u, present %u, bad file crc %u, metadata %u, size %u, seed %" PRIu64 "\n",
+            argv[0], (options.protocol == XMODEM) ? "xmodem" : "ymodem", options.crc, options.xmodem_blksize, options.low_memory,
+            options.double_buffer, options.data_source, options.step, options.dma, options.crc_offload, options.crc_async,
+            options.compress, options.delta, options.delta_regions, options.file_crc, options.present, options.bad_file_crc, options.metadata, options.size, options.seed);
+    fprintf(stdout, "  baud %u, latency %" PRIu64 " ns, ber %g, drop %g, burst %g x %u, stall %g x %" PRIu64 " ns\n",
+            options.link.baud, options.link.latency_ns, options.link.ber, options.link.drop_rate, options.link.burst_rate,
+            options.link.burst_len, options.link.stall_rate, options.link.stall_ns);
+    return true;
+}
@@ -0,0 +1,485 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include "lmodem.h"
+#include "lmodem_mux.h"
+
+// a file transfer, a control RPC and a console sharing one simulated serial line through lmodem_mux. side A sends
+// the file and RPC requests every --rpc-ms, side B receives the file and answers the requests at once. both
+// transfers are driven by lmodem_step in a single thread on a virtual clock advancing one byte time per tick: the
+// UART of each side sends one byte pulled from its mux per tick and gives the received bytes to the mux.
+// the round trip of the requests shows the latency of the control channel during the transfer.
+
+#define MUX_SIM_NB_SIDES        (2)
+#define MUX_SIM_CHANNEL_RPC     (0)
+#define MUX_SIM_CHANNEL_CONSOLE (1)
+#define MUX_SIM_CHANNEL_BULK    (2)
+#define MUX_SIM_TX_RING_SIZE    (4096)
+#define MUX_SIM_RX_RING_SIZE    (4096)
+#define MUX_SIM_SMALL_RING_SIZE (256)
+#define MUX_SIM_LINE_SIZE       (1024)
+#define MUX_SIM_FILENAME_SIZE   (256)
+#define MUX_SIM_PADDING         (0x1A)
+#define MUX_SIM_RPC_SIZE        (16)
+#define MUX_SIM_RPC_TIMEOUT_NS  (500000000ULL)
+#define MUX_SIM_TIMEOUT_NS      (1000000000ULL)
+#define MUX_SIM_MAX_TIME_NS     (3600000000000ULL)
+
+typedef enum
+{
+    OPTS_PROTOCOL,
+    OPTS_CRC,
+    OPTS_1K,
+    OPTS_SIZE,
+    OPTS_SEED,
+    OPTS_BAUD,
+    OPTS_LATENCY,
+    OPTS_BER,
+    OPTS_FRAME,
+    OPTS_RPC,
+    OPTS_CONSOLE,
+    OPTS_MAX_RPC,
+    OPTS_UNKNOWN = '?'
+} OPTS;
+
+typedef struct
+{
+    lmodem_protocol protocol;
+    uint32_t crc;
+    uint32_t xmodem_blksize;
+    uint32_t size;
+    uint64_t seed;
+    uint32_t baud;
+    uint64_t latency_ns;
+    double ber;
+    uint32_t frame;
+    uint64_t rpc_ns;
+    uint64_t console_ns;
+    double max_rpc_ms;
+} options_t;
+
+// bytes on the wire toward a side, with their arrival time
+typedef struct
+{
+    uint8_t data[MUX_SIM_LINE_SIZE];
+    uint64_t arrival_ns[MUX_SIM_LINE_SIZE];
+    uint32_t read_index;
+    uint32_t write_index;
+    uint64_t rng;
+    uint64_t corrupted;
+} mux_sim_line;
+
+typedef struct
+{
+    lmodem_mux mux;
+    uint8_t tx_storage[LMODEM_MUX_MAX_CHANNELS][MUX_SIM_TX_RING_SIZE];
+    lmodem_ring bulk_rx;
+    uint8_t bulk_rx_storage[MUX_SIM_RX_RING_SIZE];
+    modem_context_t ctx;
+    uint8_t line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    char filename[MUX_SIM_FILENAME_SIZE];
+    lmodem_step_status status;
+    uint64_t tx_free_ns;                // the UART sends its next byte
+    mux_sim_line line;                  // toward this side
+    uint64_t console_bytes;
+} mux_sim_side;
+
+static options_t options;
+static mux_sim_side sides[MUX_SIM_NB_SIDES];
+static uint64_t sim_now_ns;
+static uint64_t sim_byte_ns;
+// RPC of side A
+static uint32_t rpc_id;
+static bool rpc_pending;
+static uint64_t rpc_sent_ns;
+static uint32_t rpc_answered;
+static uint32_t rpc_lost;
+static uint64_t rpc_min_ns;
+static uint64_t rpc_max_ns;
+static uint64_t rpc_sum_ns;
+
+static struct option long_options[] =
+{
+    {"protocol", required_argument, 0, OPTS_PROTOCOL},
+    {"crc", no_argument, 0, OPTS_CRC},
+    {"1k", no_argument, 0, OPTS_1K},
+    {"size", required_argument, 0, OPTS_SIZE},
+    {"seed", required_argument, 0, OPTS_SEED},
+    {"baud", required_argument, 0, OPTS_BAUD},
+    {"latency-us", required_argument, 0, OPTS_LATENCY},
+    {"ber", required_argument, 0, OPTS_BER},
+    {"frame", required_argument, 0, OPTS_FRAME},
+    {"rpc-ms", required_argument, 0, OPTS_RPC},
+    {"console-ms", required_argument, 0, OPTS_CONSOLE},
+    {"max-rpc-ms", required_argument, 0, OPTS_MAX_RPC},
+    {0, 0, 0, 0}
+};
+
+static bool parse_options(int argc, char* argv[]);
+
+static uint64_t mux_sim_clock(modem_context_t* pThis)
+{
+    (void) pThis;
+    return sim_now_ns;
+}
+
+static double mux_sim_random(uint64_t* pRng)
+{
+    *pRng = *pRng * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (*pRng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// requests (side B) and answers (side A) of the RPC channel, the console bytes are only counted
+static void mux_sim_deliver(lmodem_mux* pThis, uint8_t channel, const uint8_t* data, uint32_t size)
+{
+    mux_sim_side* pSide;
+    uint8_t answer[MUX_SIM_RPC_SIZE];
+    uint64_t rtt;
+    uint32_t id;
+
+    pSide = (mux_sim_side*) lmodem_mux_get_user_data(pThis);
+    if (channel == MUX_SIM_CHANNEL_CONSOLE)
+    {
+        pSide->console_bytes += size;
+        return;
+    }
+    if ((channel != MUX_SIM_CHANNEL_RPC) || (size != MUX_SIM_RPC_SIZE))
+    {
+        return;
+    }
+
+    if (pSide == &sides[1])
+    {
+        //the answer is the request with the first byte changed
+        memcpy(answer, data, MUX_SIM_RPC_SIZE);
+        answer[0] = 'A';
+        lmodem_mux_send(pThis, MUX_SIM_CHANNEL_RPC, answer, MUX_SIM_RPC_SIZE);
+        return;
+    }
+
+    memcpy(&id, &data[4], sizeof(id));
+    if ((data[0] == 'A') && (rpc_pending) && (id == rpc_id))
+    {
+        rtt = sim_now_ns - rpc_sent_ns;
+        rpc_min_ns = ((rpc_answered == 0) || (rtt < rpc_min_ns)) ? rtt : rpc_min_ns;
+        rpc_max_ns = (rtt > rpc_max_ns) ? rtt : rpc_max_ns;
+        rpc_sum_ns += rtt;
+        rpc_answered++;
+        rpc_pending = false;
+    }
+}
+
+static void mux_sim_send_request(mux_sim_side* pSide)
+{
+    uint8_t request[MUX_SIM_RPC_SIZE];
+
+    //a request without answer is lost (corrupted frame), the next one replaces it
+    if ((rpc_pending) && (sim_now_ns - rpc_sent_ns < MUX_SIM_RPC_TIMEOUT_NS))
+    {
+        return;
+    }
+    if (rpc_pending)
+    {
+        rpc_lost++;
+    }
+    rpc_id++;
+    memset(request, 0, MUX_SIM_RPC_SIZE);
+    request[0] = 'Q';
+    memcpy(&request[4], &rpc_id, sizeof(rpc_id));
+    lmodem_mux_send(&pSide->mux, MUX_SIM_CHANNEL_RPC, request, MUX_SIM_RPC_SIZE);
+    rpc_pending = true;
+    rpc_sent_ns = sim_now_ns;
+}
+
+static bool mux_sim_setup_side(mux_sim_side* pSide, uint8_t* pFile, uint32_t fileSize, bool bRx)
+{
+    lxmodem_opts opts;
+    bool bOk;
+
+    opts = lxmodem_128_with_chksum;
+    if ((options.protocol == YMODEM) || (options.xmodem_blksize > 0))
+    {
+        opts = lxmodem_1k;
+    }
+    else if (options.crc > 0)
+    {
+        opts = lxmodem_128_with_crc;
+    }
+
+    //the control channel first, the console, then the file which checks its own blocks
+    bOk = lmodem_mux_init(&pSide->mux, options.frame)
+          && lmodem_mux_open_channel(&pSide->mux, MUX_SIM_CHANNEL_RPC, 0, 0, pSide->tx_storage[MUX_SIM_CHANNEL_RPC], MUX_SIM_SMALL_RING_SIZE, NULL)
+          && lmodem_mux_open_channel(&pSide->mux, MUX_SIM_CHANNEL_CONSOLE, 1, 0, pSide->tx_storage[MUX_SIM_CHANNEL_CONSOLE], MUX_SIM_SMALL_RING_SIZE, NULL)
+          && lmodem_mux_open_channel(&pSide->mux, MUX_SIM_CHANNEL_BULK, 2, LMODEM_MUX_KEEP_CORRUPTED, pSide->tx_storage[MUX_SIM_CHANNEL_BULK], MUX_SIM_TX_RING_SIZE, &pSide->bulk_rx)
+          && lmodem_ring_init(&pSide->bulk_rx, pSide->bulk_rx_storage, MUX_SIM_RX_RING_SIZE);
+    lmodem_mux_set_user_data(&pSide->mux, pSide);
+    lmodem_mux_set_deliver_cb(&pSide->mux, mux_sim_deliver);
+
+    lmodem_init(&pSide->ctx, opts);
+    lmodem_set_clock_cb(&pSide->ctx, mux_sim_clock);
+    bOk = bOk && lmodem_set_line_buffer(&pSide->ctx, pSide->line_buffer, LXMODEM_1K_BUFFER_MIN_SIZE)
+          && lmodem_set_mux(&pSide->ctx, &pSide->mux, MUX_SIM_CHANNEL_BULK, MUX_SIM_TIMEOUT_NS, NULL);
+    lmodem_set_filename_buffer(&pSide->ctx, pSide->filename, MUX_SIM_FILENAME_SIZE);
+    lmodem_set_file_buffer(&pSide->ctx, pFile, fileSize);
+    if (!bRx)
+    {
+        lmodem_buffer_set_write_offset(&pSide->ctx.ramfile, fileSize);
+        if (options.protocol == YMODEM)
+        {
+            lmodem_metadata_set_filename(&pSide->ctx, "mux.bin");
+            lmodem_metadata_set_filesize(&pSide->ctx, fileSize);
+        }
+    }
+    bOk = bOk && (bRx ? lmodem_start_receive(&pSide->ctx, options.protocol) : lmodem_start_emit(&pSide->ctx, options.protocol));
+    pSide->status = LMODEM_STEP_WOULD_BLOCK;
+    pSide->line.rng = options.seed * 2 + (bRx ? 1 : 0) + 1;
+    return bOk;
+}
+
+// one tick: each UART sends a byte of its mux and receives the bytes arrived, then the transfers run
+static void mux_sim_tick(void)
+{
+    mux_sim_side* pSide;
+    mux_sim_line* pLine;
+    uint32_t i;
+    uint8_t c;
+
+    for (i = 0; i < MUX_SIM_NB_SIDES; i++)
+    {
+        pSide = &sides[i];
+        pLine = &sides[MUX_SIM_NB_SIDES - 1 - i].line;
+        if ((sim_now_ns >= pSide->tx_free_ns) && (pLine->write_index - pLine->read_index < MUX_SIM_LINE_SIZE)
+                && (lmodem_mux_pull(&pSide->mux, &c, 1) == 1))
+        {
+            if ((options.ber > 0) && (mux_sim_random(&pLine->rng) < options.ber * 10))
+            {
+                c ^= (uint8_t) (1 << (pLine->rng >> 61));
+                pLine->corrupted++;
+            }
+            pLine->data[pLine->write_index % MUX_SIM_LINE_SIZE] = c;
+            pLine->arrival_ns[pLine->write_index % MUX_SIM_LINE_SIZE] = sim_now_ns + sim_byte_ns + options.latency_ns;
+            pLine->write_index++;
+            pSide->tx_free_ns = sim_now_ns + sim_byte_ns;
+        }
+    }
+
+    for (i = 0; i < MUX_SIM_NB_SIDES; i++)
+    {
+        pSide = &sides[i];
+        pLine = &pSide->line;
+        while ((pLine->read_index != pLine->write_index) && (pLine->arrival_ns[pLine->read_index % MUX_SIM_LINE_SIZE] <= sim_now_ns))
+        {
+            lmodem_mux_input(&pSide->mux, &pLine->data[pLine->read_index % MUX_SIM_LINE_SIZE], 1);
+            pLine->read_index++;
+        }
+        if (pSide->status == LMODEM_STEP_WOULD_BLOCK)
+        {
+            pSide->status = lmodem_step(&pSide->ctx);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const lmodem_mux_channel_stats* pStats;
+    uint8_t* pSent;
+    uint8_t* pReceived;
+    uint64_t nextRpc;
+    uint64_t nextConsole;
+    uint64_t rng;
+    uint32_t receivedSize;
+    uint32_t nbConsole;
+    uint32_t i;
+    char consoleLine[64];
+    double avgRpcMs;
+    bool bOk;
+
+    bOk = parse_options(argc, argv);
+    if (!bOk)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    pSent = malloc(options.size + 1);
+    pReceived = malloc(options.size + LXMODEM_1K_BUFFER_MIN_SIZE);
+    if ((pSent == NULL) || (pReceived == NULL))
+    {
+        fprintf(stderr, "unable to allocate %u bytes\n", options.size);
+        exit(EXIT_FAILURE);
+    }
+    rng = options.seed + 1;
+    for (i = 0; i < options.size; i++)
+    {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        pSent[i] = (uint8_t) (rng >> 56);
+    }
+
+    //10 bits per byte
+    sim_byte_ns = 10000000000ULL / options.baud;
+    bOk = mux_sim_setup_side(&sides[0], pSent, options.size, false)
+          && mux_sim_setup_side(&sides[1], pReceived, options.size + LXMODEM_1K_BUFFER_MIN_SIZE, true);
+    if (!bOk)
+    {
+        fprintf(stderr, "unable to set up the sides\n");
+        exit(EXIT_FAILURE);
+    }
+
+    nextRpc = options.rpc_ns;
+    nextConsole = options.console_ns;
+    nbConsole = 0;
+    while (((sides[0].status == LMODEM_STEP_WOULD_BLOCK) || (sides[1].status == LMODEM_STEP_WOULD_BLOCK))
+            && (sim_now_ns < MUX_SIM_MAX_TIME_NS))
+    {
+        if ((options.rpc_ns > 0) && (sim_now_ns >= nextRpc))
+        {
+            mux_sim_send_request(&sides[0]);
+            nextRpc += options.rpc_ns;
+        }
+        if ((options.console_ns > 0) && (sim_now_ns >= nextConsole))
+        {
+            snprintf(consoleLine, sizeof(consoleLine), "console line %u\r\n", nbConsole++);
+            lmodem_mux_send(&sides[1].mux, MUX_SIM_CHANNEL_CONSOLE, (uint8_t*) consoleLine, strlen(consoleLine));
+            nextConsole += options.console_ns;
+        }
+        mux_sim_tick();
+        sim_now_ns += sim_byte_ns;
+    }
+
+    receivedSize = sides[1].ctx.ramfile.write_offset;
+    bOk = (lmodem_get_result(&sides[0].ctx) >= 0) && (lmodem_get_result(&sides[1].ctx) >= 0) && (receivedSize >= options.size)
+          && (memcmp(pSent, pReceived, options.size) == 0);
+    for (i = options.size; (bOk) && (i < receivedSize); i++)
+    {
+        bOk = (pReceived[i] == MUX_SIM_PADDING);
+    }
+    if ((bOk) && (options.protocol == YMODEM))
+    {
+        bOk = (receivedSize == options.size);
+    }
+
+    fprintf(stdout, "emitted %d, received %d, %s, virtual time %.3f s, goodput %.1f B/s (%.1f%% of the line)\n",
+            lmodem_get_result(&sides[0].ctx), lmodem_get_result(&sides[1].ctx), bOk ? "data ok" : "DATA KO", sim_now_ns / 1e9,
+            (sim_now_ns > 0) ? (options.size * 1e9 / sim_now_ns) : 0.0,
+            (sim_now_ns > 0) ? (100.0 * options.size * sim_byte_ns / sim_now_ns) : 0.0);
+    for (i = 0; i < MUX_SIM_NB_SIDES; i++)
+    {
+        pStats = lmodem_mux_get_stats(&sides[i].mux, MUX_SIM_CHANNEL_BULK);
+        fprintf(stdout, "side %c: bulk %u frames %u bytes sent, %u frames received (%u corrupted), rpc %u frames sent, "
+                "console %u frames sent %" PRIu64 " bytes received\n", 'a' + i, pStats->tx_frames, pStats->tx_bytes,
+                pStats->rx_frames, pStats->rx_corrupted, lmodem_mux_get_stats(&sides[i].mux, MUX_SIM_CHANNEL_RPC)->tx_frames,
+                lmodem_mux_get_stats(&sides[i].mux, MUX_SIM_CHANNEL_CONSOLE)->tx_frames, sides[i].console_bytes);
+        fprintf(stdout, "side %c: %" PRIu64 " bytes corrupted on the way in, %u header errors, %u bytes skipped\n", 'a' + i,
+                sides[i].line.corrupted, sides[i].mux.rx_header_errors, sides[i].mux.rx_skipped);
+    }
+
+    avgRpcMs = (rpc_answered > 0) ? (rpc_sum_ns / 1e6 / rpc_answered) : 0.0;
+    fprintf(stdout, "rpc during the transfer: %u answered, %u lost, round trip min %.3f ms, avg %.3f ms, max %.3f ms\n",
+            rpc_answered, rpc_lost, rpc_min_ns / 1e6, avgRpcMs, rpc_max_ns / 1e6);
+    if ((options.rpc_ns > 0) && (rpc_answered == 0))
+    {
+        bOk = false;
+    }
+    if ((options.max_rpc_ms > 0) && (rpc_max_ns / 1e6 > options.max_rpc_ms))
+    {
+        fprintf(stdout, "rpc round trip above %.3f ms\n", options.max_rpc_ms);
+        bOk = false;
+    }
+
+    free(pSent);
+    free(pReceived);
+    fprintf(stdout, "%s\n", bOk ? "test ok" : "test failed");
+    return bOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool parse_options(int argc, char* argv[])
+{
+    int opt_index;
+    OPTS c;
+
+    memset(&options, 0, sizeof(options_t));
+    options.size = 32 * 1024;
+    options.seed = 1;
+    options.baud = 115200;
+    options.frame = 64;
+    options.rpc_ns = 50000000ULL;
+    options.console_ns = 100000000ULL;
+
+    while (1)
+    {
+        c = getopt_long(argc, argv, "", long_options, &opt_index);
+        if ((int32_t) c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case OPTS_PROTOCOL:
+                options.protocol = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_CRC:
+                options.crc = 1;
+                break;
+
+            case OPTS_1K:
+                options.xmodem_blksize = 1;
+                break;
+
+            case OPTS_SIZE:
+                options.size = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_SEED:
+                options.seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case OPTS_BAUD:
+                options.baud = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_LATENCY:
+                options.latency_ns = strtoull(optarg, NULL, 0) * 1000ULL;
+                break;
+
+            case OPTS_BER:
+                options.ber = strtod(optarg, NULL);
+                break;
+
+            case OPTS_FRAME:
+                options.frame = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_RPC:
+                options.rpc_ns = (uint64_t) (strtod(optarg, NULL) * 1e6);
+                break;
+
+            case OPTS_CONSOLE:
+                options.console_ns = (uint64_t) (strtod(optarg, NULL) * 1e6);
+                break;
+
+            case OPTS_MAX_RPC:
+                options.max_rpc_ms = strtod(optarg, NULL);
+                break;
+
+            case OPTS_UNKNOWN:
+            default:
+                fprintf(stdout, "unknow options\n");
+                return false;
+        }
+    }
+
+    if ((options.protocol != XMODEM) && (options.protocol != YMODEM))
+    {
+        fprintf(stdout, "protocol: unknown\n");
+        return false;
+    }
+    if ((options.baud == 0) || (options.frame == 0) || (options.frame > LMODEM_MUX_MAX_PAYLOAD))
+    {
+        fprintf(stdout, "baud > 0, frame from 1 to %u\n", LMODEM_MUX_MAX_PAYLOAD);
+        return false;
+    }
+    return true;
+}
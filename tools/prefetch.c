@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+
+static void* prefetch_thread(void* arg)
+{
+    prefetch_reader* pThis;
+    uint8_t* pChunk;
+    size_t nbRead;
+    bool bEnd;
+
+    pThis = (prefetch_reader*) arg;
+    bEnd = false;
+    while (!bEnd)
+    {
+        pthread_mutex_lock(&pThis->lock);
+        while ((!pThis->stop) && ((pThis->head - pThis->tail) >= pThis->nb_chunks))
+        {
+            pthread_cond_wait(&pThis->cond, &pThis->lock);
+        }
+        bEnd = pThis->stop;
+        pChunk = &pThis->chunks[(pThis->head % pThis->nb_chunks) * pThis->chunk_size];
+        pthread_mutex_unlock(&pThis->lock);
+        if (bEnd)
+        {
+            break;
+        }
+
+        //the free chunk belongs to this thread until head moves
+        nbRead = fread(pChunk, 1, pThis->chunk_size, pThis->f);
+
+        pthread_mutex_lock(&pThis->lock);
+        pThis->sizes[pThis->head % pThis->nb_chunks] = nbRead;
+        if (nbRead < pThis->chunk_size)
+        {
+            pThis->error = (ferror(pThis->f) != 0);
+            pThis->eof = true;
+            bEnd = true;
+        }
+        if (nbRead > 0)
+        {
+            pThis->head++;
+        }
+        pthread_cond_broadcast(&pThis->cond);
+        pthread_mutex_unlock(&pThis->lock);
+    }
+    return NULL;
+}
+
+bool prefetch_start(prefetch_reader* pThis, FILE* f, uint32_t chunkSize, uint32_t nbChunks)
+{
+    memset(pThis, 0, sizeof(prefetch_reader));
+    if ((nbChunks == 0) || (nbChunks > PREFETCH_MAX_CHUNKS) || (chunkSize == 0))
+    {
+        return false;
+    }
+
+    pThis->f = f;
+    pThis->chunk_size = chunkSize;
+    pThis->nb_chunks = nbChunks;
+    pThis->chunks = malloc((size_t) chunkSize * nbChunks);
+    if (pThis->chunks == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_init(&pThis->lock, NULL);
+    pthread_cond_init(&pThis->cond, NULL);
+    if (pthread_create(&pThis->thread, NULL, prefetch_thread, pThis) != 0)
+    {
+        pthread_cond_destroy(&pThis->cond);
+        pthread_mutex_destroy(&pThis->lock);
+        free(pThis->chunks);
+        pThis->chunks = NULL;
+        return false;
+    }
+    return true;
+}
+
+int32_t prefetch_read(prefetch_reader* pThis, uint8_t* data, uint32_t size)
+{
+    uint32_t available;
+    uint8_t* pChunk;
+    int32_t nbCopied;
+
+    pthread_mutex_lock(&pThis->lock);
+    while ((pThis->tail == pThis->head) && (!pThis->eof))
+    {
+        pthread_cond_wait(&pThis->cond, &pThis->lock);
+    }
+
+    if (pThis->tail == pThis->head)
+    {
+        nbCopied = pThis->error ? -1 : 0;
+        pthread_mutex_unlock(&pThis->lock);
+        return nbCopied;
+    }
+    available = pThis->sizes[pThis->tail % pThis->nb_chunks] - pThis->tail_offset;
+    pChunk = &pThis->chunks[(pThis->tail % pThis->nb_chunks) * pThis->chunk_size];
+    pthread_mutex_unlock(&pThis->lock);
+
+    //the chunk at tail is not touched by the reader thread until tail moves
+    nbCopied = (size < available) ? size : available;
+    memcpy(data, pChunk + pThis->tail_offset, nbCopied);
+    pThis->tail_offset += nbCopied;
+
+    if (pThis->tail_offset == pThis->sizes[pThis->tail % pThis->nb_chunks])
+    {
+        pthread_mutex_lock(&pThis->lock);
+        pThis->tail++;
+        pThis->tail_offset = 0;
+        pthread_cond_broadcast(&pThis->cond);
+        pthread_mutex_unlock(&pThis->lock);
+    }
+    return nbCopied;
+}
+
+void prefetch_stop(prefetch_reader* pThis)
+{
+    if (pThis->chunks == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pThis->lock);
+    pThis->stop = true;
+    pthread_cond_broadcast(&pThis->cond);
+    pthread_mutex_unlock(&pThis->lock);
+    pthread_join(pThis->thread, NULL);
+
+    pthread_cond_destroy(&pThis->cond);
+    pthread_mutex_destroy(&pThis->lock);
+    free(pThis->chunks);
+    pThis->chunks = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+
+// a reader thread reads a file ahead in chunks, so a slow storage does not delay the emission of the blocks.
+// prefetch_read is the consumer side, to be called from the data source callback of the emitting context.
+
+#define PREFETCH_MAX_CHUNKS    (64)
+
+typedef struct
+{
+    FILE* f;
+    uint8_t* chunks;
+    uint32_t chunk_size;
+    uint32_t nb_chunks;
+    uint32_t sizes[PREFETCH_MAX_CHUNKS];    // bytes in each chunk, 0 at the end of the file
+    uint32_t head;                          // next chunk filled by the reader thread
+    uint32_t tail;                          // chunk being consumed
+    uint32_t tail_offset;
+    bool eof;
+    bool error;
+    bool stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} prefetch_reader;
+
+extern bool prefetch_start(prefetch_reader* pThis, FILE* f, uint32_t chunkSize, uint32_t nbChunks);
+// same contract as the data source callback: nb of bytes copied, 0 at the end of the file, -1 on a read error
+extern int32_t prefetch_read(prefetch_reader* pThis, uint8_t* data, uint32_t size);
+extern void prefetch_stop(prefetch_reader* pThis);
+
+#endif /* PREFETCH_H */
@@ -0,0 +1,717 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <inttypes.h>
+#include "lmodem.h"
+#include "linksim.h"
+#include "serial.h"
+
+// fleet provisioning: a list of (file, port) jobs run by one worker per serial port. each worker takes its own jobs
+// first (newest first) and, when it has none left, steals the oldest job of another port, so the fast links take
+// more jobs than the slow ones. a failed job is queued again, where another port may steal it, up to --retries
+// times. jobs pinned to a port (device wired on it) are never stolen.
+// --sim runs the jobs over simulated links, one per --baud, each virtual second of transfer holding the worker
+// for --time-scale real seconds so the scheduling sees the speed of the links.
+
+#define PROVISION_MAX_PORTS        (64)
+#define PROVISION_LINE_SIZE        (1024)
+#define PROVISION_FILENAME_SIZE    (256)
+#define PROVISION_PADDING          (0x1A)
+#define PROVISION_IDLE_NS          (1000000ULL)
+
+typedef enum
+{
+    OPTS_PROTOCOL,
+    OPTS_CRC,
+    OPTS_1K,
+    OPTS_JOBS,
+    OPTS_PORT,
+    OPTS_NB_STOP,
+    OPTS_RETRIES,
+    OPTS_SIM,
+    OPTS_BAUD,
+    OPTS_SIZE,
+    OPTS_FAIL_RATE,
+    OPTS_TIME_SCALE,
+    OPTS_SEED,
+    OPTS_UNKNOWN = '?'
+} OPTS;
+
+typedef struct
+{
+    lmodem_protocol protocol;
+    uint32_t crc;
+    uint32_t xmodem_blksize;
+    char* jobs_file;
+    char* devices[PROVISION_MAX_PORTS];
+    uint32_t bauds[PROVISION_MAX_PORTS];
+    uint32_t nb_ports;
+    uint32_t nb_stop;
+    uint32_t retries;
+    uint32_t sim;                       // nb of generated jobs
+    uint32_t size;
+    double fail_rate;
+    double time_scale;
+    uint64_t seed;
+} options_t;
+
+typedef struct
+{
+    char name[PROVISION_FILENAME_SIZE];
+    uint8_t* data;
+    uint32_t size;
+    int32_t pinned_port;                // -1 when any port can run it
+    uint32_t attempts;
+    bool bOk;
+    uint32_t port;                      // port of the last attempt
+    int32_t result;
+    uint64_t elapsed_ns;                // all the attempts
+    uint64_t link_ns;                   // virtual time on the links (--sim)
+} provision_job;
+
+// jobs of one port: pinned ones in a fifo, the others in a deque, the owner pops the newest, thieves the oldest
+typedef struct
+{
+    uint32_t* items;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t tail;
+} provision_queue;
+
+typedef struct
+{
+    uint32_t index;
+    int32_t serial_fd;
+    provision_queue pinned;
+    provision_queue deque;
+    pthread_mutex_t lock;
+    uint8_t line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    uint8_t rx_line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    char filename[PROVISION_FILENAME_SIZE];
+    uint8_t* received;
+    uint32_t jobs_done;
+    uint32_t steals;
+    uint64_t busy_ns;
+    uint64_t link_ns;
+    pthread_t thread;
+} provision_port;
+
+static options_t options;
+static lxmodem_opts provision_opts;
+static provision_job* provision_jobs;
+static uint32_t provision_nb_jobs;
+static provision_port provision_ports[PROVISION_MAX_PORTS];
+static atomic_uint provision_remaining;
+
+static struct option long_options[] =
+{
+    {"protocol", required_argument, 0, OPTS_PROTOCOL},
+    {"crc", no_argument, 0, OPTS_CRC},
+    {"1k", no_argument, 0, OPTS_1K},
+    {"jobs", required_argument, 0, OPTS_JOBS},
+    {"port", required_argument, 0, OPTS_PORT},
+    {"nb-stop", required_argument, 0, OPTS_NB_STOP},
+    {"retries", required_argument, 0, OPTS_RETRIES},
+    {"sim", required_argument, 0, OPTS_SIM},
+    {"baud", required_argument, 0, OPTS_BAUD},
+    {"size", required_argument, 0, OPTS_SIZE},
+    {"fail-rate", required_argument, 0, OPTS_FAIL_RATE},
+    {"time-scale", required_argument, 0, OPTS_TIME_SCALE},
+    {"seed", required_argument, 0, OPTS_SEED},
+    {0, 0, 0, 0}
+};
+
+static bool parse_options(int argc, char* argv[]);
+
+static uint64_t provision_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void provision_sleep(uint64_t ns)
+{
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    nanosleep(&ts, NULL);
+}
+
+static bool provision_queue_init(provision_queue* pThis, uint32_t capacity)
+{
+    pThis->items = malloc((capacity + 1) * sizeof(uint32_t));
+    pThis->capacity = capacity + 1;
+    pThis->head = 0;
+    pThis->tail = 0;
+    return (pThis->items != NULL);
+}
+
+static void provision_queue_push(provision_queue* pThis, uint32_t job)
+{
+    //a job is in at most one queue, the capacity is the nb of jobs
+    pThis->items[pThis->tail % pThis->capacity] = job;
+    pThis->tail++;
+}
+
+static bool provision_queue_pop_newest(provision_queue* pThis, uint32_t* pJob)
+{
+    if (pThis->head == pThis->tail)
+    {
+        return false;
+    }
+    pThis->tail--;
+    *pJob = pThis->items[pThis->tail % pThis->capacity];
+    return true;
+}
+
+static bool provision_queue_pop_oldest(provision_queue* pThis, uint32_t* pJob)
+{
+    if (pThis->head == pThis->tail)
+    {
+        return false;
+    }
+    *pJob = pThis->items[pThis->head % pThis->capacity];
+    pThis->head++;
+    return true;
+}
+
+static void provision_enqueue(uint32_t portIndex, uint32_t job)
+{
+    provision_port* pPort;
+
+    pPort = &provision_ports[portIndex];
+    pthread_mutex_lock(&pPort->lock);
+    provision_queue_push((provision_jobs[job].pinned_port >= 0) ? &pPort->pinned : &pPort->deque, job);
+    pthread_mutex_unlock(&pPort->lock);
+}
+
+// own jobs first, then the oldest job of the other ports
+static bool provision_next_job(provision_port* pPort, uint32_t* pJob)
+{
+    provision_port* pVictim;
+    uint32_t i;
+    bool bFound;
+
+    pthread_mutex_lock(&pPort->lock);
+    bFound = provision_queue_pop_oldest(&pPort->pinned, pJob) || provision_queue_pop_newest(&pPort->deque, pJob);
+    pthread_mutex_unlock(&pPort->lock);
+
+    for (i = 1; (!bFound) && (i < options.nb_ports); i++)
+    {
+        pVictim = &provision_ports[(pPort->index + i) % options.nb_ports];
+        pthread_mutex_lock(&pVictim->lock);
+        bFound = provision_queue_pop_oldest(&pVictim->deque, pJob);
+        pthread_mutex_unlock(&pVictim->lock);
+        if (bFound)
+        {
+            pPort->steals++;
+        }
+    }
+    return bFound;
+}
+
+static void provision_setup_sender(provision_port* pPort, modem_context_t* pCtx, provision_job* pJob)
+{
+    lmodem_init(pCtx, provision_opts);
+    lmodem_set_user_data(pCtx, pPort);
+    lmodem_set_line_buffer(pCtx, pPort->line_buffer, LXMODEM_1K_BUFFER_MIN_SIZE);
+    lmodem_set_filename_buffer(pCtx, pPort->filename, PROVISION_FILENAME_SIZE);
+    lmodem_set_file_buffer(pCtx, pJob->data, pJob->size);
+    lmodem_buffer_set_write_offset(&pCtx->ramfile, pJob->size);
+    if (options.protocol == YMODEM)
+    {
+        lmodem_metadata_set_filename(pCtx, pJob->name);
+        lmodem_metadata_set_filesize(pCtx, pJob->size);
+    }
+}
+
+static int32_t provision_sim_emit(modem_context_t* pThis)
+{
+    return lmodem_emit(pThis, options.protocol);
+}
+
+static int32_t provision_sim_receive(modem_context_t* pThis)
+{
+    return lmodem_receive(pThis, options.protocol);
+}
+
+// the dead attempts only depend on the seed, the job and the attempt, not on the scheduling
+static bool provision_sim_dead_link(uint32_t job, uint32_t attempt)
+{
+    uint64_t rng;
+
+    //splitmix64 finalizer
+    rng = (options.seed * 0x9E3779B97F4A7C15ULL) + ((uint64_t) job << 32) + attempt;
+    rng = (rng ^ (rng >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    rng = (rng ^ (rng >> 27)) * 0x94D049BB133111EBULL;
+    rng = rng ^ (rng >> 31);
+    return ((rng >> 11) * (1.0 / 9007199254740992.0)) < options.fail_rate;
+}
+
+static bool provision_sim_transfer(provision_port* pPort, provision_job* pJob, uint32_t jobIndex)
+{
+    linksim sim;
+    linksim_config config;
+    modem_context_t* pRx;
+    uint32_t receivedSize;
+    uint32_t i;
+    bool bOk;
+
+    memset(&config, 0, sizeof(config));
+    config.baud = options.bauds[pPort->index];
+    config.drop_rate = provision_sim_dead_link(jobIndex, pJob->attempts) ? 1.0 : 0.0;
+    linksim_init(&sim, &config, &config, options.seed + jobIndex);
+
+    provision_setup_sender(pPort, linksim_get_context(&sim, LINKSIM_SIDE_A), pJob);
+    pRx = linksim_get_context(&sim, LINKSIM_SIDE_B);
+    lmodem_init(pRx, provision_opts);
+    lmodem_set_line_buffer(pRx, pPort->rx_line_buffer, LXMODEM_1K_BUFFER_MIN_SIZE);
+    lmodem_set_filename_buffer(pRx, pPort->filename, PROVISION_FILENAME_SIZE);
+    lmodem_set_file_buffer(pRx, pPort->received, options.size * 4 + LXMODEM_1K_BUFFER_MIN_SIZE);
+
+    bOk = linksim_run(&sim, provision_sim_emit, provision_sim_receive);
+    pJob->result = linksim_get_result(&sim, LINKSIM_SIDE_A);
+    receivedSize = pRx->ramfile.write_offset;
+    bOk = bOk && (pJob->result >= 0) && (linksim_get_result(&sim, LINKSIM_SIDE_B) >= 0) && (receivedSize >= pJob->size)
+          && (memcmp(pJob->data, pPort->received, pJob->size) == 0);
+    for (i = pJob->size; (bOk) && (i < receivedSize); i++)
+    {
+        bOk = (pPort->received[i] == PROVISION_PADDING);
+    }
+    if ((bOk) && (options.protocol == YMODEM))
+    {
+        bOk = (receivedSize == pJob->size);
+    }
+    pJob->link_ns += linksim_get_time_ns(&sim);
+    pPort->link_ns += linksim_get_time_ns(&sim);
+    //the worker is held as long as the link would be
+    provision_sleep((uint64_t) (linksim_get_time_ns(&sim) * options.time_scale));
+    linksim_destroy(&sim);
+    return bOk;
+}
+
+static bool provision_serial_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    provision_port* pPort;
+    pPort = (provision_port*) lmodem_get_user_data(pThis);
+    return serial_read(pPort->serial_fd, data, size);
+}
+
+static void provision_serial_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    provision_port* pPort;
+    pPort = (provision_port*) lmodem_get_user_data(pThis);
+    serial_write(pPort->serial_fd, data, size);
+}
+
+static bool provision_serial_transfer(provision_port* pPort, provision_job* pJob)
+{
+    modem_context_t ctx;
+
+    provision_setup_sender(pPort, &ctx, pJob);
+    lmodem_set_getchar_cb(&ctx, provision_serial_getchar);
+    lmodem_set_putchar_cb(&ctx, provision_serial_putchar);
+    pJob->result = lmodem_emit(&ctx, options.protocol);
+    return (pJob->result >= 0);
+}
+
+static void* provision_worker(void* arg)
+{
+    provision_port* pPort;
+    provision_job* pJob;
+    uint64_t start;
+    uint64_t elapsed;
+    uint32_t job;
+    bool bOk;
+
+    pPort = (provision_port*) arg;
+    while (atomic_load(&provision_remaining) > 0)
+    {
+        if (!provision_next_job(pPort, &job))
+        {
+            //a failed job may still be queued again
+            provision_sleep(PROVISION_IDLE_NS);
+            continue;
+        }
+
+        pJob = &provision_jobs[job];
+        start = provision_now();
+        bOk = (options.sim > 0) ? provision_sim_transfer(pPort, pJob, job) : provision_serial_transfer(pPort, pJob);
+        elapsed = provision_now() - start;
+        pJob->attempts++;
+        pJob->port = pPort->index;
+        pJob->elapsed_ns += elapsed;
+        pPort->busy_ns += elapsed;
+        pPort->jobs_done++;
+        if ((!bOk) && (pJob->attempts <= options.retries))
+        {
+            //at the old end of the deque, where an idle port steals it
+            fprintf(stdout, "job %u %s: attempt %u failed on port %u, queued again\n", job, pJob->name, pJob->attempts, pPort->index);
+            provision_enqueue((pJob->pinned_port >= 0) ? (uint32_t) pJob->pinned_port : pPort->index, job);
+            continue;
+        }
+        pJob->bOk = bOk;
+        atomic_fetch_sub(&provision_remaining, 1);
+    }
+    return NULL;
+}
+
+static bool provision_generate_jobs(void)
+{
+    uint64_t rng;
+    uint32_t i;
+    uint32_t j;
+
+    provision_nb_jobs = options.sim;
+    provision_jobs = calloc(provision_nb_jobs, sizeof(provision_job));
+    if (provision_jobs == NULL)
+    {
+        return false;
+    }
+    rng = options.seed + 1;
+    for (i = 0; i < provision_nb_jobs; i++)
+    {
+        //images of 1 to 4 times --size
+        provision_jobs[i].size = options.size * (1 + (i % 4));
+        provision_jobs[i].pinned_port = -1;
+        snprintf(provision_jobs[i].name, PROVISION_FILENAME_SIZE, "job-%u.bin", i);
+        provision_jobs[i].data = malloc(provision_jobs[i].size + 1);
+        if (provision_jobs[i].data == NULL)
+        {
+            return false;
+        }
+        for (j = 0; j < provision_jobs[i].size; j++)
+        {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            provision_jobs[i].data[j] = (uint8_t) (rng >> 56);
+        }
+    }
+    return true;
+}
+
+// one job per line: <file> [<port index>], the port index pins the job to a port
+static bool provision_read_jobs(void)
+{
+    char line[PROVISION_LINE_SIZE];
+    char path[PROVISION_LINE_SIZE];
+    provision_job* pJob;
+    FILE* fJobs;
+    FILE* f;
+    int32_t port;
+    long size;
+    int nbFields;
+
+    fJobs = fopen(options.jobs_file, "r");
+    if (fJobs == NULL)
+    {
+        fprintf(stderr, "unable to open '%s'\n", options.jobs_file);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), fJobs) != NULL)
+    {
+        port = -1;
+        nbFields = sscanf(line, "%1023s %d", path, &port);
+        if ((nbFields < 1) || (path[0] == '#'))
+        {
+            continue;
+        }
+        if ((port >= (int32_t) options.nb_ports) || (port < -1))
+        {
+            fprintf(stderr, "job '%s': no port %d\n", path, port);
+            fclose(fJobs);
+            return false;
+        }
+
+        provision_jobs = realloc(provision_jobs, (provision_nb_jobs + 1) * sizeof(provision_job));
+        pJob = &provision_jobs[provision_nb_jobs];
+        memset(pJob, 0, sizeof(provision_job));
+        pJob->pinned_port = port;
+        snprintf(pJob->name, PROVISION_FILENAME_SIZE, "%s", basename(path));
+        f = fopen(path, "rb");
+        if (f == NULL)
+        {
+            fprintf(stderr, "unable to open '%s'\n", path);
+            fclose(fJobs);
+            return false;
+        }
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        pJob->size = (uint32_t) size;
+        pJob->data = malloc(size + 1);
+        if ((pJob->data == NULL) || (fread(pJob->data, 1, size, f) != (size_t) size))
+        {
+            fprintf(stderr, "unable to read '%s'\n", path);
+            fclose(f);
+            fclose(fJobs);
+            return false;
+        }
+        fclose(f);
+        provision_nb_jobs++;
+    }
+    fclose(fJobs);
+    return (provision_nb_jobs > 0);
+}
+
+int main(int argc, char* argv[])
+{
+    provision_port* pPort;
+    provision_job* pJob;
+    uint64_t start;
+    uint64_t wall;
+    uint64_t sumJobs;
+    uint64_t sumLinks;
+    uint64_t maxPortLink;
+    uint32_t nbOk;
+    uint32_t i;
+    bool bOk;
+
+    bOk = parse_options(argc, argv);
+    if (bOk)
+    {
+        bOk = (options.sim > 0) ? provision_generate_jobs() : provision_read_jobs();
+    }
+    if (!bOk)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    provision_opts = lxmodem_128_with_chksum;
+    if ((options.protocol == YMODEM) || (options.xmodem_blksize > 0))
+    {
+        provision_opts = lxmodem_1k;
+    }
+    else if (options.crc > 0)
+    {
+        provision_opts = lxmodem_128_with_crc;
+    }
+
+    for (i = 0; (bOk) && (i < options.nb_ports); i++)
+    {
+        pPort = &provision_ports[i];
+        pPort->index = i;
+        pthread_mutex_init(&pPort->lock, NULL);
+        bOk = provision_queue_init(&pPort->pinned, provision_nb_jobs) && provision_queue_init(&pPort->deque, provision_nb_jobs);
+        if ((bOk) && (options.sim > 0))
+        {
+            pPort->received = malloc(options.size * 4 + LXMODEM_1K_BUFFER_MIN_SIZE);
+            bOk = (pPort->received != NULL);
+        }
+        else if (bOk)
+        {
+            pPort->serial_fd = serial_setup(options.devices[i], options.bauds[i], SERIAL_PARITY_OFF, SERIAL_RTSCTS_OFF, options.nb_stop);
+            if (pPort->serial_fd < 0)
+            {
+                fprintf(stderr, "unable to open '%s'\n", options.devices[i]);
+                bOk = false;
+            }
+        }
+    }
+    if (!bOk)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    //round robin, the stealing balances the slow and the fast ports
+    for (i = 0; i < provision_nb_jobs; i++)
+    {
+        provision_enqueue((provision_jobs[i].pinned_port >= 0) ? (uint32_t) provision_jobs[i].pinned_port : i % options.nb_ports, i);
+    }
+    atomic_init(&provision_remaining, provision_nb_jobs);
+
+    start = provision_now();
+    for (i = 0; i < options.nb_ports; i++)
+    {
+        if (pthread_create(&provision_ports[i].thread, NULL, provision_worker, &provision_ports[i]) != 0)
+        {
+            fprintf(stderr, "unable to start the worker of port %u\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < options.nb_ports; i++)
+    {
+        pthread_join(provision_ports[i].thread, NULL);
+    }
+    wall = provision_now() - start;
+
+    nbOk = 0;
+    sumJobs = 0;
+    sumLinks = 0;
+    for (i = 0; i < provision_nb_jobs; i++)
+    {
+        pJob = &provision_jobs[i];
+        fprintf(stdout, "job %u %s: %s on port %u (%u baud), %u attempts, %u bytes, %.3f s", i, pJob->name,
+                pJob->bOk ? "ok" : "FAILED", pJob->port, options.bauds[pJob->port], pJob->attempts, pJob->size,
+                pJob->elapsed_ns / 1e9);
+        if (options.sim > 0)
+        {
+            fprintf(stdout, ", link time %.3f s", pJob->link_ns / 1e9);
+        }
+        fprintf(stdout, "\n");
+        nbOk += pJob->bOk ? 1 : 0;
+        sumJobs += pJob->elapsed_ns;
+        sumLinks += pJob->link_ns;
+        free(pJob->data);
+    }
+
+    maxPortLink = 0;
+    for (i = 0; i < options.nb_ports; i++)
+    {
+        pPort = &provision_ports[i];
+        fprintf(stdout, "port %u (%u baud): %u transfers, %u stolen, busy %.3f s (%.0f%% of the wall time)\n", i, options.bauds[i],
+                pPort->jobs_done, pPort->steals, pPort->busy_ns / 1e9, (wall > 0) ? (100.0 * pPort->busy_ns / wall) : 0.0);
+        maxPortLink = (pPort->link_ns > maxPortLink) ? pPort->link_ns : maxPortLink;
+        free(pPort->pinned.items);
+        free(pPort->deque.items);
+        free(pPort->received);
+        pthread_mutex_destroy(&pPort->lock);
+        if (options.sim == 0)
+        {
+            serial_close(pPort->serial_fd);
+        }
+    }
+
+    //serial execution would take the sum of the job times
+    fprintf(stdout, "%u/%u jobs ok, wall %.3f s, sum of the jobs %.3f s, speedup %.2f on %u ports\n", nbOk, provision_nb_jobs,
+            wall / 1e9, sumJobs / 1e9, (wall > 0) ? ((double) sumJobs / wall) : 0.0, options.nb_ports);
+    if (options.sim > 0)
+    {
+        fprintf(stdout, "link time: sum %.3f s, busiest port %.3f s\n", sumLinks / 1e9, maxPortLink / 1e9);
+    }
+    free(provision_jobs);
+
+    bOk = (nbOk == provision_nb_jobs);
+    fprintf(stdout, "%s\n", bOk ? "test ok" : "test failed");
+    return bOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool parse_options(int argc, char* argv[])
+{
+    char* pBaud;
+    uint32_t nbBauds;
+    uint32_t i;
+    int opt_index;
+    OPTS c;
+
+    memset(&options, 0, sizeof(options_t));
+    options.nb_stop = 1;
+    options.retries = 2;
+    options.size = 16 * 1024;
+    options.time_scale = 0.01;
+    options.seed = 1;
+    nbBauds = 0;
+
+    while (1)
+    {
+        c = getopt_long(argc, argv, "", long_options, &opt_index);
+        if ((int32_t) c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case OPTS_PROTOCOL:
+                options.protocol = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_CRC:
+                options.crc = 1;
+                break;
+
+            case OPTS_1K:
+                options.xmodem_blksize = 1;
+                break;
+
+            case OPTS_JOBS:
+                options.jobs_file = optarg;
+                break;
+
+            case OPTS_PORT:
+                //<device>[:<baud>]
+                if (options.nb_ports >= PROVISION_MAX_PORTS)
+                {
+                    fprintf(stdout, "port: at most %u ports\n", PROVISION_MAX_PORTS);
+                    return false;
+                }
+                pBaud = strchr(optarg, ':');
+                options.bauds[options.nb_ports] = (pBaud != NULL) ? strtoul(pBaud + 1, NULL, 0) : 115200;
+                if (pBaud != NULL)
+                {
+                    *pBaud = '\0';
+                }
+                options.devices[options.nb_ports++] = optarg;
+                break;
+
+            case OPTS_NB_STOP:
+                options.nb_stop = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_RETRIES:
+                options.retries = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_SIM:
+                options.sim = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_BAUD:
+                //one simulated port per baud rate: --baud 115200,57600,9600
+                for (pBaud = strtok(optarg, ","); (pBaud != NULL) && (nbBauds < PROVISION_MAX_PORTS); pBaud = strtok(NULL, ","))
+                {
+                    options.bauds[nbBauds++] = strtoul(pBaud, NULL, 0);
+                }
+                break;
+
+            case OPTS_SIZE:
+                options.size = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_FAIL_RATE:
+                options.fail_rate = strtod(optarg, NULL);
+                break;
+
+            case OPTS_TIME_SCALE:
+                options.time_scale = strtod(optarg, NULL);
+                break;
+
+            case OPTS_SEED:
+                options.seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case OPTS_UNKNOWN:
+            default:
+                fprintf(stdout, "unknow options\n");
+                return false;
+        }
+    }
+
+    if ((options.protocol != XMODEM) && (options.protocol != YMODEM))
+    {
+        fprintf(stdout, "protocol: unknown\n");
+        return false;
+    }
+
+    if (options.sim > 0)
+    {
+        options.nb_ports = (nbBauds > 0) ? nbBauds : 4;
+        for (i = nbBauds; i < options.nb_ports; i++)
+        {
+            options.bauds[i] = 115200;
+        }
+    }
+    else if ((options.nb_ports == 0) || (options.jobs_file == NULL))
+    {
+        fprintf(stdout, "usage: %s --jobs <list> --port <device>[:<baud>] [--port ...] [--retries n] or --sim <nb jobs> "
+                "[--baud b1,b2,...] [--size n] [--fail-rate p] [--time-scale s] [--seed n]\n", argv[0]);
+        return false;
+    }
+    return true;
+}
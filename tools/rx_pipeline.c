@@ -0,0 +1,243 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "rx_pipeline.h"
+
+#define RX_PIPELINE_READ_SIZE      (4096)
+#define RX_PIPELINE_POLL_NS        (20000)
+#define RX_PIPELINE_WRITER_POLL_NS (1000000)
+
+static uint64_t rx_pipeline_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void rx_pipeline_sleep(uint64_t ns)
+{
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    nanosleep(&ts, NULL);
+}
+
+static void* rx_pipeline_reader(void* arg)
+{
+    rx_pipeline* pThis;
+    uint8_t* pSpan;
+    ssize_t nbRead;
+    uint32_t nbFree;
+    uint32_t count;
+
+    pThis = (rx_pipeline*) arg;
+    while (!atomic_load(&pThis->stop_reader))
+    {
+        //the serial line is read directly in the ring
+        nbFree = lmodem_ring_get_write_span(&pThis->line, &pSpan);
+        if (nbFree == 0)
+        {
+            rx_pipeline_sleep(RX_PIPELINE_POLL_NS);
+            continue;
+        }
+
+        //the serial read returns 0 after its timeout, the stop flag is checked at least every 0.5 s
+        nbRead = read(pThis->serial_fd, pSpan, (nbFree < RX_PIPELINE_READ_SIZE) ? nbFree : RX_PIPELINE_READ_SIZE);
+        if (nbRead <= 0)
+        {
+            continue;
+        }
+        lmodem_ring_commit(&pThis->line, nbRead);
+
+        pThis->stats.bytes_read += nbRead;
+        count = RX_PIPELINE_LINE_QUEUE_SIZE - lmodem_ring_get_free(&pThis->line);
+        if (count > pThis->stats.line_queue_max)
+        {
+            pThis->stats.line_queue_max = count;
+        }
+    }
+    return NULL;
+}
+
+static void rx_pipeline_write(rx_pipeline* pThis, uint32_t* pWritten, uint32_t target)
+{
+    uint64_t start;
+    uint64_t duration;
+    ssize_t n;
+
+    while ((*pWritten < target) && (!pThis->write_error))
+    {
+        start = rx_pipeline_now();
+        n = pwrite(pThis->file_fd, pThis->pCtx->ramfile.buffer + *pWritten, target - *pWritten, *pWritten);
+        duration = rx_pipeline_now() - start;
+        if (n <= 0)
+        {
+            pThis->write_error = true;
+            break;
+        }
+        *pWritten += n;
+        pThis->stats.bytes_written += n;
+        pThis->stats.nb_writes++;
+        if (duration > pThis->stats.max_write_ns)
+        {
+            pThis->stats.max_write_ns = duration;
+        }
+    }
+}
+
+static void* rx_pipeline_writer(void* arg)
+{
+    rx_pipeline* pThis;
+    uint8_t commits[64 * sizeof(uint32_t)];
+    uint32_t nbBytes;
+    uint32_t committed;
+    uint32_t written;
+    bool bStop;
+
+    pThis = (rx_pipeline*) arg;
+    committed = 0;
+    written = 0;
+    bStop = false;
+    while (!bStop)
+    {
+        bStop = atomic_load(&pThis->stop_writer);
+        //whole records only, the producer may be pushing the next one
+        nbBytes = lmodem_ring_get_count(&pThis->commits) & ~(uint32_t) (sizeof(uint32_t) - 1);
+        nbBytes = lmodem_ring_pop(&pThis->commits, commits, (nbBytes < sizeof(commits)) ? nbBytes : sizeof(commits));
+        if (nbBytes > 0)
+        {
+            //offsets only grow, the last one covers the previous ones
+            memcpy(&committed, &commits[nbBytes - sizeof(uint32_t)], sizeof(uint32_t));
+        }
+
+        if (bStop)
+        {
+            //the transfer is over, the final size is the truth (ymodem drops the padding of the last block)
+            rx_pipeline_write(pThis, &written, atomic_load(&pThis->final_size));
+        }
+        else if ((committed - written) >= RX_PIPELINE_WRITE_BATCH)
+        {
+            rx_pipeline_write(pThis, &written, committed);
+        }
+        else if (nbBytes == 0)
+        {
+            rx_pipeline_sleep(RX_PIPELINE_WRITER_POLL_NS);
+        }
+    }
+    return NULL;
+}
+
+static void rx_pipeline_idle(modem_context_t* pThis)
+{
+    (void) pThis;
+    rx_pipeline_sleep(RX_PIPELINE_POLL_NS);
+}
+
+static void rx_pipeline_progress(modem_context_t* pThis, const lmodem_progress* pProgress)
+{
+    rx_pipeline* pPipeline;
+    uint32_t committed;
+
+    pPipeline = (rx_pipeline*) lmodem_get_user_data(pThis);
+    //called on each committed block: everything before the write offset is final
+    committed = pThis->ramfile.write_offset;
+    //a record is pushed whole: the ring is a multiple of its size, it never wraps in the middle of one
+    while (lmodem_ring_get_free(&pPipeline->commits) < sizeof(uint32_t))
+    {
+        rx_pipeline_sleep(RX_PIPELINE_POLL_NS);
+    }
+    lmodem_ring_push(&pPipeline->commits, (const uint8_t*) &committed, sizeof(uint32_t));
+
+    if (pPipeline->progress != NULL)
+    {
+        lmodem_set_user_data(pThis, pPipeline->user_data);
+        pPipeline->progress(pThis, pProgress);
+        lmodem_set_user_data(pThis, pPipeline);
+    }
+}
+
+// the callbacks of the application still called during the reception get back their user data
+static void rx_pipeline_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    rx_pipeline* pPipeline;
+    pPipeline = (rx_pipeline*) lmodem_get_user_data(pThis);
+    lmodem_set_user_data(pThis, pPipeline->user_data);
+    pPipeline->putchar(pThis, data, size);
+    lmodem_set_user_data(pThis, pPipeline);
+}
+
+static uint64_t rx_pipeline_clock(modem_context_t* pThis)
+{
+    rx_pipeline* pPipeline;
+    uint64_t now;
+    pPipeline = (rx_pipeline*) lmodem_get_user_data(pThis);
+    lmodem_set_user_data(pThis, pPipeline->user_data);
+    now = pPipeline->clock_ns(pThis);
+    lmodem_set_user_data(pThis, pPipeline);
+    return now;
+}
+
+bool rx_pipeline_start(rx_pipeline* pThis, modem_context_t* pCtx, int32_t serialFd, int32_t fileFd, uint64_t timeoutNs)
+{
+    memset(pThis, 0, sizeof(rx_pipeline));
+    pThis->serial_fd = serialFd;
+    pThis->file_fd = fileFd;
+    pThis->pCtx = pCtx;
+    pThis->timeout_ns = timeoutNs;
+    pThis->getchar = pCtx->getchar;
+    pThis->rx_ring = pCtx->rx_ring;
+    pThis->progress = pCtx->progress;
+    pThis->putchar = pCtx->putchar;
+    pThis->clock_ns = pCtx->clock_ns;
+    pThis->user_data = lmodem_get_user_data(pCtx);
+    atomic_init(&pThis->stop_reader, false);
+    atomic_init(&pThis->stop_writer, false);
+    atomic_init(&pThis->final_size, 0);
+    lmodem_ring_init(&pThis->line, pThis->line_storage, RX_PIPELINE_LINE_QUEUE_SIZE);
+    lmodem_ring_init(&pThis->commits, pThis->commit_storage, sizeof(pThis->commit_storage));
+
+    if (pthread_create(&pThis->reader, NULL, rx_pipeline_reader, pThis) != 0)
+    {
+        return false;
+    }
+    if (pthread_create(&pThis->writer, NULL, rx_pipeline_writer, pThis) != 0)
+    {
+        atomic_store(&pThis->stop_reader, true);
+        pthread_join(pThis->reader, NULL);
+        return false;
+    }
+
+    lmodem_set_rx_ring(pCtx, &pThis->line, pThis->timeout_ns, rx_pipeline_idle);
+    lmodem_set_progress_cb(pCtx, rx_pipeline_progress);
+    lmodem_set_putchar_cb(pCtx, rx_pipeline_putchar);
+    lmodem_set_clock_cb(pCtx, rx_pipeline_clock);
+    lmodem_set_user_data(pCtx, pThis);
+    return true;
+}
+
+bool rx_pipeline_stop(rx_pipeline* pThis, int32_t result)
+{
+    uint32_t finalSize;
+
+    atomic_store(&pThis->stop_reader, true);
+    pthread_join(pThis->reader, NULL);
+
+    finalSize = (result >= 0) ? pThis->pCtx->ramfile.write_offset : 0;
+    atomic_store(&pThis->final_size, finalSize);
+    atomic_store(&pThis->stop_writer, true);
+    pthread_join(pThis->writer, NULL);
+
+    pThis->pCtx->rx_ring = pThis->rx_ring;
+    lmodem_set_getchar_cb(pThis->pCtx, pThis->getchar);
+    lmodem_set_progress_cb(pThis->pCtx, pThis->progress);
+    lmodem_set_putchar_cb(pThis->pCtx, pThis->putchar);
+    lmodem_set_clock_cb(pThis->pCtx, pThis->clock_ns);
+    lmodem_set_user_data(pThis->pCtx, pThis->user_data);
+
+    //the writer may have written the padding of the last block before the final size was known
+    if (ftruncate(pThis->file_fd, finalSize) != 0)
+    {
+        pThis->write_error = true;
+    }
+    return (result >= 0) && (!pThis->write_error);
+}
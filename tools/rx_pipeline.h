@@ -0,0 +1,60 @@
+#ifndef RX_PIPELINE_H
+#define RX_PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "lmodem.h"
+#include "lmodem_ring.h"
+
+// pipelined reception: a reader thread drains the serial line into a lmodem_ring read by lmodem_ring_getchar, the
+// protocol thread verifies and acknowledges the blocks, and a writer thread writes the committed part of the file
+// buffer to the disk in large pwrite() calls. a disk latency spike no longer delays the ACKs.
+
+#define RX_PIPELINE_LINE_QUEUE_SIZE    (64*1024)
+#define RX_PIPELINE_COMMIT_QUEUE_SIZE  (1024)            // in records of a committed offset (uint32_t)
+#define RX_PIPELINE_WRITE_BATCH        (64*1024)
+
+typedef struct
+{
+    uint64_t bytes_read;                // from the serial line
+    uint64_t bytes_written;             // to the file
+    uint32_t nb_writes;
+    uint64_t max_write_ns;
+    uint32_t line_queue_max;            // highest occupancy of the line queue
+} rx_pipeline_stats;
+
+typedef struct
+{
+    int32_t serial_fd;
+    int32_t file_fd;
+    modem_context_t* pCtx;
+    uint64_t timeout_ns;                // getchar inter-byte timeout
+    lmodem_ring line;
+    lmodem_ring commits;
+    uint8_t line_storage[RX_PIPELINE_LINE_QUEUE_SIZE];
+    uint8_t commit_storage[RX_PIPELINE_COMMIT_QUEUE_SIZE * sizeof(uint32_t)];
+    bool (*getchar)(modem_context_t* pThis, uint8_t* data, uint32_t size);
+    lmodem_ring* rx_ring;
+    void (*progress)(modem_context_t* pThis, const lmodem_progress* pProgress);
+    void (*putchar)(modem_context_t* pThis, uint8_t* data, uint32_t size);
+    uint64_t (*clock_ns)(modem_context_t* pThis);
+    void* user_data;                    // of the application, given back to its callbacks
+    atomic_bool stop_reader;
+    atomic_bool stop_writer;
+    atomic_uint final_size;
+    bool write_error;
+    rx_pipeline_stats stats;
+    pthread_t reader;
+    pthread_t writer;
+} rx_pipeline;
+
+// replaces the getchar and progress callbacks of pCtx (a progress callback already set is still called) and takes
+// its user data, the putchar, clock and progress callbacks of the application are called with their own user data.
+// to be called before any other wrapper of the callbacks (capture). the clock callback must be set
+extern bool rx_pipeline_start(rx_pipeline* pThis, modem_context_t* pCtx, int32_t serialFd, int32_t fileFd, uint64_t timeoutNs);
+// result of the reception: the file holds the received data, it is emptied on a failed transfer
+extern bool rx_pipeline_stop(rx_pipeline* pThis, int32_t result);
+
+#endif /* RX_PIPELINE_H */
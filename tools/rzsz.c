@@ -6,11 +6,23 @@
 #include <string.h>
 #include "lmodem.h"
 #include "serial.h"
+#include "capture.h"
+#include "prefetch.h"
+#include "rx_pipeline.h"
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
 
 
 #define BUFFER_FILE_SIZE       (1024*1024)
 #define BUFFER_FILENAME_SIZE    (256)
+#define TRACE_NB_EVENTS         (64*1024)
+#define PREFETCH_CHUNK_SIZE     (16*1024)
+#define PREFETCH_NB_CHUNKS      (8)
+// same as serial_read: 3 reads of 0.5 s
+#define PIPELINE_TIMEOUT_NS     (1500000000ULL)
 
 typedef enum
 {
@@ -25,6 +37,13 @@ typedef enum
     OPTS_TX,
     OPTS_RX,
     OPTS_FILE,
+    OPTS_LOW_MEMORY,
+    OPTS_STATS,
+    OPTS_PROGRESS,
+    OPTS_TRACE,
+    OPTS_RECORD,
+    OPTS_PREFETCH,
+    OPTS_PIPELINE,
     OPTS_UNKNOWN = '?'
 } OPTS;
 
@@ -41,10 +60,22 @@ typedef struct
     uint32_t tx;
     uint32_t rx;
     char* filename;
+    uint32_t low_memory;
+    uint32_t stats;
+    uint32_t progress;
+    char* trace_filename;
+    char* record_filename;
+    uint32_t prefetch;
+    uint32_t pipeline;
 } options_t;
 
 static options_t options;
 
+static inline uint64_t min_u64(uint64_t a, uint64_t b)
+{
+    return (a < b) ? a : b;
+}
+
 static struct option long_options[] =
 {
     /* These options set a flag. */
@@ -59,28 +90,50 @@ static struct option long_options[] =
     {"tx", no_argument, 0, OPTS_TX},
     {"rx", no_argument, 0, OPTS_RX},
     {"file", required_argument, 0, OPTS_FILE},
+    {"low-memory", no_argument, 0, OPTS_LOW_MEMORY},
+    {"stats", no_argument, 0, OPTS_STATS},
+    {"progress", no_argument, 0, OPTS_PROGRESS},
+    {"trace", required_argument, 0, OPTS_TRACE},
+    {"record", required_argument, 0, OPTS_RECORD},
+    {"prefetch", no_argument, 0, OPTS_PREFETCH},
+    {"pipeline", no_argument, 0, OPTS_PIPELINE},
     {0, 0, 0, 0}
 };
 
 
-static int32_t serial_fd;
-static modem_context_t xmodem_ctx;
-static uint8_t* xmodem_buffer;
-static uint32_t xmodem_buffer_size;
-static char xmodem_filename_buffer[BUFFER_FILENAME_SIZE];
-
-static uint8_t xmodem_recvFile[BUFFER_FILE_SIZE];
+// state of one transfer, the callbacks get it through the user data of the context
+typedef struct
+{
+    modem_context_t ctx;
+    int32_t serial_fd;
+    prefetch_reader prefetch;
+    rx_pipeline pipeline;
+    int32_t file_fd;
+    int32_t result;
+    uint8_t* buffer;
+    uint32_t buffer_size;
+    char filename_buffer[BUFFER_FILENAME_SIZE];
+    uint8_t next_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    uint8_t recvFile[BUFFER_FILE_SIZE];
+    lmodem_trace_event trace[TRACE_NB_EVENTS];
+} rzsz_session;
 
 static bool parse_options(int argc, char* argv[]);
 static bool serial_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size);
 static void serial_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size);
-int do_file_transmission(void);
-int do_file_reception(void);
+static uint64_t monotonic_clock_ns(modem_context_t* pThis);
+static void print_stats_json(FILE* f, const lmodem_stats* pStats);
+static void print_progress(modem_context_t* pThis, const lmodem_progress* pProgress);
+static bool dump_trace(const char* filename, lmodem_trace_ring* pTrace);
+static int32_t prefetch_data_source(modem_context_t* pThis, uint8_t* data, uint32_t size);
+int do_file_transmission(rzsz_session* pSession);
+int do_file_reception(rzsz_session* pSession);
 
 int main(int argc, char* argv[])
 {
     bool bOk;
     int exit_code;
+    rzsz_session* pSession;
     exit_code = EXIT_FAILURE;
 
     bOk = parse_options(argc, argv);
@@ -89,10 +142,16 @@ int main(int argc, char* argv[])
         exit(EXIT_FAILURE);
     }
 
-    serial_fd = serial_setup(options.device, options.speed, options.parity, options.ctrl_flow, options.nb_stop);
-    if (serial_fd < 0)
+    pSession = calloc(1, sizeof(rzsz_session));
+    assert(pSession != NULL);
+    pSession->file_fd = -1;
+    pSession->result = -1;
+
+    pSession->serial_fd = serial_setup(options.device, options.speed, options.parity, options.ctrl_flow, options.nb_stop);
+    if (pSession->serial_fd < 0)
     {
         fprintf(stderr, "unable to open '%s'\n", options.device);
+        free(pSession);
         exit(EXIT_FAILURE);
     }
 
@@ -102,53 +161,130 @@ int main(int argc, char* argv[])
         if (options.xmodem_blksize > 0)
         {
             xmodem_opts = lxmodem_1k;
-            xmodem_buffer_size = LXMODEM_1K_BUFFER_MIN_SIZE;
+            pSession->buffer_size = LXMODEM_1K_BUFFER_MIN_SIZE;
         }
         else if (options.crc > 0)
         {
             xmodem_opts = lxmodem_128_with_crc;
-            xmodem_buffer_size = LXMODEM_128_CRC_BUFFER_MIN_SIZE;
+            pSession->buffer_size = LXMODEM_128_CRC_BUFFER_MIN_SIZE;
         }
         else
         {
             xmodem_opts = lxmodem_128_with_chksum;
-            xmodem_buffer_size = LXMODEM_128_CHKSUM_BUFFER_MIN_SIZE;
+            pSession->buffer_size = LXMODEM_128_CHKSUM_BUFFER_MIN_SIZE;
         }
     }
     else if (options.protocol == YMODEM)
     {
-        xmodem_buffer_size = LYMODEM_BUFFER_MIN_SIZE;
+        pSession->buffer_size = LYMODEM_BUFFER_MIN_SIZE;
     }
 
-    lmodem_init(&xmodem_ctx, xmodem_opts);
-    xmodem_buffer = malloc(xmodem_buffer_size);
-    assert(xmodem_buffer != NULL);
+    lmodem_init(&pSession->ctx, xmodem_opts);
+    if ((options.low_memory) && (options.rx))
+    {
+        lmodem_set_low_memory_rx(&pSession->ctx, true);
+        pSession->buffer_size = LXMODEM_LOW_MEMORY_RX_BUFFER_MIN_SIZE;
+    }
+    pSession->buffer = malloc(pSession->buffer_size);
+    assert(pSession->buffer != NULL);
 
-    bOk = lmodem_set_line_buffer(&xmodem_ctx, xmodem_buffer, xmodem_buffer_size);
+    bOk = lmodem_set_line_buffer(&pSession->ctx, pSession->buffer, pSession->buffer_size);
     if (!bOk)
     {
         fprintf(stdout, "internal error\n");
-        free(xmodem_buffer);
-        serial_close(serial_fd);
+        free(pSession->buffer);
+        serial_close(pSession->serial_fd);
+        free(pSession);
         exit(EXIT_FAILURE);
     }
 
-    lmodem_set_filename_buffer(&xmodem_ctx, xmodem_filename_buffer, BUFFER_FILENAME_SIZE);
-    lmodem_set_getchar_cb(&xmodem_ctx, serial_getchar);
-    lmodem_set_putchar_cb(&xmodem_ctx, serial_putchar);
+    lmodem_set_filename_buffer(&pSession->ctx, pSession->filename_buffer, BUFFER_FILENAME_SIZE);
+    lmodem_set_user_data(&pSession->ctx, pSession);
+    lmodem_set_getchar_cb(&pSession->ctx, serial_getchar);
+    lmodem_set_putchar_cb(&pSession->ctx, serial_putchar);
+    lmodem_set_clock_cb(&pSession->ctx, monotonic_clock_ns);
+    if (options.progress)
+    {
+        lmodem_set_progress_cb(&pSession->ctx, print_progress);
+    }
+    if (options.trace_filename != NULL)
+    {
+        lmodem_set_trace_buffer(&pSession->ctx, pSession->trace, TRACE_NB_EVENTS);
+    }
+    if ((options.rx) && (options.pipeline))
+    {
+        //the pipeline reads the serial line itself, it is started before the capture wraps the callbacks
+        pSession->file_fd = open(options.filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ((pSession->file_fd < 0)
+                || (!rx_pipeline_start(&pSession->pipeline, &pSession->ctx, pSession->serial_fd, pSession->file_fd, PIPELINE_TIMEOUT_NS)))
+        {
+            fprintf(stdout, "unable to start the reception pipeline for '%s'\n", options.filename);
+            serial_close(pSession->serial_fd);
+            free(pSession->buffer);
+            free(pSession);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (options.record_filename != NULL)
+    {
+        if (!capture_start(options.record_filename, &pSession->ctx, options.protocol, options.rx))
+        {
+            fprintf(stderr, "unable to create capture '%s'\n", options.record_filename);
+            options.record_filename = NULL;
+        }
+    }
 
     if (options.rx)
     {
-        exit_code = do_file_reception();
+        exit_code = do_file_reception(pSession);
     }
 
     if (options.tx)
     {
-        exit_code = do_file_transmission();
+        exit_code = do_file_transmission(pSession);
+    }
+
+    if (options.progress)
+    {
+        fprintf(stderr, "\n");
+    }
+
+    if (options.record_filename != NULL)
+    {
+        if (!capture_stop(&pSession->ctx, pSession->result))
+        {
+            fprintf(stderr, "unable to write capture '%s'\n", options.record_filename);
+        }
     }
 
-    serial_close(serial_fd);
-    free(xmodem_buffer);
+    if (pSession->file_fd >= 0)
+    {
+        if (!rx_pipeline_stop(&pSession->pipeline, pSession->result))
+        {
+            exit_code = EXIT_FAILURE;
+        }
+        close(pSession->file_fd);
+        fprintf(stdout, "pipeline: %" PRIu64 " bytes read, %" PRIu64 " bytes written in %u writes, longest write %.3f ms, "
+                "line queue max %u bytes\n", pSession->pipeline.stats.bytes_read, pSession->pipeline.stats.bytes_written,
+                pSession->pipeline.stats.nb_writes, pSession->pipeline.stats.max_write_ns / 1e6, pSession->pipeline.stats.line_queue_max);
+    }
+
+    if (options.stats)
+    {
+        print_stats_json(stdout, lmodem_get_stats(&pSession->ctx));
+    }
+
+    if (options.trace_filename != NULL)
+    {
+        if (!dump_trace(options.trace_filename, &pSession->ctx.trace))
+        {
+            fprintf(stderr, "unable to write trace '%s'\n", options.trace_filename);
+        }
+    }
+
+    serial_close(pSession->serial_fd);
+    free(pSession->buffer);
+    free(pSession);
     return exit_code;
 }
 
@@ -215,6 +351,34 @@ static bool parse_options(int argc, char* argv[])
                 options.filename = optarg;
                 break;
 
+            case OPTS_LOW_MEMORY:
+                options.low_memory = 1;
+                break;
+
+            case OPTS_STATS:
+                options.stats = 1;
+                break;
+
+            case OPTS_PROGRESS:
+                options.progress = 1;
+                break;
+
+            case OPTS_TRACE:
+                options.trace_filename = optarg;
+                break;
+
+            case OPTS_RECORD:
+                options.record_filename = optarg;
+                break;
+
+            case OPTS_PREFETCH:
+                options.prefetch = 1;
+                break;
+
+            case OPTS_PIPELINE:
+                options.pipeline = 1;
+                break;
+
             case OPTS_UNKNOWN:
                 fprintf(stdout, "unknow options\n");
                 exit(EXIT_FAILURE);
@@ -302,17 +466,98 @@ static bool parse_options(int argc, char* argv[])
 
 bool serial_getchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
 {
-    (void) pThis;
-    return serial_read(serial_fd, data, size);;
+    rzsz_session* pSession;
+    pSession = (rzsz_session*) lmodem_get_user_data(pThis);
+    return serial_read(pSession->serial_fd, data, size);
 }
 
 void serial_putchar(modem_context_t* pThis, uint8_t* data, uint32_t size)
 {
+    rzsz_session* pSession;
+    pSession = (rzsz_session*) lmodem_get_user_data(pThis);
+    serial_write(pSession->serial_fd, data, size);
+}
+
+static uint64_t monotonic_clock_ns(modem_context_t* pThis)
+{
+    struct timespec ts;
     (void) pThis;
-    serial_write(serial_fd, data, size);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void print_stats_json(FILE* f, const lmodem_stats* pStats)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"blocks_sent\": %" PRIu32 ",\n", pStats->blocks_sent);
+    fprintf(f, "  \"blocks_received\": %" PRIu32 ",\n", pStats->blocks_received);
+    fprintf(f, "  \"naks_sent\": %" PRIu32 ",\n", pStats->naks_sent);
+    fprintf(f, "  \"naks_received\": %" PRIu32 ",\n", pStats->naks_received);
+    fprintf(f, "  \"retransmissions\": %" PRIu32 ",\n", pStats->retransmissions);
+    fprintf(f, "  \"crc_errors\": %" PRIu32 ",\n", pStats->crc_errors);
+    fprintf(f, "  \"checksum_errors\": %" PRIu32 ",\n", pStats->checksum_errors);
+    fprintf(f, "  \"block_number_errors\": %" PRIu32 ",\n", pStats->block_number_errors);
+    fprintf(f, "  \"duplicate_blocks\": %" PRIu32 ",\n", pStats->duplicate_blocks);
+    fprintf(f, "  \"timeouts\": %" PRIu32 ",\n", pStats->timeouts);
+    fprintf(f, "  \"cans_received\": %" PRIu32 ",\n", pStats->cans_received);
+    fprintf(f, "  \"bytes_on_wire_tx\": %" PRIu64 ",\n", pStats->bytes_on_wire_tx);
+    fprintf(f, "  \"bytes_on_wire_rx\": %" PRIu64 ",\n", pStats->bytes_on_wire_rx);
+    fprintf(f, "  \"payload_bytes\": %" PRIu64 ",\n", pStats->payload_bytes);
+    fprintf(f, "  \"handshake_time_ns\": %" PRIu64 ",\n", pStats->handshake_time_ns);
+    fprintf(f, "  \"transfer_time_ns\": %" PRIu64 ",\n", pStats->transfer_time_ns);
+    fprintf(f, "  \"ack_rtt_count\": %" PRIu32 ",\n", pStats->ack_rtt_count);
+    fprintf(f, "  \"ack_rtt_min_ns\": %" PRIu64 ",\n", pStats->ack_rtt_min_ns);
+    fprintf(f, "  \"ack_rtt_avg_ns\": %" PRIu64 ",\n", lmodem_stats_get_ack_rtt_avg_ns(pStats));
+    fprintf(f, "  \"ack_rtt_max_ns\": %" PRIu64 "\n", pStats->ack_rtt_max_ns);
+    fprintf(f, "}\n");
 }
 
-int do_file_transmission(void)
+static void print_progress(modem_context_t* pThis, const lmodem_progress* pProgress)
+{
+    (void) pThis;
+    //one status line on stderr, rewritten after each block
+    fprintf(stderr, "\r%10" PRIu64 " bytes", pProgress->bytes_done);
+    if (pProgress->bytes_total > 0)
+    {
+        fprintf(stderr, " / %" PRIu64 " (%3" PRIu64 "%%)", pProgress->bytes_total,
+                min_u64(pProgress->bytes_done, pProgress->bytes_total) * 100 / pProgress->bytes_total);
+    }
+    fprintf(stderr, "  %8.1f kB/s (avg %8.1f kB/s)", pProgress->instant_bps / 1000.0, pProgress->smoothed_bps / 1000.0);
+    if (pProgress->eta_ns > 0)
+    {
+        fprintf(stderr, "  eta %6.1f s", pProgress->eta_ns / 1e9);
+    }
+    fprintf(stderr, "  retries %" PRIu32 "   ", pProgress->retries);
+    fflush(stderr);
+}
+
+static bool dump_trace(const char* filename, lmodem_trace_ring* pTrace)
+{
+    lmodem_trace_file_header header;
+    FILE* f;
+    uint32_t i;
+    bool bOk;
+
+    f = fopen(filename, "wb");
+    if (f == NULL)
+    {
+        return false;
+    }
+
+    memcpy(header.magic, LMODEM_TRACE_FILE_MAGIC, 4);
+    header.version = LMODEM_TRACE_FILE_VERSION;
+    header.event_size = sizeof(lmodem_trace_event);
+    header.count = lmodem_trace_get_count(pTrace);
+    bOk = (fwrite(&header, sizeof(header), 1, f) == 1);
+    for (i = 0; (bOk) && (i < header.count); i++)
+    {
+        bOk = (fwrite(lmodem_trace_get_event(pTrace, i), sizeof(lmodem_trace_event), 1, f) == 1);
+    }
+    fclose(f);
+    return bOk;
+}
+
+int do_file_transmission(rzsz_session* pSession)
 {
     int exit_code;
     exit_code = EXIT_FAILURE;
@@ -325,29 +570,49 @@ int do_file_transmission(void)
         FILE* f = fopen(options.filename, "r");
         if (f != NULL)
         {
-            uint8_t* datafile = malloc(fileStat.st_size);
+            uint8_t* datafile = NULL;
             uint32_t nbRead;
             int32_t nbBytesEmitted;
             bool b;
-            nbRead = fread(datafile, fileStat.st_size, 1, f);
-            fprintf(stdout, "nbBlockRead = %d\n", nbRead);
 
-            lmodem_set_file_buffer(&xmodem_ctx, datafile, fileStat.st_size);
-            b = lmodem_buffer_set_write_offset(&xmodem_ctx.ramfile, fileStat.st_size);
-            assert(b == true);
+            if (options.prefetch)
+            {
+                //the file is read ahead by a thread instead of being loaded in memory
+                b = prefetch_start(&pSession->prefetch, f, PREFETCH_CHUNK_SIZE, PREFETCH_NB_CHUNKS);
+                assert(b == true);
+                lmodem_set_data_source_cb(&pSession->ctx, prefetch_data_source);
+            }
+            else
+            {
+                datafile = malloc(fileStat.st_size);
+                nbRead = fread(datafile, fileStat.st_size, 1, f);
+                fprintf(stdout, "nbBlockRead = %d\n", nbRead);
+
+                lmodem_set_file_buffer(&pSession->ctx, datafile, fileStat.st_size);
+                b = lmodem_buffer_set_write_offset(&pSession->ctx.ramfile, fileStat.st_size);
+                assert(b == true);
+            }
+            //the next block is built while the ACK of the current one is awaited
+            lmodem_set_next_line_buffer(&pSession->ctx, pSession->next_buffer, LXMODEM_1K_BUFFER_MIN_SIZE);
 
             if (options.protocol == YMODEM)
             {
-                lmodem_metadata_set_filename(&xmodem_ctx, strrchr(options.filename, '/') + 1);
-                lmodem_metadata_set_filesize(&xmodem_ctx, fileStat.st_size);
-                lmodem_metadata_set_modif_time(&xmodem_ctx, fileStat.st_mtime);
-                lmodem_metadata_set_permission(&xmodem_ctx, fileStat.st_mode);
-                lmodem_metadata_set_serial(&xmodem_ctx, 0);
+                lmodem_metadata_set_filename(&pSession->ctx, strrchr(options.filename, '/') + 1);
+                lmodem_metadata_set_filesize(&pSession->ctx, fileStat.st_size);
+                lmodem_metadata_set_modif_time(&pSession->ctx, fileStat.st_mtime);
+                lmodem_metadata_set_permission(&pSession->ctx, fileStat.st_mode);
+                lmodem_metadata_set_serial(&pSession->ctx, 0);
             }
 
-            nbBytesEmitted = lmodem_emit(&xmodem_ctx, options.protocol);
+            nbBytesEmitted = lmodem_emit(&pSession->ctx, options.protocol);
+            pSession->result = nbBytesEmitted;
             fprintf(stdout, "nbBytesEmitted = %d\n", nbBytesEmitted);
+            if (options.prefetch)
+            {
+                prefetch_stop(&pSession->prefetch);
+            }
             free(datafile);
+            fclose(f);
             if (nbBytesEmitted >= 0)
             {
                 exit_code = EXIT_SUCCESS;
@@ -362,21 +627,30 @@ int do_file_transmission(void)
 }
 
 
-int do_file_reception()
+int do_file_reception(rzsz_session* pSession)
 {
     int exit_code;
     int32_t nbBytesReceived;
     exit_code = EXIT_FAILURE;
-    lmodem_set_file_buffer(&xmodem_ctx, xmodem_recvFile, BUFFER_FILE_SIZE);
+    lmodem_set_file_buffer(&pSession->ctx, pSession->recvFile, BUFFER_FILE_SIZE);
 
-    FILE* f = fopen(options.filename, "w");
-    if (f != NULL)
+    //with the pipeline, the file is written by its writer thread during the transfer
+    FILE* f = NULL;
+    if (!options.pipeline)
+    {
+        f = fopen(options.filename, "w");
+    }
+    if ((f != NULL) || (options.pipeline))
     {
-        nbBytesReceived = lmodem_receive(&xmodem_ctx, options.protocol);
+        nbBytesReceived = lmodem_receive(&pSession->ctx, options.protocol);
+        pSession->result = nbBytesReceived;
         fprintf(stdout, "> %d bytes received\n", nbBytesReceived);
         if (nbBytesReceived >= 0)
         {
-            fwrite(xmodem_ctx.ramfile.buffer, 1, xmodem_ctx.ramfile.write_offset, f);
+            if (f != NULL)
+            {
+                fwrite(pSession->ctx.ramfile.buffer, 1, pSession->ctx.ramfile.write_offset, f);
+            }
             exit_code = EXIT_SUCCESS;
         }
 
@@ -388,32 +662,35 @@ int do_file_reception()
             uint32_t mode;
             uint32_t serial;
 
-            if (lmodem_metadata_get_filename(&xmodem_ctx, filename, 256) == true)
+            if (lmodem_metadata_get_filename(&pSession->ctx, filename, 256) == true)
             {
                 fprintf(stdout, "reception of file: '%s'\n", filename);
             }
 
-            if (lmodem_metadata_get_filesize(&xmodem_ctx, &size) == true)
+            if (lmodem_metadata_get_filesize(&pSession->ctx, &size) == true)
             {
                 fprintf(stdout, "  size: '%d'\n", size);
             }
-            if (lmodem_metadata_get_modif_time(&xmodem_ctx, &modif_time) == true)
+            if (lmodem_metadata_get_modif_time(&pSession->ctx, &modif_time) == true)
             {
                 fprintf(stdout, "  modification time: '%d'\n", modif_time);
             }
 
-            if (lmodem_metadata_get_permission(&xmodem_ctx, &mode) == true)
+            if (lmodem_metadata_get_permission(&pSession->ctx, &mode) == true)
             {
                 fprintf(stdout, "  mode: 0'%o'\n", mode);
             }
 
-            if (lmodem_metadata_get_serial(&xmodem_ctx, &serial) == true)
+            if (lmodem_metadata_get_serial(&pSession->ctx, &serial) == true)
             {
                 fprintf(stdout, "  serial: %d\n", serial);
             }
         }
 
-        fclose(f);
+        if (f != NULL)
+        {
+            fclose(f);
+        }
     }
     else
     {
@@ -421,3 +698,10 @@ int do_file_reception()
     }
     return exit_code;
 }
+
+static int32_t prefetch_data_source(modem_context_t* pThis, uint8_t* data, uint32_t size)
+{
+    rzsz_session* pSession;
+    pSession = (rzsz_session*) lmodem_get_user_data(pThis);
+    return prefetch_read(&pSession->prefetch, data, size);
+}
@@ -0,0 +1,304 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "lmodem.h"
+#include "linksim.h"
+
+// many sender/receiver pairs over the link simulator at the same time, one thread per pair (and two per link).
+// the contexts share nothing: every callback gets its state through the user data. built with MODEM_TSAN,
+// ThreadSanitizer reports any access shared between the pairs.
+
+#define STRESS_FILENAME_SIZE   (256)
+#define STRESS_PADDING         (0x1A)
+#define STRESS_TRACE_NB_EVENTS (256)
+
+typedef struct
+{
+    const char* name;
+    lmodem_protocol protocol;
+    lxmodem_opts opts;
+    bool lowMemoryRx;
+    bool doubleBuffer;
+} stress_mode;
+
+static const stress_mode stress_modes[] =
+{
+    { "xmodem-chksum-128", XMODEM, lxmodem_128_with_chksum, false, false },
+    { "xmodem-crc-128", XMODEM, lxmodem_128_with_crc, false, true },
+    { "xmodem-1k", XMODEM, lxmodem_1k, false, false },
+    { "xmodem-1k-low-memory", XMODEM, lxmodem_1k, true, true },
+    { "ymodem", YMODEM, lxmodem_1k, false, true },
+    { "ymodem-low-memory", YMODEM, lxmodem_1k, true, false },
+};
+
+#define STRESS_NB_MODES        (sizeof(stress_modes) / sizeof(stress_modes[0]))
+
+typedef struct
+{
+    const stress_mode* pMode;
+    uint8_t line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    uint8_t next_line_buffer[LXMODEM_1K_BUFFER_MIN_SIZE];
+    char filename[STRESS_FILENAME_SIZE];
+    lmodem_trace_event trace[STRESS_TRACE_NB_EVENTS];
+    uint32_t nb_progress;
+} stress_side;
+
+typedef struct
+{
+    linksim sim;
+    stress_side side[LINKSIM_NB_SIDES];
+    uint8_t* sent;
+    uint8_t* received;
+    uint32_t size;
+    uint64_t seed;
+    double ber;
+    bool bOk;
+    pthread_t thread;
+} stress_pair;
+
+typedef enum
+{
+    OPTS_PAIRS,
+    OPTS_SIZE,
+    OPTS_BER,
+    OPTS_SEED,
+    OPTS_UNKNOWN = '?'
+} OPTS;
+
+static struct option long_options[] =
+{
+    {"pairs", required_argument, 0, OPTS_PAIRS},
+    {"size", required_argument, 0, OPTS_SIZE},
+    {"ber", required_argument, 0, OPTS_BER},
+    {"seed", required_argument, 0, OPTS_SEED},
+    {0, 0, 0, 0}
+};
+
+static int32_t stress_emit(modem_context_t* pThis)
+{
+    stress_side* pSide;
+    pSide = (stress_side*) lmodem_get_user_data(pThis);
+    return lmodem_emit(pThis, pSide->pMode->protocol);
+}
+
+static int32_t stress_receive(modem_context_t* pThis)
+{
+    stress_side* pSide;
+    pSide = (stress_side*) lmodem_get_user_data(pThis);
+    return lmodem_receive(pThis, pSide->pMode->protocol);
+}
+
+static void stress_progress(modem_context_t* pThis, const lmodem_progress* pProgress)
+{
+    stress_side* pSide;
+    (void) pProgress;
+    pSide = (stress_side*) lmodem_get_user_data(pThis);
+    pSide->nb_progress++;
+}
+
+static void stress_setup_context(stress_pair* pPair, uint32_t sideIndex)
+{
+    modem_context_t* pCtx;
+    stress_side* pSide;
+    const stress_mode* pMode;
+    char filename[STRESS_FILENAME_SIZE];
+    bool bRx;
+
+    bRx = (sideIndex == LINKSIM_SIDE_B);
+    pSide = &pPair->side[sideIndex];
+    pMode = pSide->pMode;
+    pCtx = linksim_get_context(&pPair->sim, sideIndex);
+
+    lmodem_init(pCtx, pMode->opts);
+    lmodem_set_user_data(pCtx, pSide);
+    lmodem_set_progress_cb(pCtx, stress_progress);
+    lmodem_set_trace_buffer(pCtx, pSide->trace, STRESS_TRACE_NB_EVENTS);
+    if ((bRx) && (pMode->lowMemoryRx))
+    {
+        lmodem_set_low_memory_rx(pCtx, true);
+        lmodem_set_line_buffer(pCtx, pSide->line_buffer, LXMODEM_LOW_MEMORY_RX_BUFFER_MIN_SIZE);
+    }
+    else
+    {
+        lmodem_set_line_buffer(pCtx, pSide->line_buffer, LXMODEM_1K_BUFFER_MIN_SIZE);
+    }
+    lmodem_set_filename_buffer(pCtx, pSide->filename, STRESS_FILENAME_SIZE);
+
+    if (bRx)
+    {
+        lmodem_set_file_buffer(pCtx, pPair->received, pPair->size + LXMODEM_1K_BUFFER_MIN_SIZE);
+    }
+    else
+    {
+        lmodem_set_file_buffer(pCtx, pPair->sent, pPair->size);
+        lmodem_buffer_set_write_offset(&pCtx->ramfile, pPair->size);
+        if (pMode->doubleBuffer)
+        {
+            lmodem_set_next_line_buffer(pCtx, pSide->next_line_buffer, LXMODEM_1K_BUFFER_MIN_SIZE);
+        }
+        if (pMode->protocol == YMODEM)
+        {
+            snprintf(filename, STRESS_FILENAME_SIZE, "stress-%llu.bin", (unsigned long long) pPair->seed);
+            lmodem_metadata_set_filename(pCtx, filename);
+            lmodem_metadata_set_filesize(pCtx, pPair->size);
+        }
+    }
+}
+
+static bool stress_check(stress_pair* pPair)
+{
+    modem_context_t* pRx;
+    uint32_t receivedSize;
+    uint32_t i;
+    bool bOk;
+
+    pRx = linksim_get_context(&pPair->sim, LINKSIM_SIDE_B);
+    receivedSize = pRx->ramfile.write_offset;
+    bOk = (linksim_get_result(&pPair->sim, LINKSIM_SIDE_A) >= 0) && (linksim_get_result(&pPair->sim, LINKSIM_SIDE_B) >= 0)
+          && (receivedSize >= pPair->size) && (memcmp(pPair->sent, pPair->received, pPair->size) == 0);
+    for (i = pPair->size; (bOk) && (i < receivedSize); i++)
+    {
+        bOk = (pPair->received[i] == STRESS_PADDING);
+    }
+    if ((bOk) && (pPair->side[LINKSIM_SIDE_A].pMode->protocol == YMODEM))
+    {
+        bOk = (receivedSize == pPair->size);
+    }
+    //every acknowledged block is reported to the progress callback of its own context
+    return bOk && (pPair->side[LINKSIM_SIDE_A].nb_progress > 0) && (pPair->side[LINKSIM_SIDE_B].nb_progress > 0);
+}
+
+static void* stress_pair_thread(void* arg)
+{
+    stress_pair* pPair;
+    linksim_config config;
+    uint64_t rng;
+    uint32_t i;
+
+    pPair = (stress_pair*) arg;
+    memset(&config, 0, sizeof(config));
+    config.baud = 115200;
+    config.ber = pPair->ber;
+    linksim_init(&pPair->sim, &config, &config, pPair->seed);
+
+    rng = pPair->seed;
+    for (i = 0; i < pPair->size; i++)
+    {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        pPair->sent[i] = (uint8_t) (rng >> 56);
+    }
+
+    stress_setup_context(pPair, LINKSIM_SIDE_A);
+    stress_setup_context(pPair, LINKSIM_SIDE_B);
+    pPair->bOk = linksim_run(&pPair->sim, stress_emit, stress_receive) && stress_check(pPair);
+    linksim_destroy(&pPair->sim);
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    stress_pair* pairs;
+    uint32_t nbPairs;
+    uint32_t size;
+    uint32_t nbFailed;
+    uint64_t seed;
+    double ber;
+    int opt_index;
+    OPTS c;
+    bool bOk;
+    uint32_t i;
+
+    nbPairs = 32;
+    size = 32800;
+    ber = 1e-5;
+    seed = 1;
+    bOk = true;
+    while (bOk)
+    {
+        c = getopt_long(argc, argv, "", long_options, &opt_index);
+        if ((int32_t) c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case OPTS_PAIRS:
+                nbPairs = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_SIZE:
+                size = strtoul(optarg, NULL, 0);
+                break;
+
+            case OPTS_BER:
+                ber = strtod(optarg, NULL);
+                break;
+
+            case OPTS_SEED:
+                seed = strtoull(optarg, NULL, 0);
+                break;
+
+            case OPTS_UNKNOWN:
+            default:
+                bOk = false;
+                break;
+        }
+    }
+    if ((!bOk) || (nbPairs == 0) || (size == 0))
+    {
+        fprintf(stderr, "usage: %s [--pairs n] [--size bytes] [--ber e] [--seed n]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    pairs = calloc(nbPairs, sizeof(stress_pair));
+    if (pairs == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < nbPairs; i++)
+    {
+        pairs[i].size = size;
+        pairs[i].seed = seed + i;
+        pairs[i].ber = ber;
+        pairs[i].side[LINKSIM_SIDE_A].pMode = &stress_modes[i % STRESS_NB_MODES];
+        pairs[i].side[LINKSIM_SIDE_B].pMode = &stress_modes[i % STRESS_NB_MODES];
+        pairs[i].sent = malloc(size);
+        pairs[i].received = calloc(1, size + LXMODEM_1K_BUFFER_MIN_SIZE);
+        if ((pairs[i].sent == NULL) || (pairs[i].received == NULL))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    //all the pairs run at the same time
+    for (i = 0; i < nbPairs; i++)
+    {
+        if (pthread_create(&pairs[i].thread, NULL, stress_pair_thread, &pairs[i]) != 0)
+        {
+            fprintf(stderr, "unable to start pair %u\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    nbFailed = 0;
+    for (i = 0; i < nbPairs; i++)
+    {
+        pthread_join(pairs[i].thread, NULL);
+        fprintf(stdout, "pair %2u %-22s seed %llu: %s\n", i, pairs[i].side[LINKSIM_SIDE_A].pMode->name,
+                (unsigned long long) pairs[i].seed, pairs[i].bOk ? "ok" : "failed");
+        if (!pairs[i].bOk)
+        {
+            nbFailed++;
+        }
+        free(pairs[i].sent);
+        free(pairs[i].received);
+    }
+    free(pairs);
+
+    fprintf(stdout, "%u pairs, %u failed\n", nbPairs, nbFailed);
+    fprintf(stdout, "%s\n", (nbFailed == 0) ? "test ok" : "test failed");
+    return (nbFailed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
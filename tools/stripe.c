@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+#include "stripe.h"
+#include "lmodem_delta.h"
+
+static void stripe_put_u16(uint8_t* pOut, uint16_t value)
+{
+    pOut[0] = (uint8_t) value;
+    pOut[1] = (uint8_t) (value >> 8);
+}
+
+static void stripe_put_u32(uint8_t* pOut, uint32_t value)
+{
+    pOut[0] = (uint8_t) value;
+    pOut[1] = (uint8_t) (value >> 8);
+    pOut[2] = (uint8_t) (value >> 16);
+    pOut[3] = (uint8_t) (value >> 24);
+}
+
+static uint16_t stripe_get_u16(const uint8_t* pIn)
+{
+    return (uint16_t) (pIn[0] | (pIn[1] << 8));
+}
+
+static uint32_t stripe_get_u32(const uint8_t* pIn)
+{
+    return (uint32_t) pIn[0] | ((uint32_t) pIn[1] << 8) | ((uint32_t) pIn[2] << 16) | ((uint32_t) pIn[3] << 24);
+}
+
+void stripe_split(uint32_t total, const uint32_t* pWeights, uint16_t count, uint32_t* pOffsets, uint32_t* pSizes)
+{
+    uint64_t sumWeights;
+    uint64_t size;
+    uint32_t offset;
+    uint16_t i;
+
+    sumWeights = 0;
+    for (i = 0; i < count; i++)
+    {
+        sumWeights += pWeights[i];
+    }
+
+    offset = 0;
+    for (i = 0; i < count; i++)
+    {
+        size = (sumWeights > 0) ? (((uint64_t) total * pWeights[i]) / sumWeights) : (total / count);
+        size -= size % STRIPE_ALIGNMENT;
+        //the last stripe takes what the rounding left
+        if ((i == count - 1) || (offset + size > total))
+        {
+            size = total - offset;
+        }
+        pOffsets[i] = offset;
+        pSizes[i] = (uint32_t) size;
+        offset += (uint32_t) size;
+    }
+}
+
+void stripe_header_write(const stripe_header* pHeader, uint8_t* pOut)
+{
+    memcpy(pOut, STRIPE_MAGIC, 4);
+    pOut[4] = STRIPE_VERSION;
+    memset(&pOut[5], 0, 3);
+    stripe_put_u16(&pOut[8], pHeader->index);
+    stripe_put_u16(&pOut[10], pHeader->count);
+    stripe_put_u32(&pOut[12], pHeader->offset);
+    stripe_put_u32(&pOut[16], pHeader->size);
+    stripe_put_u32(&pOut[20], pHeader->total);
+    stripe_put_u32(&pOut[24], pHeader->file_hash);
+}
+
+bool stripe_header_read(stripe_header* pHeader, const uint8_t* pIn, uint32_t size)
+{
+    if ((size < STRIPE_HEADER_SIZE) || (memcmp(pIn, STRIPE_MAGIC, 4) != 0) || (pIn[4] != STRIPE_VERSION))
+    {
+        return false;
+    }
+    pHeader->index = stripe_get_u16(&pIn[8]);
+    pHeader->count = stripe_get_u16(&pIn[10]);
+    pHeader->offset = stripe_get_u32(&pIn[12]);
+    pHeader->size = stripe_get_u32(&pIn[16]);
+    pHeader->total = stripe_get_u32(&pIn[20]);
+    pHeader->file_hash = stripe_get_u32(&pIn[24]);
+    //the session may be longer (XMODEM padding), never shorter
+    return (pHeader->index < pHeader->count) && (pHeader->offset <= pHeader->total)
+           && (pHeader->size <= pHeader->total - pHeader->offset) && (pHeader->size <= size - STRIPE_HEADER_SIZE);
+}
+
+void stripe_assembly_init(stripe_assembly* pThis)
+{
+    memset(pThis, 0, sizeof(stripe_assembly));
+}
+
+bool stripe_assembly_add(stripe_assembly* pThis, const uint8_t* pSession, uint32_t size)
+{
+    stripe_header header;
+
+    if (!stripe_header_read(&header, pSession, size))
+    {
+        return false;
+    }
+
+    if (pThis->data == NULL)
+    {
+        pThis->data = malloc(header.total + 1);
+        pThis->received = calloc(header.count, sizeof(bool));
+        if ((pThis->data == NULL) || (pThis->received == NULL))
+        {
+            return false;
+        }
+        pThis->total = header.total;
+        pThis->file_hash = header.file_hash;
+        pThis->count = header.count;
+    }
+    else if ((header.total != pThis->total) || (header.file_hash != pThis->file_hash) || (header.count != pThis->count))
+    {
+        //a stripe of another file
+        return false;
+    }
+
+    if (pThis->received[header.index])
+    {
+        return false;
+    }
+    memcpy(&pThis->data[header.offset], &pSession[STRIPE_HEADER_SIZE], header.size);
+    pThis->received[header.index] = true;
+    pThis->nb_received++;
+    return true;
+}
+
+bool stripe_assembly_complete(const stripe_assembly* pThis)
+{
+    return (pThis->data != NULL) && (pThis->nb_received == pThis->count)
+           && (lmodem_fnv1a(LMODEM_FNV1A_INIT, pThis->data, pThis->total) == pThis->file_hash);
+}
+
+void stripe_assembly_destroy(stripe_assembly* pThis)
+{
+    free(pThis->data);
+    free(pThis->received);
+    memset(pThis, 0, sizeof(stripe_assembly));
+}
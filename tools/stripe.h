@@ -0,0 +1,51 @@
+#ifndef STRIPE_H
+#define STRIPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// one file split in stripes sent concurrently over several links, one XMODEM/YMODEM session per stripe.
+// each session carries a header followed by the bytes of its stripe, the header gives where the stripe goes, so the
+// receiver rebuilds the file whatever port a stripe arrived on. fields are little endian:
+//   magic "LMSB", version (8 bits), reserved (24 bits), stripe index (16 bits), nb of stripes (16 bits),
+//   offset in the file, size of the stripe, size of the file, FNV-1a of the whole file (32 bits each)
+
+#define STRIPE_MAGIC            "LMSB"
+#define STRIPE_VERSION          (1)
+#define STRIPE_HEADER_SIZE      (28)
+// stripes are cut on multiples of a 1k block, only the last block of a session is padded
+#define STRIPE_ALIGNMENT        (1024)
+
+typedef struct
+{
+    uint16_t index;
+    uint16_t count;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t total;
+    uint32_t file_hash;
+} stripe_header;
+
+typedef struct
+{
+    uint8_t* data;
+    uint32_t total;
+    uint32_t file_hash;
+    uint16_t count;
+    uint16_t nb_received;
+    bool* received;
+} stripe_assembly;
+
+// sizes proportional to the weights (baud rates) so the links finish together, pSizes/pOffsets get count entries
+extern void stripe_split(uint32_t total, const uint32_t* pWeights, uint16_t count, uint32_t* pOffsets, uint32_t* pSizes);
+extern void stripe_header_write(const stripe_header* pHeader, uint8_t* pOut);
+extern bool stripe_header_read(stripe_header* pHeader, const uint8_t* pIn, uint32_t size);
+
+// the first stripe received sets the file, the others must belong to the same file
+extern void stripe_assembly_init(stripe_assembly* pThis);
+extern bool stripe_assembly_add(stripe_assembly* pThis, const uint8_t* pSession, uint32_t size);
+// every stripe received and the file hash matches
+extern bool stripe_assembly_complete(const stripe_assembly* pThis);
+extern void stripe_assembly_destroy(stripe_assembly* pThis);
+
+#endif /* STRIPE_H */
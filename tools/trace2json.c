@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "lmodem_trace.h"
+
+// convert a trace dumped by rzsz --trace to the chrome trace event format (chrome://tracing, ui.perfetto.dev)
+
+#define TRACE2JSON_TID_TX       (1)
+#define TRACE2JSON_TID_RX       (2)
+#define TRACE2JSON_TID_PROTOCOL (3)
+
+static uint32_t trace2json_tid(uint8_t type)
+{
+    uint32_t tid;
+    switch (type)
+    {
+        case LMODEM_TRACE_TX:
+            tid = TRACE2JSON_TID_TX;
+            break;
+
+        case LMODEM_TRACE_RX:
+        case LMODEM_TRACE_TIMEOUT:
+            tid = TRACE2JSON_TID_RX;
+            break;
+
+        default:
+            tid = TRACE2JSON_TID_PROTOCOL;
+            break;
+    }
+    return tid;
+}
+
+static void trace2json_print_ts(FILE* f, uint64_t ns)
+{
+    //chrome trace timestamps are in microseconds
+    fprintf(f, "%" PRIu64 ".%03" PRIu64, ns / 1000, ns % 1000);
+}
+
+static void trace2json_print_thread_name(FILE* f, uint32_t tid, const char* name)
+{
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%" PRIu32 ",\"args\":{\"name\":\"%s\"}},\n", tid, name);
+}
+
+int main(int argc, char* argv[])
+{
+    lmodem_trace_file_header header;
+    lmodem_trace_event* events;
+    FILE* in;
+    FILE* out;
+    uint64_t origin;
+    uint32_t i;
+    uint32_t j;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <trace file> [<json file>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        fprintf(stderr, "unable to open '%s'\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    if ((fread(&header, sizeof(header), 1, in) != 1) || (memcmp(header.magic, LMODEM_TRACE_FILE_MAGIC, 4) != 0)
+            || (header.version != LMODEM_TRACE_FILE_VERSION) || (header.event_size != sizeof(lmodem_trace_event)))
+    {
+        fprintf(stderr, "'%s' is not a lmodem trace\n", argv[1]);
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+
+    events = malloc(((size_t) header.count + 1) * sizeof(lmodem_trace_event));
+    if ((events == NULL) || (fread(events, sizeof(lmodem_trace_event), header.count, in) != header.count))
+    {
+        fprintf(stderr, "truncated trace '%s'\n", argv[1]);
+        free(events);
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+    fclose(in);
+
+    out = stdout;
+    if (argc > 2)
+    {
+        out = fopen(argv[2], "w");
+        if (out == NULL)
+        {
+            fprintf(stderr, "unable to create '%s'\n", argv[2]);
+            free(events);
+            return EXIT_FAILURE;
+        }
+    }
+
+    origin = (header.count > 0) ? events[0].time_ns : 0;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    trace2json_print_thread_name(out, TRACE2JSON_TID_TX, "tx");
+    trace2json_print_thread_name(out, TRACE2JSON_TID_RX, "rx");
+    trace2json_print_thread_name(out, TRACE2JSON_TID_PROTOCOL, "protocol");
+    for (i = 0; i < header.count; i++)
+    {
+        lmodem_trace_event* pEvent = &events[i];
+
+        if (pEvent->type == LMODEM_TRACE_STATE)
+        {
+            //a state lasts until the next state change
+            for (j = i + 1; (j < header.count) && (events[j].type != LMODEM_TRACE_STATE); j++)
+            {
+            }
+            fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":", lmodem_trace_state_name(pEvent->data),
+                    TRACE2JSON_TID_PROTOCOL);
+            trace2json_print_ts(out, pEvent->time_ns - origin);
+            fprintf(out, ",\"dur\":");
+            trace2json_print_ts(out, ((j < header.count) ? events[j].time_ns : pEvent->time_ns) - pEvent->time_ns);
+            fprintf(out, "},\n");
+        }
+        else
+        {
+            fprintf(out, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":",
+                    lmodem_trace_type_name(pEvent->type), trace2json_tid(pEvent->type));
+            trace2json_print_ts(out, pEvent->time_ns - origin);
+            fprintf(out, ",\"args\":{\"value\":%" PRIu32 ",\"data\":%d}},\n", pEvent->value, pEvent->data);
+        }
+    }
+    //last element without a trailing comma
+    fprintf(out, "{\"name\":\"end\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%d,\"ts\":", TRACE2JSON_TID_PROTOCOL);
+    trace2json_print_ts(out, (header.count > 0) ? (events[header.count - 1].time_ns - origin) : 0);
+    fprintf(out, "}\n]}\n");
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    free(events);
+    return EXIT_SUCCESS;
+}